@@ -15,9 +15,17 @@ static struct list live_handlers;
 static struct list free_handlers;
 
 static void exception_handler_install() {
-  for (int i = 0; i < MAX_EXCEPTION_HANDLERS; i++) {
-    struct exception_handler *handler = &handlers[i];
-    list_add(&free_handlers, &handler->it);
+  /* handlers are returned to the free list as they're removed, only fill it
+     the first time the platform handler is installed */
+  static int initialized;
+
+  if (!initialized) {
+    for (int i = 0; i < MAX_EXCEPTION_HANDLERS; i++) {
+      struct exception_handler *handler = &handlers[i];
+      list_add(&free_handlers, &handler->it);
+    }
+
+    initialized = 1;
   }
 
   int res = exception_handler_install_platform();
@@ -1,6 +1,7 @@
 #ifndef REDREAM_HASH_H
 #define REDREAM_HASH_H
 
+#include <string.h>
 #include "core/list.h"
 #include "core/math.h"
 
@@ -32,4 +33,43 @@
 #define hash_bkt_for_each_entry(it, bkt, type, member) \
   list_for_each_entry(it, bkt, type, member)
 
+/*
+ * 64-bit murmurhash (MurmurHash64A) for hashing arbitrary blocks of data, such
+ * as texture contents. it isn't suitable for anything security related
+ */
+static inline uint64_t hash_data(const void *data, int size, uint64_t seed) {
+  const uint64_t m = UINT64_C(0xc6a4a7935bd1e995);
+  const int r = 47;
+  const uint8_t *ptr = (const uint8_t *)data;
+  const uint8_t *end = ptr + (size & ~7);
+  uint64_t h = seed ^ ((uint64_t)size * m);
+
+  while (ptr != end) {
+    uint64_t k;
+    memcpy(&k, ptr, sizeof(k));
+    ptr += sizeof(k);
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  /* mix in the remaining bytes */
+  if (size & 7) {
+    uint64_t k = 0;
+    memcpy(&k, ptr, size & 7);
+    h ^= k;
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
 #endif
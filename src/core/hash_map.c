@@ -0,0 +1,86 @@
+#include "core/hash_map.h"
+#include "core/core.h"
+
+static uint64_t hash_map_slot(const struct hash_map *map, uint64_t key) {
+  uint64_t mask = (UINT64_C(1) << map->bits) - 1;
+  uint64_t i = hash_key(key, map->bits);
+
+  while (map->entries[i].value && map->entries[i].key != key) {
+    i = (i + 1) & mask;
+  }
+
+  return i;
+}
+
+void hash_map_clear(struct hash_map *map) {
+  memset(map->entries, 0, sizeof(map->entries[0]) << map->bits);
+  map->size = 0;
+}
+
+void hash_map_remove(struct hash_map *map, uint64_t key) {
+  uint64_t mask = (UINT64_C(1) << map->bits) - 1;
+  uint64_t i = hash_map_slot(map, key);
+
+  if (!map->entries[i].value) {
+    return;
+  }
+
+  /* shift back each entry in the probe sequence following the removed entry,
+     unless its home slot lies cyclically within (i, j] in which case moving
+     it would place it before its home slot */
+  uint64_t j = i;
+
+  while (1) {
+    j = (j + 1) & mask;
+
+    if (!map->entries[j].value) {
+      break;
+    }
+
+    uint64_t k = hash_key(map->entries[j].key, map->bits);
+
+    if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+      continue;
+    }
+
+    map->entries[i] = map->entries[j];
+    i = j;
+  }
+
+  map->entries[i].key = 0;
+  map->entries[i].value = NULL;
+  map->size--;
+}
+
+void hash_map_insert(struct hash_map *map, uint64_t key, void *value) {
+  CHECK_NOTNULL(value);
+
+  uint64_t i = hash_map_slot(map, key);
+
+  if (!map->entries[i].value) {
+    CHECK_LT(map->size + 1, 1 << map->bits);
+    map->size++;
+  }
+
+  map->entries[i].key = key;
+  map->entries[i].value = value;
+}
+
+void hash_map_destroy(struct hash_map *map) {
+  free(map->entries);
+  free(map);
+}
+
+struct hash_map *hash_map_create(int max_size) {
+  struct hash_map *map = calloc(1, sizeof(struct hash_map));
+
+  /* keep the load factor at or below 50% */
+  map->bits = 1;
+  while ((1 << map->bits) < max_size * 2) {
+    map->bits++;
+  }
+
+  map->entries = calloc(1 << map->bits, sizeof(struct hash_map_entry));
+
+  return map;
+}
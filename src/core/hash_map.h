@@ -0,0 +1,46 @@
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <stdint.h>
+#include "core/hash.h"
+
+/*
+ * open-addressing hash map from 64-bit keys to non-null values. collisions are
+ * resolved with linear probing, and removals shift back the entries following
+ * the removed one instead of leaving tombstones, keeping probe sequences short
+ * for maps which see constant churn
+ */
+
+struct hash_map_entry {
+  uint64_t key;
+  void *value;
+};
+
+struct hash_map {
+  struct hash_map_entry *entries;
+  int bits;
+  int size;
+};
+
+struct hash_map *hash_map_create(int max_size);
+void hash_map_destroy(struct hash_map *map);
+
+void hash_map_insert(struct hash_map *map, uint64_t key, void *value);
+void hash_map_remove(struct hash_map *map, uint64_t key);
+void hash_map_clear(struct hash_map *map);
+
+static inline void *hash_map_find(const struct hash_map *map, uint64_t key) {
+  uint64_t mask = (UINT64_C(1) << map->bits) - 1;
+  uint64_t i = hash_key(key, map->bits);
+
+  while (map->entries[i].value) {
+    if (map->entries[i].key == key) {
+      return map->entries[i].value;
+    }
+    i = (i + 1) & mask;
+  }
+
+  return NULL;
+}
+
+#endif
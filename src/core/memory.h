@@ -35,6 +35,12 @@ void *map_shared_memory(shmem_handle_t handle, size_t offset, void *start,
 int unmap_shared_memory(shmem_handle_t handle, void *start, size_t size);
 int destroy_shared_memory(shmem_handle_t handle);
 
+/*
+ * read-only file mappings
+ */
+void *map_file(const char *filename, size_t *size);
+int unmap_file(void *ptr, size_t size);
+
 /*
  * access watches
  */
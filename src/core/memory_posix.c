@@ -208,3 +208,31 @@ shmem_handle_t create_shared_memory(const char *filename, size_t size,
 
   return (shmem_handle_t)shmem;
 }
+
+int unmap_file(void *ptr, size_t size) {
+  return munmap(ptr, size) == 0;
+}
+
+void *map_file(const char *filename, size_t *size) {
+  int handle = open(filename, O_RDONLY);
+  if (handle == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(handle, &st) == -1 || !st.st_size) {
+    close(handle);
+    return NULL;
+  }
+
+  /* the mapping stays valid after the file is closed */
+  void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+  close(handle);
+
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+
+  *size = (size_t)st.st_size;
+  return ptr;
+}
@@ -98,3 +98,41 @@ shmem_handle_t create_shared_memory(const char *filename, size_t size,
   return CreateFileMapping(INVALID_HANDLE_VALUE, NULL, protect | SEC_RESERVE,
                            (DWORD)(size >> 32), (DWORD)(size), filename);
 }
+
+int unmap_file(void *ptr, size_t size) {
+  return UnmapViewOfFile(ptr) != 0;
+}
+
+void *map_file(const char *filename, size_t *size) {
+  HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || !file_size.QuadPart) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  void *ptr = NULL;
+
+  if (mapping) {
+    ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  }
+
+  /* the view stays valid after the handles are closed */
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+
+  if (!ptr) {
+    return NULL;
+  }
+
+  *size = (size_t)file_size.QuadPart;
+  return ptr;
+}
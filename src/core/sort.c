@@ -44,3 +44,54 @@ void msort(void *data, int num, size_t size, sort_cmp cmp) {
   msort_noalloc(data, tmp, num, size, cmp);
   free(tmp);
 }
+
+void rsort_noalloc(uint64_t *data, uint64_t *tmp, int num) {
+  if (num < 2) {
+    return;
+  }
+
+  /* histogram each 8-bit digit of the keys in a single pass */
+  int counts[4][256] = {{0}};
+
+  for (int i = 0; i < num; i++) {
+    uint32_t key = (uint32_t)(data[i] >> 32);
+    counts[0][key & 0xff]++;
+    counts[1][(key >> 8) & 0xff]++;
+    counts[2][(key >> 16) & 0xff]++;
+    counts[3][key >> 24]++;
+  }
+
+  uint64_t *in = data;
+  uint64_t *out = tmp;
+
+  for (int pass = 0; pass < 4; pass++) {
+    int shift = 32 + pass * 8;
+    int *count = counts[pass];
+
+    /* skip passes where every key has the same digit, e.g. the exponent bits
+       of depths which are all in the same range */
+    if (count[(in[0] >> shift) & 0xff] == num) {
+      continue;
+    }
+
+    int offsets[256];
+    int offset = 0;
+
+    for (int i = 0; i < 256; i++) {
+      offsets[i] = offset;
+      offset += count[i];
+    }
+
+    for (int i = 0; i < num; i++) {
+      out[offsets[(in[i] >> shift) & 0xff]++] = in[i];
+    }
+
+    uint64_t *swap = in;
+    in = out;
+    out = swap;
+  }
+
+  if (in != data) {
+    memcpy(data, in, num * sizeof(uint64_t));
+  }
+}
@@ -2,6 +2,8 @@
 #define SORT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 /* returns if a is <= b */
 typedef int (*sort_cmp)(const void *, const void *);
@@ -10,4 +12,21 @@ typedef int (*sort_cmp)(const void *, const void *);
 void msort_noalloc(void *data, void *tmp, int num, size_t size, sort_cmp cmp);
 void msort(void *data, int num, size_t size, sort_cmp cmp);
 
+/* stable lsd radix sort, ordering each element by its upper 32 bits. the lower
+   32 bits are free to carry a payload, such as the index of the element */
+void rsort_noalloc(uint64_t *data, uint64_t *tmp, int num);
+
+/* map a float to an unsigned key which sorts in the same order. negative zero
+   compares equal to positive zero, so they're given the same key */
+static inline uint32_t rsort_float_key(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+
+  if (!(u & 0x7fffffff)) {
+    return 0x80000000;
+  }
+
+  return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
+
 #endif
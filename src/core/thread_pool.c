@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include "core/thread_pool.h"
+#include "core/core.h"
+#include "core/thread.h"
+
+struct thread_pool_job {
+  thread_pool_fn fn;
+  void *data;
+};
+
+struct thread_pool {
+  thread_t threads[THREAD_POOL_MAX_THREADS];
+  int num_threads;
+
+  mutex_t mutex;
+  cond_t job_cond;
+  cond_t done_cond;
+  int shutdown;
+
+  /* ring of jobs waiting to be picked up */
+  struct thread_pool_job jobs[THREAD_POOL_MAX_JOBS];
+  int head;
+  int tail;
+
+  /* jobs either queued or currently running */
+  int pending;
+};
+
+static int thread_pool_pop(struct thread_pool *pool,
+                           struct thread_pool_job *job) {
+  if (pool->head == pool->tail) {
+    return 0;
+  }
+
+  *job = pool->jobs[pool->head % THREAD_POOL_MAX_JOBS];
+  pool->head++;
+  return 1;
+}
+
+static void thread_pool_finish(struct thread_pool *pool) {
+  if (--pool->pending == 0) {
+    cond_signal(pool->done_cond);
+  }
+}
+
+static void *thread_pool_worker(void *data) {
+  struct thread_pool *pool = data;
+  struct thread_pool_job job;
+
+  mutex_lock(pool->mutex);
+
+  while (1) {
+    while (!pool->shutdown && !thread_pool_pop(pool, &job)) {
+      cond_wait(pool->job_cond, pool->mutex);
+    }
+
+    if (pool->shutdown) {
+      break;
+    }
+
+    mutex_unlock(pool->mutex);
+    job.fn(job.data);
+    mutex_lock(pool->mutex);
+
+    thread_pool_finish(pool);
+  }
+
+  /* there's no broadcast, pass the shutdown signal on to the next worker */
+  cond_signal(pool->job_cond);
+
+  mutex_unlock(pool->mutex);
+
+  return NULL;
+}
+
+void thread_pool_wait(struct thread_pool *pool) {
+  struct thread_pool_job job;
+
+  mutex_lock(pool->mutex);
+
+  /* help drain the queue rather than idling while the workers run */
+  while (thread_pool_pop(pool, &job)) {
+    mutex_unlock(pool->mutex);
+    job.fn(job.data);
+    mutex_lock(pool->mutex);
+
+    thread_pool_finish(pool);
+  }
+
+  while (pool->pending) {
+    cond_wait(pool->done_cond, pool->mutex);
+  }
+
+  mutex_unlock(pool->mutex);
+}
+
+void thread_pool_submit(struct thread_pool *pool, thread_pool_fn fn,
+                        void *data) {
+  mutex_lock(pool->mutex);
+
+  /* with no workers, or the ring full, run the job inline */
+  if (!pool->num_threads ||
+      (pool->tail - pool->head) >= THREAD_POOL_MAX_JOBS) {
+    mutex_unlock(pool->mutex);
+    fn(data);
+    return;
+  }
+
+  struct thread_pool_job *job = &pool->jobs[pool->tail % THREAD_POOL_MAX_JOBS];
+  job->fn = fn;
+  job->data = data;
+  pool->tail++;
+  pool->pending++;
+
+  cond_signal(pool->job_cond);
+
+  mutex_unlock(pool->mutex);
+}
+
+int thread_pool_num_threads(struct thread_pool *pool) {
+  return pool->num_threads;
+}
+
+void thread_pool_destroy(struct thread_pool *pool) {
+  if (!pool) {
+    return;
+  }
+
+  if (pool->mutex) {
+    thread_pool_wait(pool);
+
+    mutex_lock(pool->mutex);
+    pool->shutdown = 1;
+    cond_signal(pool->job_cond);
+    mutex_unlock(pool->mutex);
+  }
+
+  for (int i = 0; i < pool->num_threads; i++) {
+    void *result;
+    thread_join(pool->threads[i], &result);
+  }
+
+  if (pool->done_cond) {
+    cond_destroy(pool->done_cond);
+  }
+
+  if (pool->job_cond) {
+    cond_destroy(pool->job_cond);
+  }
+
+  if (pool->mutex) {
+    mutex_destroy(pool->mutex);
+  }
+
+  free(pool);
+}
+
+struct thread_pool *thread_pool_create(int num_threads) {
+  struct thread_pool *pool = calloc(1, sizeof(struct thread_pool));
+
+  pool->mutex = mutex_create();
+  pool->job_cond = cond_create();
+  pool->done_cond = cond_create();
+
+  num_threads = MIN(MAX(num_threads, 0), THREAD_POOL_MAX_THREADS);
+
+  for (int i = 0; i < num_threads; i++) {
+    pool->threads[i] = thread_create(&thread_pool_worker, NULL, pool);
+
+    if (!pool->threads[i]) {
+      LOG_WARNING("thread_pool_create failed to create worker %d", i);
+      break;
+    }
+
+    pool->num_threads++;
+  }
+
+  return pool;
+}
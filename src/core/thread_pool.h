@@ -0,0 +1,24 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/*
+ * fixed-size pool of worker threads, used to fan out independent jobs and then
+ * block until they've all completed
+ */
+#define THREAD_POOL_MAX_THREADS 16
+#define THREAD_POOL_MAX_JOBS 256
+
+struct thread_pool;
+
+typedef void (*thread_pool_fn)(void *);
+
+struct thread_pool *thread_pool_create(int num_threads);
+void thread_pool_destroy(struct thread_pool *pool);
+
+int thread_pool_num_threads(struct thread_pool *pool);
+
+void thread_pool_submit(struct thread_pool *pool, thread_pool_fn fn,
+                        void *data);
+void thread_pool_wait(struct thread_pool *pool);
+
+#endif
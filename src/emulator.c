@@ -12,9 +12,13 @@
  */
 
 #include "emulator.h"
-#include "core/memory.h"
+#include "core/filesystem.h"
+#include "core/hash.h"
+#include "core/hash_map.h"
+#include "core/ringbuf.h"
 #include "core/thread.h"
 #include "core/time.h"
+#include "file/tex_cache.h"
 #include "file/trace.h"
 #include "guest/aica/aica.h"
 #include "guest/arm7/arm7.h"
@@ -26,6 +30,8 @@
 #include "guest/pvr/pvr.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tr.h"
+#include "guest/rewind.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "host/host.h"
@@ -55,22 +61,75 @@ enum {
   EMU_SOURCE_PXL,
 };
 
+/* events pushed from the emulation thread to the video thread */
+enum {
+  EMU_EVENT_CONTEXT,
+  EMU_EVENT_PIXELS,
+  EMU_EVENT_VBLANK,
+};
+
+/* maximum number of frames the emulation thread may run ahead of the video
+   thread, and the number of framebuffers needed to support that */
+#define EMU_MAX_FRAME_QUEUE 3
+#define EMU_NUM_FRAMEBUFFERS 3
+
+/* contexts in flight between the two threads, one being rendered by the video
+   thread, one queued up for it and one being filled by the emulation thread */
+#define EMU_NUM_CONTEXTS 3
+
+/* time budget for each frame, and the most time the frameskip logic will try
+   to make up for once the host falls behind */
+#define EMU_FRAME_PERIOD HZ_TO_NANO(60)
+#define EMU_MAX_FRAME_DEBT (4 * EMU_FRAME_PERIOD)
+
+/* the device state saved varies in size with the amount of pending ta
+   parameters and gd-rom transfers, leave room for it to grow when reporting
+   the size of a serialized state */
+#define EMU_STATE_SLACK (4 * 1024 * 1024)
+
+struct emu_event {
+  int type;
+  int fb;
+  int context;
+  int vid_disabled;
+};
+
 struct emu_framebuffer {
   uint8_t data[PVR_FRAMEBUFFER_SIZE];
   int width;
   int height;
 };
 
+/* each context pushed to the video thread is copied into one of these, along
+   with the texture entries it references, leaving the emulation thread free to
+   keep running while it's converted */
+struct emu_context {
+  struct ta_context ctx;
+  struct tr_context *rc;
+
+  /* texture entries as of when the context was pushed, looked up by the video
+     thread while converting it */
+  struct tr_texture textures[8192];
+  int num_textures;
+  struct hash_map *texture_map;
+  struct tr_texture *last_texture;
+
+  /* host textures released while the context was being pushed. the context
+     being rendered by the video thread may still reference them, so they're
+     destroyed once this one replaces it */
+  struct tr_host_texture *released[8192];
+  int num_released;
+};
+
 struct emu_texture {
   struct tr_texture;
   struct emu *emu;
   struct list_node free_it;
-  struct rb_node live_it;
 
-  struct memory_watch *texture_watch;
-  struct memory_watch *palette_watch;
-  struct list_node modified_it;
-  int modified;
+  /* position in the lru list, and the decoded size as of the last time the
+     texture was resolved */
+  struct list_node lru_it;
+  int size;
 };
 
 struct emu {
@@ -96,31 +155,88 @@ struct emu {
   mutex_t res_mutex;
   cond_t res_cond;
 
-  /* latest video state pushed by the dreamcast */
-  volatile int vid_disabled;
-  volatile int vid_source;
-  struct tr_context vid_rc;
-  struct emu_framebuffer vid_fb;
-
-  /* latest context submitted to emu_start_render */
-  struct ta_context *pending_ctx;
+  /* the emulation thread is allowed to run up to OPTION_frame_queue frames
+     ahead of the video thread. the contexts, framebuffers and vblanks produced
+     by each frame are handed off through a lock-free queue, which the video
+     thread drains in order. the emulation thread only blocks when it's too far
+     ahead, or when it's about to overwrite data the video thread still needs */
+  struct ringbuf *events;
+
+  /* guarded by req_mutex. each bit of contexts_used flags a context which is
+     queued or being rendered by the video thread */
+  int paused;
+  int64_t frames_allowed;
+  int contexts_used;
+  int64_t pixels_consumed;
+
+  /* guarded by res_mutex, set while the emulation thread is between frames */
+  int parked;
+
+  /* owned by the emulation thread, pending_ctx is set while a context is
+     being pushed */
+  int64_t frames_run;
+  int64_t pixels_pushed;
+  struct emu_framebuffer fbs[EMU_NUM_FRAMEBUFFERS];
+  struct emu_context contexts[EMU_NUM_CONTEXTS];
+  struct emu_context *pending_ctx;
+
+  /* video state, owned by the video thread */
+  int64_t vid_frames_requested;
+  int vid_frames_ready;
+  int vid_disabled;
+  int vid_source;
+  struct emu_context *vid_ctx;
+  struct emu_framebuffer *vid_fb;
+
+  /* frameskip state, owned by the video thread. while vid_skip is set, new
+     contexts aren't converted, leaving vid_ctx stale until the next context
+     that is converted. host textures released by the skipped contexts are
+     held onto until then */
+  int64_t vid_deadline;
+  int vid_skip;
+  int vid_stale;
+  int vid_frames_skipped;
+  struct tr_host_texture **vid_released;
+  int num_vid_released;
+  int max_vid_released;
 
   /* texture cache. the dreamcast interface calls into us when new contexts are
      available to be rendered. parsing the contexts, uploading their textures to
      the render backend, and managing the texture cache is our responsibility */
   struct emu_texture textures[8192];
   struct list free_textures;
-  struct rb_tree live_textures;
-
-  /* textures for the current context are uploaded to the render backend by the
-     video thread in parallel to the emulation thread executing. normally, this
-     is safe as the real hardware also rendered asynchronously. unfortunately,
-     some games will be naughty and modify a texture before receiving the end of
-     render interrupt. in order to avoid race conditions around accessing the
-     texture's dirty state, textures are not immediately marked dirty by the
-     emulation thread when modified. instead, they are added to this modified
-     list which will be processed the next time the threads are synchronized */
-  struct list modified_textures;
+  struct hash_map *live_textures;
+
+  /* consecutive surfaces commonly share the same texture, so the last texture
+     registered is cached. this is reset each frame, and whenever a texture is
+     freed */
+  struct emu_texture *last_registered;
+
+  /* live textures ordered from least to most recently used. once the pool is
+     exhausted, or the decoded size of the live textures exceeds the budget,
+     the least recently used textures are evicted */
+  struct list lru_textures;
+  int64_t texture_bytes;
+
+  /* keys of recently evicted textures, used to detect textures that are
+     decoded again after being evicted */
+  tr_texture_key_t evicted_keys[4096];
+
+  /* optional on-disk cache of decoded textures for the loaded game */
+  struct tex_cache *tex_cache;
+
+  /* snapshot of the machine, saved incrementally so that saving again only
+     copies the memory pages changed since the previous save. quick saves of
+     the loaded game are written to state_path */
+  struct savestate *snapshot;
+  char state_path[PATH_MAX];
+
+  /* history of states recorded by the emulation thread every
+     OPTION_rewind_interval frames. while rewinding is set, the video thread
+     steps back through them a state each frame */
+  struct rewind *rewind;
+  int rewind_frames;
+  volatile int rewinding;
 
   /* debugging */
   struct trace_writer *trace_writer;
@@ -129,126 +245,226 @@ struct emu {
 /*
  * texture cache
  */
-static int emu_texture_cmp(const struct rb_node *rb_lhs,
-                           const struct rb_node *rb_rhs) {
-  const struct emu_texture *lhs =
-      rb_entry(rb_lhs, const struct emu_texture, live_it);
-  tr_texture_key_t lhs_key = tr_texture_key(lhs->tsp, lhs->tcw);
-
-  const struct emu_texture *rhs =
-      rb_entry(rb_rhs, const struct emu_texture, live_it);
-  tr_texture_key_t rhs_key = tr_texture_key(rhs->tsp, rhs->tcw);
-
-  if (lhs_key < rhs_key) {
-    return -1;
-  } else if (lhs_key > rhs_key) {
-    return 1;
-  } else {
-    return 0;
+static void emu_dirty_textures(struct emu *emu) {
+  LOG_INFO("emu_dirty_textures");
+
+  list_for_each_entry(tex, &emu->lru_textures, struct emu_texture, lru_it) {
+    tex->dirty = 1;
   }
 }
 
-static struct rb_callbacks emu_texture_cb = {&emu_texture_cmp, NULL, NULL};
-
-static void emu_dirty_textures(struct emu *emu) {
-  LOG_INFO("emu_dirty_textures");
+/* rather than marking textures dirty as they're written to, the pvr records
+   the pages written, and each texture overlapping them is marked dirty in a
+   single pass when the next context is pushed */
+static void emu_dirty_modified_textures(struct emu *emu) {
+  struct pvr *pvr = emu->dc->pvr;
+  const uint8_t *palette_ram = (const uint8_t *)pvr->PALETTE_RAM000;
+  int num_dirtied = 0;
 
-  struct rb_node *it = rb_first(&emu->live_textures);
+  list_for_each_entry(tex, &emu->lru_textures, struct emu_texture, lru_it) {
+    if (tex->dirty || !tex->texture) {
+      continue;
+    }
 
-  while (it) {
-    struct rb_node *next = rb_next(it);
-    struct emu_texture *tex = rb_entry(it, struct emu_texture, live_it);
+    uint32_t texture_addr = (uint32_t)(tex->texture - pvr->vram);
+    int dirty = pvr_vram_dirty(pvr, texture_addr, tex->texture_size);
 
-    tex->dirty = 1;
+    if (!dirty && tex->palette) {
+      uint32_t palette_addr = (uint32_t)(tex->palette - palette_ram);
+      dirty = pvr_palette_dirty(pvr, palette_addr, tex->palette_size);
+    }
 
-    it = next;
+    if (dirty) {
+      tex->dirty = 1;
+      num_dirtied++;
+    }
   }
+
+  pvr_clear_dirty(pvr);
+
+  prof_counter_add(COUNTER_tex_invalidations, num_dirtied);
 }
 
-static void emu_dirty_modified_textures(struct emu *emu) {
-  list_for_each_entry(tex, &emu->modified_textures, struct emu_texture,
-                      modified_it) {
-    tex->dirty = 1;
-    tex->modified = 0;
-  }
+static void emu_free_texture(struct emu *emu, struct emu_texture *tex) {
+  /* remove from live map */
+  hash_map_remove(emu->live_textures, tr_texture_key(tex->tsp, tex->tcw));
+  list_remove(&emu->lru_textures, &tex->lru_it);
+  emu->last_registered = NULL;
+  emu->texture_bytes -= tex->size;
 
-  list_clear(&emu->modified_textures);
+  /* add back to free list */
+  list_add(&emu->free_textures, &tex->free_it);
 }
 
-static void emu_texture_modified(const struct exception_state *ex, void *data) {
-  struct emu_texture *tex = data;
-  tex->texture_watch = NULL;
+/* called on the emulation thread while pushing a context. once the texture's
+   host texture is no longer shared, it's handed off to the video thread to be
+   destroyed after this context is converted */
+static void emu_release_texture(struct emu *emu, struct emu_texture *tex) {
+  struct tr_host_texture *host = tr_unref_texture((struct tr_texture *)tex);
 
-  if (!tex->modified) {
-    list_add(&tex->emu->modified_textures, &tex->modified_it);
-    tex->modified = 1;
+  if (!host) {
+    return;
   }
+
+  struct emu_context *c = emu->pending_ctx;
+  CHECK_NOTNULL(c);
+  CHECK_LT(c->num_released, ARRAY_SIZE(c->released));
+  c->released[c->num_released++] = host;
 }
 
-static void emu_palette_modified(const struct exception_state *ex, void *data) {
-  struct emu_texture *tex = data;
-  tex->palette_watch = NULL;
+/* called on the video thread once the context it's rendering has been replaced
+   by c, which doesn't reference any of the released host textures */
+static void emu_destroy_released_textures(struct emu *emu,
+                                          struct emu_context *c) {
+  for (int i = 0; i < emu->num_vid_released; i++) {
+    tr_destroy_host_texture(emu->r, emu->vid_released[i]);
+  }
+  emu->num_vid_released = 0;
 
-  if (!tex->modified) {
-    list_add(&tex->emu->modified_textures, &tex->modified_it);
-    tex->modified = 1;
+  for (int i = 0; i < c->num_released; i++) {
+    tr_destroy_host_texture(emu->r, c->released[i]);
   }
+  c->num_released = 0;
 }
 
-static void emu_free_texture(struct emu *emu, struct emu_texture *tex) {
-  /* remove from live tree */
-  rb_unlink(&emu->live_textures, &tex->live_it, &emu_texture_cb);
+/* called on the video thread when c is skipped, the context it's rendering may
+   still reference the host textures released by it */
+static void emu_hold_released_textures(struct emu *emu,
+                                       struct emu_context *c) {
+  int num_released = emu->num_vid_released + c->num_released;
+
+  if (num_released > emu->max_vid_released) {
+    emu->max_vid_released = MAX(emu->max_vid_released * 2, num_released);
+    emu->vid_released =
+        realloc(emu->vid_released,
+                emu->max_vid_released * sizeof(emu->vid_released[0]));
+    CHECK_NOTNULL(emu->vid_released);
+  }
 
-  /* add back to free list */
-  list_add(&emu->free_textures, &tex->free_it);
+  memcpy(&emu->vid_released[emu->num_vid_released], c->released,
+         c->num_released * sizeof(c->released[0]));
+  emu->num_vid_released = num_released;
+  c->num_released = 0;
+}
+
+static int emu_can_evict_texture(struct emu *emu) {
+  struct emu_texture *tex =
+      list_first_entry(&emu->lru_textures, struct emu_texture, lru_it);
+
+  /* textures referenced by the pending context can't be evicted */
+  return tex && tex->frame != emu->frame;
+}
+
+static void emu_evict_texture(struct emu *emu) {
+  struct emu_texture *tex =
+      list_first_entry(&emu->lru_textures, struct emu_texture, lru_it);
+
+  emu_release_texture(emu, tex);
+
+  tr_texture_key_t key = tr_texture_key(tex->tsp, tex->tcw);
+  emu->evicted_keys[hash_key(key, HASH_BITS(emu->evicted_keys))] = key;
+
+  prof_counter_add(COUNTER_tex_evictions, 1);
+
+  emu_free_texture(emu, tex);
+}
+
+static void emu_evict_textures(struct emu *emu) {
+  int64_t budget = (int64_t)OPTION_texture_budget * 1024 * 1024;
+
+  while (emu->texture_bytes > budget && emu_can_evict_texture(emu)) {
+    emu_evict_texture(emu);
+  }
 }
 
 static struct emu_texture *emu_alloc_texture(struct emu *emu, union tsp tsp,
                                              union tcw tcw) {
+  /* make room by evicting the least recently used texture */
+  if (list_empty(&emu->free_textures)) {
+    if (!emu_can_evict_texture(emu)) {
+      LOG_FATAL("emu_alloc_texture texture pool exhausted");
+    }
+
+    emu_evict_texture(emu);
+  }
+
   /* remove from free list */
   struct emu_texture *tex =
       list_first_entry(&emu->free_textures, struct emu_texture, free_it);
   CHECK_NOTNULL(tex);
   list_remove(&emu->free_textures, &tex->free_it);
 
+  /* textures evicted and requested again will need to be decoded again */
+  tr_texture_key_t key = tr_texture_key(tsp, tcw);
+  tr_texture_key_t *evicted_key =
+      &emu->evicted_keys[hash_key(key, HASH_BITS(emu->evicted_keys))];
+
+  if (*evicted_key == key) {
+    prof_counter_add(COUNTER_tex_redecodes, 1);
+    *evicted_key = 0;
+  }
+
   /* reset tex */
   memset(tex, 0, sizeof(*tex));
   tex->emu = emu;
   tex->tsp = tsp;
   tex->tcw = tcw;
 
-  /* add to live tree */
-  rb_insert(&emu->live_textures, &tex->live_it, &emu_texture_cb);
+  /* add to live map */
+  hash_map_insert(emu->live_textures, key, tex);
+  list_add(&emu->lru_textures, &tex->lru_it);
 
   return tex;
 }
 
+static struct emu_texture *emu_lookup_texture(struct emu *emu,
+                                              struct emu_texture **last,
+                                              union tsp tsp, union tcw tcw) {
+  struct emu_texture *tex = *last;
+
+  if (tex && tex->tsp.full == tsp.full && tex->tcw.full == tcw.full) {
+    return tex;
+  }
+
+  tex = hash_map_find(emu->live_textures, tr_texture_key(tsp, tcw));
+  *last = tex;
+
+  return tex;
+}
+
+/* called on the video thread while converting a context, returning the
+   texture entries as they were when the context was pushed */
 static struct tr_texture *emu_find_texture(void *userdata, union tsp tsp,
                                            union tcw tcw) {
-  struct emu *emu = userdata;
+  struct emu_context *c = userdata;
+  struct tr_texture *tex = c->last_texture;
 
-  struct emu_texture search;
-  search.tsp = tsp;
-  search.tcw = tcw;
+  if (tex && tex->tsp.full == tsp.full && tex->tcw.full == tcw.full) {
+    return tex;
+  }
 
-  struct emu_texture *tex =
-      rb_find_entry(&emu->live_textures, &search, struct emu_texture, live_it,
-                    &emu_texture_cb);
-  return (struct tr_texture *)tex;
+  tex = hash_map_find(c->texture_map, tr_texture_key(tsp, tcw));
+  c->last_texture = tex;
+
+  return tex;
 }
 
-static void emu_register_texture_source(struct emu *emu, union tsp tsp,
-                                        union tcw tcw) {
+static void emu_register_texture_source(struct emu *emu,
+                                        const struct ta_context *ctx,
+                                        union tsp tsp, union tcw tcw) {
   struct emu_texture *entry =
-      (struct emu_texture *)emu_find_texture(emu, tsp, tcw);
+      emu_lookup_texture(emu, &emu->last_registered, tsp, tcw);
 
   if (!entry) {
     entry = emu_alloc_texture(emu, tsp, tcw);
     entry->dirty = 1;
+    emu->last_registered = entry;
   }
 
-  /* mark texture source valid for the current pending frame */
-  int first_registration_this_frame = entry->frame != emu->frame;
+  /* each texture is only registered once per context */
+  if (entry->frame == emu->frame) {
+    return;
+  }
   entry->frame = emu->frame;
 
   /* set texture address */
@@ -258,36 +474,43 @@ static void emu_register_texture_source(struct emu *emu, union tsp tsp,
                     &entry->palette_size);
   }
 
-#ifdef NDEBUG
-  /* add write callback in order to invalidate on future writes. the callback
-     address will be page aligned, therefore it will be triggered falsely in
-     some cases. over invalidate in these cases */
-  if (!entry->texture_watch) {
-    entry->texture_watch = add_single_write_watch(
-        entry->texture, entry->texture_size, &emu_texture_modified, entry);
-  }
-
-  if (entry->palette && !entry->palette_watch) {
-    entry->palette_watch = add_single_write_watch(
-        entry->palette, entry->palette_size, &emu_palette_modified, entry);
-  }
-#endif
-
-  if (emu->trace_writer && entry->dirty && first_registration_this_frame) {
+  if (emu->trace_writer && entry->dirty) {
     trace_writer_insert_texture(emu->trace_writer, tsp, tcw, entry->frame,
                                 entry->palette, entry->palette_size,
                                 entry->texture, entry->texture_size);
   }
+
+  /* resolve the texture to a host texture now, while its source data is known
+     to be intact. the video thread decodes it from a copy */
+  if (entry->dirty || !entry->host) {
+    emu_release_texture(emu, entry);
+    tr_resolve_texture(ctx, (struct tr_texture *)entry);
+  }
+
+  /* move to the back of the lru list, updating its size now that it's been
+     resolved */
+  int size = entry->width * entry->height * 4;
+  emu->texture_bytes += size - entry->size;
+  entry->size = size;
+
+  list_remove(&emu->lru_textures, &entry->lru_it);
+  list_add(&emu->lru_textures, &entry->lru_it);
+
+  /* hand the video thread a copy of the entry to convert the context with */
+  struct emu_context *c = emu->pending_ctx;
+  struct tr_texture *tex = &c->textures[c->num_textures++];
+  *tex = *(struct tr_texture *)entry;
+  hash_map_insert(c->texture_map, tr_texture_key(tsp, tcw), tex);
 }
 
 static void emu_register_texture_sources(struct emu *emu,
-                                         struct ta_context *ctx) {
+                                         const struct ta_context *ctx) {
   const uint8_t *data = ctx->params;
   const uint8_t *end = ctx->params + ctx->size;
   int vert_type = 0;
 
   if (ctx->bg_isp.texture) {
-    emu_register_texture_source(emu, ctx->bg_tsp, ctx->bg_tcw);
+    emu_register_texture_source(emu, ctx, ctx->bg_tsp, ctx->bg_tcw);
   }
 
   while (data < end) {
@@ -301,7 +524,8 @@ static void emu_register_texture_sources(struct emu *emu,
         vert_type = ta_vert_type(param->type0.pcw);
 
         if (param->type0.pcw.texture) {
-          emu_register_texture_source(emu, param->type0.tsp, param->type0.tcw);
+          emu_register_texture_source(emu, ctx, param->type0.tsp,
+                                      param->type0.tcw);
         }
       } break;
 
@@ -350,91 +574,347 @@ static void emu_start_tracing(struct emu *emu) {
 }
 
 /*
- * dreamcast guest interface
+ * event queue
  */
-static void emu_vblank_in(void *userdata, int vid_disabled) {
-  struct emu *emu = userdata;
+/* returns a mask of the contexts the video thread is done with */
+static int emu_handle_event(struct emu *emu, const struct emu_event *ev) {
+  int released = 0;
+
+  switch (ev->type) {
+    case EMU_EVENT_CONTEXT: {
+      struct emu_context *c = &emu->contexts[ev->context];
+
+      if (emu->vid_skip) {
+        /* textures referenced by the skipped context are decoded the next time
+           a context referencing them is converted. host textures it released
+           may still be referenced by vid_ctx, so they're held onto until
+           then as well */
+        emu_hold_released_textures(emu, c);
+        released |= 1 << ev->context;
+
+        emu->vid_stale = 1;
+        prof_counter_add(COUNTER_contexts_skipped, 1);
+      } else {
+        tr_convert_context(emu->r, c, &emu_find_texture, &c->ctx, c->rc);
+
+        /* the newly converted context replaces vid_ctx, and doesn't reference
+           any of the host textures released before it was pushed */
+        emu_destroy_released_textures(emu, c);
+
+        if (emu->vid_ctx) {
+          released |= 1 << (int)(emu->vid_ctx - emu->contexts);
+        }
+        emu->vid_ctx = c;
+        emu->vid_stale = 0;
+      }
 
-  if (emu->multi_threaded) {
-    mutex_lock(emu->res_mutex);
+      emu->vid_source = EMU_SOURCE_CTX;
+    } break;
+
+    case EMU_EVENT_PIXELS: {
+      emu->vid_fb = &emu->fbs[ev->fb];
+      emu->vid_source = EMU_SOURCE_PXL;
+    } break;
+
+    case EMU_EVENT_VBLANK: {
+      emu->vid_disabled = ev->vid_disabled;
+      emu->vid_frames_ready++;
+    } break;
+
+    default:
+      LOG_FATAL("emu_handle_event unexpected event %d", ev->type);
+      break;
   }
 
-  emu->state = EMU_DRAWFRAME;
-  emu->vid_disabled = vid_disabled;
+  return released;
+}
 
-  if (emu->multi_threaded) {
-    cond_signal(emu->res_cond);
-    mutex_unlock(emu->res_mutex);
+/* called on the video thread to process the next event in the queue, and let
+   the emulation thread know which of its buffers are no longer in use */
+static void emu_pump_event(struct emu *emu) {
+  struct emu_event ev;
+  memcpy(&ev, ringbuf_read_ptr(emu->events), sizeof(ev));
+  ringbuf_advance_read_ptr(emu->events, sizeof(ev));
+
+  int released = emu_handle_event(emu, &ev);
+
+  /* vblanks don't free up anything the emulation thread may be waiting on */
+  if (ev.type == EMU_EVENT_VBLANK) {
+    return;
   }
+
+  mutex_lock(emu->req_mutex);
+
+  emu->contexts_used &= ~released;
+  if (ev.type == EMU_EVENT_PIXELS) {
+    emu->pixels_consumed++;
+  }
+  cond_signal(emu->req_cond);
+
+  mutex_unlock(emu->req_mutex);
 }
 
-static void emu_vblank_out(void *userdata) {
-  struct emu *emu = userdata;
+/* called on the video thread to wait for the next event. if stop_when_parked
+   is set, returns 0 once the queue is empty and the emulation thread is parked
+   between frames */
+static int emu_wait_event(struct emu *emu, int stop_when_parked) {
+  int64_t start = time_nanoseconds();
+  int available;
 
-  emu->state = EMU_ENDFRAME;
+  mutex_lock(emu->res_mutex);
+
+  while (!(available = ringbuf_available(emu->events)) &&
+         !(stop_when_parked && emu->parked)) {
+    cond_wait(emu->res_cond, emu->res_mutex);
+  }
+
+  mutex_unlock(emu->res_mutex);
+
+  prof_counter_add(COUNTER_vid_wait_time, (time_nanoseconds() - start) / 1000);
+
+  return available > 0;
 }
 
-static void emu_finish_render(void *userdata) {
-  struct emu *emu = userdata;
+/* called on the emulation thread to wake up the video thread if it's waiting
+   on the queue */
+static void emu_wake_video_thread(struct emu *emu) {
+  mutex_lock(emu->res_mutex);
+  cond_signal(emu->res_cond);
+  mutex_unlock(emu->res_mutex);
+}
+
+/* called on the emulation thread. when running single-threaded, the event is
+   handled immediately */
+static void emu_push_event(struct emu *emu, const struct emu_event *ev) {
+  if (!emu->multi_threaded) {
+    emu->contexts_used &= ~emu_handle_event(emu, ev);
+    return;
+  }
+
+  /* the queue holds many frames worth of events, it'll only be full if the
+     video thread has stalled */
+  if (ringbuf_remaining(emu->events) < (int)sizeof(*ev)) {
+    int64_t start = time_nanoseconds();
+
+    emu_wake_video_thread(emu);
+
+    mutex_lock(emu->req_mutex);
+    while (ringbuf_remaining(emu->events) < (int)sizeof(*ev)) {
+      cond_wait(emu->req_cond, emu->req_mutex);
+    }
+    mutex_unlock(emu->req_mutex);
+
+    prof_counter_add(COUNTER_emu_wait_time,
+                     (time_nanoseconds() - start) / 1000);
+  }
+
+  memcpy(ringbuf_write_ptr(emu->events), ev, sizeof(*ev));
+  ringbuf_advance_write_ptr(emu->events, sizeof(*ev));
+
+  /* the video thread only acts on a frame's events once its vblank arrives,
+     so it's only woken up then, rather than for every event. anywhere the
+     emulation thread blocks on the video thread, it wakes it up first, in case
+     it's waiting on events pushed since */
+  if (ev->type == EMU_EVENT_VBLANK) {
+    emu_wake_video_thread(emu);
+  }
+}
+
+/* called on the emulation thread to claim a context which isn't queued or
+   being rendered by the video thread, waiting for one to be released if
+   they're all in use */
+static struct emu_context *emu_alloc_context(struct emu *emu) {
+  int all_used = (1 << EMU_NUM_CONTEXTS) - 1;
+  int used = emu->contexts_used;
 
   if (emu->multi_threaded) {
-    /* ideally, the video thread has parsed the pending context, uploaded its
-       textures, etc. during the estimated render time. however, if it hasn't
-       finished, the emulation thread must be paused to avoid altering
-       the yet-to-be-uploaded texture memory */
-    mutex_lock(emu->res_mutex);
+    int64_t start = time_nanoseconds();
 
-    /* if pending_ctx is non-NULL here, a frame is being skipped */
-    emu->pending_ctx = NULL;
-    cond_signal(emu->res_cond);
+    mutex_lock(emu->req_mutex);
+    if (emu->contexts_used == all_used) {
+      mutex_unlock(emu->req_mutex);
+      emu_wake_video_thread(emu);
+      mutex_lock(emu->req_mutex);
 
-    mutex_unlock(emu->res_mutex);
+      while (emu->contexts_used == all_used) {
+        cond_wait(emu->req_cond, emu->req_mutex);
+      }
+
+      prof_counter_add(COUNTER_emu_wait_time,
+                       (time_nanoseconds() - start) / 1000);
+    }
+    used = emu->contexts_used;
+    mutex_unlock(emu->req_mutex);
+  }
+
+  CHECK_NE(used, all_used);
+
+  int i = 0;
+  while (used & (1 << i)) {
+    i++;
+  }
+
+  struct emu_context *c = &emu->contexts[i];
+
+  /* clear out the texture entries from the last time it was used */
+  for (int j = 0; j < c->num_textures; j++) {
+    struct tr_texture *tex = &c->textures[j];
+    hash_map_remove(c->texture_map, tr_texture_key(tex->tsp, tex->tcw));
   }
+  c->num_textures = 0;
+  c->last_texture = NULL;
+  CHECK_EQ(c->num_released, 0);
+
+  return c;
+}
+
+/* called on the emulation thread to wait for a framebuffer which isn't queued
+   or being displayed by the video thread */
+static void emu_wait_framebuffer(struct emu *emu) {
+  if (!emu->multi_threaded) {
+    return;
+  }
+
+  int64_t start = time_nanoseconds();
+
+  mutex_lock(emu->req_mutex);
+  if (emu->pixels_pushed - emu->pixels_consumed >= EMU_NUM_FRAMEBUFFERS - 1) {
+    mutex_unlock(emu->req_mutex);
+    emu_wake_video_thread(emu);
+    mutex_lock(emu->req_mutex);
+
+    while (emu->pixels_pushed - emu->pixels_consumed >=
+           EMU_NUM_FRAMEBUFFERS - 1) {
+      cond_wait(emu->req_cond, emu->req_mutex);
+    }
+  }
+  mutex_unlock(emu->req_mutex);
+
+  prof_counter_add(COUNTER_emu_wait_time, (time_nanoseconds() - start) / 1000);
+}
+
+/* called on the video thread to park the emulation thread between frames, so
+   state shared with it can be safely accessed */
+static void emu_pause_thread(struct emu *emu) {
+  if (!emu->multi_threaded) {
+    return;
+  }
+
+  mutex_lock(emu->req_mutex);
+  emu->paused = 1;
+  mutex_unlock(emu->req_mutex);
+
+  /* keep draining the queue, the emulation thread may be blocked waiting on a
+     context or framebuffer to be released before it can finish its frame */
+  while (emu_wait_event(emu, 1)) {
+    emu_pump_event(emu);
+  }
+}
+
+static void emu_resume_thread(struct emu *emu) {
+  if (!emu->multi_threaded) {
+    return;
+  }
+
+  mutex_lock(emu->req_mutex);
+  emu->paused = 0;
+  cond_signal(emu->req_cond);
+  mutex_unlock(emu->req_mutex);
+}
+
+/*
+ * dreamcast guest interface
+ */
+static void emu_vblank_in(void *userdata, int vid_disabled) {
+  struct emu *emu = userdata;
+
+  emu->state = EMU_DRAWFRAME;
+
+  struct emu_event ev = {0};
+  ev.type = EMU_EVENT_VBLANK;
+  ev.vid_disabled = vid_disabled;
+  emu_push_event(emu, &ev);
+}
+
+static void emu_vblank_out(void *userdata) {
+  struct emu *emu = userdata;
+
+  emu->state = EMU_ENDFRAME;
 }
 
 static void emu_start_render(void *userdata, struct ta_context *ctx) {
   struct emu *emu = userdata;
 
+  /* claim a context to hand off to the video thread. this only waits when the
+     video thread is still holding onto all of them */
+  struct emu_context *c = emu_alloc_context(emu);
+  emu->pending_ctx = c;
+
   /* incement internal frame number. this frame number is assigned to the each
-     texture source registered to assert synchronization between the emulator
-     and video thread is working as expected */
+     texture source registered, so each is only registered once per context */
   emu->frame++;
+  emu->last_registered = NULL;
 
-  /* now that the video thread is sure to not be accessing the texture data,
-     mark any textures dirty that were invalidated by a memory watch */
+  /* mark any textures dirty whose source pages were written to since the last
+     context was pushed */
   emu_dirty_modified_textures(emu);
 
-  /* register the source of each texture referenced by the context with the
-     tile renderer. note, uploading the texture to the render backend happens
-     lazily while converting the context. this registration just lets the
-     backend know where the texture's source data is */
+  /* register the source of each texture referenced by the context, resolving
+     each to a host texture and copying the source data of new ones. decoding
+     and uploading them to the render backend happens lazily on the video
+     thread while converting the context */
   emu_register_texture_sources(emu, ctx);
 
+  /* evict textures not referenced by this context until under budget */
+  emu_evict_textures(emu);
+
   if (emu->trace_writer) {
     trace_writer_render_context(emu->trace_writer, ctx);
   }
 
-  if (emu->multi_threaded) {
-    /* save off context and notify video thread that it's available */
-    mutex_lock(emu->res_mutex);
+  /* copy the context's params, and take ownership of the surfaces and
+     vertices parsed from them so far, leaving the ta an empty tr_context to
+     parse into should the context continue to be written to */
+  struct tr_context *rc = c->rc;
+  ta_copy_context(&c->ctx, ctx);
+  c->rc = ctx->rc;
+  ctx->rc = rc;
+  tr_init_context(ctx->rc);
 
-    emu->pending_ctx = ctx;
-    cond_signal(emu->res_cond);
+  /* notify video thread that the context is available */
+  int i = (int)(c - emu->contexts);
 
-    mutex_unlock(emu->res_mutex);
+  if (emu->multi_threaded) {
+    mutex_lock(emu->req_mutex);
+    emu->contexts_used |= 1 << i;
+    mutex_unlock(emu->req_mutex);
   } else {
-    emu->pending_ctx = ctx;
+    emu->contexts_used |= 1 << i;
   }
+
+  struct emu_event ev = {0};
+  ev.type = EMU_EVENT_CONTEXT;
+  ev.context = i;
+  emu_push_event(emu, &ev);
+
+  emu->pending_ctx = NULL;
 }
 
 static void emu_push_pixels(void *userdata, const uint8_t *data, int w, int h) {
   struct emu *emu = userdata;
 
-  memcpy(emu->vid_fb.data, data, w * h * 4);
-  emu->vid_fb.width = w;
-  emu->vid_fb.height = h;
+  emu_wait_framebuffer(emu);
+
+  int fb = (int)(emu->pixels_pushed % EMU_NUM_FRAMEBUFFERS);
+  memcpy(emu->fbs[fb].data, data, w * h * 4);
+  emu->fbs[fb].width = w;
+  emu->fbs[fb].height = h;
 
-  emu->vid_source = EMU_SOURCE_PXL;
+  struct emu_event ev = {0};
+  ev.type = EMU_EVENT_PIXELS;
+  ev.fb = fb;
+  emu->pixels_pushed++;
+  emu_push_event(emu, &ev);
 }
 
 static void emu_push_audio(void *userdata, const int16_t *data, int frames) {
@@ -475,10 +955,19 @@ static void *emu_run_thread(void *data) {
   struct emu *emu = data;
 
   while (1) {
-    /* wait for video thread to request a frame to be ran */
+    /* let the video thread know the frame has finished */
+    mutex_lock(emu->res_mutex);
+    emu->parked = 1;
+    cond_signal(emu->res_cond);
+    mutex_unlock(emu->res_mutex);
+
+    /* wait for video thread to allow another frame to be ran */
+    int64_t start = time_nanoseconds();
+
     mutex_lock(emu->req_mutex);
 
-    while (emu->state == EMU_WAITING) {
+    while (emu->state != EMU_SHUTDOWN &&
+           (emu->paused || emu->frames_run >= emu->frames_allowed)) {
       cond_wait(emu->req_cond, emu->req_mutex);
     }
 
@@ -487,16 +976,41 @@ static void *emu_run_thread(void *data) {
       break;
     }
 
-    emu_run_until_vblank(emu);
-
-    emu->state = EMU_WAITING;
+    /* unpark while still holding req_mutex, so emu_pause_thread can't see the
+       thread as parked after it's been allowed to run */
+    mutex_lock(emu->res_mutex);
+    emu->parked = 0;
+    mutex_unlock(emu->res_mutex);
 
     mutex_unlock(emu->req_mutex);
+
+    prof_counter_add(COUNTER_emu_wait_time,
+                     (time_nanoseconds() - start) / 1000);
+
+    emu_run_until_vblank(emu);
+
+    emu->frames_run++;
   }
 
   return NULL;
 }
 
+static void emu_record_rewind(struct emu *emu) {
+  if (!emu->rewind || emu->rewinding || !dc_running(emu->dc)) {
+    return;
+  }
+
+  if (++emu->rewind_frames < OPTION_rewind_interval) {
+    return;
+  }
+
+  emu->rewind_frames = 0;
+
+  int64_t start = time_nanoseconds();
+  rewind_save(emu->rewind, emu->dc);
+  prof_counter_add(COUNTER_rewind_time, (time_nanoseconds() - start) / 1000);
+}
+
 static void emu_run_until_vblank(struct emu *emu) {
   const int64_t MACHINE_STEP = HZ_TO_NANO(1000);
 
@@ -505,9 +1019,37 @@ static void emu_run_until_vblank(struct emu *emu) {
   while (emu->state == EMU_RUNFRAME || emu->state == EMU_DRAWFRAME) {
     dc_tick(emu->dc, MACHINE_STEP);
   }
+
+  emu_record_rewind(emu);
 }
 
-void emu_render_frame(struct emu *emu) {
+/* called on the video thread at the start of each frame to decide if the
+   frame should be skipped. each frame is expected to start a frame period after
+   the previous one. once the host falls more than a frame behind, up to
+   OPTION_frameskip consecutive frames are skipped until it catches up. frames
+   are never skipped if the host has no way to present a skipped frame */
+static int emu_skip_frame(struct emu *emu) {
+  int64_t now = time_nanoseconds();
+
+  if (!emu->vid_deadline) {
+    emu->vid_deadline = now;
+  }
+
+  /* don't bank time while the host is running ahead, and don't accumulate
+     more debt than skipping frames could pay off */
+  emu->vid_deadline += EMU_FRAME_PERIOD;
+  emu->vid_deadline = CLAMP(emu->vid_deadline, now - EMU_MAX_FRAME_DEBT,
+                            now + EMU_FRAME_PERIOD);
+
+  int64_t lateness = now - emu->vid_deadline;
+  prof_counter_set(COUNTER_frame_lateness, MAX(lateness, 0) / 1000);
+
+  return lateness > EMU_FRAME_PERIOD &&
+         emu->vid_frames_skipped < OPTION_frameskip &&
+         video_can_skip(emu->host);
+}
+
+int emu_render_frame(struct emu *emu) {
   prof_counter_add(COUNTER_frames, 1);
 
   if (OPTION_aspect_dirty) {
@@ -515,17 +1057,31 @@ void emu_render_frame(struct emu *emu) {
     OPTION_aspect_dirty = 0;
   }
 
-  r_clear(emu->r);
-
   if (!dc_running(emu->dc)) {
+    r_clear(emu->r);
+
+    /* restart the frameskip schedule once the dreamcast is resumed */
+    emu->vid_deadline = 0;
+
     /* since the host times itself based off of our audio output, it's important
        to pump out silent audio frames even when not running the dreamcast, else
        the host will render the ui completely unthrottled  */
     uint32_t silence[AICA_SAMPLE_FREQ / 60] = {0};
     audio_push(emu->host, (int16_t *)silence, ARRAY_SIZE(silence));
-    return;
+    return 1;
   }
 
+  /* step back to the previous recorded state before running the frame */
+  if (emu->rewind && emu->rewinding) {
+    emu_pause_thread(emu);
+    rewind_load(emu->rewind, emu->dc);
+    emu_resume_thread(emu);
+  }
+
+  /* skipping a frame avoids converting any contexts pushed during it, and
+     drawing it. the emulation thread still runs the frame as usual */
+  emu->vid_skip = emu_skip_frame(emu);
+
   int width = r_width(emu->r);
   int height = r_height(emu->r);
   int frame_width;
@@ -558,30 +1114,37 @@ void emu_render_frame(struct emu *emu) {
 
      main thread                        | emulation thread
      ---------------------------------------------------------------------------
-     set EMU_RUNFRAME                   |
+     allow frame n + depth - 1 to run   |
      ---------------------------------------------------------------------------
-                                        | see EMU_RUNFRAME, start running frame
+                                        | start running frame once allowed
      ---------------------------------------------------------------------------
-     wait for EMU_DRAWFRAME / or for    |
-     pending_ctx to be set              |
+     wait for events to be pushed       |
      ---------------------------------------------------------------------------
-                                        | emu_start_render sets pending_ctx or
-                                        | emu_push_pixels copies off framebuffer
+                                        | emu_start_render pushes a context,
+                                        | emu_push_pixels pushes a framebuffer
      ---------------------------------------------------------------------------
-     convert pending_ctx if set         |
+                                        | emu_vblank_in pushes a vblank, waking
+                                        | up the video thread
      ---------------------------------------------------------------------------
-                                        | emu_vblank_in sets EMU_DRAWFRAME
+     convert the context, or latch the  |
+     framebuffer                        |
      ---------------------------------------------------------------------------
-     see EMU_DRAWFRAME, start drawing   |
+     see vblank, start drawing frame n  |
      ---------------------------------------------------------------------------
-                                        | emu_vblank_out sets EMU_ENDFRAME */
+                                        | run frame n + 1 if allowed
 
-  /* request a frame to be ran */
+     with a depth of 1, frame n + 1 isn't allowed to run until the video thread
+     requests it, and the threads run in lockstep like the original hardware.
+     with larger depths, the emulation thread can start on the following frames
+     while the video thread is presenting, at the cost of added latency */
   if (emu->multi_threaded) {
+    int depth = CLAMP(OPTION_frame_queue, 1, EMU_MAX_FRAME_QUEUE);
+
     mutex_lock(emu->req_mutex);
 
-    CHECK_EQ(emu->state, EMU_WAITING);
-    emu->state = EMU_RUNFRAME;
+    emu->vid_frames_requested++;
+    emu->frames_allowed = MAX(emu->frames_allowed,
+                              emu->vid_frames_requested + depth - 1);
     cond_signal(emu->req_cond);
 
     mutex_unlock(emu->req_mutex);
@@ -589,60 +1152,133 @@ void emu_render_frame(struct emu *emu) {
     emu_run_until_vblank(emu);
   }
 
-  /* process any context submitted during the frame */
-  if (emu->multi_threaded) {
-    mutex_lock(emu->res_mutex);
-
-    while (emu->state == EMU_RUNFRAME && !emu->pending_ctx) {
-      cond_wait(emu->res_cond, emu->res_mutex);
-    }
-  }
-
-  if (emu->pending_ctx) {
-    tr_convert_context(emu->r, emu, &emu_find_texture, emu->pending_ctx,
-                       &emu->vid_rc);
-    emu->pending_ctx = NULL;
-
-    emu->vid_source = EMU_SOURCE_CTX;
+  /* process the events pushed by the emulation thread up to the next vblank */
+  while (!emu->vid_frames_ready) {
+    emu_wait_event(emu, 0);
+    emu_pump_event(emu);
   }
 
-  if (emu->multi_threaded) {
-    mutex_unlock(emu->res_mutex);
+  emu->vid_frames_ready--;
+
+  /* if the latest context wasn't converted, there's nothing up to date to
+     draw. the frame is skipped as well, leaving the previous one on screen.
+     this counts against the same limit, as the skipped context may be the
+     last one the game submits. once the limit is hit, the most recently
+     converted context is drawn so the display keeps updating */
+  int stale = emu->vid_source == EMU_SOURCE_CTX && emu->vid_stale &&
+              emu->vid_frames_skipped < OPTION_frameskip;
+
+  /* the framebuffer isn't cleared until now, a skipped frame must leave the
+     previous one intact for the host to present again */
+  if (emu->vid_skip || stale) {
+    emu->vid_frames_skipped++;
+    prof_counter_add(COUNTER_frames_skipped, 1);
+    return 0;
   }
 
-  /* wait for vblank_in */
-  if (emu->multi_threaded) {
-    mutex_lock(emu->res_mutex);
+  emu->vid_frames_skipped = 0;
 
-    while (emu->state == EMU_RUNFRAME) {
-      cond_wait(emu->res_cond, emu->res_mutex);
-    }
+  /* once drawn, don't keep holding off frames for a context that may never
+     be replaced */
+  emu->vid_stale = 0;
 
-    mutex_unlock(emu->res_mutex);
-  }
+  r_clear(emu->r);
 
   /* render the latest video source */
   if (!emu->vid_disabled) {
     if (emu->vid_source == EMU_SOURCE_PXL) {
-      r_draw_pixels(emu->r, emu->vid_fb.data, 0, 0, emu->vid_fb.width,
-                    emu->vid_fb.height);
-    } else if (emu->vid_source == EMU_SOURCE_CTX) {
-      tr_render_context(emu->r, &emu->vid_rc);
+      r_draw_pixels(emu->r, emu->vid_fb->data, 0, 0, emu->vid_fb->width,
+                    emu->vid_fb->height);
+    } else if (emu->vid_source == EMU_SOURCE_CTX && emu->vid_ctx) {
+      tr_render_context(emu->r, emu->vid_ctx->rc);
     }
   }
 
   /* note, the emulation thread may still be running the code between vblank_in
      and vblank_out at this point, but there's no need to wait for it */
+  return 1;
+}
+
+/*
+ * save states, the emulation thread must be paused when calling these
+ */
+static void emu_snapshot(struct emu *emu) {
+  struct savestate *ss = emu->snapshot;
+
+  dc_save_state(emu->dc, ss, 1);
+
+  LOG_INFO("emu_snapshot saved in %.3f ms, %d / %d pages changed",
+           ss->save_time / (float)NS_PER_MS, ss->num_dirty,
+           savestate_num_pages(ss));
+}
+
+static void emu_restore(struct emu *emu) {
+  struct savestate *ss = emu->snapshot;
+
+  dc_load_state(emu->dc, ss);
+
+  LOG_INFO("emu_restore loaded in %.3f ms, %d / %d pages restored",
+           ss->load_time / (float)NS_PER_MS, ss->num_restored,
+           savestate_num_pages(ss));
+}
+
+static void emu_quick_save(struct emu *emu) {
+  emu_snapshot(emu);
+  savestate_write_file(emu->snapshot, emu->state_path);
+}
+
+static void emu_quick_load(struct emu *emu) {
+  if (!savestate_read_file(emu->snapshot, emu->state_path)) {
+    return;
+  }
+
+  emu_restore(emu);
+}
+
+int emu_state_size(struct emu *emu) {
+  emu_pause_thread(emu);
+
+  if (!emu->snapshot->mem_valid) {
+    emu_snapshot(emu);
+  }
+
+  int size = savestate_size(emu->snapshot) + EMU_STATE_SLACK;
+
+  emu_resume_thread(emu);
+
+  return ALIGN_UP(size, 1024 * 1024);
+}
+
+int emu_save_state(struct emu *emu, void *data, int size) {
+  emu_pause_thread(emu);
+
+  emu_snapshot(emu);
+  int res = savestate_write(emu->snapshot, data, size);
+
+  emu_resume_thread(emu);
+
+  return res;
+}
+
+int emu_load_state(struct emu *emu, const void *data, int size) {
+  emu_pause_thread(emu);
+
+  int res = savestate_read(emu->snapshot, data, size);
+  if (res) {
+    emu_restore(emu);
+  }
+
+  emu_resume_thread(emu);
+
+  return res;
 }
 
 void emu_debug_menu(struct emu *emu) {
 #ifdef HAVE_IMGUI
-  /* ensure the emulation thread isn't still executing a previous frame */
-  if (emu->multi_threaded) {
-    mutex_lock(emu->req_mutex);
-    CHECK_EQ(emu->state, EMU_WAITING);
-    mutex_unlock(emu->req_mutex);
-  }
+  /* ensure the emulation thread isn't executing a frame while the menus
+     access the dreamcast. note, this drains the event queue, so frames aren't
+     queued up while the menus are shown */
+  emu_pause_thread(emu);
 
   if (igBeginMainMenuBar()) {
     if (igBeginMenu("EMU", 1)) {
@@ -655,6 +1291,56 @@ void emu_debug_menu(struct emu *emu) {
       if (emu->trace_writer && igMenuItem("stop trace", NULL, 1, 1)) {
         emu_stop_tracing(emu);
       }
+      if (igMenuItem("save state", NULL, 0, emu->state_path[0] != 0)) {
+        emu_quick_save(emu);
+      }
+      if (igMenuItem("load state", NULL, 0, emu->state_path[0] != 0)) {
+        emu_quick_load(emu);
+      }
+
+      igSeparator();
+      igText("texture hits: %d", (int)prof_counter_load(COUNTER_tex_hits));
+      igText("texture misses: %d", (int)prof_counter_load(COUNTER_tex_misses));
+      igText("texture bytes saved: %d kb",
+             (int)(prof_counter_load(COUNTER_tex_bytes_saved) / 1024));
+      igText("texture memory: %d / %d kb", (int)(emu->texture_bytes / 1024),
+             OPTION_texture_budget * 1024);
+      igText("texture evictions: %d",
+             (int)prof_counter_load(COUNTER_tex_evictions));
+      igText("texture re-decodes: %d",
+             (int)prof_counter_load(COUNTER_tex_redecodes));
+      igText("texture invalidations: %d",
+             (int)prof_counter_load(COUNTER_tex_invalidations));
+
+      igSeparator();
+      igText("emulation thread wait: %d us / s",
+             (int)prof_counter_load(COUNTER_emu_wait_time));
+      igText("video thread wait: %d us / s",
+             (int)prof_counter_load(COUNTER_vid_wait_time));
+
+      igSeparator();
+      igText("frames skipped: %d / s",
+             (int)prof_counter_load(COUNTER_frames_skipped));
+      igText("contexts skipped: %d / s",
+             (int)prof_counter_load(COUNTER_contexts_skipped));
+      igText("frame lateness: %d us",
+             (int)prof_counter_load(COUNTER_frame_lateness));
+
+      igSeparator();
+      igText("state save: %.3f ms",
+             emu->snapshot->save_time / (float)NS_PER_MS);
+      igText("state load: %.3f ms",
+             emu->snapshot->load_time / (float)NS_PER_MS);
+
+      if (emu->rewind) {
+        int frames = MAX((int)prof_counter_load(COUNTER_frames), 1);
+        igText("rewind states: %d", rewind_num_states(emu->rewind));
+        igText("rewind memory: %d / %d kb",
+               (int)(rewind_size(emu->rewind) / 1024),
+               OPTION_rewind_budget * 1024);
+        igText("rewind overhead: %d us / frame",
+               (int)prof_counter_load(COUNTER_rewind_time) / frames);
+      }
       igEndMenu();
     }
 
@@ -670,14 +1356,21 @@ void emu_debug_menu(struct emu *emu) {
   if (igBeginMainMenuBar()) {
     char status[128];
     int frames = (int)prof_counter_load(COUNTER_frames);
+    int frames_skipped = (int)prof_counter_load(COUNTER_frames_skipped);
     int ta_renders = (int)prof_counter_load(COUNTER_ta_renders);
     int pvr_vblanks = (int)prof_counter_load(COUNTER_pvr_vblanks);
     int sh4_instrs = (int)(prof_counter_load(COUNTER_sh4_instrs) / 1000000.0f);
     int arm7_instrs =
         (int)(prof_counter_load(COUNTER_arm7_instrs) / 1000000.0f);
+    int tex_decodes = (int)prof_counter_load(COUNTER_tex_decodes);
+    int tex_queue_depth = (int)prof_counter_load(COUNTER_tex_queue_depth);
+    int tex_latency = (int)prof_counter_load(COUNTER_tex_decode_latency);
 
-    snprintf(status, sizeof(status), "FPS %3d RPS %3d VBS %3d SH4 %4d ARM %d",
-             frames, ta_renders, pvr_vblanks, sh4_instrs, arm7_instrs);
+    snprintf(status, sizeof(status),
+             "FPS %3d (%d skipped) RPS %3d VBS %3d SH4 %4d ARM %d "
+             "TEX %3d (%d queued, %d us)",
+             frames, frames_skipped, ta_renders, pvr_vblanks, sh4_instrs,
+             arm7_instrs, tex_decodes, tex_queue_depth, tex_latency);
 
     /* right align */
     struct ImVec2 content;
@@ -689,14 +1382,91 @@ void emu_debug_menu(struct emu *emu) {
 
     igEndMainMenuBar();
   }
+
+  emu_resume_thread(emu);
 #endif
 }
 
+static void emu_close_texture_cache(struct emu *emu) {
+  if (!emu->tex_cache) {
+    return;
+  }
+
+  tr_set_texture_cache(NULL);
+  tex_cache_destroy(emu->tex_cache);
+  emu->tex_cache = NULL;
+}
+
+static void emu_open_texture_cache(struct emu *emu, const char *path) {
+  emu_close_texture_cache(emu);
+
+  if (!OPTION_texture_cache || !path) {
+    return;
+  }
+
+  /* each game gets its own cache, named after the game's file */
+  char cachedir[PATH_MAX];
+  snprintf(cachedir, sizeof(cachedir), "%s" PATH_SEPARATOR "cache",
+           fs_appdir());
+
+  if (!fs_mkdir(cachedir)) {
+    LOG_WARNING("emu_open_texture_cache failed to create %s", cachedir);
+    return;
+  }
+
+  char game[PATH_MAX];
+  fs_basename(path, game, sizeof(game));
+
+  char gamedir[PATH_MAX];
+  snprintf(gamedir, sizeof(gamedir), "%s" PATH_SEPARATOR "%s", cachedir, game);
+
+  int64_t max_size = (int64_t)OPTION_texture_cache_size * 1024 * 1024;
+  emu->tex_cache =
+      tex_cache_create(gamedir, max_size, OPTION_texture_cache_compress);
+  tr_set_texture_cache(emu->tex_cache);
+}
+
+static void emu_init_state_path(struct emu *emu, const char *path) {
+  emu->state_path[0] = 0;
+
+  if (!path) {
+    return;
+  }
+
+  /* each game gets a single quick save slot, named after the game's file */
+  char statedir[PATH_MAX];
+  snprintf(statedir, sizeof(statedir), "%s" PATH_SEPARATOR "states",
+           fs_appdir());
+
+  if (!fs_mkdir(statedir)) {
+    LOG_WARNING("emu_init_state_path failed to create %s", statedir);
+    return;
+  }
+
+  char game[PATH_MAX];
+  fs_basename(path, game, sizeof(game));
+
+  snprintf(emu->state_path, sizeof(emu->state_path),
+           "%s" PATH_SEPARATOR "%s.state", statedir, game);
+}
+
 int emu_load(struct emu *emu, const char *path) {
-  return dc_load(emu->dc, path);
+  if (!dc_load(emu->dc, path)) {
+    return 0;
+  }
+
+  emu_open_texture_cache(emu, path);
+  emu_init_state_path(emu, path);
+
+  return 1;
 }
 
 int emu_keydown(struct emu *emu, int port, int key, int16_t value) {
+  if (key == K_BACKSPACE && emu->rewind) {
+    emu->rewinding = value != 0;
+    return 1;
+  }
+
   if (key >= K_CONT_C && key <= K_CONT_RTRIG) {
     dc_input(emu->dc, port, key - K_CONT_C, value);
   }
@@ -705,13 +1475,30 @@ int emu_keydown(struct emu *emu, int port, int key, int16_t value) {
 }
 
 void emu_vid_destroyed(struct emu *emu) {
-  rb_for_each_entry_safe(tex, &emu->live_textures, struct emu_texture,
-                         live_it) {
-    r_destroy_texture(emu->r, tex->handle);
+  emu_pause_thread(emu);
+
+  list_for_each_entry_safe(tex, &emu->lru_textures, struct emu_texture,
+                           lru_it) {
+    tr_release_texture(emu->r, (struct tr_texture *)tex);
     emu_free_texture(emu, tex);
   }
 
+  for (int i = 0; i < emu->num_vid_released; i++) {
+    tr_destroy_host_texture(emu->r, emu->vid_released[i]);
+  }
+  emu->num_vid_released = 0;
+
+  /* the converted context references the destroyed textures, hand it back */
+  if (emu->vid_ctx) {
+    /* the emulation thread is parked, it won't be looking at contexts_used */
+    emu->contexts_used &= ~(1 << (int)(emu->vid_ctx - emu->contexts));
+
+    emu->vid_ctx = NULL;
+  }
+
   emu->r = NULL;
+
+  emu_resume_thread(emu);
 }
 
 void emu_vid_created(struct emu *emu, struct render_backend *r) {
@@ -719,8 +1506,10 @@ void emu_vid_created(struct emu *emu, struct render_backend *r) {
 }
 
 void emu_destroy(struct emu *emu) {
-  /* shutdown the emulation thread */
+  /* shutdown the emulation thread once it's finished its current frame */
   if (emu->multi_threaded) {
+    emu_pause_thread(emu);
+
     mutex_lock(emu->req_mutex);
     emu->state = EMU_SHUTDOWN;
     cond_signal(emu->req_cond);
@@ -728,15 +1517,30 @@ void emu_destroy(struct emu *emu) {
 
     void *result;
     thread_join(emu->run_thread, &result);
+  }
+
+  emu_stop_tracing(emu);
+  emu_vid_destroyed(emu);
+  emu_close_texture_cache(emu);
+  hash_map_destroy(emu->live_textures);
+  for (int i = 0; i < EMU_NUM_CONTEXTS; i++) {
+    hash_map_destroy(emu->contexts[i].texture_map);
+    free(emu->contexts[i].rc);
+  }
+  free(emu->vid_released);
+  savestate_destroy(emu->snapshot);
+  if (emu->rewind) {
+    rewind_destroy(emu->rewind);
+  }
 
+  if (emu->multi_threaded) {
+    ringbuf_destroy(emu->events);
     mutex_destroy(emu->req_mutex);
     cond_destroy(emu->req_cond);
     mutex_destroy(emu->res_mutex);
     cond_destroy(emu->res_cond);
   }
 
-  emu_stop_tracing(emu);
-  emu_vid_destroyed(emu);
   dc_destroy(emu->dc);
   free(emu);
 }
@@ -752,16 +1556,34 @@ struct emu *emu_create(struct host *host) {
   emu->dc->push_audio = &emu_push_audio;
   emu->dc->push_pixels = &emu_push_pixels;
   emu->dc->start_render = &emu_start_render;
-  emu->dc->finish_render = &emu_finish_render;
   emu->dc->vblank_in = &emu_vblank_in;
   emu->dc->vblank_out = &emu_vblank_out;
 
+  emu->snapshot = savestate_create();
+
+  if (OPTION_rewind) {
+    int64_t budget = (int64_t)OPTION_rewind_budget * 1024 * 1024;
+    emu->rewind = rewind_create(budget);
+
+    /* states are recorded as often as every frame, track the pages written
+       rather than comparing all of memory each time */
+    dc_track_writes(emu->dc, 1);
+  }
+
   /* add all textures to free list by default */
+  emu->live_textures = hash_map_create(ARRAY_SIZE(emu->textures));
+
   for (int i = 0; i < ARRAY_SIZE(emu->textures); i++) {
     struct emu_texture *tex = &emu->textures[i];
     list_add(&emu->free_textures, &tex->free_it);
   }
 
+  for (int i = 0; i < EMU_NUM_CONTEXTS; i++) {
+    struct emu_context *c = &emu->contexts[i];
+    c->rc = calloc(1, sizeof(struct tr_context));
+    c->texture_map = hash_map_create(ARRAY_SIZE(c->textures));
+  }
+
   /* enable the cpu / gpu to be emulated in parallel */
   emu->multi_threaded = 1;
 
@@ -771,6 +1593,7 @@ struct emu *emu_create(struct host *host) {
     emu->req_cond = cond_create();
     emu->res_mutex = mutex_create();
     emu->res_cond = cond_create();
+    emu->events = ringbuf_create(4096 * sizeof(struct emu_event));
 
     emu->run_thread = thread_create(&emu_run_thread, NULL, emu);
     CHECK_NOTNULL(emu->run_thread);
@@ -0,0 +1,325 @@
+#include <zlib.h>
+#include "file/tex_cache.h"
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "core/hash.h"
+#include "core/thread.h"
+
+#define TEX_CACHE_MAGIC 0x58455452 /* RTEX */
+#define TEX_CACHE_VERSION 1
+
+struct tex_cache_header {
+  uint32_t magic;
+  uint32_t version;
+  int32_t size;
+  int32_t data_size;
+  int32_t compressed;
+};
+
+struct tex_cache_entry {
+  uint64_t key;
+  int64_t size;
+  struct list_node hash_it;
+  struct list_node lru_it;
+};
+
+struct tex_cache {
+  char path[PATH_MAX];
+  int64_t max_size;
+  int compress;
+
+  /* the index is accessed by the texture decode workers, guard it */
+  mutex_t mutex;
+  DECLARE_HASHTABLE(entries, 12);
+  int num_entries;
+  int64_t size;
+
+  /* entries ordered from least to most recently used */
+  struct list lru;
+};
+
+static void tex_cache_filename(struct tex_cache *cache, uint64_t key,
+                               char *filename, size_t size) {
+  snprintf(filename, size, "%s" PATH_SEPARATOR "%016" PRIx64 ".tex",
+           cache->path, key);
+}
+
+static struct tex_cache_entry *tex_cache_find(struct tex_cache *cache,
+                                              uint64_t key) {
+  struct list *bkt = hash_bkt(cache->entries, key);
+
+  hash_bkt_for_each_entry(entry, bkt, struct tex_cache_entry, hash_it) {
+    if (entry->key == key) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static void tex_cache_add(struct tex_cache *cache, uint64_t key,
+                          int64_t size) {
+  struct tex_cache_entry *entry = calloc(1, sizeof(*entry));
+  CHECK_NOTNULL(entry);
+  entry->key = key;
+  entry->size = size;
+
+  hash_add(hash_bkt(cache->entries, key), &entry->hash_it);
+  list_add(&cache->lru, &entry->lru_it);
+  cache->num_entries++;
+  cache->size += size;
+}
+
+static void tex_cache_remove(struct tex_cache *cache,
+                             struct tex_cache_entry *entry) {
+  char filename[PATH_MAX];
+  tex_cache_filename(cache, entry->key, filename, sizeof(filename));
+  remove(filename);
+
+  hash_del(hash_bkt(cache->entries, entry->key), &entry->hash_it);
+  list_remove(&cache->lru, &entry->lru_it);
+  cache->num_entries--;
+  cache->size -= entry->size;
+  free(entry);
+}
+
+static void tex_cache_trim(struct tex_cache *cache) {
+  while (cache->size > cache->max_size && !list_empty(&cache->lru)) {
+    struct tex_cache_entry *entry =
+        list_first_entry(&cache->lru, struct tex_cache_entry, lru_it);
+    tex_cache_remove(cache, entry);
+  }
+}
+
+static void tex_cache_scan(struct tex_cache *cache) {
+  DIR *dir = opendir(cache->path);
+
+  if (!dir) {
+    LOG_WARNING("tex_cache_scan failed to open %s", cache->path);
+    return;
+  }
+
+  struct dirent *ent = NULL;
+
+  /* there's no record of when entries from previous sessions were last used,
+     they're ordered as they're found */
+  while ((ent = readdir(dir)) != NULL) {
+    uint64_t key;
+    char ext[8];
+
+    if (sscanf(ent->d_name, "%16" SCNx64 ".%3s", &key, ext) != 2 ||
+        strcmp(ext, "tex")) {
+      continue;
+    }
+
+    char filename[PATH_MAX];
+    tex_cache_filename(cache, key, filename, sizeof(filename));
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+      continue;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    int64_t size = ftell(fp);
+    fclose(fp);
+
+    tex_cache_add(cache, key, size);
+  }
+
+  closedir(dir);
+}
+
+static int tex_cache_read_file(struct tex_cache *cache, uint64_t key,
+                               uint8_t *data, int size) {
+  char filename[PATH_MAX];
+  tex_cache_filename(cache, key, filename, sizeof(filename));
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  struct tex_cache_header hdr;
+  uint8_t *compressed = NULL;
+  int res = 0;
+
+  if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != TEX_CACHE_MAGIC ||
+      hdr.version != TEX_CACHE_VERSION || hdr.size != size) {
+    goto done;
+  }
+
+  if (!hdr.compressed) {
+    res = hdr.data_size == size && fread(data, size, 1, fp) == 1;
+    goto done;
+  }
+
+  compressed = malloc(hdr.data_size);
+  CHECK_NOTNULL(compressed);
+
+  if (fread(compressed, hdr.data_size, 1, fp) != 1) {
+    goto done;
+  }
+
+  uLongf data_size = size;
+  res = uncompress(data, &data_size, compressed, hdr.data_size) == Z_OK &&
+        data_size == (uLongf)size;
+
+done:
+  free(compressed);
+  fclose(fp);
+  return res;
+}
+
+static int64_t tex_cache_write_file(struct tex_cache *cache, uint64_t key,
+                                    const uint8_t *data, int size) {
+  char filename[PATH_MAX];
+  tex_cache_filename(cache, key, filename, sizeof(filename));
+
+  struct tex_cache_header hdr = {0};
+  hdr.magic = TEX_CACHE_MAGIC;
+  hdr.version = TEX_CACHE_VERSION;
+  hdr.size = size;
+  hdr.data_size = size;
+
+  uint8_t *compressed = NULL;
+  const uint8_t *out = data;
+
+  if (cache->compress) {
+    uLongf compressed_size = compressBound(size);
+    compressed = malloc(compressed_size);
+    CHECK_NOTNULL(compressed);
+
+    /* favor speed, this runs on the decode workers */
+    if (compress2(compressed, &compressed_size, data, size, Z_BEST_SPEED) ==
+            Z_OK &&
+        compressed_size < (uLongf)size) {
+      hdr.data_size = (int32_t)compressed_size;
+      hdr.compressed = 1;
+      out = compressed;
+    }
+  }
+
+  FILE *fp = fopen(filename, "wb");
+  int res = 0;
+
+  if (fp) {
+    res = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+          fwrite(out, hdr.data_size, 1, fp) == 1;
+    fclose(fp);
+
+    if (!res) {
+      remove(filename);
+    }
+  }
+
+  free(compressed);
+
+  return res ? (int64_t)sizeof(hdr) + hdr.data_size : 0;
+}
+
+int64_t tex_cache_size(struct tex_cache *cache) {
+  mutex_lock(cache->mutex);
+  int64_t size = cache->size;
+  mutex_unlock(cache->mutex);
+  return size;
+}
+
+int tex_cache_num_entries(struct tex_cache *cache) {
+  mutex_lock(cache->mutex);
+  int num_entries = cache->num_entries;
+  mutex_unlock(cache->mutex);
+  return num_entries;
+}
+
+void tex_cache_write(struct tex_cache *cache, uint64_t key,
+                     const uint8_t *data, int size) {
+  mutex_lock(cache->mutex);
+  int exists = tex_cache_find(cache, key) != NULL;
+  mutex_unlock(cache->mutex);
+
+  if (exists) {
+    return;
+  }
+
+  /* the file is written out before the entry is added to the index, so that
+     readers never see a partially written file */
+  int64_t file_size = tex_cache_write_file(cache, key, data, size);
+
+  if (!file_size) {
+    LOG_WARNING("tex_cache_write failed to write %016" PRIx64, key);
+    return;
+  }
+
+  mutex_lock(cache->mutex);
+  if (!tex_cache_find(cache, key)) {
+    tex_cache_add(cache, key, file_size);
+    tex_cache_trim(cache);
+  }
+  mutex_unlock(cache->mutex);
+}
+
+int tex_cache_read(struct tex_cache *cache, uint64_t key, uint8_t *data,
+                   int size) {
+  mutex_lock(cache->mutex);
+
+  struct tex_cache_entry *entry = tex_cache_find(cache, key);
+
+  if (entry) {
+    /* move to the back of the lru list */
+    list_remove(&cache->lru, &entry->lru_it);
+    list_add(&cache->lru, &entry->lru_it);
+  }
+
+  mutex_unlock(cache->mutex);
+
+  if (!entry) {
+    return 0;
+  }
+
+  if (tex_cache_read_file(cache, key, data, size)) {
+    return 1;
+  }
+
+  /* drop entries which are corrupt, or were trimmed while being read */
+  mutex_lock(cache->mutex);
+  entry = tex_cache_find(cache, key);
+  if (entry) {
+    tex_cache_remove(cache, entry);
+  }
+  mutex_unlock(cache->mutex);
+
+  return 0;
+}
+
+void tex_cache_destroy(struct tex_cache *cache) {
+  list_for_each_entry_safe(entry, &cache->lru, struct tex_cache_entry,
+                           lru_it) {
+    free(entry);
+  }
+
+  mutex_destroy(cache->mutex);
+  free(cache);
+}
+
+struct tex_cache *tex_cache_create(const char *path, int64_t max_size,
+                                   int compress) {
+  if (!fs_mkdir(path)) {
+    LOG_WARNING("tex_cache_create failed to create %s", path);
+    return NULL;
+  }
+
+  struct tex_cache *cache = calloc(1, sizeof(struct tex_cache));
+  strncpy(cache->path, path, sizeof(cache->path) - 1);
+  cache->max_size = max_size;
+  cache->compress = compress;
+  cache->mutex = mutex_create();
+
+  tex_cache_scan(cache);
+  tex_cache_trim(cache);
+
+  LOG_INFO("tex_cache_create path=%s entries=%d size=%" PRId64, path,
+           cache->num_entries, cache->size);
+
+  return cache;
+}
@@ -0,0 +1,26 @@
+#ifndef TEX_CACHE_H
+#define TEX_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * persistent cache of decoded textures, keyed by a hash of their source data
+ * and format. each texture is stored in its own file, and the least recently
+ * used ones are trimmed once the cache grows past its size limit
+ */
+
+struct tex_cache;
+
+struct tex_cache *tex_cache_create(const char *path, int64_t max_size,
+                                   int compress);
+void tex_cache_destroy(struct tex_cache *cache);
+
+int tex_cache_read(struct tex_cache *cache, uint64_t key, uint8_t *data,
+                   int size);
+void tex_cache_write(struct tex_cache *cache, uint64_t key,
+                     const uint8_t *data, int size);
+
+int tex_cache_num_entries(struct tex_cache *cache);
+int64_t tex_cache_size(struct tex_cache *cache);
+
+#endif
@@ -1,14 +1,216 @@
 #include <limits.h>
+#include <zlib.h>
 #include "file/trace.h"
 #include "core/core.h"
 #include "core/filesystem.h"
+#include "core/hash.h"
+#include "core/hash_map.h"
+#include "core/memory.h"
 #include "guest/pvr/tr.h"
 
+#define TRACE_MAGIC 0x43525452 /* RTRC */
+#define TRACE_RECORD_MAGIC 0x43455252 /* RREC */
+#define TRACE_VERSION 3
+
+struct trace_header {
+  uint32_t magic;
+  uint32_t version;
+};
+
+struct trace_footer {
+  int64_t index_offset;
+  int32_t num_cmds;
+  int32_t num_blocks;
+  int32_t num_frames;
+  uint32_t magic;
+};
+
+struct trace_block {
+  int64_t offset;
+  int32_t size;
+  int32_t data_size;
+};
+
+/* each block and command is written out as a record as soon as it's added.
+   the index at the end of the file is only written on close, a trace from a
+   writer that never closed it, e.g. because the process crashed, is recovered
+   by scanning the records instead */
+enum {
+  TRACE_RECORD_BLOCK,
+  TRACE_RECORD_CMD,
+};
+
+struct trace_record {
+  uint32_t magic;
+  int32_t type;
+  int32_t size;
+  int32_t data_size;
+};
+
+/* commands are indexed with their data pointers cleared, along with the block
+   holding their data */
+struct trace_index_cmd {
+  struct trace_cmd cmd;
+  int32_t block;
+};
+
+/* the data is kept to rule out hash collisions between different textures */
+struct trace_texture_block {
+  uint64_t key;
+  int32_t palette_size;
+  int32_t texture_size;
+  int32_t block;
+  struct list_node it;
+  uint8_t data[];
+};
+
+struct trace_writer {
+  FILE *file;
+  int64_t offset;
+
+  /* index written out on close */
+  struct trace_index_cmd *cmds;
+  int num_cmds;
+  int max_cmds;
+
+  struct trace_block *blocks;
+  int num_blocks;
+  int max_blocks;
+
+  int32_t *frames;
+  int num_frames;
+  int max_frames;
+
+  /* texture blocks already written, keyed by a hash of their contents. games
+     commonly upload the same texture data many times over */
+  DECLARE_HASHTABLE(textures, 12);
+
+  /* staging buffers for each block's data before and after compression */
+  uint8_t *data;
+  int data_size;
+  uint8_t *compressed;
+  int compressed_size;
+};
+
+static void *trace_reserve(void *ptr, int *max, int num, int elem_size) {
+  if (num <= *max) {
+    return ptr;
+  }
+
+  while (*max < num) {
+    *max = MAX(*max * 2, 64);
+  }
+
+  ptr = realloc(ptr, (size_t)*max * elem_size);
+  CHECK_NOTNULL(ptr);
+  return ptr;
+}
+
+/*
+ * trace writer
+ */
+static void trace_writer_write_record(struct trace_writer *writer, int type,
+                                      const void *data, int size,
+                                      int data_size) {
+  struct trace_record record = {0};
+  record.magic = TRACE_RECORD_MAGIC;
+  record.type = type;
+  record.size = size;
+  record.data_size = data_size;
+
+  CHECK_EQ(fwrite(&record, sizeof(record), 1, writer->file), 1);
+  if (size) {
+    CHECK_EQ(fwrite(data, size, 1, writer->file), 1);
+  }
+
+  writer->offset += sizeof(record) + size;
+}
+
+static int trace_writer_write_block(struct trace_writer *writer, int size) {
+  uLongf compressed_size = compressBound(size);
+  writer->compressed =
+      trace_reserve(writer->compressed, &writer->compressed_size,
+                    (int)compressed_size, 1);
+
+  int res = compress2(writer->compressed, &compressed_size, writer->data, size,
+                      Z_BEST_SPEED);
+  CHECK_EQ(res, Z_OK);
+
+  writer->blocks = trace_reserve(writer->blocks, &writer->max_blocks,
+                                 writer->num_blocks + 1,
+                                 sizeof(struct trace_block));
+
+  struct trace_block *block = &writer->blocks[writer->num_blocks];
+  block->offset = writer->offset + sizeof(struct trace_record);
+  block->size = (int32_t)compressed_size;
+  block->data_size = size;
+
+  trace_writer_write_record(writer, TRACE_RECORD_BLOCK, writer->compressed,
+                            (int)compressed_size, size);
+
+  return writer->num_blocks++;
+}
+
+static void trace_writer_add_cmd(struct trace_writer *writer,
+                                 const struct trace_cmd *cmd, int block) {
+  writer->cmds =
+      trace_reserve(writer->cmds, &writer->max_cmds, writer->num_cmds + 1,
+                    sizeof(struct trace_index_cmd));
+
+  struct trace_index_cmd *entry = &writer->cmds[writer->num_cmds++];
+  memset(entry, 0, sizeof(*entry));
+  entry->cmd = *cmd;
+  entry->block = block;
+
+  trace_writer_write_record(writer, TRACE_RECORD_CMD, entry, sizeof(*entry),
+                            0);
+}
+
+static void trace_writer_write_index(struct trace_writer *writer) {
+  struct trace_footer footer = {0};
+  footer.index_offset = writer->offset;
+  footer.num_cmds = writer->num_cmds;
+  footer.num_blocks = writer->num_blocks;
+  footer.num_frames = writer->num_frames;
+  footer.magic = TRACE_MAGIC;
+
+  if (writer->num_cmds) {
+    CHECK_EQ(fwrite(writer->cmds, sizeof(struct trace_index_cmd),
+                    writer->num_cmds, writer->file),
+             (size_t)writer->num_cmds);
+  }
+  if (writer->num_blocks) {
+    CHECK_EQ(fwrite(writer->blocks, sizeof(struct trace_block),
+                    writer->num_blocks, writer->file),
+             (size_t)writer->num_blocks);
+  }
+  if (writer->num_frames) {
+    CHECK_EQ(fwrite(writer->frames, sizeof(int32_t), writer->num_frames,
+                    writer->file),
+             (size_t)writer->num_frames);
+  }
+  CHECK_EQ(fwrite(&footer, sizeof(footer), 1, writer->file), 1);
+}
+
 void trace_writer_close(struct trace_writer *writer) {
   if (writer->file) {
+    trace_writer_write_index(writer);
     fclose(writer->file);
   }
 
+  for (int i = 0; i < HASH_SIZE(writer->textures); i++) {
+    struct list *bkt = &writer->textures[i];
+
+    list_for_each_entry_safe(entry, bkt, struct trace_texture_block, it) {
+      free(entry);
+    }
+  }
+
+  free(writer->compressed);
+  free(writer->data);
+  free(writer->frames);
+  free(writer->blocks);
+  free(writer->cmds);
   free(writer);
 }
 
@@ -27,17 +229,25 @@ void trace_writer_render_context(struct trace_writer *writer,
   cmd.context.bg_tcw = ctx->bg_tcw;
   cmd.context.bg_depth = ctx->bg_depth;
   cmd.context.bg_vertices_size = sizeof(ctx->bg_vertices);
-  cmd.context.bg_vertices = (const uint8_t *)(intptr_t)sizeof(cmd);
   cmd.context.params_size = ctx->size;
-  cmd.context.params =
-      (const uint8_t *)(intptr_t)(sizeof(cmd) + sizeof(ctx->bg_vertices));
 
-  CHECK_EQ(fwrite(&cmd, sizeof(cmd), 1, writer->file), 1);
-  CHECK_EQ(fwrite(ctx->bg_vertices, sizeof(ctx->bg_vertices), 1, writer->file),
-           1);
-  if (ctx->size) {
-    CHECK_EQ(fwrite(ctx->params, ctx->size, 1, writer->file), 1);
-  }
+  int size = sizeof(ctx->bg_vertices) + ctx->size;
+  writer->data = trace_reserve(writer->data, &writer->data_size, size, 1);
+  memcpy(writer->data, ctx->bg_vertices, sizeof(ctx->bg_vertices));
+  memcpy(writer->data + sizeof(ctx->bg_vertices), ctx->params, ctx->size);
+
+  int block = trace_writer_write_block(writer, size);
+
+  writer->frames =
+      trace_reserve(writer->frames, &writer->max_frames,
+                    writer->num_frames + 1, sizeof(int32_t));
+  writer->frames[writer->num_frames++] = writer->num_cmds;
+
+  trace_writer_add_cmd(writer, &cmd, block);
+
+  /* flush at the end of each frame, so a crash loses at most the frame it
+     happened in */
+  fflush(writer->file);
 }
 
 void trace_writer_insert_texture(struct trace_writer *writer, union tsp tsp,
@@ -50,17 +260,43 @@ void trace_writer_insert_texture(struct trace_writer *writer, union tsp tsp,
   cmd.texture.tcw = tcw;
   cmd.texture.frame = frame;
   cmd.texture.palette_size = palette_size;
-  cmd.texture.palette = (const uint8_t *)(intptr_t)sizeof(cmd);
   cmd.texture.texture_size = texture_size;
-  cmd.texture.texture = (const uint8_t *)(intptr_t)(sizeof(cmd) + palette_size);
 
-  CHECK_EQ(fwrite(&cmd, sizeof(cmd), 1, writer->file), 1);
+  int size = palette_size + texture_size;
+  writer->data = trace_reserve(writer->data, &writer->data_size, size, 1);
   if (palette_size) {
-    CHECK_EQ(fwrite(palette, palette_size, 1, writer->file), 1);
+    memcpy(writer->data, palette, palette_size);
   }
   if (texture_size) {
-    CHECK_EQ(fwrite(texture, texture_size, 1, writer->file), 1);
+    memcpy(writer->data + palette_size, texture, texture_size);
+  }
+
+  /* only write out the data if it hasn't been seen before */
+  uint64_t key = hash_data(writer->data, size, 0);
+  struct list *bkt = hash_bkt(writer->textures, key);
+  struct trace_texture_block *found = NULL;
+
+  hash_bkt_for_each_entry(entry, bkt, struct trace_texture_block, it) {
+    if (entry->key == key && entry->palette_size == palette_size &&
+        entry->texture_size == texture_size &&
+        !memcmp(entry->data, writer->data, size)) {
+      found = entry;
+      break;
+    }
   }
+
+  if (!found) {
+    found = calloc(1, sizeof(struct trace_texture_block) + size);
+    CHECK_NOTNULL(found);
+    found->key = key;
+    found->palette_size = palette_size;
+    found->texture_size = texture_size;
+    memcpy(found->data, writer->data, size);
+    found->block = trace_writer_write_block(writer, size);
+    hash_add(bkt, &found->it);
+  }
+
+  trace_writer_add_cmd(writer, &cmd, found->block);
 }
 
 struct trace_writer *trace_writer_open(const char *filename) {
@@ -73,50 +309,77 @@ struct trace_writer *trace_writer_open(const char *filename) {
     return NULL;
   }
 
+  struct trace_header hdr = {0};
+  hdr.magic = TRACE_MAGIC;
+  hdr.version = TRACE_VERSION;
+  CHECK_EQ(fwrite(&hdr, sizeof(hdr), 1, writer->file), 1);
+  writer->offset = sizeof(hdr);
+
   return writer;
 }
 
+/*
+ * trace reader
+ */
+
 /* for commands which mutate global state, the previous state needs to be
    tracked in order to support unwinding. To do so, each command is iterated
    and tagged with the previous command that it overrides */
-static int trace_patch_overrides(struct trace_cmd *cmd) {
+static int trace_patch_overrides(struct trace *trace) {
+  struct hash_map *last_textures = hash_map_create(MAX(trace->num_cmds, 1));
+  struct trace_cmd *cmd = trace->cmds;
+
   while (cmd) {
     if (cmd->type == TRACE_CMD_TEXTURE) {
       tr_texture_key_t texture_key =
           tr_texture_key(cmd->texture.tsp, cmd->texture.tcw);
 
-      /* walk backwards and see if this texture overrode a previous command
-         TODO could cache this information in a map */
-      struct trace_cmd *prev = cmd->prev;
-
-      while (prev) {
-        if (prev->type == TRACE_CMD_TEXTURE) {
-          tr_texture_key_t prev_texture_key =
-              tr_texture_key(prev->texture.tsp, prev->texture.tcw);
-
-          if (prev_texture_key == texture_key) {
-            cmd->override = prev;
-            break;
-          }
-        }
+      cmd->override = hash_map_find(last_textures, texture_key);
 
-        prev = prev->prev;
+      if (cmd->override) {
+        hash_map_remove(last_textures, texture_key);
       }
+      hash_map_insert(last_textures, texture_key, cmd);
     }
 
     cmd = cmd->next;
   }
 
+  hash_map_destroy(last_textures);
+
+  return 1;
+}
+
+static int trace_index_frames(struct trace *trace) {
+  trace->num_frames = 0;
+
+  for (struct trace_cmd *cmd = trace->cmds; cmd; cmd = cmd->next) {
+    if (cmd->type == TRACE_CMD_CONTEXT) {
+      trace->num_frames++;
+    }
+  }
+
+  trace->frames = calloc(MAX(trace->num_frames, 1), sizeof(struct trace_cmd *));
+  CHECK_NOTNULL(trace->frames);
+
+  int frame = 0;
+
+  for (struct trace_cmd *cmd = trace->cmds; cmd; cmd = cmd->next) {
+    if (cmd->type == TRACE_CMD_CONTEXT) {
+      trace->frames[frame++] = cmd;
+    }
+  }
+
   return 1;
 }
 
 /* commands are written out with null list pointers, and pointers to data
    are written out relative to the command itself. Set the list pointers,
    and make the data pointers absolute */
-static int trace_patch_pointers(void *begin, int size) {
+static int trace_patch_pointers(struct trace *trace, int size) {
   struct trace_cmd *prev_cmd = NULL;
   struct trace_cmd *curr_cmd = NULL;
-  uint8_t *ptr = begin;
+  uint8_t *ptr = (uint8_t *)trace->cmds;
   uint8_t *end = ptr + size;
 
   while (ptr < end) {
@@ -151,18 +414,297 @@ static int trace_patch_pointers(void *begin, int size) {
         LOG_INFO("Unexpected trace command type %d", curr_cmd->type);
         return 0;
     }
+
+    trace->num_cmds++;
   }
 
   return 1;
 }
 
+/* traces in the original format are read in full, and patched in place */
+static int trace_parse_uncompressed(struct trace *trace) {
+  int size = (int)trace->map_size;
+
+  trace->cmds = malloc(size);
+  CHECK_NOTNULL(trace->cmds);
+  memcpy(trace->cmds, trace->map, size);
+
+  unmap_file(trace->map, trace->map_size);
+  trace->map = NULL;
+  trace->map_size = 0;
+
+  if (!trace_patch_pointers(trace, size)) {
+    return 0;
+  }
+
+  return trace_index_frames(trace);
+}
+
+/* build the command list from the index entries. if frames is NULL, the
+   frames are found by walking the commands */
+static int trace_load_index(struct trace *trace, const uint8_t *cmds,
+                            int num_cmds, const uint8_t *blocks,
+                            int num_blocks, const uint8_t *frames,
+                            int num_frames, int64_t blocks_end) {
+  trace->cmds = calloc(MAX(num_cmds, 1), sizeof(struct trace_cmd));
+  trace->cmd_blocks = calloc(MAX(num_cmds, 1), sizeof(int32_t));
+  trace->blocks = calloc(MAX(num_blocks, 1), sizeof(struct trace_block));
+  trace->block_data = calloc(MAX(num_blocks, 1), sizeof(uint8_t *));
+  trace->num_cmds = num_cmds;
+  trace->num_blocks = num_blocks;
+
+  if (!num_cmds) {
+    /* an empty trace, leave the command list empty */
+    free(trace->cmds);
+    trace->cmds = NULL;
+  }
+
+  for (int i = 0; i < num_cmds; i++) {
+    struct trace_index_cmd entry;
+    memcpy(&entry, cmds + i * sizeof(entry), sizeof(entry));
+
+    if ((entry.cmd.type != TRACE_CMD_TEXTURE &&
+         entry.cmd.type != TRACE_CMD_CONTEXT) ||
+        entry.block < 0 || entry.block >= num_blocks) {
+      LOG_WARNING("trace_load_index invalid command %d", i);
+      return 0;
+    }
+
+    struct trace_cmd *cmd = &trace->cmds[i];
+    *cmd = entry.cmd;
+    cmd->prev = i > 0 ? &trace->cmds[i - 1] : NULL;
+    cmd->next = i < num_cmds - 1 ? &trace->cmds[i + 1] : NULL;
+    cmd->override = NULL;
+
+    if (cmd->type == TRACE_CMD_TEXTURE) {
+      cmd->texture.palette = NULL;
+      cmd->texture.texture = NULL;
+    } else {
+      cmd->context.bg_vertices = NULL;
+      cmd->context.params = NULL;
+    }
+
+    trace->cmd_blocks[i] = entry.block;
+  }
+
+  memcpy(trace->blocks, blocks, num_blocks * sizeof(struct trace_block));
+
+  for (int i = 0; i < num_blocks; i++) {
+    struct trace_block *block = &trace->blocks[i];
+
+    if (block->size < 0 || block->data_size < 0 ||
+        block->offset < (int64_t)sizeof(struct trace_header) ||
+        block->offset + block->size > blocks_end) {
+      LOG_WARNING("trace_load_index invalid block %d", i);
+      return 0;
+    }
+  }
+
+  if (!frames) {
+    return trace_index_frames(trace);
+  }
+
+  trace->frames = calloc(MAX(num_frames, 1), sizeof(struct trace_cmd *));
+  trace->num_frames = num_frames;
+
+  for (int i = 0; i < num_frames; i++) {
+    int32_t index;
+    memcpy(&index, frames + i * sizeof(index), sizeof(index));
+
+    if (index < 0 || index >= num_cmds ||
+        trace->cmds[index].type != TRACE_CMD_CONTEXT) {
+      LOG_WARNING("trace_load_index invalid frame %d", i);
+      return 0;
+    }
+
+    trace->frames[i] = &trace->cmds[index];
+  }
+
+  return 1;
+}
+
+/* recover the index of a trace without one by scanning its records, stopping
+   at the first that's incomplete */
+static int trace_scan_records(struct trace *trace) {
+  struct trace_index_cmd *cmds = NULL;
+  int num_cmds = 0;
+  int max_cmds = 0;
+  struct trace_block *blocks = NULL;
+  int num_blocks = 0;
+  int max_blocks = 0;
+
+  int64_t offset = sizeof(struct trace_header);
+  int64_t end = (int64_t)trace->map_size;
+
+  while (offset + (int64_t)sizeof(struct trace_record) <= end) {
+    struct trace_record record;
+    memcpy(&record, trace->map + offset, sizeof(record));
+
+    int64_t data_offset = offset + sizeof(record);
+
+    if (record.magic != TRACE_RECORD_MAGIC || record.size < 0 ||
+        data_offset + record.size > end) {
+      break;
+    }
+
+    if (record.type == TRACE_RECORD_BLOCK) {
+      blocks = trace_reserve(blocks, &max_blocks, num_blocks + 1,
+                             sizeof(struct trace_block));
+
+      struct trace_block *block = &blocks[num_blocks++];
+      block->offset = data_offset;
+      block->size = record.size;
+      block->data_size = record.data_size;
+    } else if (record.type == TRACE_RECORD_CMD &&
+               record.size == (int)sizeof(struct trace_index_cmd)) {
+      cmds = trace_reserve(cmds, &max_cmds, num_cmds + 1,
+                           sizeof(struct trace_index_cmd));
+      memcpy(&cmds[num_cmds++], trace->map + data_offset, record.size);
+    } else {
+      break;
+    }
+
+    offset = data_offset + record.size;
+  }
+
+  LOG_WARNING("trace_scan_records trace wasn't closed, recovered %d commands",
+              num_cmds);
+
+  int res = trace_load_index(trace, (const uint8_t *)cmds, num_cmds,
+                             (const uint8_t *)blocks, num_blocks, NULL, 0,
+                             offset);
+
+  free(blocks);
+  free(cmds);
+
+  return res;
+}
+
+static int trace_parse_compressed(struct trace *trace) {
+  struct trace_header hdr;
+  struct trace_footer footer;
+
+  if (trace->map_size < sizeof(hdr)) {
+    return 0;
+  }
+
+  memcpy(&hdr, trace->map, sizeof(hdr));
+
+  if (hdr.version != TRACE_VERSION) {
+    LOG_WARNING("trace_parse_compressed unsupported version %d",
+                hdr.version);
+    return 0;
+  }
+
+  if (trace->map_size < sizeof(hdr) + sizeof(footer)) {
+    return trace_scan_records(trace);
+  }
+
+  memcpy(&footer, trace->map + trace->map_size - sizeof(footer),
+         sizeof(footer));
+
+  /* make sure the index fits exactly between the records and the footer */
+  int64_t index_size =
+      (int64_t)footer.num_cmds * sizeof(struct trace_index_cmd) +
+      (int64_t)footer.num_blocks * sizeof(struct trace_block) +
+      (int64_t)footer.num_frames * sizeof(int32_t);
+
+  if (footer.magic != TRACE_MAGIC || footer.num_cmds < 0 ||
+      footer.num_blocks < 0 || footer.num_frames < 0 ||
+      footer.index_offset < (int64_t)sizeof(hdr) ||
+      footer.index_offset + index_size + (int64_t)sizeof(footer) !=
+          (int64_t)trace->map_size) {
+    return trace_scan_records(trace);
+  }
+
+  const uint8_t *cmds = trace->map + footer.index_offset;
+  const uint8_t *blocks =
+      cmds + footer.num_cmds * sizeof(struct trace_index_cmd);
+  const uint8_t *frames =
+      blocks + footer.num_blocks * sizeof(struct trace_block);
+
+  return trace_load_index(trace, cmds, footer.num_cmds, blocks,
+                          footer.num_blocks, frames, footer.num_frames,
+                          footer.index_offset);
+}
+
+static void trace_decompress_block(struct trace *trace, int index,
+                                   uint8_t *dst) {
+  struct trace_block *block = &trace->blocks[index];
+  uLongf size = block->data_size;
+
+  int res = uncompress(dst, &size, trace->map + block->offset, block->size);
+  CHECK(res == Z_OK && size == (uLongf)block->data_size,
+        "trace_decompress_block failed to decompress block %d", index);
+}
+
 void trace_destroy(struct trace *trace) {
+  for (int i = 0; i < trace->num_blocks; i++) {
+    free(trace->block_data[i]);
+  }
+
+  if (trace->map) {
+    unmap_file(trace->map, trace->map_size);
+  }
+
+  free(trace->scratch);
+  free(trace->block_data);
+  free(trace->blocks);
+  free(trace->cmd_blocks);
+  free(trace->frames);
   free(trace->cmds);
   free(trace);
 }
 
-void trace_copy_context(const struct trace_cmd *cmd, struct ta_context *ctx) {
+void trace_load_texture(struct trace *trace, struct trace_cmd *cmd) {
+  CHECK_EQ(cmd->type, TRACE_CMD_TEXTURE);
+
+  if (!trace->map) {
+    return;
+  }
+
+  /* texture blocks are shared between commands with the same data, and are
+     kept around once decompressed */
+  int index = trace->cmd_blocks[cmd - trace->cmds];
+  struct trace_block *block = &trace->blocks[index];
+  CHECK_EQ(block->data_size,
+           cmd->texture.palette_size + cmd->texture.texture_size);
+
+  if (!trace->block_data[index]) {
+    uint8_t *data = malloc(MAX(block->data_size, 1));
+    CHECK_NOTNULL(data);
+    trace_decompress_block(trace, index, data);
+    trace->block_data[index] = data;
+  }
+
+  cmd->texture.palette = trace->block_data[index];
+  cmd->texture.texture = trace->block_data[index] + cmd->texture.palette_size;
+}
+
+void trace_copy_context(struct trace *trace, const struct trace_cmd *cmd,
+                        struct ta_context *ctx) {
   CHECK_EQ(cmd->type, TRACE_CMD_CONTEXT);
+  CHECK_LE(cmd->context.bg_vertices_size, (int)sizeof(ctx->bg_vertices));
+  CHECK_LE(cmd->context.params_size, (int)sizeof(ctx->params));
+
+  const uint8_t *bg_vertices = cmd->context.bg_vertices;
+  const uint8_t *params = cmd->context.params;
+
+  /* context blocks are decompressed to scratch space each time they're copied,
+     rather than being kept around */
+  if (trace->map) {
+    int index = trace->cmd_blocks[cmd - trace->cmds];
+    struct trace_block *block = &trace->blocks[index];
+    CHECK_EQ(block->data_size,
+             cmd->context.bg_vertices_size + cmd->context.params_size);
+
+    trace->scratch = trace_reserve(trace->scratch, &trace->scratch_size,
+                                   block->data_size, 1);
+    trace_decompress_block(trace, index, trace->scratch);
+
+    bg_vertices = trace->scratch;
+    params = trace->scratch + cmd->context.bg_vertices_size;
+  }
 
   ctx->autosort = cmd->context.autosort;
   ctx->stride = cmd->context.stride;
@@ -174,52 +716,35 @@ void trace_copy_context(const struct trace_cmd *cmd, struct ta_context *ctx) {
   ctx->bg_tsp = cmd->context.bg_tsp;
   ctx->bg_tcw = cmd->context.bg_tcw;
   ctx->bg_depth = cmd->context.bg_depth;
-  memcpy(ctx->bg_vertices, cmd->context.bg_vertices,
-         cmd->context.bg_vertices_size);
-  memcpy(ctx->params, cmd->context.params, cmd->context.params_size);
+  memcpy(ctx->bg_vertices, bg_vertices, cmd->context.bg_vertices_size);
+  memcpy(ctx->params, params, cmd->context.params_size);
   ctx->size = cmd->context.params_size;
 }
 
 struct trace *trace_parse(const char *filename) {
-  struct trace *trace = calloc(1, sizeof(struct trace));
+  size_t size = 0;
+  uint8_t *map = map_file(filename, &size);
 
-  FILE *fp = fopen(filename, "rb");
-  if (!fp) {
-    trace_destroy(trace);
+  if (!map) {
     return NULL;
   }
 
-  fseek(fp, 0, SEEK_END);
-  int size = (int)ftell(fp);
-  fseek(fp, 0, SEEK_SET);
+  struct trace *trace = calloc(1, sizeof(struct trace));
+  trace->map = map;
+  trace->map_size = size;
 
-  trace->cmds = malloc(size);
-  CHECK_EQ(fread(trace->cmds, size, 1, fp), 1);
-  fclose(fp);
+  /* files in the original format start with a raw command instead */
+  uint32_t magic = 0;
+  memcpy(&magic, map, MIN(size, sizeof(magic)));
 
-  if (!trace_patch_pointers(trace->cmds, size)) {
-    trace_destroy(trace);
-    return NULL;
-  }
+  int res = magic == TRACE_MAGIC ? trace_parse_compressed(trace)
+                                 : trace_parse_uncompressed(trace);
 
-  if (!trace_patch_overrides(trace->cmds)) {
+  if (!res || !trace_patch_overrides(trace)) {
     trace_destroy(trace);
     return NULL;
   }
 
-  /* count max frames */
-  {
-    struct trace_cmd *cmd = trace->cmds;
-
-    while (cmd) {
-      if (cmd->type == TRACE_CMD_CONTEXT) {
-        trace->num_frames++;
-      }
-
-      cmd = cmd->next;
-    }
-  }
-
   return trace;
 }
 
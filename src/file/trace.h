@@ -1,7 +1,7 @@
 #ifndef TRACE_H
 #define TRACE_H
 
-#include <stdio.h>
+#include <stddef.h>
 #include "guest/pvr/ta_types.h"
 
 enum trace_cmd_type {
@@ -10,6 +10,20 @@ enum trace_cmd_type {
   TRACE_CMD_CONTEXT,
 };
 
+/*
+ * traces are written out as a header, followed by a record for each command
+ * and for each zlib compressed block of data belonging to a context or unique
+ * texture, followed by an index of the commands, blocks and frames, and
+ * finally a footer pointing to the index. traces are mapped in when read, and
+ * a command's block is only decompressed when its data is needed, so any
+ * frame can be seeked to without reading the ones before it
+ *
+ * the index is only written once the trace is closed. traces without one are
+ * recovered by scanning the records up to the first incomplete one
+ *
+ * traces written by older versions stored each command and its data back to
+ * back uncompressed, these are still read in full
+ */
 struct trace_cmd {
   enum trace_cmd_type type;
 
@@ -18,8 +32,9 @@ struct trace_cmd {
   struct trace_cmd *next;
   struct trace_cmd *override;
 
-  /* the data pointers in these structs are written out relative to the cmd,
-     and patched to absolute pointers on read */
+  /* in the uncompressed format, the data pointers in these structs are written
+     out relative to the cmd, and patched to absolute pointers on read. in the
+     compressed format, they're NULL until the data is loaded */
   union {
     struct {
       union tsp tsp;
@@ -53,19 +68,36 @@ struct trace_cmd {
   };
 };
 
+struct trace_block;
+
 struct trace {
   struct trace_cmd *cmds;
+  int num_cmds;
+
+  /* context command for each frame */
+  struct trace_cmd **frames;
   int num_frames;
-};
 
-struct trace_writer {
-  FILE *file;
+  /* compressed traces are mapped in, and the blocks holding each command's
+     data are only decompressed once the data is accessed */
+  uint8_t *map;
+  size_t map_size;
+  int32_t *cmd_blocks;
+  struct trace_block *blocks;
+  int num_blocks;
+  uint8_t **block_data;
+  uint8_t *scratch;
+  int scratch_size;
 };
 
+struct trace_writer;
+
 void get_next_trace_filename(char *filename, size_t size);
 
 struct trace *trace_parse(const char *filename);
-void trace_copy_context(const struct trace_cmd *cmd, struct ta_context *ctx);
+void trace_load_texture(struct trace *trace, struct trace_cmd *cmd);
+void trace_copy_context(struct trace *trace, const struct trace_cmd *cmd,
+                        struct ta_context *ctx);
 void trace_destroy(struct trace *trace);
 
 struct trace_writer *trace_writer_open(const char *filename);
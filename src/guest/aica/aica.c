@@ -6,6 +6,7 @@
 #include "guest/dreamcast.h"
 #include "guest/holly/holly.h"
 #include "guest/memory.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "imgui.h"
@@ -868,6 +869,48 @@ static void aica_toggle_recording(struct aica *aica) {
   }
 }
 
+static void aica_serialize(struct device *dev, struct savestate *ss) {
+  struct aica *aica = (struct aica *)dev;
+  struct scheduler *sched = aica->dc->sched;
+
+  SAVESTATE_VALUE(ss, aica->reg);
+  SAVESTATE_VALUE(ss, aica->arm_resetting);
+
+  for (int i = 0; i < ARRAY_SIZE(aica->timers); i++) {
+    sched_serialize_timer(sched, ss, &aica->timers[i]);
+  }
+
+  sched_serialize_timer(sched, ss, &aica->rtc_timer);
+  SAVESTATE_VALUE(ss, aica->rtc_write);
+  SAVESTATE_VALUE(ss, aica->rtc);
+
+  /* the register data pointers are fixed at init, while the sound source is
+     saved as an offset into wave memory */
+  for (int i = 0; i < AICA_NUM_CHANNELS; i++) {
+    struct aica_channel *ch = &aica->channels[i];
+    int32_t base = ch->base ? (int32_t)(ch->base - aica->aram) : -1;
+
+    SAVESTATE_VALUE(ss, ch->active);
+    SAVESTATE_VALUE(ss, base);
+    SAVESTATE_VALUE(ss, ch->phase);
+    SAVESTATE_VALUE(ss, ch->phasefrc);
+    SAVESTATE_VALUE(ss, ch->phaseinc);
+    SAVESTATE_VALUE(ss, ch->prev_sample);
+    SAVESTATE_VALUE(ss, ch->prev_quant);
+    SAVESTATE_VALUE(ss, ch->next_sample);
+    SAVESTATE_VALUE(ss, ch->next_quant);
+    SAVESTATE_VALUE(ss, ch->loop_sample);
+    SAVESTATE_VALUE(ss, ch->loop_quant);
+    SAVESTATE_VALUE(ss, ch->looped);
+
+    if (savestate_loading(ss)) {
+      ch->base = base >= 0 ? aica->aram + base : NULL;
+    }
+  }
+
+  sched_serialize_timer(sched, ss, &aica->sample_timer);
+}
+
 static int aica_init(struct device *dev) {
   struct aica *aica = (struct aica *)dev;
   struct memory *mem = aica->dc->mem;
@@ -1033,6 +1076,10 @@ struct aica *aica_create(struct dreamcast *dc) {
   struct aica *aica =
       dc_create_device(dc, sizeof(struct aica), "aica", &aica_init, NULL);
 
+  /* setup state interface */
+  aica->stateif.enabled = 1;
+  aica->stateif.serialize = &aica_serialize;
+
   /* assign ids */
   for (int i = 0; i < AICA_NUM_CHANNELS; i++) {
     struct aica_channel *ch = &aica->channels[i];
@@ -3,6 +3,7 @@
 #include "guest/aica/aica.h"
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "imgui.h"
 #include "jit/frontend/armv3/armv3_context.h"
@@ -189,6 +190,28 @@ static void arm7_run(struct device *dev, int64_t ns) {
   prof_counter_add(COUNTER_arm7_instrs, arm->ctx.ran_instrs);
 }
 
+static void arm7_serialize(struct device *dev, struct savestate *ss) {
+  struct arm7 *arm = (struct arm7 *)dev;
+
+  SAVESTATE_VALUE(ss, arm->ctx.r);
+  SAVESTATE_VALUE(ss, arm->ctx.pending_interrupts);
+  SAVESTATE_VALUE(ss, arm->ctx.run_cycles);
+  SAVESTATE_VALUE(ss, arm->ctx.ran_instrs);
+  SAVESTATE_VALUE(ss, arm->requested_interrupts);
+
+  if (!savestate_loading(ss)) {
+    return;
+  }
+
+  /* the user bank pointers aren't saved, rebuild them for the current mode */
+  int mode = arm->ctx.r[CPSR] & M_MASK;
+  for (int n = 0; n < 16; n++) {
+    arm->ctx.rusr[n] = &arm->ctx.r[armv3_reg_table[mode][n]];
+  }
+
+  jit_free_code(arm->jit);
+}
+
 static void arm7_guest_destroy(struct jit_guest *guest) {
   free((struct armv3_guest *)guest);
 }
@@ -276,5 +299,9 @@ struct arm7 *arm7_create(struct dreamcast *dc) {
   arm->runif.enabled = 1;
   arm->runif.run = &arm7_run;
 
+  /* setup state interface */
+  arm->stateif.enabled = 1;
+  arm->stateif.serialize = &arm7_serialize;
+
   return arm;
 }
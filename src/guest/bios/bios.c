@@ -11,6 +11,7 @@
 #include "guest/memory.h"
 #include "guest/rom/boot.h"
 #include "guest/rom/flash.h"
+#include "guest/savestate.h"
 #include "guest/sh4/sh4.h"
 #include "options.h"
 
@@ -367,6 +368,16 @@ int bios_invalid_instr(struct bios *bios) {
   return handled;
 }
 
+static void bios_serialize(struct device *dev, struct savestate *ss) {
+  struct bios *bios = (struct bios *)dev;
+
+  SAVESTATE_VALUE(ss, bios->status);
+  SAVESTATE_VALUE(ss, bios->cmd_id);
+  SAVESTATE_VALUE(ss, bios->cmd_code);
+  SAVESTATE_VALUE(ss, bios->params);
+  SAVESTATE_VALUE(ss, bios->result);
+}
+
 void bios_destroy(struct bios *bios) {
   free(bios);
 }
@@ -374,5 +385,10 @@ void bios_destroy(struct bios *bios) {
 struct bios *bios_create(struct dreamcast *dc) {
   struct bios *bios =
       dc_create_device(dc, sizeof(struct bios), "bios", NULL, &bios_post_init);
+
+  /* setup state interface */
+  bios->stateif.enabled = 1;
+  bios->stateif.serialize = &bios_serialize;
+
   return bios;
 }
@@ -1,5 +1,6 @@
 #include "guest/dreamcast.h"
 #include "core/core.h"
+#include "core/time.h"
 #include "guest/aica/aica.h"
 #include "guest/arm7/arm7.h"
 #include "guest/bios/bios.h"
@@ -12,6 +13,7 @@
 #include "guest/pvr/ta.h"
 #include "guest/rom/boot.h"
 #include "guest/rom/flash.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 
@@ -84,6 +86,7 @@ void *dc_create_device(struct dreamcast *dc, size_t size, const char *name,
 
   dev->dc = dc;
   dev->name = name;
+  dev->size = size;
   dev->init = init;
   dev->post_init = post_init;
 
@@ -92,6 +95,45 @@ void *dc_create_device(struct dreamcast *dc, size_t size, const char *name,
   return dev;
 }
 
+static void dc_serialize(struct dreamcast *dc, struct savestate *ss) {
+  sched_serialize(dc->sched, ss);
+  mem_serialize(dc->mem, ss);
+
+  list_for_each_entry(dev, &dc->devices, struct device, it) {
+    SAVESTATE_VALUE(ss, dev->runif.running);
+
+    if (dev->stateif.enabled) {
+      dev->stateif.serialize(dev, ss);
+    }
+  }
+}
+
+/* note, the state can only be saved and loaded between calls to dc_tick */
+void dc_load_state(struct dreamcast *dc, struct savestate *ss) {
+  int64_t start = time_nanoseconds();
+
+  savestate_begin(ss, 1, 0);
+  dc_serialize(dc, ss);
+  savestate_end(ss);
+
+  ss->load_time = time_nanoseconds() - start;
+}
+
+void dc_track_writes(struct dreamcast *dc, int enable) {
+  mem_track_writes(dc->mem, enable);
+}
+
+void dc_save_state(struct dreamcast *dc, struct savestate *ss,
+                   int incremental) {
+  int64_t start = time_nanoseconds();
+
+  savestate_begin(ss, 0, incremental);
+  dc_serialize(dc, ss);
+  savestate_end(ss);
+
+  ss->save_time = time_nanoseconds() - start;
+}
+
 void dc_remove_serial_device(struct dreamcast *dc) {
   dc->serial = NULL;
 }
@@ -138,6 +180,7 @@ static int dc_load_bin(struct dreamcast *dc, const char *path) {
 
   /* load to 0x0c010000 (area 3) which is where 1ST_READ.BIN is loaded to */
   uint8_t *data = mem_ram(dc->mem, 0x00010000);
+  mem_host_write(dc->mem, data, size);
   int n = (int)fread(data, sizeof(uint8_t), size, fp);
   fclose(fp);
 
@@ -20,6 +20,7 @@ struct holly;
 struct maple;
 struct memory;
 struct pvr;
+struct savestate;
 struct scheduler;
 struct sh4;
 struct ta;
@@ -81,6 +82,15 @@ struct runif {
   device_run_cb run;
 };
 
+/* state interface. serialize is called both when saving and loading the
+   machine's state, see guest/savestate.h */
+typedef void (*device_serialize_cb)(struct device *, struct savestate *);
+
+struct stateif {
+  int enabled;
+  device_serialize_cb serialize;
+};
+
 /*
  * device
  */
@@ -90,6 +100,7 @@ typedef int (*device_post_init_cb)(struct device *);
 struct device {
   struct dreamcast *dc;
   const char *name;
+  size_t size;
 
   /* called for each device during dc_init. at this point each device should
      initialize their own state, but not depend on the state of others */
@@ -103,6 +114,7 @@ struct device {
   /* optional interfaces */
   struct dbgif dbgif;
   struct runif runif;
+  struct stateif stateif;
 
   struct list_node it;
 };
@@ -163,6 +175,15 @@ void dc_input(struct dreamcast *dc, int port, int button, int16_t value);
 void dc_add_serial_device(struct dreamcast *dc, struct serial *serial);
 void dc_remove_serial_device(struct dreamcast *dc);
 
+/* save states */
+void dc_save_state(struct dreamcast *dc, struct savestate *ss, int incremental);
+void dc_load_state(struct dreamcast *dc, struct savestate *ss);
+
+/* track the pages of guest memory written to between saves, rather than
+   comparing each page when saving. this makes saving every frame cheap, at
+   the cost of a fault on each page's first write after a save */
+void dc_track_writes(struct dreamcast *dc, int enable);
+
 /* device registration */
 void *dc_create_device(struct dreamcast *dc, size_t size, const char *name,
                        device_init_cb init, device_post_init_cb post_init);
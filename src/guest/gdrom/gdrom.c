@@ -4,6 +4,7 @@
 #include "guest/gdrom/gdrom_replies.inc"
 #include "guest/gdrom/gdrom_types.h"
 #include "guest/holly/holly.h"
+#include "guest/savestate.h"
 #include "imgui.h"
 
 #if 0
@@ -849,6 +850,38 @@ struct disc *gdrom_get_disc(struct gdrom *gd) {
   return gd->disc;
 }
 
+static void gdrom_serialize(struct device *dev, struct savestate *ss) {
+  struct gdrom *gd = (struct gdrom *)dev;
+
+  /* the disc itself isn't saved, the same disc is expected to be inserted
+     when the state is loaded */
+  SAVESTATE_VALUE(ss, gd->state);
+  SAVESTATE_VALUE(ss, gd->hw_info);
+  SAVESTATE_VALUE(ss, gd->error);
+  SAVESTATE_VALUE(ss, gd->features);
+  SAVESTATE_VALUE(ss, gd->ireason);
+  SAVESTATE_VALUE(ss, gd->sectnum);
+  SAVESTATE_VALUE(ss, gd->byte_count);
+  SAVESTATE_VALUE(ss, gd->status);
+  SAVESTATE_VALUE(ss, gd->cdr_dma);
+  SAVESTATE_VALUE(ss, gd->cdr_secfmt);
+  SAVESTATE_VALUE(ss, gd->cdr_secmask);
+  SAVESTATE_VALUE(ss, gd->cdr_first_sector);
+  SAVESTATE_VALUE(ss, gd->cdr_num_sectors);
+
+  /* only the pending portion of each transfer buffer is saved */
+  SAVESTATE_VALUE(ss, gd->pio_head);
+  SAVESTATE_VALUE(ss, gd->pio_size);
+  SAVESTATE_VALUE(ss, gd->pio_offset);
+  CHECK(gd->pio_size >= 0 && gd->pio_size <= (int)sizeof(gd->pio_buffer));
+  savestate_bytes(ss, gd->pio_buffer, gd->pio_size);
+
+  SAVESTATE_VALUE(ss, gd->dma_head);
+  SAVESTATE_VALUE(ss, gd->dma_size);
+  CHECK(gd->dma_size >= 0 && gd->dma_size <= (int)sizeof(gd->dma_buffer));
+  savestate_bytes(ss, gd->dma_buffer, gd->dma_size);
+}
+
 void gdrom_destroy(struct gdrom *gd) {
   if (gd->disc) {
     disc_destroy(gd->disc);
@@ -860,6 +893,11 @@ void gdrom_destroy(struct gdrom *gd) {
 struct gdrom *gdrom_create(struct dreamcast *dc) {
   struct gdrom *gd =
       dc_create_device(dc, sizeof(struct gdrom), "gdrom", &gdrom_init, NULL);
+
+  /* setup state interface */
+  gd->stateif.enabled = 1;
+  gd->stateif.serialize = &gdrom_serialize;
+
   return gd;
 }
 
@@ -3,6 +3,7 @@
 #include "guest/gdrom/gdrom.h"
 #include "guest/maple/maple.h"
 #include "guest/memory.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "imgui.h"
@@ -380,6 +381,13 @@ void holly_debug_menu(struct holly *hl) {
 }
 #endif
 
+static void holly_serialize(struct device *dev, struct savestate *ss) {
+  struct holly *hl = (struct holly *)dev;
+
+  SAVESTATE_VALUE(ss, hl->reg);
+  SAVESTATE_VALUE(ss, hl->dma);
+}
+
 void holly_destroy(struct holly *hl) {
   dc_destroy_device((struct device *)hl);
 }
@@ -395,6 +403,10 @@ struct holly *holly_create(struct dreamcast *dc) {
 #include "guest/holly/holly_regs.inc"
 #undef HOLLY_REG
 
+  /* setup state interface */
+  hl->stateif.enabled = 1;
+  hl->stateif.serialize = &holly_serialize;
+
   return hl;
 }
 
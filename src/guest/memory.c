@@ -20,13 +20,28 @@
  * if accessed. this mechanic is used by the jit to optimistically compile code
  * to go the fast route, falling back to calling into *_read_bytes or
  * *_write_bytes if a segfault occurs
+ *
+ * for savestates, each page of physical memory is stamped with the epoch it
+ * was last written in. writes to video ram are already tracked by the pvr.
+ * writes to ram and aram come from compiled code as well as native code, so
+ * when enabled they're caught by write protecting every view of them at the
+ * start of each epoch, and unprotecting each page as it's first written to.
+ * this costs a fault per page written each epoch, so it's only enabled for
+ * consumers which save every frame, e.g. the rewind buffer. otherwise, the
+ * pages of ram and aram are compared when saving
+ *
+ * host code writing to guest memory through a system call, e.g. fread, must
+ * call mem_host_write first, as the kernel doesn't raise a fault for it
  */
 
 #include <stdint.h>
 #include "guest/memory.h"
 #include "core/core.h"
+#include "core/exception_handler.h"
 #include "guest/arm7/arm7.h"
 #include "guest/dreamcast.h"
+#include "guest/pvr/pvr.h"
+#include "guest/savestate.h"
 #include "guest/sh4/sh4.h"
 
 /* physical memory constants */
@@ -38,6 +53,12 @@
 #define ARAM_OFFSET VRAM_OFFSET + VRAM_SIZE
 #define PHYSICAL_SIZE RAM_SIZE + VRAM_SIZE + ARAM_SIZE
 
+/* write tracking constants */
+#define MEM_TRACK_SHIFT SAVESTATE_PAGE_SHIFT
+#define MEM_TRACK_SIZE (1 << MEM_TRACK_SHIFT)
+#define MEM_TRACK_PAGES ((PHYSICAL_SIZE) >> MEM_TRACK_SHIFT)
+#define MEM_MAX_VIEWS 64
+
 /* page table constants */
 #define MEM_PAGE_BITS 11
 #define MEM_OFFSET_BITS 21
@@ -55,6 +76,21 @@ struct address_space {
   mmio_write_cb write[MEM_MAX_PAGES];
   mmio_read_string_cb read_string[MEM_MAX_PAGES];
   mmio_write_string_cb write_string[MEM_MAX_PAGES];
+
+  /* size of the shared memory mapped at each page by as_map, so the mappings
+     can be released when the address space is destroyed */
+  uint32_t mapped[MEM_MAX_PAGES];
+};
+
+/* a mapping of ram or aram which may be written through. the range of pages
+   unprotected in it since the current epoch began is kept, to be protected
+   again at the start of the next one with a single call */
+struct mem_view {
+  uint8_t *ptr;
+  uint32_t size;
+  uint32_t offset;
+  uint32_t unprotected_begin;
+  uint32_t unprotected_end;
 };
 
 struct memory {
@@ -66,6 +102,20 @@ struct memory {
   shmem_handle_t shmem;
 #endif
 
+  /* write tracking. once enabled, views are write protected from the start of
+     the next epoch, and each page is stamped with the epoch it was last
+     written to in. stamps for ram and aram are only valid from tracked_since
+     onward */
+  struct exception_handler *exc_handler;
+  struct mem_view views[MEM_MAX_VIEWS];
+  int num_views;
+  int track_writes;
+  int tracking;
+  uint32_t tracked_since;
+  uint32_t epoch;
+  uint32_t page_epoch[MEM_TRACK_PAGES];
+  bitmap_t written[MEM_TRACK_PAGES];
+
   /* the machine's physical memory */
   uint8_t *ram;
   uint8_t *vram;
@@ -113,6 +163,167 @@ static void mem_unhandled_write(struct memory *mem, uint32_t addr,
   LOG_WARNING("mem_unhandled_write addr=0x%08x", addr);
 }
 
+/*
+ * write tracking
+ */
+#ifdef HAVE_FASTMEM
+static void mem_add_view(struct memory *mem, uint8_t *ptr, uint32_t size,
+                         uint32_t offset) {
+  CHECK_LT(mem->num_views, MEM_MAX_VIEWS);
+
+  struct mem_view *view = &mem->views[mem->num_views++];
+  view->ptr = ptr;
+  view->size = size;
+  view->offset = offset;
+}
+#endif
+
+static int mem_protect_views(struct memory *mem, enum page_access access) {
+  for (int i = 0; i < mem->num_views; i++) {
+    struct mem_view *view = &mem->views[i];
+
+    if (!protect_pages(view->ptr, view->size, access)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void mem_unprotect_page(struct memory *mem, struct mem_view *view,
+                               uint32_t page) {
+  uint8_t *page_ptr = view->ptr + (page << MEM_TRACK_SHIFT);
+  CHECK(protect_pages(page_ptr, MEM_TRACK_SIZE, ACC_READWRITE));
+
+  mem->page_epoch[(view->offset >> MEM_TRACK_SHIFT) + page] = mem->epoch;
+
+  if (view->unprotected_begin >= view->unprotected_end) {
+    view->unprotected_begin = page;
+    view->unprotected_end = page + 1;
+  } else {
+    view->unprotected_begin = MIN(view->unprotected_begin, page);
+    view->unprotected_end = MAX(view->unprotected_end, page + 1);
+  }
+}
+
+static struct mem_view *mem_lookup_view(struct memory *mem,
+                                        const uint8_t *ptr) {
+  for (int i = 0; i < mem->num_views; i++) {
+    struct mem_view *view = &mem->views[i];
+
+    if (ptr >= view->ptr && ptr < view->ptr + view->size) {
+      return view;
+    }
+  }
+
+  return NULL;
+}
+
+static int mem_handle_exception(void *data, struct exception_state *ex) {
+  struct memory *mem = data;
+
+  if (!mem->tracking) {
+    return 0;
+  }
+
+  const uint8_t *addr = (const uint8_t *)ex->fault_addr;
+  struct mem_view *view = mem_lookup_view(mem, addr);
+
+  if (!view) {
+    return 0;
+  }
+
+  /* stamp the page, and let the write through. the page is only unprotected
+     in this view, writes through other views will fault once as well */
+  uint32_t page = (uint32_t)(addr - view->ptr) >> MEM_TRACK_SHIFT;
+  mem_unprotect_page(mem, view, page);
+
+  return 1;
+}
+
+static void mem_stop_tracking(struct memory *mem) {
+  if (mem->tracking) {
+    mem_protect_views(mem, ACC_READWRITE);
+  }
+
+  for (int i = 0; i < mem->num_views; i++) {
+    struct mem_view *view = &mem->views[i];
+    view->unprotected_begin = view->unprotected_end = 0;
+  }
+
+  mem->tracking = 0;
+}
+
+/* start a new epoch, protecting each page written to during the previous one
+   so that the next write to it is caught again. protecting the range spanning
+   the written pages in one call is much cheaper than a call per page, even
+   though most of the range is still protected */
+static void mem_next_epoch(struct memory *mem) {
+  mem->epoch++;
+
+  if (!mem->track_writes) {
+    return;
+  }
+
+  if (!mem->tracking) {
+    if (!mem_protect_views(mem, ACC_READONLY)) {
+      LOG_WARNING("mem_next_epoch failed to write protect memory");
+      mem_stop_tracking(mem);
+      mem->track_writes = 0;
+      return;
+    }
+
+    mem->tracked_since = mem->epoch;
+  } else {
+    for (int i = 0; i < mem->num_views; i++) {
+      struct mem_view *view = &mem->views[i];
+
+      if (view->unprotected_begin >= view->unprotected_end) {
+        continue;
+      }
+
+      uint8_t *begin = view->ptr + (view->unprotected_begin << MEM_TRACK_SHIFT);
+      uint32_t size = (view->unprotected_end - view->unprotected_begin)
+                      << MEM_TRACK_SHIFT;
+      CHECK(protect_pages(begin, size, ACC_READONLY));
+    }
+  }
+
+  for (int i = 0; i < mem->num_views; i++) {
+    struct mem_view *view = &mem->views[i];
+    view->unprotected_begin = view->unprotected_end = 0;
+  }
+
+  mem->tracking = 1;
+}
+
+/* video ram is only written to through the pvr, which flags each page written
+   to since they were last collected */
+static void mem_collect_vram(struct memory *mem) {
+  struct pvr *pvr = mem->dc->pvr;
+  int first = (VRAM_OFFSET) >> MEM_TRACK_SHIFT;
+  int shift = MEM_TRACK_SHIFT - PVR_VRAM_PAGE_SHIFT;
+
+  for (int i = 0; i < PVR_VRAM_PAGES; i += 1 << shift) {
+    if (bitmap_any(pvr->state_dirty, i, 1 << shift)) {
+      mem->page_epoch[first + (i >> shift)] = mem->epoch;
+    }
+  }
+
+  bitmap_clear(pvr->state_dirty, 0, PVR_VRAM_PAGES);
+}
+
+static void mem_init_tracking(struct memory *mem) {
+  /* pages are tracked at the savestate's granularity */
+  if (!mem->num_views || get_page_size() != MEM_TRACK_SIZE) {
+    return;
+  }
+
+  /* added before the jit's handler, so the jit doesn't mistake a tracked
+     write for an mmio access and patch it to use the slow path */
+  mem->exc_handler = exception_handler_add(mem, &mem_handle_exception);
+}
+
 /*
  * address space common
  */
@@ -348,17 +559,39 @@ static void as_map(struct memory *mem, struct address_space *space,
   if (offset >= 0) {
     /* map physical memory into the address space */
     res = map_shared_memory(mem->shmem, offset, target, size, ACC_READWRITE);
+
+    if (type != MAP_VRAM) {
+      mem_add_view(mem, target, size, offset);
+    }
   } else {
     /* disable access to mmio areas */
     res = map_shared_memory(mem->shmem, 0x0, target, size, ACC_NONE);
   }
 
   CHECK_NE(res, SHMEM_MAP_FAILED);
+
+  space->mapped[begin >> MEM_PAGE_SHIFT] = size;
 #else
   (void)(offset);
 #endif
 }
 
+static void as_shutdown(struct memory *mem, struct address_space *space) {
+#ifdef HAVE_FASTMEM
+  /* release the range reserved for the address space, else each machine
+     created leaks 4 gb of it */
+  for (int i = 0; i < MEM_MAX_PAGES; i++) {
+    if (!space->mapped[i]) {
+      continue;
+    }
+
+    uint8_t *target = space->base + ((uint32_t)i << MEM_PAGE_SHIFT);
+    unmap_shared_memory(mem->shmem, target, space->mapped[i]);
+    space->mapped[i] = 0;
+  }
+#endif
+}
+
 static int as_init(struct address_space *space) {
   /* bind default handler */
   for (int i = 0; i < MEM_MAX_PAGES; i++) {
@@ -532,6 +765,87 @@ int sh4_init(struct memory *mem) {
   return 1;
 }
 
+void mem_host_write(struct memory *mem, uint8_t *ptr, int size) {
+  if (!mem->tracking || size <= 0) {
+    return;
+  }
+
+  /* video ram isn't protected, its writes are tracked by the pvr */
+  struct mem_view *view = mem_lookup_view(mem, ptr);
+  if (!view) {
+    return;
+  }
+
+  CHECK_LE(ptr + size, view->ptr + view->size);
+
+  uint32_t first = (uint32_t)(ptr - view->ptr) >> MEM_TRACK_SHIFT;
+  uint32_t last = (uint32_t)(ptr + size - 1 - view->ptr) >> MEM_TRACK_SHIFT;
+
+  for (uint32_t page = first; page <= last; page++) {
+    mem_unprotect_page(mem, view, page);
+  }
+}
+
+void mem_track_writes(struct memory *mem, int enable) {
+  if (!mem->exc_handler) {
+    return;
+  }
+
+  /* protection is applied at the start of the next epoch */
+  mem->track_writes = enable;
+
+  if (!enable) {
+    mem_stop_tracking(mem);
+  }
+}
+
+void mem_serialize(struct memory *mem, struct savestate *ss) {
+  int ram_page = (RAM_OFFSET) >> MEM_TRACK_SHIFT;
+  int vram_page = (VRAM_OFFSET) >> MEM_TRACK_SHIFT;
+  int aram_page = (ARAM_OFFSET) >> MEM_TRACK_SHIFT;
+  int num_vram_pages = (VRAM_SIZE) >> MEM_TRACK_SHIFT;
+
+  mem_collect_vram(mem);
+
+  /* flag each page written to since the snapshot was last synced with memory */
+  bitmap_clear(mem->written, 0, MEM_TRACK_PAGES);
+
+  for (int i = 0; i < MEM_TRACK_PAGES; i++) {
+    if (mem->page_epoch[i] >= ss->epoch) {
+      bitmap_set(mem->written, i, 1);
+    }
+  }
+
+  /* if writes to ram and aram weren't being tracked for the entire time since
+     the snapshot was synced, each of their pages is compared instead */
+  const bitmap_t *tracked = NULL;
+
+  if (mem->tracking && ss->epoch >= mem->tracked_since) {
+    tracked = mem->written;
+  }
+
+  int first_vram_page = ss->mem_pos >> SAVESTATE_PAGE_SHIFT;
+
+  savestate_pages(ss, mem->ram, RAM_SIZE, tracked, ram_page);
+  savestate_pages(ss, mem->vram, VRAM_SIZE, mem->written, vram_page);
+  savestate_pages(ss, mem->aram, ARAM_SIZE, tracked, aram_page);
+
+  /* writes to ram and aram while loading are caught like any other, but video
+     ram is written to directly. stamp the restored pages so other snapshots
+     see them as changed */
+  if (savestate_loading(ss)) {
+    for (int i = 0; i < num_vram_pages; i++) {
+      if (bitmap_test(ss->dirty, first_vram_page + i, 1)) {
+        mem->page_epoch[vram_page + i] = mem->epoch;
+      }
+    }
+  }
+
+  /* the snapshot is now in sync with memory */
+  mem_next_epoch(mem);
+  ss->epoch = mem->epoch;
+}
+
 uint8_t *mem_vram(struct memory *mem, uint32_t offset) {
   return mem->vram + offset;
 }
@@ -568,6 +882,9 @@ int mem_init(struct memory *mem) {
   mem->aram = map_shared_memory(mem->shmem, ARAM_OFFSET, NULL, ARAM_SIZE,
                                 ACC_READWRITE);
   CHECK_NE(mem->aram, SHMEM_MAP_FAILED);
+
+  mem_add_view(mem, mem->ram, RAM_SIZE, RAM_OFFSET);
+  mem_add_view(mem, mem->aram, ARAM_SIZE, ARAM_OFFSET);
 #else
   mem->ram = calloc(RAM_SIZE, 1);
   mem->vram = calloc(VRAM_SIZE, 1);
@@ -582,12 +899,27 @@ int mem_init(struct memory *mem) {
     return 0;
   }
 
+  mem_init_tracking(mem);
+
   return 1;
 }
 
 void mem_destroy(struct memory *mem) {
+  if (mem->exc_handler) {
+    mem_stop_tracking(mem);
+    exception_handler_remove(mem->exc_handler);
+  }
+
+  as_shutdown(mem, &mem->arm7);
+  as_shutdown(mem, &mem->sh4);
+
 #ifdef HAVE_FASTMEM
-  destroy_shared_memory(mem->shmem);
+  if (mem->shmem != SHMEM_INVALID) {
+    unmap_shared_memory(mem->shmem, mem->ram, RAM_SIZE);
+    unmap_shared_memory(mem->shmem, mem->vram, VRAM_SIZE);
+    unmap_shared_memory(mem->shmem, mem->aram, ARAM_SIZE);
+    destroy_shared_memory(mem->shmem);
+  }
 #else
   free(mem->ram);
   free(mem->vram);
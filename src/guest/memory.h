@@ -6,6 +6,7 @@
 
 struct dreamcast;
 struct memory;
+struct savestate;
 
 /*
  * mmio callbacks and helpers
@@ -50,4 +51,10 @@ uint8_t *mem_ram(struct memory *mem, uint32_t offset);
 uint8_t *mem_aram(struct memory *mem, uint32_t offset);
 uint8_t *mem_vram(struct memory *mem, uint32_t offset);
 
+/* write tracking for savestates, see the comment at the top of memory.c */
+void mem_track_writes(struct memory *mem, int enable);
+void mem_host_write(struct memory *mem, uint8_t *ptr, int size);
+
+void mem_serialize(struct memory *mem, struct savestate *ss);
+
 #endif
@@ -4,10 +4,15 @@
 #include "guest/holly/holly.h"
 #include "guest/memory.h"
 #include "guest/pvr/ta.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "stats.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
 static struct reg_cb pvr_cb[PVR_NUM_REGS];
 
 /* the dreamcast has 8MB of vram, split into two 4MB banks, with two ways of
@@ -83,6 +88,7 @@ static void pvr_mark_framebuffer(struct pvr *pvr, uint32_t addr) {
   }
 
   *(uint32_t *)&pvr->vram[VRAM64(addr)] = PVR_FB_COOKIE;
+  pvr_mark_vram(pvr, VRAM64(addr), 4);
 
   /* it's not enough to just mark the starting address of this framebuffer. next
      frame, this framebuffer could be used as field 2, in which case FB_R_SOF2
@@ -96,11 +102,151 @@ static void pvr_mark_framebuffer(struct pvr *pvr, uint32_t addr) {
       for (int k = 0; k < ARRAY_SIZE(line_scale); k++) {
         uint32_t next_line = addr + line_width[i] * line_bpp[j] * line_scale[k];
         *(uint32_t *)&pvr->vram[VRAM64(next_line)] = PVR_FB_COOKIE;
+        pvr_mark_vram(pvr, VRAM64(next_line), 4);
       }
     }
   }
 }
 
+/* copy a row of the framebuffer out of the interleaved vram layout. rows which
+   are word aligned and don't cross banks are copied four words at a time */
+static void pvr_read_row(struct pvr *pvr, uint32_t addr, int size,
+                         uint8_t *dst) {
+  uint32_t end = addr + size - 1;
+
+  if ((addr & 0x3) || (size & 0x3) || ((addr ^ end) & 0x00400000)) {
+    for (int i = 0; i < size; i++) {
+      dst[i] = pvr->vram[VRAM64(addr + i)];
+    }
+    return;
+  }
+
+  /* each consecutive word of a bank is 8 bytes apart in the 64-bit layout */
+  const uint8_t *src = &pvr->vram[VRAM64(addr)];
+  int num_words = size >> 2;
+  int i = 0;
+
+#if ARCH_X64
+  /* note, the loop stops short of the last group of words to avoid reading past
+     the end of vram */
+  for (; i + 4 < num_words; i += 4) {
+    __m128 lo = _mm_loadu_ps((const float *)&src[i * 8]);
+    __m128 hi = _mm_loadu_ps((const float *)&src[i * 8 + 16]);
+    __m128 words = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storeu_ps((float *)&dst[i * 4], words);
+  }
+#endif
+
+  for (; i < num_words; i++) {
+    memcpy(&dst[i * 4], &src[i * 8], 4);
+  }
+}
+
+static int pvr_row_dirty(struct pvr *pvr, uint32_t addr, int size) {
+  uint32_t end = addr + size - 1;
+
+  if ((addr ^ end) & 0x00400000) {
+    return 1;
+  }
+
+  uint32_t first = VRAM64(addr) >> PVR_VRAM_PAGE_SHIFT;
+  uint32_t last = VRAM64(end) >> PVR_VRAM_PAGE_SHIFT;
+  return bitmap_any(pvr->fb_dirty, first, last - first + 1);
+}
+
+#if ARCH_X64
+static inline void pvr_pack_rgb(__m128i r, __m128i g, __m128i b,
+                                uint8_t *dst) {
+  __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+  __m128i ba = _mm_or_si128(b, _mm_set1_epi16((int16_t)0xff00));
+  _mm_storeu_si128((__m128i *)&dst[0], _mm_unpacklo_epi16(rg, ba));
+  _mm_storeu_si128((__m128i *)&dst[16], _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
+static void pvr_convert_0555(const uint8_t *src, uint8_t *dst, int width) {
+  int x = 0;
+
+#if ARCH_X64
+  const __m128i mask = _mm_set1_epi16(0xf8);
+
+  for (; x + 8 <= width; x += 8) {
+    __m128i rgb = _mm_loadu_si128((const __m128i *)&src[x * 2]);
+    __m128i r = _mm_and_si128(_mm_srli_epi16(rgb, 7), mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(rgb, 2), mask);
+    __m128i b = _mm_and_si128(_mm_slli_epi16(rgb, 3), mask);
+    pvr_pack_rgb(r, g, b, &dst[x * 4]);
+  }
+#endif
+
+  for (; x < width; x++) {
+    uint16_t rgb = *(uint16_t *)&src[x * 2];
+    dst[x * 4 + 0] = (rgb & 0b0111110000000000) >> 7;
+    dst[x * 4 + 1] = (rgb & 0b0000001111100000) >> 2;
+    dst[x * 4 + 2] = (rgb & 0b0000000000011111) << 3;
+    dst[x * 4 + 3] = 0xff;
+  }
+}
+
+static void pvr_convert_0565(const uint8_t *src, uint8_t *dst, int width) {
+  int x = 0;
+
+#if ARCH_X64
+  for (; x + 8 <= width; x += 8) {
+    __m128i rgb = _mm_loadu_si128((const __m128i *)&src[x * 2]);
+    __m128i r = _mm_srli_epi16(rgb, 11);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(rgb, 3), _mm_set1_epi16(0xfc));
+    __m128i b = _mm_and_si128(_mm_slli_epi16(rgb, 3), _mm_set1_epi16(0xf8));
+    pvr_pack_rgb(_mm_slli_epi16(r, 3), g, b, &dst[x * 4]);
+  }
+#endif
+
+  for (; x < width; x++) {
+    uint16_t rgb = *(uint16_t *)&src[x * 2];
+    dst[x * 4 + 0] = (rgb & 0b1111100000000000) >> 8;
+    dst[x * 4 + 1] = (rgb & 0b0000011111100000) >> 3;
+    dst[x * 4 + 2] = (rgb & 0b0000000000011111) << 3;
+    dst[x * 4 + 3] = 0xff;
+  }
+}
+
+static void pvr_convert_888(const uint8_t *src, uint8_t *dst, int width) {
+  for (int x = 0; x < width; x++) {
+    const uint8_t *rgb = &src[x * 3];
+    dst[x * 4 + 0] = rgb[2];
+    dst[x * 4 + 1] = rgb[1];
+    dst[x * 4 + 2] = rgb[0];
+    dst[x * 4 + 3] = 0xff;
+  }
+}
+
+static void pvr_convert_0888(const uint8_t *src, uint8_t *dst, int width) {
+  int x = 0;
+
+#if ARCH_X64
+  const __m128i g_mask = _mm_set1_epi32(0x0000ff00);
+  const __m128i b_mask = _mm_set1_epi32(0x000000ff);
+  const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+  for (; x + 4 <= width; x += 4) {
+    __m128i krgb = _mm_loadu_si128((const __m128i *)&src[x * 4]);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(krgb, 16), b_mask);
+    __m128i g = _mm_and_si128(krgb, g_mask);
+    __m128i b = _mm_slli_epi32(_mm_and_si128(krgb, b_mask), 16);
+    __m128i rgba = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, alpha));
+    _mm_storeu_si128((__m128i *)&dst[x * 4], rgba);
+  }
+#endif
+
+  for (; x < width; x++) {
+    const uint8_t *krgb = &src[x * 4];
+    dst[x * 4 + 0] = krgb[2];
+    dst[x * 4 + 1] = krgb[1];
+    dst[x * 4 + 2] = krgb[0];
+    dst[x * 4 + 3] = 0xff;
+  }
+}
+
 static int pvr_update_framebuffer(struct pvr *pvr) {
   uint32_t fields[2] = {*pvr->FB_R_SOF1, *pvr->FB_R_SOF2};
   int num_fields = pvr->SPG_CONTROL->interlace ? 2 : 1;
@@ -117,85 +263,70 @@ static int pvr_update_framebuffer(struct pvr *pvr) {
 
   pvr_framebuffer_size(pvr, &pvr->framebuffer_w, &pvr->framebuffer_h);
 
-  /* convert framebuffer into a 24-bit RGB pixel buffer */
-  uint8_t *dst = pvr->framebuffer;
-  uint8_t *src = pvr->vram;
+  if (pvr->framebuffer_w * pvr->framebuffer_h * 4 > PVR_FRAMEBUFFER_SIZE) {
+    LOG_WARNING("pvr_update_framebuffer framebuffer too large %dx%d",
+                pvr->framebuffer_w, pvr->framebuffer_h);
+    return 0;
+  }
 
   /* values in FB_R_SIZE are in 32-bit units */
   int line_mod = (pvr->FB_R_SIZE->mod << 2) - 4;
   int x_size = (pvr->FB_R_SIZE->x + 1) << 2;
   int y_size = (pvr->FB_R_SIZE->y + 1);
+  int width = pvr->framebuffer_w;
 
-  /* TODO use fb_concat */
+  void (*convert)(const uint8_t *, uint8_t *, int) = NULL;
 
   switch (pvr->FB_R_CTRL->fb_depth) {
-    case 0: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 2) {
-            uint16_t rgb = *(uint16_t *)&src[VRAM64(fields[n])];
-            dst[0] = (rgb & 0b0111110000000000) >> 7;
-            dst[1] = (rgb & 0b0000001111100000) >> 2;
-            dst[2] = (rgb & 0b0000000000011111) << 3;
-            fields[n] += 2;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-
-    case 1: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 2) {
-            uint16_t rgb = *(uint16_t *)&src[VRAM64(fields[n])];
-            dst[0] = (rgb & 0b1111100000000000) >> 8;
-            dst[1] = (rgb & 0b0000011111100000) >> 3;
-            dst[2] = (rgb & 0b0000000000011111) << 3;
-            fields[n] += 2;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-    case 2: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 3) {
-            uint8_t *rgb = &src[VRAM64(fields[n])];
-            dst[0] = rgb[2];
-            dst[1] = rgb[1];
-            dst[2] = rgb[0];
-            fields[n] += 3;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
-    case 3: {
-      for (int y = 0; y < y_size; y++) {
-        for (int n = 0; n < num_fields; n++) {
-          for (int x = 0; x < x_size; x += 4) {
-            uint8_t *krgb = &src[VRAM64(fields[n])];
-            dst[0] = krgb[2];
-            dst[1] = krgb[1];
-            dst[2] = krgb[0];
-            fields[n] += 4;
-            dst += 3;
-          }
-          fields[n] += line_mod;
-        }
-      }
-    } break;
+    case 0:
+      convert = &pvr_convert_0555;
+      break;
+    case 1:
+      convert = &pvr_convert_0565;
+      break;
+    case 2:
+      convert = &pvr_convert_888;
+      break;
+    case 3:
+      convert = &pvr_convert_0888;
+      break;
     default:
       LOG_FATAL("pvr_push_framebuffer unexpected fb_depth %d",
                 pvr->FB_R_CTRL->fb_depth);
       break;
   }
 
+  /* rows are only converted again if the layout has changed, or if their
+     pages have been written to since the last conversion */
+  uint32_t layout[ARRAY_SIZE(pvr->framebuffer_layout)] = {
+      fields[0],        fields[1],        (uint32_t)num_fields,
+      pvr->FB_R_CTRL->fb_depth, (uint32_t)x_size, (uint32_t)y_size,
+      (uint32_t)line_mod};
+  int full = memcmp(layout, pvr->framebuffer_layout, sizeof(layout)) != 0;
+  memcpy(pvr->framebuffer_layout, layout, sizeof(layout));
+
+  /* convert framebuffer into a 32-bit RGBA pixel buffer a row at a time,
+     deinterlacing the fields */
+  uint8_t row[4096];
+  uint8_t *dst = pvr->framebuffer;
+
+  /* TODO use fb_concat */
+
+  for (int y = 0; y < y_size; y++) {
+    for (int n = 0; n < num_fields; n++) {
+      uint32_t addr = fields[n] + y * (x_size + line_mod);
+
+      if (full || pvr_row_dirty(pvr, addr, x_size)) {
+        pvr_read_row(pvr, addr, x_size, row);
+        convert(row, dst, width);
+      }
+
+      dst += width * 4;
+    }
+  }
+
+  bitmap_clear(pvr->fb_dirty, 0, PVR_VRAM_PAGES);
+
   dc_push_pixels(pvr->dc, pvr->framebuffer, pvr->framebuffer_w,
                  pvr->framebuffer_h);
 
@@ -227,13 +358,52 @@ static void pvr_vblank_in(struct pvr *pvr) {
   dc_vblank_in(pvr->dc, pvr->VO_CONTROL->blank_video);
 }
 
-static void pvr_next_scanline(void *data) {
-  struct pvr *pvr = data;
-  struct holly *hl = pvr->dc->holly;
+static int64_t pvr_current_time(struct pvr *pvr) {
   struct scheduler *sched = pvr->dc->sched;
 
-  uint32_t num_lines = pvr->SPG_LOAD->vcount + 1;
-  pvr->current_line = (pvr->current_line + 1) % num_lines;
+  /* while the sh4 is running, the scheduler's clock is at the end of its slice.
+     account for how far into the slice it actually is */
+  return sched_current_time(sched) - sh4_slice_remaining(pvr->dc->sh4);
+}
+
+static int64_t pvr_line_num(struct pvr *pvr, int64_t time) {
+  if (!pvr->line_period || time < pvr->line_epoch) {
+    return 0;
+  }
+
+  return (time - pvr->line_epoch) / pvr->line_period;
+}
+
+static uint32_t pvr_line(struct pvr *pvr, int64_t line_num) {
+  if (!line_num) {
+    return pvr->line_base;
+  }
+
+  return (uint32_t)((pvr->line_base + line_num) % pvr->num_lines);
+}
+
+static int pvr_lines_until(struct pvr *pvr, uint32_t line, uint32_t target) {
+  uint32_t num_lines = pvr->num_lines;
+
+  if (target >= num_lines) {
+    return num_lines;
+  }
+
+  return (int)((target + num_lines - line % num_lines - 1) % num_lines) + 1;
+}
+
+static int pvr_vsync(struct pvr *pvr, uint32_t line) {
+  if (pvr->SPG_VBLANK->vbstart < pvr->SPG_VBLANK->vbend) {
+    return line >= pvr->SPG_VBLANK->vbstart && line < pvr->SPG_VBLANK->vbend;
+  } else {
+    return line >= pvr->SPG_VBLANK->vbstart || line < pvr->SPG_VBLANK->vbend;
+  }
+}
+
+static void pvr_process_line(struct pvr *pvr, uint32_t line) {
+  struct holly *hl = pvr->dc->holly;
+
+  pvr->current_line = line;
 
   /* hblank in */
   switch (pvr->SPG_HBLANK_INT->hblank_int_mode) {
@@ -261,13 +431,7 @@ static void pvr_next_scanline(void *data) {
   }
 
   int was_vsync = pvr->SPG_STATUS->vsync;
-  if (pvr->SPG_VBLANK->vbstart < pvr->SPG_VBLANK->vbend) {
-    pvr->SPG_STATUS->vsync = pvr->current_line >= pvr->SPG_VBLANK->vbstart &&
-                             pvr->current_line < pvr->SPG_VBLANK->vbend;
-  } else {
-    pvr->SPG_STATUS->vsync = pvr->current_line >= pvr->SPG_VBLANK->vbstart ||
-                             pvr->current_line < pvr->SPG_VBLANK->vbend;
-  }
+  pvr->SPG_STATUS->vsync = pvr_vsync(pvr, pvr->current_line);
   pvr->SPG_STATUS->scanline = pvr->current_line;
 
   if (!was_vsync && pvr->SPG_STATUS->vsync) {
@@ -275,26 +439,108 @@ static void pvr_next_scanline(void *data) {
   } else if (was_vsync && !pvr->SPG_STATUS->vsync) {
     pvr_vblank_out(pvr);
   }
+}
 
-  /* reschedule */
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+/* process the lines started up until the current time */
+static void pvr_update_lines(struct pvr *pvr) {
+  int64_t line_num = pvr_line_num(pvr, pvr_current_time(pvr));
+
+  /* lines without a timer scheduled for them don't raise interrupts or toggle
+     vsync, so there's no need to process them. that is, unless the registers
+     controlling them have been written to since the timer was scheduled */
+  if (!pvr->line_resync) {
+    pvr->line_num = MAX(pvr->line_num, line_num - 1);
+  }
+
+  pvr->line_resync = 0;
+
+  while (pvr->line_num < line_num) {
+    pvr->line_num++;
+    pvr_process_line(pvr, pvr_line(pvr, pvr->line_num));
+  }
 }
 
-static void pvr_reconfigure_spg(struct pvr *pvr) {
+static void pvr_next_scanline(void *data);
+
+static void pvr_schedule_line(struct pvr *pvr, int64_t line_num) {
   struct scheduler *sched = pvr->dc->sched;
 
+  if (pvr->line_timer) {
+    sched_cancel_timer(sched, pvr->line_timer);
+    pvr->line_timer = NULL;
+  }
+
+  int64_t expire = pvr->line_epoch + line_num * pvr->line_period;
+  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
+                                      expire - sched_current_time(sched));
+}
+
+static void pvr_schedule_next_line(struct pvr *pvr) {
+  uint32_t line = pvr->current_line;
+  int next = pvr->num_lines;
+
+  /* find the next line which raises an interrupt or toggles vsync. note, when
+     not comparing against line_comp_val, either every line raises an hblank
+     interrupt or the mode is unsupported */
+  if (pvr->SPG_HBLANK_INT->hblank_int_mode == 0x0) {
+    next = MIN(next,
+               pvr_lines_until(pvr, line, pvr->SPG_HBLANK_INT->line_comp_val));
+  } else {
+    next = 1;
+  }
+
+  next = MIN(next, pvr_lines_until(
+                       pvr, line, pvr->SPG_VBLANK_INT->vblank_in_line_number));
+  next = MIN(next, pvr_lines_until(
+                       pvr, line, pvr->SPG_VBLANK_INT->vblank_out_line_number));
+  next = MIN(next, pvr_lines_until(pvr, line, pvr->SPG_VBLANK->vbstart));
+  next = MIN(next, pvr_lines_until(pvr, line, pvr->SPG_VBLANK->vbend));
+  next = MIN(next, pvr_lines_until(pvr, line, 0));
+
+  pvr_schedule_line(pvr, pvr->line_num + next);
+}
+
+static void pvr_next_scanline(void *data) {
+  struct pvr *pvr = data;
+
+  pvr->line_timer = NULL;
+
+  pvr_update_lines(pvr);
+  pvr_schedule_next_line(pvr);
+}
+
+/* called before a register controlling the raster is written to. the lines
+   started so far are processed with the previous value, while each line after
+   is processed with the new value until the next timer expires */
+static void pvr_resync_lines(struct pvr *pvr) {
+  pvr_update_lines(pvr);
+
+  pvr->line_resync = 1;
+  pvr_schedule_line(pvr, pvr->line_num + 1);
+}
+
+static void pvr_reconfigure_spg(struct pvr *pvr) {
   /* scale pixel clock frequency */
   int pixel_clock = 13500000;
   if (pvr->FB_R_CTRL->vclk_div) {
     pixel_clock *= 2;
   }
 
+  /* finish the lines started with the previous timing, and carry the current
+     line over to the new timing */
+  pvr_update_lines(pvr);
+
+  pvr->line_base = pvr->current_line;
+  pvr->line_epoch = pvr_current_time(pvr);
+  pvr->line_num = 0;
+
   /* hcount is number of pixel clock cycles per line - 1 */
   pvr->line_clock = pixel_clock / (pvr->SPG_LOAD->hcount + 1);
   if (pvr->SPG_CONTROL->interlace) {
     pvr->line_clock *= 2;
   }
+  pvr->line_period = HZ_TO_NANO(pvr->line_clock);
+  pvr->num_lines = pvr->SPG_LOAD->vcount + 1;
 
   const char *mode = "vga";
   if (pvr->SPG_CONTROL->NTSC == 1) {
@@ -310,13 +556,10 @@ static void pvr_reconfigure_spg(struct pvr *pvr) {
       pvr->SPG_LOAD->hcount, pvr->SPG_HBLANK->hbstart, pvr->SPG_HBLANK->hbend,
       pvr->SPG_LOAD->vcount, pvr->SPG_VBLANK->vbstart, pvr->SPG_VBLANK->vbend);
 
-  if (pvr->line_timer) {
-    sched_cancel_timer(sched, pvr->line_timer);
-    pvr->line_timer = NULL;
-  }
-
-  pvr->line_timer = sched_start_timer(sched, &pvr_next_scanline, pvr,
-                                      HZ_TO_NANO(pvr->line_clock));
+  /* process the next line in full, as the previous timer may not have been
+     scheduled for it */
+  pvr->line_resync = 1;
+  pvr_schedule_line(pvr, 1);
 }
 
 static int pvr_init(struct device *dev) {
@@ -338,10 +581,47 @@ static int pvr_init(struct device *dev) {
   return 1;
 }
 
+static void pvr_mark_page(bitmap_t *map, uint32_t page) {
+  bitmap_set(map, page, 1);
+}
+
+static int pvr_pages_dirty(const bitmap_t *map, int num_pages, int shift,
+                           uint32_t addr, int size) {
+  int first = addr >> shift;
+  int last = MIN((addr + size - 1) >> shift, (uint32_t)num_pages - 1);
+  return bitmap_any(map, first, last - first + 1);
+}
+
+void pvr_clear_dirty(struct pvr *pvr) {
+  bitmap_clear(pvr->vram_dirty, 0, PVR_VRAM_PAGES);
+  bitmap_clear(pvr->palette_dirty, 0, PVR_PALETTE_PAGES);
+}
+
+int pvr_palette_dirty(struct pvr *pvr, uint32_t addr, int size) {
+  return pvr_pages_dirty(pvr->palette_dirty, PVR_PALETTE_PAGES,
+                         PVR_PALETTE_PAGE_SHIFT, addr, size);
+}
+
+int pvr_vram_dirty(struct pvr *pvr, uint32_t addr, int size) {
+  return pvr_pages_dirty(pvr->vram_dirty, PVR_VRAM_PAGES, PVR_VRAM_PAGE_SHIFT,
+                         addr, size);
+}
+
+void pvr_mark_vram(struct pvr *pvr, uint32_t addr, int size) {
+  uint32_t first = addr >> PVR_VRAM_PAGE_SHIFT;
+  uint32_t last = (addr + size - 1) >> PVR_VRAM_PAGE_SHIFT;
+  bitmap_set(pvr->vram_dirty, first, last - first + 1);
+  bitmap_set(pvr->fb_dirty, first, last - first + 1);
+  bitmap_set(pvr->state_dirty, first, last - first + 1);
+}
+
 void pvr_vram32_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                       uint32_t mask) {
   addr = VRAM64(addr);
   WRITE_DATA(&pvr->vram[addr]);
+  pvr_mark_page(pvr->vram_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
+  pvr_mark_page(pvr->fb_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
+  pvr_mark_page(pvr->state_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
 }
 
 uint32_t pvr_vram32_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
@@ -352,12 +632,15 @@ uint32_t pvr_vram32_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
 void pvr_vram64_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                       uint32_t mask) {
   WRITE_DATA(&pvr->vram[addr]);
+  pvr_mark_page(pvr->vram_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
+  pvr_mark_page(pvr->fb_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
+  pvr_mark_page(pvr->state_dirty, addr >> PVR_VRAM_PAGE_SHIFT);
 }
 
 uint32_t pvr_vram64_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
   /* note, the video ram can't be directly accessed through fastmem, or texture
-     cache invalidations will break. this is because textures cache entries
-     only watch the physical video ram address, not all of its mirrors */
+     cache invalidations will break. this is because the dirty pages used to
+     invalidate texture cache entries are only marked by these handlers */
   return READ_DATA(&pvr->vram[addr]);
 }
 
@@ -378,6 +661,11 @@ void pvr_reg_write(struct pvr *pvr, uint32_t addr, uint32_t data,
   }
 
   pvr->reg[offset] = data;
+
+  if (offset >= PALETTE_RAM000 && offset <= PALETTE_RAM3FC) {
+    uint32_t palette_addr = (offset - PALETTE_RAM000) << 2;
+    pvr_mark_page(pvr->palette_dirty, palette_addr >> PVR_PALETTE_PAGE_SHIFT);
+  }
 }
 
 uint32_t pvr_reg_read(struct pvr *pvr, uint32_t addr, uint32_t mask) {
@@ -419,6 +707,35 @@ void pvr_video_size(struct pvr *pvr, int *width, int *height) {
   }
 }
 
+static void pvr_serialize(struct device *dev, struct savestate *ss) {
+  struct pvr *pvr = (struct pvr *)dev;
+  struct scheduler *sched = pvr->dc->sched;
+
+  SAVESTATE_VALUE(ss, pvr->reg);
+  sched_serialize_timer(sched, ss, &pvr->line_timer);
+  SAVESTATE_VALUE(ss, pvr->line_clock);
+  SAVESTATE_VALUE(ss, pvr->num_lines);
+  SAVESTATE_VALUE(ss, pvr->line_period);
+  SAVESTATE_VALUE(ss, pvr->line_epoch);
+  SAVESTATE_VALUE(ss, pvr->line_num);
+  SAVESTATE_VALUE(ss, pvr->line_base);
+  SAVESTATE_VALUE(ss, pvr->current_line);
+  SAVESTATE_VALUE(ss, pvr->line_resync);
+  SAVESTATE_VALUE(ss, pvr->got_startrender);
+
+  if (!savestate_loading(ss)) {
+    return;
+  }
+
+  /* video and palette ram may have changed entirely, force the framebuffer
+     and any textures sourced from them to be converted again. the pages
+     restored are tracked for savestates by the memory itself */
+  memset(pvr->framebuffer_layout, 0, sizeof(pvr->framebuffer_layout));
+  bitmap_set(pvr->vram_dirty, 0, PVR_VRAM_PAGES);
+  bitmap_set(pvr->fb_dirty, 0, PVR_VRAM_PAGES);
+  bitmap_set(pvr->palette_dirty, 0, PVR_PALETTE_PAGES);
+}
+
 void pvr_destroy(struct pvr *pvr) {
   dc_destroy_device((struct device *)pvr);
 }
@@ -427,6 +744,10 @@ struct pvr *pvr_create(struct dreamcast *dc) {
   struct pvr *pvr =
       dc_create_device(dc, sizeof(struct pvr), "pvr", &pvr_init, NULL);
 
+  /* setup state interface */
+  pvr->stateif.enabled = 1;
+  pvr->stateif.serialize = &pvr_serialize;
+
   return pvr;
 }
 
@@ -487,6 +808,42 @@ REG_W32(pvr_cb, TA_YUV_TEX_BASE) {
   ta_yuv_init(ta);
 }
 
+REG_R32(pvr_cb, SPG_STATUS) {
+  struct pvr *pvr = dc->pvr;
+
+  /* the current line is derived from the clock, while vsync and the field
+     number are only updated by the timers */
+  union spg_status status = *pvr->SPG_STATUS;
+  int64_t line_num = pvr_line_num(pvr, pvr_current_time(pvr));
+  status.scanline = pvr_line(pvr, MAX(line_num, pvr->line_num));
+
+  return status.full;
+}
+
+REG_W32(pvr_cb, SPG_HBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_resync_lines(pvr);
+
+  pvr->SPG_HBLANK_INT->full = value;
+}
+
+REG_W32(pvr_cb, SPG_VBLANK_INT) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_resync_lines(pvr);
+
+  pvr->SPG_VBLANK_INT->full = value;
+}
+
+REG_W32(pvr_cb, SPG_VBLANK) {
+  struct pvr *pvr = dc->pvr;
+
+  pvr_resync_lines(pvr);
+
+  pvr->SPG_VBLANK->full = value;
+}
+
 REG_W32(pvr_cb, SPG_LOAD) {
   struct pvr *pvr = dc->pvr;
 
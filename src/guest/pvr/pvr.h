@@ -1,6 +1,7 @@
 #ifndef PVR_H
 #define PVR_H
 
+#include "core/bitmap.h"
 #include "guest/dreamcast.h"
 #include "guest/pvr/pvr_types.h"
 
@@ -10,24 +11,56 @@ struct timer;
 
 #define PVR_FRAMEBUFFER_SIZE 640 * 640 * 4
 
+/* video and palette ram writes are tracked at this granularity */
+#define PVR_VRAM_PAGE_SHIFT 10
+#define PVR_VRAM_PAGES ((8 * 1024 * 1024) >> PVR_VRAM_PAGE_SHIFT)
+#define PVR_PALETTE_PAGE_SHIFT 6
+#define PVR_PALETTE_PAGES (4096 >> PVR_PALETTE_PAGE_SHIFT)
+
 struct pvr {
   struct device;
   uint8_t *vram;
   uint32_t reg[PVR_NUM_REGS];
 
-  /* raster progress */
+  /* raster progress. the current line is derived from the scheduler's clock
+     when read, timers are only scheduled for the lines which raise interrupts
+     or toggle vsync. line_num counts the lines processed since line_epoch,
+     the time at which the raster was on line_base */
   struct timer *line_timer;
   int line_clock;
+  int num_lines;
+  int64_t line_period;
+  int64_t line_epoch;
+  int64_t line_num;
+  uint32_t line_base;
   uint32_t current_line;
 
-  /* copy of deinterlaced framebuffer from texture memory */
+  /* set when a register controlling the raster is written to, forcing each
+     line up to the next timer to be processed */
+  int line_resync;
+
+  /* copy of deinterlaced framebuffer from texture memory, stored as 32-bit
+     RGBA. the layout it was last converted with is saved, along with the
+     pages written to since, so that unchanged rows can be skipped */
   uint8_t framebuffer[PVR_FRAMEBUFFER_SIZE];
   int framebuffer_w;
   int framebuffer_h;
+  uint32_t framebuffer_layout[7];
+  DECLARE_BITMAP(fb_dirty, PVR_VRAM_PAGES);
 
   /* tracks if a STARTRENDER was received for the current frame */
   int got_startrender;
 
+  /* pages of video and palette ram written to since the last time they were
+     cleared. every write path marks the pages it modifies, letting cached
+     textures be invalidated in a single pass at the end of each frame */
+  DECLARE_BITMAP(vram_dirty, PVR_VRAM_PAGES);
+  DECLARE_BITMAP(palette_dirty, PVR_PALETTE_PAGES);
+
+  /* pages of video ram written to since they were last collected by the
+     memory's write tracking for savestates, marked by the same paths */
+  DECLARE_BITMAP(state_dirty, PVR_VRAM_PAGES);
+
 #define PVR_REG(offset, name, default, type) type *name;
 #include "guest/pvr/pvr_regs.inc"
 #undef PVR_REG
@@ -38,6 +71,11 @@ void pvr_destroy(struct pvr *pvr);
 
 void pvr_video_size(struct pvr *pvr, int *video_width, int *video_height);
 
+void pvr_mark_vram(struct pvr *pvr, uint32_t addr, int size);
+int pvr_vram_dirty(struct pvr *pvr, uint32_t addr, int size);
+int pvr_palette_dirty(struct pvr *pvr, uint32_t addr, int size);
+void pvr_clear_dirty(struct pvr *pvr);
+
 uint32_t pvr_reg_read(struct pvr *pvr, uint32_t addr, uint32_t mask);
 void pvr_reg_write(struct pvr *pvr, uint32_t addr, uint32_t data,
                    uint32_t mask);
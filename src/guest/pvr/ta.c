@@ -27,6 +27,7 @@
 #include "guest/memory.h"
 #include "guest/pvr/pvr.h"
 #include "guest/pvr/tr.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "guest/sh4/sh4.h"
 #include "stats.h"
@@ -368,6 +369,7 @@ static struct ta_context *ta_demand_context(struct ta *ta, uint32_t addr) {
   CHECK_LT(ta->num_contexts, ARRAY_SIZE(ta->contexts));
   ctx = &ta->contexts[ta->num_contexts++];
   ctx->addr = addr;
+  ctx->rc = calloc(1, sizeof(struct tr_context));
 
   return ctx;
 }
@@ -388,6 +390,8 @@ static void ta_init_context(struct ta *ta, struct ta_context *ctx) {
   ctx->size = 0;
   ctx->list_type = TA_NUM_LISTS;
   ctx->vert_type = TA_NUM_VERTS;
+
+  tr_init_context(ctx->rc);
 }
 
 static void ta_write_context(struct ta *ta, struct ta_context *ctx,
@@ -452,6 +456,13 @@ static void ta_write_context(struct ta *ta, struct ta_context *ctx,
     }
 
     ctx->cursor += recv;
+
+    /* parse the param into surfaces and vertices now, rather than leaving all
+       of the work for when rendering starts. vertices are held back until
+       their strip ends, so each strip is decoded as a single batch */
+    if (pcw.para_type != TA_PARAM_VERTEX || pcw.end_of_strip) {
+      tr_parse_context(ctx, ctx->rc, ctx->cursor);
+    }
   }
 }
 
@@ -578,7 +589,7 @@ static void ta_render_context(struct ta *ta, struct ta_context *ctx) {
 /*
  * yuv420 -> yuv422 conversion routines
  */
-#define TA_YUV420_MACROBLOCK_SIZE 384
+#define TA_YUV420_MACROBLOCK_SIZE PVR_YUV420_MACROBLOCK_SIZE
 #define TA_YUV422_MACROBLOCK_SIZE 512
 #define TA_MAX_MACROBLOCK_SIZE \
   MAX(TA_YUV420_MACROBLOCK_SIZE, TA_YUV422_MACROBLOCK_SIZE)
@@ -606,45 +617,6 @@ static void ta_yuv_reset(struct ta *ta) {
   pvr->TA_YUV_TEX_CNT->num = 0;
 }
 
-static void ta_yuv_process_block(struct ta *ta, const uint8_t *in_uv,
-                                 const uint8_t *in_y, uint8_t *out_uyvy) {
-  uint8_t *out_row0 = out_uyvy;
-  uint8_t *out_row1 = out_uyvy + (ta->yuv_width << 1);
-
-  /* reencode 8x8 subblock of YUV420 data as UYVY422 */
-  for (int j = 0; j < 8; j += 2) {
-    for (int i = 0; i < 8; i += 2) {
-      uint8_t u = in_uv[0];
-      uint8_t v = in_uv[64];
-      uint8_t y0 = in_y[0];
-      uint8_t y1 = in_y[1];
-      uint8_t y2 = in_y[8];
-      uint8_t y3 = in_y[9];
-
-      out_row0[0] = u;
-      out_row0[1] = y0;
-      out_row0[2] = v;
-      out_row0[3] = y1;
-
-      out_row1[0] = u;
-      out_row1[1] = y2;
-      out_row1[2] = v;
-      out_row1[3] = y3;
-
-      in_uv += 1;
-      in_y += 2;
-      out_row0 += 4;
-      out_row1 += 4;
-    }
-
-    /* skip past adjacent 8x8 subblock */
-    in_uv += 4;
-    in_y += 8;
-    out_row0 += (ta->yuv_width << 2) - 16;
-    out_row1 += (ta->yuv_width << 2) - 16;
-  }
-}
-
 static void ta_yuv_process_macroblock(struct ta *ta, const void *data) {
   struct pvr *pvr = ta->dc->pvr;
   struct holly *hl = ta->dc->holly;
@@ -658,15 +630,12 @@ static void ta_yuv_process_macroblock(struct ta *ta, const void *data) {
       (pvr->TA_YUV_TEX_CNT->num / (pvr->TA_YUV_TEX_CTRL->u_size + 1)) * 16;
   uint8_t *out = &ta->yuv_data[(out_y * ta->yuv_width + out_x) << 1];
 
-  /* process each 8x8 subblock individually */
-  /* (0, 0) */
-  ta_yuv_process_block(ta, &in[0], &in[128], &out[0]);
-  /* (8, 0) */
-  ta_yuv_process_block(ta, &in[4], &in[192], &out[16]);
-  /* (0, 8) */
-  ta_yuv_process_block(ta, &in[32], &in[256], &out[ta->yuv_width * 16]);
-  /* (8, 8) */
-  ta_yuv_process_block(ta, &in[36], &in[320], &out[ta->yuv_width * 16 + 16]);
+  /* reencode the macroblock directly into its place in the output texture */
+  pvr_yuv420_decode(in, out, ta->yuv_width << 1);
+
+  /* mark the rows of the texture written to by the macroblock */
+  uint32_t out_addr = (uint32_t)(out - ta->vram);
+  pvr_mark_vram(pvr, out_addr, ta->yuv_width * 30 + 32);
 
   /* reset state once all macroblocks have been processed */
   pvr->TA_YUV_TEX_CNT->num++;
@@ -682,6 +651,78 @@ static void ta_yuv_process_macroblock(struct ta *ta, const void *data) {
 /*
  * ta device interface
  */
+static void ta_serialize_context(struct ta *ta, struct ta_context *ctx,
+                                 struct savestate *ss) {
+  SAVESTATE_VALUE(ss, ctx->addr);
+  SAVESTATE_VALUE(ss, ctx->rendering);
+  SAVESTATE_VALUE(ss, ctx->autosort);
+  SAVESTATE_VALUE(ss, ctx->stride);
+  SAVESTATE_VALUE(ss, ctx->palette_fmt);
+  SAVESTATE_VALUE(ss, ctx->video_width);
+  SAVESTATE_VALUE(ss, ctx->video_height);
+  SAVESTATE_VALUE(ss, ctx->alpha_ref);
+  SAVESTATE_VALUE(ss, ctx->bg_isp);
+  SAVESTATE_VALUE(ss, ctx->bg_tsp);
+  SAVESTATE_VALUE(ss, ctx->bg_tcw);
+  SAVESTATE_VALUE(ss, ctx->bg_depth);
+  SAVESTATE_VALUE(ss, ctx->bg_vertices);
+  SAVESTATE_VALUE(ss, ctx->cursor);
+  SAVESTATE_VALUE(ss, ctx->size);
+  SAVESTATE_VALUE(ss, ctx->list_type);
+  SAVESTATE_VALUE(ss, ctx->vert_type);
+
+  /* only the portion of the parameter buffer received so far is saved */
+  CHECK(ctx->size >= 0 && ctx->size <= (int)sizeof(ctx->params));
+  savestate_bytes(ss, ctx->params, ctx->size);
+
+  if (!savestate_loading(ss)) {
+    return;
+  }
+
+  /* rebuild the surfaces and vertices parsed from the received params */
+  if (!ctx->rc) {
+    ctx->rc = calloc(1, sizeof(struct tr_context));
+  }
+  ctx->userdata = ta;
+  tr_init_context(ctx->rc);
+  tr_parse_context(ctx, ctx->rc, ctx->cursor);
+}
+
+static void ta_serialize(struct device *dev, struct savestate *ss) {
+  struct ta *ta = (struct ta *)dev;
+  int num_contexts = ta->num_contexts;
+  int curr_context = ta->curr_context ? (int)(ta->curr_context - ta->contexts)
+                                      : -1;
+  int32_t yuv_data = ta->yuv_data ? (int32_t)(ta->yuv_data - ta->vram) : -1;
+
+  SAVESTATE_VALUE(ss, num_contexts);
+  SAVESTATE_VALUE(ss, curr_context);
+  CHECK(num_contexts >= 0 && num_contexts <= ARRAY_SIZE(ta->contexts));
+  CHECK_LT(curr_context, num_contexts);
+
+  /* contexts are never removed from the pool, release any created after the
+     snapshot was taken */
+  for (int i = num_contexts; i < ta->num_contexts; i++) {
+    free(ta->contexts[i].rc);
+    memset(&ta->contexts[i], 0, sizeof(ta->contexts[i]));
+  }
+
+  ta->num_contexts = num_contexts;
+  ta->curr_context = curr_context >= 0 ? &ta->contexts[curr_context] : NULL;
+
+  for (int i = 0; i < ta->num_contexts; i++) {
+    ta_serialize_context(ta, &ta->contexts[i], ss);
+  }
+
+  SAVESTATE_VALUE(ss, yuv_data);
+  SAVESTATE_VALUE(ss, ta->yuv_width);
+  SAVESTATE_VALUE(ss, ta->yuv_height);
+  SAVESTATE_VALUE(ss, ta->yuv_macroblock_size);
+  SAVESTATE_VALUE(ss, ta->yuv_macroblock_count);
+
+  ta->yuv_data = yuv_data >= 0 ? ta->vram + yuv_data : NULL;
+}
+
 static int ta_init(struct device *dev) {
   struct ta *ta = (struct ta *)dev;
   struct dreamcast *dc = ta->dc;
@@ -747,6 +788,7 @@ void ta_texture_write(struct ta *ta, uint32_t dst, const uint8_t *src,
 
   dst &= 0xeeffffff;
   memcpy(&ta->vram[dst], src, size);
+  pvr_mark_vram(ta->dc->pvr, dst, size);
 }
 
 void ta_yuv_write(struct ta *ta, uint32_t dst, const uint8_t *src, int size) {
@@ -775,6 +817,18 @@ void ta_poly_write(struct ta *ta, uint32_t dst, const uint8_t *src, int size) {
   }
 }
 
+void ta_copy_context(struct ta_context *dst, const struct ta_context *src) {
+  /* the param buffer makes up the bulk of the context, only copy the part of
+     it that's in use */
+  memcpy(dst, src, offsetof(struct ta_context, params));
+  memcpy(dst->params, src->params, src->size);
+  dst->cursor = src->cursor;
+  dst->size = src->size;
+  dst->list_type = src->list_type;
+  dst->vert_type = src->vert_type;
+  dst->rc = src->rc;
+}
+
 void ta_texture_info(struct ta *ta, union tsp tsp, union tcw tcw,
                      const uint8_t **texture, int *texture_size,
                      const uint8_t **palette, int *palette_size) {
@@ -820,6 +874,10 @@ void ta_soft_reset(struct ta *ta) {
 }
 
 void ta_destroy(struct ta *ta) {
+  for (int i = 0; i < ta->num_contexts; i++) {
+    free(ta->contexts[i].rc);
+  }
+
   dc_destroy_device((struct device *)ta);
 }
 
@@ -828,5 +886,9 @@ struct ta *ta_create(struct dreamcast *dc) {
 
   struct ta *ta = dc_create_device(dc, sizeof(struct ta), "ta", &ta_init, NULL);
 
+  /* setup state interface */
+  ta->stateif.enabled = 1;
+  ta->stateif.serialize = &ta_serialize;
+
   return ta;
 }
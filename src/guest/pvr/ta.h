@@ -15,6 +15,7 @@ void ta_start_render(struct ta *ta);
 void ta_list_init(struct ta *ta);
 void ta_list_cont(struct ta *ta);
 void ta_yuv_init(struct ta *ta);
+void ta_copy_context(struct ta_context *dst, const struct ta_context *src);
 void ta_texture_info(struct ta *ta, union tsp tsp, union tcw tcw,
                      const uint8_t **texture, int *texture_size,
                      const uint8_t **palette, int *palette_size);
@@ -416,6 +416,8 @@ union vert_param {
   } sprite1;
 };
 
+struct tr_context;
+
 struct ta_context {
   uint32_t addr;
   void *userdata;
@@ -443,6 +445,9 @@ struct ta_context {
   int list_type;
   int vert_type;
 
+  /* params parsed as they're received, may be NULL */
+  struct tr_context *rc;
+
   struct list_node it;
 };
 
@@ -2,6 +2,10 @@
 #include "core/core.h"
 #include "render/render_backend.h"
 
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
 /*
  * pixel formats
  */
@@ -282,6 +286,139 @@ static inline void RGBA_pack_twiddled(RGBA_type *dst, int x, int y, int stride,
   RGBA_pack(&dst[(y + 1) * stride + (x + 1)], rgba + 0xc);
 }
 
+#if ARCH_X64
+/*
+ * sse2 pixel formats
+ *
+ * each 16-bit format is unpacked 8 texels at a time into two vectors of 4 RGBA
+ * texels. the channels are expanded to 16-bit lanes, extended to 8 bits in the
+ * same manner as the scalar routines above, and finally interleaved
+ */
+static inline void RGBA_interleave(__m128i r, __m128i g, __m128i b, __m128i a,
+                                   __m128i *lo, __m128i *hi) {
+  __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+  __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+  *lo = _mm_unpacklo_epi16(rg, ba);
+  *hi = _mm_unpackhi_epi16(rg, ba);
+}
+
+static inline void ARGB1555_unpack8(__m128i src, __m128i *lo, __m128i *hi) {
+  const __m128i mask = _mm_set1_epi16(0x1f);
+  __m128i r = _mm_and_si128(_mm_srli_epi16(src, 10), mask);
+  __m128i g = _mm_and_si128(_mm_srli_epi16(src, 5), mask);
+  __m128i b = _mm_and_si128(src, mask);
+  __m128i a = _mm_srli_epi16(_mm_srai_epi16(src, 15), 8);
+  r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+  g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+  b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+  RGBA_interleave(r, g, b, a, lo, hi);
+}
+
+static inline void RGB565_unpack8(__m128i src, __m128i *lo, __m128i *hi) {
+  __m128i r = _mm_srli_epi16(src, 11);
+  __m128i g = _mm_and_si128(_mm_srli_epi16(src, 5), _mm_set1_epi16(0x3f));
+  __m128i b = _mm_and_si128(src, _mm_set1_epi16(0x1f));
+  __m128i a = _mm_set1_epi16(0xff);
+  r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+  g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+  b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+  RGBA_interleave(r, g, b, a, lo, hi);
+}
+
+static inline void ARGB4444_unpack8(__m128i src, __m128i *lo, __m128i *hi) {
+  const __m128i mask = _mm_set1_epi16(0xf);
+  __m128i r = _mm_and_si128(_mm_srli_epi16(src, 8), mask);
+  __m128i g = _mm_and_si128(_mm_srli_epi16(src, 4), mask);
+  __m128i b = _mm_and_si128(src, mask);
+  __m128i a = _mm_srli_epi16(src, 12);
+  r = _mm_or_si128(_mm_slli_epi16(r, 4), r);
+  g = _mm_or_si128(_mm_slli_epi16(g, 4), g);
+  b = _mm_or_si128(_mm_slli_epi16(b, 4), b);
+  a = _mm_or_si128(_mm_slli_epi16(a, 4), a);
+  RGBA_interleave(r, g, b, a, lo, hi);
+}
+
+static inline __m128i UYVY422_div(__m128i x, int shift) {
+  /* signed division by a power of two, rounding towards zero like C */
+  __m128i bias = _mm_srli_epi16(_mm_srai_epi16(x, 15), 16 - shift);
+  return _mm_srai_epi16(_mm_add_epi16(x, bias), shift);
+}
+
+static inline void UYVY422_unpack8(__m128i src, __m128i *lo, __m128i *hi) {
+  /* each pair of texels shares the u from the first and the v from the
+     second. the intermediate results all fit in 16 bits, and the final
+     clamp to 0-255 is handled by the saturating pack */
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi16(0xff);
+  __m128i y = _mm_srli_epi16(src, 8);
+  __m128i c = _mm_sub_epi16(_mm_and_si128(src, mask), _mm_set1_epi16(128));
+  __m128i u = _mm_shufflelo_epi16(c, _MM_SHUFFLE(2, 2, 0, 0));
+  u = _mm_shufflehi_epi16(u, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128i v = _mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 1, 1));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 1, 1));
+
+  __m128i u11 = _mm_mullo_epi16(u, _mm_set1_epi16(11));
+  __m128i v11 = _mm_mullo_epi16(v, _mm_set1_epi16(11));
+  __m128i u55 = _mm_mullo_epi16(u, _mm_set1_epi16(55));
+
+  __m128i r = _mm_add_epi16(y, UYVY422_div(v11, 3));
+  __m128i g = _mm_sub_epi16(
+      y, UYVY422_div(_mm_add_epi16(u11, _mm_slli_epi16(v11, 1)), 5));
+  __m128i b = _mm_add_epi16(y, UYVY422_div(u55, 5));
+
+  /* clamp, then zero-extend back to 16-bit lanes */
+  r = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), zero);
+  g = _mm_unpacklo_epi8(_mm_packus_epi16(g, g), zero);
+  b = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), zero);
+  RGBA_interleave(r, g, b, mask, lo, hi);
+}
+
+/* twiddled data is unpacked as two 2x2 blocks of texels. UYVY422 is the only
+   format where this differs from the bitmap unpacking, as its u / v pairs are
+   horizontal neighbors, which are the first and third texels of each block */
+#define ARGB1555_unpack8_twiddled ARGB1555_unpack8
+#define RGB565_unpack8_twiddled RGB565_unpack8
+#define ARGB4444_unpack8_twiddled ARGB4444_unpack8
+
+static inline void UYVY422_unpack8_twiddled(__m128i src, __m128i *lo,
+                                            __m128i *hi) {
+  src = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 1, 2, 0));
+  src = _mm_shufflehi_epi16(src, _MM_SHUFFLE(3, 1, 2, 0));
+  UYVY422_unpack8(src, lo, hi);
+  *lo = _mm_shuffle_epi32(*lo, _MM_SHUFFLE(3, 1, 2, 0));
+  *hi = _mm_shuffle_epi32(*hi, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline void RGBA_pack_tile(RGBA_type *dst, int x, int y, int stride,
+                                  __m128i b0, __m128i b1, __m128i b2,
+                                  __m128i b3) {
+  /* a 4x4 tile is made up of four 2x2 blocks, both of which are ordered
+     (0,0), (0,1), (1,0), (1,1). transpose them into rows */
+  b0 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(3, 1, 2, 0));
+  b1 = _mm_shuffle_epi32(b1, _MM_SHUFFLE(3, 1, 2, 0));
+  b2 = _mm_shuffle_epi32(b2, _MM_SHUFFLE(3, 1, 2, 0));
+  b3 = _mm_shuffle_epi32(b3, _MM_SHUFFLE(3, 1, 2, 0));
+
+  RGBA_type *row = &dst[y * stride + x];
+  _mm_storeu_si128((__m128i *)&row[0 * stride], _mm_unpacklo_epi64(b0, b2));
+  _mm_storeu_si128((__m128i *)&row[1 * stride], _mm_unpackhi_epi64(b0, b2));
+  _mm_storeu_si128((__m128i *)&row[2 * stride], _mm_unpacklo_epi64(b1, b3));
+  _mm_storeu_si128((__m128i *)&row[3 * stride], _mm_unpackhi_epi64(b1, b3));
+}
+
+static inline __m128i RGBA_lookup4(const RGBA_type *pal, int a, int b, int c,
+                                   int d) {
+  return _mm_set_epi32(pal[d], pal[c], pal[b], pal[a]);
+}
+
+static inline __m128i VQ_lookup2(const uint8_t *codebook, int a, int b) {
+  /* each codebook entry is 4x2 bytes long */
+  __m128i lo = _mm_loadl_epi64((const __m128i *)&codebook[a * 8]);
+  __m128i hi = _mm_loadl_epi64((const __m128i *)&codebook[b * 8]);
+  return _mm_unpacklo_epi64(lo, hi);
+}
+#endif
+
 /*
  * texture formats
  *
@@ -464,6 +601,202 @@ define_convert_vq(RGB565, RGBA);
 define_convert_vq(ARGB4444, RGBA);
 define_convert_vq(UYVY422, RGBA);
 
+#if ARCH_X64
+/*
+ * sse2 texture formats
+ *
+ * rather than looking up the twiddled index of each 2x2 block, the sse2
+ * routines walk the texture a 4x4 tile at a time, incrementing the x and y
+ * components of the tile's twiddled index directly in their interleaved form
+ */
+#define TWIDDLE_X_MASK 0xaaaaaaaa
+#define TWIDDLE_Y_MASK 0x55555555
+#define TWIDDLE_INC(t, mask) (((t) - (mask)) & (mask))
+
+#define define_convert_bitmap_sse2(FROM, TO)                                 \
+  void convert_bitmap_##FROM##_##TO##_sse2(const FROM##_type *src,           \
+                                           TO##_type *dst, int width,        \
+                                           int height, int stride) {         \
+    uint8_t rgba[4 * 4];                                                     \
+    __m128i lo, hi;                                                          \
+                                                                             \
+    for (int y = 0; y < height; y++) {                                       \
+      const FROM##_type *row = &src[y * stride];                             \
+      TO##_type *out = &dst[y * width];                                      \
+      int x = 0;                                                             \
+                                                                             \
+      for (; x + 8 <= width; x += 8) {                                       \
+        FROM##_unpack8(_mm_loadu_si128((const __m128i *)&row[x]), &lo, &hi); \
+        _mm_storeu_si128((__m128i *)&out[x + 0], lo);                        \
+        _mm_storeu_si128((__m128i *)&out[x + 4], hi);                        \
+      }                                                                      \
+                                                                             \
+      for (; x < width; x += 4) {                                            \
+        FROM##_unpack_bitmap(&row[x], rgba);                                 \
+        TO##_pack_bitmap(dst, x, y, width, rgba);                            \
+      }                                                                      \
+    }                                                                        \
+  }
+
+#define define_convert_twiddled_sse2(FROM, TO)                          \
+  void convert_twiddled_##FROM##_##TO##_sse2(const FROM##_type *src,    \
+                                             TO##_type *dst, int width, \
+                                             int height) {              \
+    __m128i b0, b1, b2, b3;                                             \
+    int size = MIN(width, height);                                      \
+    int base = 0;                                                       \
+                                                                        \
+    for (int y = 0; y < height; y += size) {                            \
+      for (int x = 0; x < width; x += size) {                           \
+        uint32_t ty = 0;                                                \
+        for (int y2 = 0; y2 < size; y2 += 4) {                          \
+          uint32_t tx = 0;                                              \
+          for (int x2 = 0; x2 < size; x2 += 4) {                        \
+            const FROM##_type *tile = &src[base + (ty | tx) * 16];      \
+            FROM##_unpack8_twiddled(                                    \
+                _mm_loadu_si128((const __m128i *)&tile[0]), &b0, &b1);  \
+            FROM##_unpack8_twiddled(                                    \
+                _mm_loadu_si128((const __m128i *)&tile[8]), &b2, &b3);  \
+            TO##_pack_tile(dst, x + x2, y + y2, width, b0, b1, b2, b3); \
+            tx = TWIDDLE_INC(tx, TWIDDLE_X_MASK);                       \
+          }                                                             \
+          ty = TWIDDLE_INC(ty, TWIDDLE_Y_MASK);                         \
+        }                                                               \
+        base += size * size;                                            \
+      }                                                                 \
+    }                                                                   \
+  }
+
+/* the paletted routines convert the palette up front, leaving a single lookup
+   per texel */
+#define define_convert_pal4_sse2(FROM, TO)                                   \
+  void convert_pal4_##FROM##_##TO##_sse2(const uint8_t *src, TO##_type *dst, \
+                                         const uint32_t *palette, int width, \
+                                         int height) {                       \
+    TO##_type pal[16];                                                       \
+    for (int i = 0; i < ARRAY_SIZE(pal); i++) {                              \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&pal[i]);            \
+    }                                                                        \
+                                                                             \
+    __m128i b0, b1, b2, b3;                                                  \
+    int size = MIN(width, height);                                           \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        uint32_t ty = 0;                                                     \
+        for (int y2 = 0; y2 < size; y2 += 4) {                               \
+          uint32_t tx = 0;                                                   \
+          for (int x2 = 0; x2 < size; x2 += 4) {                             \
+            const uint8_t *idx = &src[(base + (ty | tx) * 16) >> 1];         \
+            b0 = RGBA_lookup4(pal, idx[0] & 15, idx[0] >> 4, idx[1] & 15,    \
+                              idx[1] >> 4);                                  \
+            b1 = RGBA_lookup4(pal, idx[2] & 15, idx[2] >> 4, idx[3] & 15,    \
+                              idx[3] >> 4);                                  \
+            b2 = RGBA_lookup4(pal, idx[4] & 15, idx[4] >> 4, idx[5] & 15,    \
+                              idx[5] >> 4);                                  \
+            b3 = RGBA_lookup4(pal, idx[6] & 15, idx[6] >> 4, idx[7] & 15,    \
+                              idx[7] >> 4);                                  \
+            TO##_pack_tile(dst, x + x2, y + y2, width, b0, b1, b2, b3);      \
+            tx = TWIDDLE_INC(tx, TWIDDLE_X_MASK);                            \
+          }                                                                  \
+          ty = TWIDDLE_INC(ty, TWIDDLE_Y_MASK);                              \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
+#define define_convert_pal8_sse2(FROM, TO)                                   \
+  void convert_pal8_##FROM##_##TO##_sse2(const uint8_t *src, TO##_type *dst, \
+                                         const uint32_t *palette, int width, \
+                                         int height) {                       \
+    TO##_type pal[256];                                                      \
+    for (int i = 0; i < ARRAY_SIZE(pal); i++) {                              \
+      FROM##_unpack((FROM##_type)palette[i], (uint8_t *)&pal[i]);            \
+    }                                                                        \
+                                                                             \
+    __m128i b0, b1, b2, b3;                                                  \
+    int size = MIN(width, height);                                           \
+    int base = 0;                                                            \
+                                                                             \
+    for (int y = 0; y < height; y += size) {                                 \
+      for (int x = 0; x < width; x += size) {                                \
+        uint32_t ty = 0;                                                     \
+        for (int y2 = 0; y2 < size; y2 += 4) {                               \
+          uint32_t tx = 0;                                                   \
+          for (int x2 = 0; x2 < size; x2 += 4) {                             \
+            const uint8_t *idx = &src[base + (ty | tx) * 16];                \
+            b0 = RGBA_lookup4(pal, idx[0], idx[1], idx[2], idx[3]);          \
+            b1 = RGBA_lookup4(pal, idx[4], idx[5], idx[6], idx[7]);          \
+            b2 = RGBA_lookup4(pal, idx[8], idx[9], idx[10], idx[11]);        \
+            b3 = RGBA_lookup4(pal, idx[12], idx[13], idx[14], idx[15]);      \
+            TO##_pack_tile(dst, x + x2, y + y2, width, b0, b1, b2, b3);      \
+            tx = TWIDDLE_INC(tx, TWIDDLE_X_MASK);                            \
+          }                                                                  \
+          ty = TWIDDLE_INC(ty, TWIDDLE_Y_MASK);                              \
+        }                                                                    \
+        base += size * size;                                                 \
+      }                                                                      \
+    }                                                                        \
+  }
+
+#define define_convert_vq_sse2(FROM, TO)                                  \
+  void convert_vq_##FROM##_##TO##_sse2(const uint8_t *src,                \
+                                       const uint8_t *codebook,           \
+                                       TO##_type *dst, int width,         \
+                                       int height) {                      \
+    __m128i b0, b1, b2, b3;                                               \
+    int size = MIN(width, height);                                        \
+    int base = 0;                                                         \
+                                                                          \
+    for (int y = 0; y < height; y += size) {                              \
+      for (int x = 0; x < width; x += size) {                             \
+        uint32_t ty = 0;                                                  \
+        for (int y2 = 0; y2 < size; y2 += 4) {                            \
+          uint32_t tx = 0;                                                \
+          for (int x2 = 0; x2 < size; x2 += 4) {                          \
+            const uint8_t *idx = &src[(base + (ty | tx) * 16) / 4];       \
+            FROM##_unpack8_twiddled(VQ_lookup2(codebook, idx[0], idx[1]), \
+                                    &b0, &b1);                            \
+            FROM##_unpack8_twiddled(VQ_lookup2(codebook, idx[2], idx[3]), \
+                                    &b2, &b3);                            \
+            TO##_pack_tile(dst, x + x2, y + y2, width, b0, b1, b2, b3);   \
+            tx = TWIDDLE_INC(tx, TWIDDLE_X_MASK);                         \
+          }                                                               \
+          ty = TWIDDLE_INC(ty, TWIDDLE_Y_MASK);                           \
+        }                                                                 \
+        base += size * size;                                              \
+      }                                                                   \
+    }                                                                     \
+  }
+
+define_convert_bitmap_sse2(ARGB1555, RGBA);
+define_convert_bitmap_sse2(RGB565, RGBA);
+define_convert_bitmap_sse2(UYVY422, RGBA);
+define_convert_bitmap_sse2(ARGB4444, RGBA);
+
+define_convert_twiddled_sse2(ARGB1555, RGBA);
+define_convert_twiddled_sse2(RGB565, RGBA);
+define_convert_twiddled_sse2(UYVY422, RGBA);
+define_convert_twiddled_sse2(ARGB4444, RGBA);
+
+define_convert_pal4_sse2(ARGB1555, RGBA);
+define_convert_pal4_sse2(RGB565, RGBA);
+define_convert_pal4_sse2(ARGB4444, RGBA);
+define_convert_pal4_sse2(ARGB8888, RGBA);
+
+define_convert_pal8_sse2(ARGB1555, RGBA);
+define_convert_pal8_sse2(RGB565, RGBA);
+define_convert_pal8_sse2(ARGB4444, RGBA);
+define_convert_pal8_sse2(ARGB8888, RGBA);
+
+define_convert_vq_sse2(ARGB1555, RGBA);
+define_convert_vq_sse2(RGB565, RGBA);
+define_convert_vq_sse2(ARGB4444, RGBA);
+define_convert_vq_sse2(UYVY422, RGBA);
+#endif
+
 /*
  * texture loading
  */
@@ -574,9 +907,23 @@ const uint8_t *pvr_tex_data(const uint8_t *src) {
   return data;
 }
 
-void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
-                    int texture_fmt, int pixel_fmt, const uint8_t *palette,
-                    int palette_fmt, uint8_t *dst, int size) {
+/* use the sse2 converters when requested, and when the texture is large enough
+   for them to walk it a 4x4 tile at a time */
+#if ARCH_X64
+#define CONVERT(fn, ...)                 \
+  if (simd && MIN(width, height) >= 4) { \
+    fn##_sse2(__VA_ARGS__);              \
+  } else {                               \
+    fn(__VA_ARGS__);                     \
+  }
+#else
+#define CONVERT(fn, ...) fn(__VA_ARGS__)
+#endif
+
+static void pvr_tex_decode_ex(const uint8_t *src, int width, int height,
+                              int stride, int texture_fmt, int pixel_fmt,
+                              const uint8_t *palette, int palette_fmt,
+                              uint8_t *dst, int size, int simd) {
   int twiddled = pvr_tex_twiddled(texture_fmt);
   int compressed = pvr_tex_compressed(texture_fmt);
   int mipmaps = pvr_tex_mipmaps(texture_fmt);
@@ -612,41 +959,47 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
     case PVR_PXL_ARGB1555:
     case PVR_PXL_RESERVED:
       if (compressed) {
-        convert_vq_ARGB1555_RGBA(index, codebook, dst32, width, height);
+        CONVERT(convert_vq_ARGB1555_RGBA, index, codebook, dst32, width,
+                height);
       } else if (twiddled) {
-        convert_twiddled_ARGB1555_RGBA(src16, dst32, width, height);
+        CONVERT(convert_twiddled_ARGB1555_RGBA, src16, dst32, width, height);
       } else {
-        convert_bitmap_ARGB1555_RGBA(src16, dst32, width, height, stride);
+        CONVERT(convert_bitmap_ARGB1555_RGBA, src16, dst32, width, height,
+                stride);
       }
       break;
 
     case PVR_PXL_RGB565:
       if (compressed) {
-        convert_vq_RGB565_RGBA(index, codebook, dst32, width, height);
+        CONVERT(convert_vq_RGB565_RGBA, index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_RGB565_RGBA(src16, dst32, width, height);
+        CONVERT(convert_twiddled_RGB565_RGBA, src16, dst32, width, height);
       } else {
-        convert_bitmap_RGB565_RGBA(src16, dst32, width, height, stride);
+        CONVERT(convert_bitmap_RGB565_RGBA, src16, dst32, width, height,
+                stride);
       }
       break;
 
     case PVR_PXL_ARGB4444:
       if (compressed) {
-        convert_vq_ARGB4444_RGBA(index, codebook, dst32, width, height);
+        CONVERT(convert_vq_ARGB4444_RGBA, index, codebook, dst32, width,
+                height);
       } else if (twiddled) {
-        convert_twiddled_ARGB4444_RGBA(src16, dst32, width, height);
+        CONVERT(convert_twiddled_ARGB4444_RGBA, src16, dst32, width, height);
       } else {
-        convert_bitmap_ARGB4444_RGBA(src16, dst32, width, height, stride);
+        CONVERT(convert_bitmap_ARGB4444_RGBA, src16, dst32, width, height,
+                stride);
       }
       break;
 
     case PVR_PXL_YUV422:
       if (compressed) {
-        convert_vq_UYVY422_RGBA(index, codebook, dst32, width, height);
+        CONVERT(convert_vq_UYVY422_RGBA, index, codebook, dst32, width, height);
       } else if (twiddled) {
-        convert_twiddled_UYVY422_RGBA(src16, dst32, width, height);
+        CONVERT(convert_twiddled_UYVY422_RGBA, src16, dst32, width, height);
       } else {
-        convert_bitmap_UYVY422_RGBA(src16, dst32, width, height, stride);
+        CONVERT(convert_bitmap_UYVY422_RGBA, src16, dst32, width, height,
+                stride);
       }
       break;
 
@@ -654,19 +1007,19 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal4_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal4_ARGB1555_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal4_RGB565_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal4_RGB565_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal4_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal4_ARGB4444_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal4_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal4_ARGB8888_RGBA, src, dst32, pal32, width, height);
           break;
 
         default:
@@ -680,19 +1033,19 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       CHECK(!compressed);
       switch (palette_fmt) {
         case PVR_PAL_ARGB1555:
-          convert_pal8_ARGB1555_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal8_ARGB1555_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_RGB565:
-          convert_pal8_RGB565_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal8_RGB565_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB4444:
-          convert_pal8_ARGB4444_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal8_ARGB4444_RGBA, src, dst32, pal32, width, height);
           break;
 
         case PVR_PAL_ARGB8888:
-          convert_pal8_ARGB8888_RGBA(src, dst32, pal32, width, height);
+          CONVERT(convert_pal8_ARGB8888_RGBA, src, dst32, pal32, width, height);
           break;
 
         default:
@@ -707,3 +1060,87 @@ void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
       break;
   }
 }
+
+/*
+ * yuv420 macroblock reencoding
+ *
+ * each 16x16 macroblock is made up of an 8x8 block of u samples, an 8x8 block
+ * of v samples and four 8x8 blocks of y samples, ordered top left, top right,
+ * bottom left and bottom right. each u / v sample is shared by a 2x2 quad of y
+ * samples, so each pair of output rows is built from the same row of u / v
+ */
+static void yuv420_macroblock_UYVY422(const uint8_t *src, uint8_t *dst,
+                                      int stride) {
+  const uint8_t *in_u = src;
+  const uint8_t *in_v = src + 64;
+
+  for (int y = 0; y < 16; y++) {
+    const uint8_t *u = &in_u[(y >> 1) * 8];
+    const uint8_t *v = &in_v[(y >> 1) * 8];
+    const uint8_t *in_y = &src[128 + (y >> 3) * 128 + (y & 7) * 8];
+    uint8_t *out = &dst[y * stride];
+
+    for (int x = 0; x < 16; x += 2) {
+      const uint8_t *row = &in_y[(x >> 3) * 64 + (x & 7)];
+      out[0] = u[x >> 1];
+      out[1] = row[0];
+      out[2] = v[x >> 1];
+      out[3] = row[1];
+      out += 4;
+    }
+  }
+}
+
+#if ARCH_X64
+/* a row of u / v samples is interleaved once for both rows of y samples that
+   share it, and each 16 texel row is written out as two 16 byte stores */
+static void yuv420_macroblock_UYVY422_sse2(const uint8_t *src, uint8_t *dst,
+                                           int stride) {
+  const uint8_t *in_u = src;
+  const uint8_t *in_v = src + 64;
+  const uint8_t *in_y = src + 128;
+
+  for (int y = 0; y < 16; y += 2) {
+    __m128i u = _mm_loadl_epi64((const __m128i *)&in_u[(y >> 1) * 8]);
+    __m128i v = _mm_loadl_epi64((const __m128i *)&in_v[(y >> 1) * 8]);
+    __m128i uv = _mm_unpacklo_epi8(u, v);
+
+    for (int i = 0; i < 2; i++) {
+      const uint8_t *row = &in_y[((y + i) >> 3) * 128 + ((y + i) & 7) * 8];
+      __m128i y_lo = _mm_loadl_epi64((const __m128i *)&row[0]);
+      __m128i y_hi = _mm_loadl_epi64((const __m128i *)&row[64]);
+      __m128i yy = _mm_unpacklo_epi64(y_lo, y_hi);
+
+      __m128i *out = (__m128i *)&dst[(y + i) * stride];
+      _mm_storeu_si128(&out[0], _mm_unpacklo_epi8(uv, yy));
+      _mm_storeu_si128(&out[1], _mm_unpackhi_epi8(uv, yy));
+    }
+  }
+}
+#endif
+
+void pvr_yuv420_decode_ref(const uint8_t *src, uint8_t *dst, int stride) {
+  yuv420_macroblock_UYVY422(src, dst, stride);
+}
+
+void pvr_yuv420_decode(const uint8_t *src, uint8_t *dst, int stride) {
+#if ARCH_X64
+  yuv420_macroblock_UYVY422_sse2(src, dst, stride);
+#else
+  yuv420_macroblock_UYVY422(src, dst, stride);
+#endif
+}
+
+void pvr_tex_decode_ref(const uint8_t *src, int width, int height, int stride,
+                        int texture_fmt, int pixel_fmt, const uint8_t *palette,
+                        int palette_fmt, uint8_t *dst, int size) {
+  pvr_tex_decode_ex(src, width, height, stride, texture_fmt, pixel_fmt,
+                    palette, palette_fmt, dst, size, 0);
+}
+
+void pvr_tex_decode(const uint8_t *src, int width, int height, int stride,
+                    int texture_fmt, int pixel_fmt, const uint8_t *palette,
+                    int palette_fmt, uint8_t *dst, int size) {
+  pvr_tex_decode_ex(src, width, height, stride, texture_fmt, pixel_fmt,
+                    palette, palette_fmt, dst, size, 1);
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #define PVR_CODEBOOK_SIZE (256 * 8)
+#define PVR_YUV420_MACROBLOCK_SIZE 384
 
 enum pvr_texture_fmt {
   PVR_TEX_INVALID = 0x0,
@@ -78,4 +79,16 @@ void pvr_tex_decode(const uint8_t *data, int width, int height, int stride,
                     int texture_fmt, int pixel_fmt, const uint8_t *palette,
                     int pal_pixel_fmt, uint8_t *out, int size);
 
+/* scalar reference implementation of pvr_tex_decode */
+void pvr_tex_decode_ref(const uint8_t *data, int width, int height, int stride,
+                        int texture_fmt, int pixel_fmt, const uint8_t *palette,
+                        int pal_pixel_fmt, uint8_t *out, int size);
+
+/* reencode a single 16x16 yuv420 macroblock as uyvy422 texels, stride is the
+   distance in bytes between each row of the destination texture */
+void pvr_yuv420_decode(const uint8_t *src, uint8_t *dst, int stride);
+
+/* scalar reference implementation of pvr_yuv420_decode */
+void pvr_yuv420_decode_ref(const uint8_t *src, uint8_t *dst, int stride);
+
 #endif
@@ -7,27 +7,137 @@
 
 #include "guest/pvr/tr.h"
 #include "core/core.h"
+#include "core/hash.h"
 #include "core/sort.h"
+#include "core/thread_pool.h"
+#include "core/time.h"
+#include "file/tex_cache.h"
 #include "guest/pvr/ta.h"
 #include "guest/pvr/tex.h"
+#include "guest/pvr/tr_vert.h"
+#include "options.h"
+#include "stats.h"
+
+/* contexts with fewer surfaces than this are finalized serially, as the cost
+   of waking the workers outweighs the work itself */
+#define TR_PARALLEL_MIN_SURFS 2048
+
+/* max number of texture decodes in flight before they're flushed */
+#define TR_MAX_TEXTURE_JOBS 1024
+
+/* everything besides the source data which affects the decoded texture */
+struct tr_texture_desc {
+  int texture_fmt;
+  int pixel_fmt;
+  int palette_fmt;
+  int mipmaps;
+  int width;
+  int height;
+  int stride;
+  int filter;
+  int wrap_u;
+  int wrap_v;
+};
+
+/* decoded texture uploaded to the render backend, shared by each cache entry
+   whose source data and format hash to the same value. the description and
+   source sizes are kept to rule out hash collisions between textures that
+   can't be the same */
+struct tr_host_texture {
+  uint64_t hash;
+  struct tr_texture_desc desc;
+  int texture_size;
+  int palette_size;
+  texture_handle_t handle;
+  int refs;
+  int size;
+  struct list_node it;
+
+  /* copy of the source data, held until the texture is first decoded. this
+     lets the texture be resolved on one thread and decoded on another, with
+     guest memory being free to change in between */
+  uint8_t *source;
+
+  /* decode in flight while the context referencing the texture is converted */
+  struct tr_texture_job *job;
+};
+
+struct tr_texture_job {
+  struct tr_host_texture *host;
+  uint64_t hash;
+  struct tex_cache *cache;
+
+  /* source info */
+  const uint8_t *texture;
+  const uint8_t *palette;
+  int texture_fmt;
+  int pixel_fmt;
+  int palette_fmt;
+  int mipmaps;
+  int width;
+  int height;
+  int stride;
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+
+  /* decoded output */
+  uint8_t *data;
+  int size;
+
+  /* timestamps used to measure the decode latency */
+  int64_t queued;
+  int64_t decoded;
+};
+
+struct tr_deferred_surf {
+  int surf;
+  struct tr_texture *entry;
+};
 
 struct tr {
   struct render_backend *r;
   void *userdata;
   tr_find_texture_cb find_texture;
 
-  /* current global state */
-  const union vert_param *last_vertex;
-  int list_type;
-  int vert_type;
-  /* poly params */
-  uint8_t face_color[4];
-  uint8_t face_offset_color[4];
-  /* sprite params */
-  uint8_t sprite_color[4];
-  uint8_t sprite_offset_color[4];
+  /* current global state, accessible as a whole in order to save / restore it
+     between incremental parses */
+  union {
+    struct tr_state state;
+    struct tr_state;
+  };
+
+  /* texture decodes in flight, and the surfaces waiting on them */
+  int num_texture_jobs;
+  int num_deferred;
+
+  /* decode stats */
+  int num_decodes;
+  int max_texture_jobs;
+  int64_t decode_latency;
 };
 
+static struct tr_texture_job tr_texture_jobs[TR_MAX_TEXTURE_JOBS];
+static struct tr_deferred_surf tr_deferred_surfs[TR_MAX_SURFS];
+static DECLARE_HASHTABLE(tr_host_textures, 12);
+static struct tex_cache *tr_tex_cache;
+
+static struct thread_pool *tr_pool;
+static int tr_pool_threads;
+
+static struct thread_pool *tr_thread_pool() {
+  int num_threads = MAX(OPTION_render_threads, 0);
+
+  /* the pool is created lazily, and recreated if the option changes */
+  if (num_threads != tr_pool_threads) {
+    thread_pool_destroy(tr_pool);
+    tr_pool = num_threads ? thread_pool_create(num_threads) : NULL;
+    tr_pool_threads = num_threads;
+  }
+
+  return tr_pool;
+}
+
 static int compressed_mipmap_offsets[] = {
     0x00006, /* 8 x 8 */
     0x00016, /* 16 x 16 */
@@ -109,30 +219,178 @@ static inline enum shade_mode translate_shade_mode(uint32_t shade_mode) {
   return shade_modes[shade_mode];
 }
 
-static texture_handle_t tr_convert_texture(struct tr *tr,
-                                           const struct ta_context *ctx,
-                                           union tsp tsp, union tcw tcw) {
-  /* TODO it's bad that textures are only cached based off tsp / tcw yet the
-     TEXT_CONTROL registers and PAL_RAM_CTRL registers are used here to control
-     texture generation */
+static void tr_decode_texture(void *data) {
+  struct tr_texture_job *job = data;
 
-  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
-  CHECK_NOTNULL(entry);
+  /* try the disk cache before decoding, adding the texture to it on a miss */
+  if (!job->cache ||
+      !tex_cache_read(job->cache, job->hash, job->data, job->size)) {
+    pvr_tex_decode(job->texture, job->width, job->height, job->stride,
+                   job->texture_fmt, job->pixel_fmt, job->palette,
+                   job->palette_fmt, job->data, job->size);
 
-  /* if there's a non-dirty handle, return it */
-  if (entry->handle && !entry->dirty) {
-    return entry->handle;
+    if (job->cache) {
+      tex_cache_write(job->cache, job->hash, job->data, job->size);
+    }
   }
 
-  /* if there's a dirty handle, destroy it before creating the new one */
-  if (entry->handle && entry->dirty) {
-    r_destroy_texture(tr->r, entry->handle);
-    entry->handle = 0;
+  job->decoded = time_nanoseconds();
+}
+
+static void tr_upload_textures(struct tr *tr) {
+  if (!tr->num_texture_jobs) {
+    return;
+  }
+
+  /* the decodes were queued on the pool, wait for any that are outstanding */
+  struct thread_pool *pool = tr_thread_pool();
+  if (pool) {
+    thread_pool_wait(pool);
+  }
+
+  /* uploads are made from the calling thread, as the render backend isn't
+     thread-safe */
+  for (int i = 0; i < tr->num_texture_jobs; i++) {
+    struct tr_texture_job *job = &tr_texture_jobs[i];
+    struct tr_host_texture *host = job->host;
+
+    /* textures are decoded but not uploaded when converting headlessly, e.g.
+       when prebuilding the texture cache */
+    if (tr->r) {
+      host->handle =
+          r_create_texture(tr->r, PXL_RGBA, job->filter, job->wrap_u,
+                           job->wrap_v, job->mipmaps, job->width, job->height,
+                           job->data);
+    }
+    host->job = NULL;
+
+    /* the source data is no longer needed once decoded */
+    free(host->source);
+    host->source = NULL;
+
+    tr->decode_latency += job->decoded - job->queued;
+    free(job->data);
+  }
+
+  tr->num_decodes += tr->num_texture_jobs;
+  tr->num_texture_jobs = 0;
+}
+
+static void tr_decode_host_texture(struct tr *tr,
+                                   struct tr_host_texture *host) {
+  const struct tr_texture_desc *desc = &host->desc;
+
+  /* make room for the new job by flushing the outstanding ones */
+  if (tr->num_texture_jobs >= TR_MAX_TEXTURE_JOBS) {
+    tr_upload_textures(tr);
+  }
+
+  struct tr_texture_job *job = &tr_texture_jobs[tr->num_texture_jobs++];
+  job->host = host;
+  job->hash = host->hash;
+  job->cache = tr_tex_cache;
+  job->texture = host->source;
+  job->palette =
+      host->palette_size ? host->source + host->texture_size : NULL;
+  job->texture_fmt = desc->texture_fmt;
+  job->pixel_fmt = desc->pixel_fmt;
+  job->palette_fmt = desc->palette_fmt;
+  job->mipmaps = desc->mipmaps;
+  job->width = desc->width;
+  job->height = desc->height;
+  job->stride = desc->stride;
+  job->filter = desc->filter;
+  job->wrap_u = desc->wrap_u;
+  job->wrap_v = desc->wrap_v;
+
+  /* each job decodes to its own buffer, freed once it's been uploaded */
+  job->size = host->size;
+  job->data = malloc(job->size);
+  CHECK_NOTNULL(job->data);
+
+  host->job = job;
+  job->queued = time_nanoseconds();
+
+  struct thread_pool *pool = tr_thread_pool();
+  if (pool) {
+    thread_pool_submit(pool, &tr_decode_texture, job);
+  } else {
+    tr_decode_texture(job);
   }
 
-  static uint8_t converted[1024 * 1024 * 4];
-  const uint8_t *palette = entry->palette;
-  const uint8_t *texture = entry->texture;
+  tr->max_texture_jobs = MAX(tr->max_texture_jobs, tr->num_texture_jobs);
+}
+
+static struct tr_host_texture *tr_find_host_texture(
+    uint64_t hash, const struct tr_texture_desc *desc, int texture_size,
+    int palette_size) {
+  struct list *bkt = hash_bkt(tr_host_textures, hash);
+
+  hash_bkt_for_each_entry(host, bkt, struct tr_host_texture, it) {
+    if (host->hash == hash && host->texture_size == texture_size &&
+        host->palette_size == palette_size &&
+        !memcmp(&host->desc, desc, sizeof(*desc))) {
+      return host;
+    }
+  }
+
+  return NULL;
+}
+
+void tr_set_texture_cache(struct tex_cache *cache) {
+  tr_tex_cache = cache;
+}
+
+void tr_destroy_host_texture(struct render_backend *r,
+                             struct tr_host_texture *host) {
+  CHECK(!host->job);
+
+  if (host->handle) {
+    r_destroy_texture(r, host->handle);
+  }
+
+  free(host->source);
+  free(host);
+}
+
+struct tr_host_texture *tr_unref_texture(struct tr_texture *entry) {
+  struct tr_host_texture *host = entry->host;
+
+  entry->host = NULL;
+  entry->handle = 0;
+
+  if (!host) {
+    return NULL;
+  }
+
+  /* the host texture is destroyed once the last entry sharing it is gone */
+  if (--host->refs) {
+    prof_counter_add(COUNTER_tex_bytes_saved, -host->size);
+    return NULL;
+  }
+
+  hash_del(hash_bkt(tr_host_textures, host->hash), &host->it);
+
+  return host;
+}
+
+void tr_release_texture(struct render_backend *r, struct tr_texture *entry) {
+  struct tr_host_texture *host = tr_unref_texture(entry);
+
+  if (host) {
+    tr_destroy_host_texture(r, host);
+  }
+}
+
+void tr_resolve_texture(const struct ta_context *ctx,
+                        struct tr_texture *entry) {
+  /* TODO it's bad that textures are only cached based off tsp / tcw yet the
+     TEXT_CONTROL registers and PAL_RAM_CTRL registers are used here to control
+     texture generation */
+  union tsp tsp = entry->tsp;
+  union tcw tcw = entry->tcw;
+
+  CHECK(!entry->host);
 
   /* get texture dimensions */
   int texture_fmt = ta_texture_format(tcw);
@@ -141,10 +399,6 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
   int height = ta_texture_height(tsp, tcw);
   int stride = ta_texture_stride(tsp, tcw, ctx->stride);
 
-  /* figure out the texture format */
-  pvr_tex_decode(texture, width, height, stride, texture_fmt, tcw.pixel_fmt,
-                 palette, ctx->palette_fmt, converted, sizeof(converted));
-
   /* ignore trilinear filtering for now */
   enum filter_mode filter =
       tsp.filter_mode == 0 ? FILTER_NEAREST : FILTER_BILINEAR;
@@ -155,8 +409,6 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
       tsp.clamp_v ? WRAP_CLAMP_TO_EDGE
                   : (tsp.flip_v ? WRAP_MIRRORED_REPEAT : WRAP_REPEAT);
 
-  entry->handle = r_create_texture(tr->r, PXL_RGBA, filter, wrap_u, wrap_v,
-                                   mipmaps, width, height, converted);
   entry->filter = filter;
   entry->wrap_u = wrap_u;
   entry->wrap_v = wrap_v;
@@ -165,7 +417,125 @@ static texture_handle_t tr_convert_texture(struct tr *tr,
   entry->height = height;
   entry->dirty = 0;
 
-  return entry->handle;
+  /* hash the source data along with everything else affecting the decoded
+     output, so that identical textures living at different addresses, or
+     re-uploaded to a new address, share the same host texture */
+  struct tr_texture_desc desc = {0};
+  desc.texture_fmt = texture_fmt;
+  desc.pixel_fmt = tcw.pixel_fmt;
+  desc.palette_fmt = ctx->palette_fmt;
+  desc.mipmaps = mipmaps;
+  desc.width = width;
+  desc.height = height;
+  desc.stride = stride;
+  desc.filter = filter;
+  desc.wrap_u = wrap_u;
+  desc.wrap_v = wrap_v;
+
+  uint64_t hash = hash_data(&desc, sizeof(desc), 0);
+  hash = hash_data(entry->texture, entry->texture_size, hash);
+  if (entry->palette) {
+    hash = hash_data(entry->palette, entry->palette_size, hash);
+  }
+
+  int palette_size = entry->palette ? entry->palette_size : 0;
+  struct tr_host_texture *host =
+      tr_find_host_texture(hash, &desc, entry->texture_size, palette_size);
+
+  if (host) {
+    host->refs++;
+    entry->host = host;
+
+    prof_counter_add(COUNTER_tex_hits, 1);
+    prof_counter_add(COUNTER_tex_bytes_saved, host->size);
+    return;
+  }
+
+  prof_counter_add(COUNTER_tex_misses, 1);
+
+  host = calloc(1, sizeof(*host));
+  CHECK_NOTNULL(host);
+  host->hash = hash;
+  host->desc = desc;
+  host->texture_size = entry->texture_size;
+  host->palette_size = palette_size;
+  host->refs = 1;
+  host->size = width * height * 4;
+  hash_add(hash_bkt(tr_host_textures, hash), &host->it);
+
+  /* the palette is stored after the texture data */
+  host->source = malloc(entry->texture_size + palette_size);
+  CHECK_NOTNULL(host->source);
+  memcpy(host->source, entry->texture, entry->texture_size);
+  if (palette_size) {
+    memcpy(host->source + entry->texture_size, entry->palette, palette_size);
+  }
+
+  entry->host = host;
+}
+
+static struct tr_texture *tr_convert_texture(struct tr *tr,
+                                             const struct ta_context *ctx,
+                                             union tsp tsp, union tcw tcw) {
+  struct tr_texture *entry = tr->find_texture(tr->userdata, tsp, tcw);
+  CHECK_NOTNULL(entry);
+
+  /* entries given a handle up front by the caller are used as is */
+  if (!entry->dirty && !entry->host && entry->handle) {
+    return entry;
+  }
+
+  /* if there's a dirty handle, release it before creating the new one */
+  if (entry->dirty) {
+    tr_release_texture(tr->r, entry);
+  }
+
+  if (!entry->host) {
+    tr_resolve_texture(ctx, entry);
+  }
+
+  /* host textures are decoded the first time a context referencing them is
+     converted. until the decode completes, the entry's handle is left unset */
+  struct tr_host_texture *host = entry->host;
+
+  if (host->source && !host->job) {
+    tr_decode_host_texture(tr, host);
+  }
+
+  if (!host->job) {
+    entry->handle = host->handle;
+  }
+
+  return entry;
+}
+
+static void tr_bind_texture(struct tr *tr, struct tr_context *rc, int surf,
+                            struct tr_texture *entry) {
+  texture_handle_t handle = 0;
+
+  /* surfaces referencing a texture that's still being decoded are bound once
+     the decode completes, see tr_bind_deferred */
+  if (entry && entry->host && entry->host->job) {
+    struct tr_deferred_surf *deferred = &tr_deferred_surfs[tr->num_deferred++];
+    deferred->surf = surf;
+    deferred->entry = entry;
+  } else if (entry) {
+    handle = entry->handle;
+  }
+
+  rc->surfs[surf].params.texture = handle;
+}
+
+static void tr_bind_deferred(struct tr *tr, struct tr_context *rc) {
+  for (int i = 0; i < tr->num_deferred; i++) {
+    struct tr_deferred_surf *deferred = &tr_deferred_surfs[i];
+    struct tr_texture *entry = deferred->entry;
+
+    entry->handle = entry->host->handle;
+    rc->surfs[deferred->surf].params.texture = entry->handle;
+  }
+
+  tr->num_deferred = 0;
 }
 
 static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
@@ -178,8 +548,10 @@ static struct ta_surface *tr_reserve_surf(struct tr *tr, struct tr_context *rc,
   if (copy_from_prev) {
     CHECK(rc->num_surfs);
     *surf = rc->surfs[rc->num_surfs - 1];
+    rc->surf_polys[surf_index] = rc->surf_polys[rc->num_surfs - 1];
   } else {
     memset(surf, 0, sizeof(*surf));
+    rc->surf_polys[surf_index] = tr->last_poly;
   }
 
   surf->first_vert = rc->num_verts;
@@ -251,75 +623,6 @@ static void tr_commit_surf(struct tr *tr, struct tr_context *rc) {
   }
 }
 
-/*
-* polygon parsing helpers
-*/
-static inline uint8_t ftou8(float x) {
-  /* saturating floating point to uint8_t conversion */
-  return MIN(MAX((int32_t)(x * 255.0f), 0), 255);
-}
-
-static inline uint8_t fmulu8(uint8_t a, uint8_t b) {
-  /* fixed point multiply */
-  return (uint8_t)((uint32_t)a * (uint32_t)b / 255);
-}
-
-#define PARSE_XYZ(xyz, out) \
-  {                         \
-    (out)[0] = (xyz)[0];    \
-    (out)[1] = (xyz)[1];    \
-    (out)[2] = (xyz)[2];    \
-  }
-
-#define PARSE_UV(uv, out) \
-  {                       \
-    (out)[0] = (uv)[0];   \
-    (out)[1] = (uv)[1];   \
-  }
-
-#define PARSE_UV16(uv, out)     \
-  {                             \
-    uint32_t u = (uv)[1] << 16; \
-    uint32_t v = (uv)[0] << 16; \
-    (out)[0] = *(float *)&u;    \
-    (out)[1] = *(float *)&v;    \
-  }
-
-#define PARSE_FLOAT_COLOR(color, out)                                 \
-  {                                                                   \
-    /* when converting from float point to a packed color, clamp each \
-       component to 0-255 */                                          \
-    ((uint8_t *)out)[0] = ftou8(color##_r);                           \
-    ((uint8_t *)out)[1] = ftou8(color##_g);                           \
-    ((uint8_t *)out)[2] = ftou8(color##_b);                           \
-    ((uint8_t *)out)[3] = ftou8(color##_a);                           \
-  }
-
-#define PARSE_PACKED_COLOR(color, out)                \
-  {                                                   \
-    ((uint8_t *)out)[0] = (color & 0x00ff0000) >> 16; \
-    ((uint8_t *)out)[1] = (color & 0x0000ff00) >> 8;  \
-    ((uint8_t *)out)[2] = (color & 0x000000ff);       \
-    ((uint8_t *)out)[3] = (color & 0xff000000) >> 24; \
-  }
-
-#define PARSE_INTENSITY(color, intensity, out)                           \
-  {                                                                      \
-    /* when converting from intensity to a packed color, each operand is \
-       clamped to 0-255 before multiplication */                         \
-    uint8_t i = ftou8(intensity);                                        \
-    ((uint8_t *)out)[0] = fmulu8(color[0], i);                           \
-    ((uint8_t *)out)[1] = fmulu8(color[1], i);                           \
-    ((uint8_t *)out)[2] = fmulu8(color[2], i);                           \
-    ((uint8_t *)out)[3] = color[3];                                      \
-  }
-
-#define PARSE_BASE_INTENSITY(base_intensity, out) \
-  PARSE_INTENSITY(tr->face_color, base_intensity, out)
-
-#define PARSE_OFFSET_INTENSITY(offset_intensity, out) \
-  PARSE_INTENSITY(tr->face_offset_color, offset_intensity, out)
-
 static int tr_parse_bg_vert(const struct ta_context *ctx, struct tr_context *rc,
                             int offset, struct ta_vertex *v) {
   PARSE_XYZ((float *)&ctx->bg_vertices[offset], v->xyz);
@@ -346,27 +649,31 @@ static int tr_parse_bg_vert(const struct ta_context *ctx, struct tr_context *rc,
 
 static void tr_parse_bg(struct tr *tr, const struct ta_context *ctx,
                         struct tr_context *rc) {
-  tr->list_type = TA_LIST_OPAQUE;
-
-  /* translate the surface */
-  struct ta_surface *surf = tr_reserve_surf(tr, rc, 0);
+  /* the background's surface and vertices are reserved by tr_init_context, as
+     its state isn't available until rendering starts */
+  struct ta_surface *surf = &rc->surfs[0];
+  memset(surf, 0, sizeof(*surf));
 
-  surf->params.texture =
+  struct tr_texture *entry =
       ctx->bg_isp.texture
           ? tr_convert_texture(tr, ctx, ctx->bg_tsp, ctx->bg_tcw)
-          : 0;
+          : NULL;
+  tr_bind_texture(tr, rc, 0, entry);
   surf->params.depth_write = !ctx->bg_isp.z_write_disable;
   surf->params.depth_func =
       translate_depth_func(ctx->bg_isp.depth_compare_mode);
   surf->params.cull = translate_cull(ctx->bg_isp.culling_mode);
   surf->params.src_blend = BLEND_NONE;
   surf->params.dst_blend = BLEND_NONE;
+  surf->first_vert = 0;
+  surf->num_verts = 4;
 
   /* translate the first 3 vertices */
-  struct ta_vertex *va = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vb = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vd = tr_reserve_vert(tr, rc);
-  struct ta_vertex *vc = tr_reserve_vert(tr, rc);
+  struct ta_vertex *va = &rc->verts[0];
+  struct ta_vertex *vb = &rc->verts[1];
+  struct ta_vertex *vd = &rc->verts[2];
+  struct ta_vertex *vc = &rc->verts[3];
+  memset(rc->verts, 0, sizeof(rc->verts[0]) * 4);
 
   int offset = 0;
   offset = tr_parse_bg_vert(ctx, rc, offset, va);
@@ -436,10 +743,6 @@ static void tr_parse_bg(struct tr *tr, const struct ta_context *ctx,
   /* TODO interpolate this properly when a game is found to test with */
   vd->color = va->color;
   vd->offset_color = va->offset_color;
-
-  tr_commit_surf(tr, rc);
-
-  tr->list_type = TA_NUM_LISTS;
 }
 
 /* this offset color implementation is not correct at all, see the
@@ -450,6 +753,7 @@ static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
 
   /* reset state */
   tr->last_vertex = NULL;
+  tr->last_poly = (int)(data - ctx->params);
   tr->vert_type = ta_vert_type(param->type0.pcw);
 
   int poly_type = ta_poly_type(param->type0.pcw);
@@ -504,25 +808,59 @@ static void tr_parse_poly_param(struct tr *tr, const struct ta_context *ctx,
   surf->params.ignore_texture_alpha = param->type0.tsp.ignore_tex_alpha;
   surf->params.offset_color = param->type0.pcw.offset;
   surf->params.alpha_test = tr->list_type == TA_LIST_PUNCH_THROUGH;
-  surf->params.alpha_ref = ctx->alpha_ref;
 
-  /* override a few surface parameters based on the list type */
+  /* override a few surface parameters based on the list type. note, the
+     texture, alpha ref and autosort overrides depend on state latched at render
+     start, and are resolved by tr_resolve_surfs */
   if (tr->list_type != TA_LIST_TRANSLUCENT &&
       tr->list_type != TA_LIST_TRANSLUCENT_MODVOL) {
     surf->params.src_blend = BLEND_NONE;
     surf->params.dst_blend = BLEND_NONE;
-  } else if ((tr->list_type == TA_LIST_TRANSLUCENT ||
-              tr->list_type == TA_LIST_TRANSLUCENT_MODVOL) &&
-             ctx->autosort) {
-    surf->params.depth_func = DEPTH_LEQUAL;
   } else if (tr->list_type == TA_LIST_PUNCH_THROUGH) {
     surf->params.depth_func = DEPTH_GEQUAL;
   }
+}
+
+static void tr_resolve_surfs(struct tr *tr, const struct ta_context *ctx,
+                             struct tr_context *rc) {
+  int last_poly = -1;
+  struct tr_texture *last_texture = NULL;
 
-  surf->params.texture =
-      param->type0.pcw.texture
-          ? tr_convert_texture(tr, ctx, param->type0.tsp, param->type0.tcw)
-          : 0;
+  /* skip the background surface, it's resolved by tr_parse_bg */
+  for (int i = 1; i < rc->num_surfs; i++) {
+    struct ta_surface *surf = &rc->surfs[i];
+    int poly = rc->surf_polys[i];
+
+    if (poly < 0) {
+      continue;
+    }
+
+    /* surfaces generated from the same poly param share the same texture,
+       avoid looking it up for each of them */
+    if (poly != last_poly) {
+      const union poly_param *param =
+          (const union poly_param *)&ctx->params[poly];
+
+      last_texture =
+          param->type0.pcw.texture
+              ? tr_convert_texture(tr, ctx, param->type0.tsp, param->type0.tcw)
+              : NULL;
+      last_poly = poly;
+    }
+
+    tr_bind_texture(tr, rc, i, last_texture);
+    surf->params.alpha_ref = ctx->alpha_ref;
+  }
+
+  if (ctx->autosort) {
+    for (int i = TA_LIST_TRANSLUCENT; i <= TA_LIST_TRANSLUCENT_MODVOL; i++) {
+      struct tr_list *list = &rc->lists[i];
+
+      for (int j = 0; j < list->num_surfs; j++) {
+        rc->surfs[list->surfs[j]].params.depth_func = DEPTH_LEQUAL;
+      }
+    }
+  }
 }
 
 static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
@@ -543,74 +881,6 @@ static void tr_parse_vert_param(struct tr *tr, const struct ta_context *ctx,
   tr->last_vertex = param;
 
   switch (tr->vert_type) {
-    case 0: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type0.xyz, vert->xyz);
-      PARSE_PACKED_COLOR(param->type0.base_color, &vert->color);
-    } break;
-
-    case 1: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type1.xyz, vert->xyz);
-      PARSE_FLOAT_COLOR(param->type1.base_color, &vert->color);
-    } break;
-
-    case 2: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type2.xyz, vert->xyz);
-      PARSE_BASE_INTENSITY(param->type2.base_intensity, &vert->color);
-    } break;
-
-    case 3: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type3.xyz, vert->xyz);
-      PARSE_UV(param->type3.uv, vert->uv);
-      PARSE_PACKED_COLOR(param->type3.base_color, &vert->color);
-      PARSE_PACKED_COLOR(param->type3.offset_color, &vert->offset_color);
-    } break;
-
-    case 4: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type4.xyz, vert->xyz);
-      PARSE_UV16(param->type4.uv, vert->uv);
-      PARSE_PACKED_COLOR(param->type4.base_color, &vert->color);
-      PARSE_PACKED_COLOR(param->type4.offset_color, &vert->offset_color);
-    } break;
-
-    case 5: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type5.xyz, vert->xyz);
-      PARSE_UV(param->type5.uv, vert->uv);
-      PARSE_FLOAT_COLOR(param->type5.base_color, &vert->color);
-      PARSE_FLOAT_COLOR(param->type5.offset_color, &vert->offset_color);
-    } break;
-
-    case 6: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type6.xyz, vert->xyz);
-      PARSE_UV16(param->type6.uv, vert->uv);
-      PARSE_FLOAT_COLOR(param->type6.base_color, &vert->color);
-      PARSE_FLOAT_COLOR(param->type6.offset_color, &vert->offset_color);
-    } break;
-
-    case 7: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type7.xyz, vert->xyz);
-      PARSE_UV(param->type7.uv, vert->uv);
-      PARSE_BASE_INTENSITY(param->type7.base_intensity, &vert->color);
-      PARSE_OFFSET_INTENSITY(param->type7.offset_intensity,
-                             &vert->offset_color);
-    } break;
-
-    case 8: {
-      struct ta_vertex *vert = tr_reserve_vert(tr, rc);
-      PARSE_XYZ(param->type8.xyz, vert->xyz);
-      PARSE_UV16(param->type8.uv, vert->uv);
-      PARSE_BASE_INTENSITY(param->type8.base_intensity, &vert->color);
-      PARSE_OFFSET_INTENSITY(param->type8.offset_intensity,
-                             &vert->offset_color);
-    } break;
-
     case 15:
     case 16: {
       CHECK(param->type0.pcw.end_of_strip);
@@ -716,8 +986,8 @@ static inline int tr_can_merge_surfs(struct ta_surface *a,
   return a->params.full == b->params.full;
 }
 
-static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
-                                int list_type) {
+static void tr_generate_indices(struct tr_context *rc, int list_type,
+                                int num_indices) {
   /* polygons are fed to the TA as triangle strips, with the vertices being fed
      in a CW order, so a given quad looks like:
 
@@ -731,12 +1001,13 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
      convert from these triangle strips to triangles, and convert to CCW to
      match OpenGL defaults */
   struct tr_list *list = &rc->lists[list_type];
+  uint16_t *indices = rc->indices;
 
   int num_merged = 0;
 
   for (int i = 0, j = 0; i < list->num_surfs; i = j) {
     struct ta_surface *root = &rc->surfs[list->surfs[i]];
-    int first_index = rc->num_indices;
+    int first_index = num_indices;
 
     /* merge adjacent surfaces at this time */
     for (j = i; j < list->num_surfs; j++) {
@@ -750,29 +1021,26 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
         num_merged++;
       }
 
-      int num_indices = (surf->num_verts - 2) * 3;
-      CHECK_LT(rc->num_indices + num_indices, ARRAY_SIZE(rc->indices));
-
       for (int j = 0; j < surf->num_verts - 2; j++) {
         int strip_offset = surf->strip_offset + j;
         int vertex_offset = surf->first_vert + j;
 
         /* be careful to maintain a CCW winding order */
         if (strip_offset & 1) {
-          rc->indices[rc->num_indices++] = vertex_offset + 0;
-          rc->indices[rc->num_indices++] = vertex_offset + 1;
-          rc->indices[rc->num_indices++] = vertex_offset + 2;
+          indices[num_indices++] = vertex_offset + 0;
+          indices[num_indices++] = vertex_offset + 1;
+          indices[num_indices++] = vertex_offset + 2;
         } else {
-          rc->indices[rc->num_indices++] = vertex_offset + 0;
-          rc->indices[rc->num_indices++] = vertex_offset + 2;
-          rc->indices[rc->num_indices++] = vertex_offset + 1;
+          indices[num_indices++] = vertex_offset + 0;
+          indices[num_indices++] = vertex_offset + 2;
+          indices[num_indices++] = vertex_offset + 1;
         }
       }
     }
 
     /* update to point at triangle indices instead of the raw tristrip verts */
     root->first_vert = first_index;
-    root->num_verts = rc->num_indices - first_index;
+    root->num_verts = num_indices - first_index;
 
     /* shift the list to account for merges */
     list->surfs[j - num_merged - 1] = list->surfs[i];
@@ -781,56 +1049,296 @@ static void tr_generate_indices(struct tr *tr, struct tr_context *rc,
   list->num_surfs -= num_merged;
 }
 
-static int sort_tmp[TR_MAX_SURFS];
-static float sort_minz[TR_MAX_SURFS];
+static int tr_count_indices(struct tr_context *rc, int list_type) {
+  struct tr_list *list = &rc->lists[list_type];
+  int num_indices = 0;
+
+  for (int i = 0; i < list->num_surfs; i++) {
+    struct ta_surface *surf = &rc->surfs[list->surfs[i]];
+    num_indices += MAX(surf->num_verts - 2, 0) * 3;
+  }
 
-static int tr_compare_surf(const void *a, const void *b) {
-  int i = *(const int *)a;
-  int j = *(const int *)b;
-  return sort_minz[i] <= sort_minz[j];
+  return num_indices;
 }
 
-static void tr_sort_surfaces(struct tr *tr, struct tr_context *rc,
-                             int list_type) {
+/* each list is sorted on its own thread, so each needs its own scratch space */
+static uint64_t sort_keys[TA_NUM_LISTS][TR_MAX_SURFS];
+static uint64_t sort_tmp[TA_NUM_LISTS][TR_MAX_SURFS];
+
+static void tr_sort_surfaces(struct tr_context *rc, int list_type) {
   struct tr_list *list = &rc->lists[list_type];
+  uint64_t *keys = sort_keys[list_type];
 
-  /* sort each surface from back to front based on its minz */
+  /* sort each surface from back to front based on its minz. the radix sort is
+     stable, so surfaces with the same minz keep their submission order */
   for (int i = 0; i < list->num_surfs; i++) {
     int surf_index = list->surfs[i];
     struct ta_surface *surf = &rc->surfs[surf_index];
-    float *minz = &sort_minz[surf_index];
 
     struct ta_vertex *verts = &rc->verts[surf->first_vert];
     CHECK_EQ(surf->num_verts, 3);
 
-    *minz = MIN(verts[0].xyz[2], verts[1].xyz[2]);
-    *minz = MIN(*minz, verts[2].xyz[2]);
+    float minz = MIN(verts[0].xyz[2], verts[1].xyz[2]);
+    minz = MIN(minz, verts[2].xyz[2]);
+
+    keys[i] = ((uint64_t)rsort_float_key(minz) << 32) | (uint32_t)surf_index;
   }
 
-  msort_noalloc(list->surfs, sort_tmp, list->num_surfs, sizeof(int),
-                &tr_compare_surf);
+  rsort_noalloc(keys, sort_tmp[list_type], list->num_surfs);
+
+  for (int i = 0; i < list->num_surfs; i++) {
+    list->surfs[i] = (int)(uint32_t)keys[i];
+  }
 }
 
-static void tr_reset(struct tr *tr, struct tr_context *rc) {
-  /* reset global state */
-  tr->last_vertex = NULL;
-  tr->list_type = TA_NUM_LISTS;
-  tr->vert_type = TA_NUM_VERTS;
-  memset(tr->face_color, 0, sizeof(tr->face_color));
-  memset(tr->face_offset_color, 0, sizeof(tr->face_offset_color));
-  memset(tr->sprite_color, 0, sizeof(tr->sprite_color));
-  memset(tr->sprite_offset_color, 0, sizeof(tr->sprite_offset_color));
+/* opaque surfaces are depth tested, so apart from coplanar surfaces, the order
+   they're drawn in doesn't affect the final image. when enabled, they're
+   grouped by their render state, letting each group be merged into a single
+   draw when generating indices */
+#define TR_BATCH_BITS 12
+#define TR_MAX_BATCHES ((1 << TR_BATCH_BITS) / 2)
+
+struct tr_batch {
+  uint64_t params;
+  /* one-based, zero marks an empty slot */
+  int id;
+};
+
+static struct tr_batch tr_batches[TA_NUM_LISTS][1 << TR_BATCH_BITS];
+static int tr_batch_slots[TA_NUM_LISTS][TR_MAX_BATCHES];
+
+static int tr_batch_barrier(const struct ta_surface *surf) {
+  /* surfaces which don't write depth, or aren't depth tested, depend on the
+     order they're drawn in */
+  return !surf->params.depth_write || surf->params.depth_func == DEPTH_NONE ||
+         surf->params.depth_func == DEPTH_ALWAYS;
+}
+
+static void tr_batch_surfaces(struct tr_context *rc, int list_type) {
+  struct tr_list *list = &rc->lists[list_type];
+  struct tr_batch *batches = tr_batches[list_type];
+  int *slots = tr_batch_slots[list_type];
+  uint64_t *keys = sort_keys[list_type];
+  const int mask = (1 << TR_BATCH_BITS) - 1;
+  int num_slots = 0;
+  int num_ids = 0;
+  int num_runs = 0;
+
+  /* assign each surface the id of the first surface sharing its params. the
+     ids increase in submission order, so a stable sort by them groups the
+     surfaces while preserving the order within each group */
+  for (int i = 0; i < list->num_surfs; i++) {
+    int surf_index = list->surfs[i];
+    struct ta_surface *surf = &rc->surfs[surf_index];
+    uint64_t params = surf->params.full;
+    int id = -1;
+
+    if (!i || params != rc->surfs[list->surfs[i - 1]].params.full) {
+      num_runs++;
+    }
+
+    if (tr_batch_barrier(surf)) {
+      /* start over, so nothing after the barrier is moved in front of it */
+      for (int j = 0; j < num_slots; j++) {
+        batches[slots[j]].id = 0;
+      }
+      num_slots = 0;
+    } else {
+      int slot = hash_key(params, TR_BATCH_BITS);
+
+      while (batches[slot].id && batches[slot].params != params) {
+        slot = (slot + 1) & mask;
+      }
+
+      if (batches[slot].id) {
+        id = batches[slot].id - 1;
+      } else if (num_slots < TR_MAX_BATCHES) {
+        batches[slot].params = params;
+        batches[slot].id = num_ids + 1;
+        slots[num_slots++] = slot;
+      }
+    }
+
+    if (id < 0) {
+      id = num_ids++;
+    }
+
+    keys[i] = ((uint64_t)id << 32) | (uint32_t)surf_index;
+  }
+
+  for (int j = 0; j < num_slots; j++) {
+    batches[slots[j]].id = 0;
+  }
+
+  list->num_unbatched_surfs = num_runs;
+
+  /* nothing to group */
+  if (num_ids == list->num_surfs) {
+    return;
+  }
+
+  rsort_noalloc(keys, sort_tmp[list_type], list->num_surfs);
+
+  for (int i = 0; i < list->num_surfs; i++) {
+    list->surfs[i] = (int)(uint32_t)keys[i];
+  }
+}
+
+static void tr_copy_context(struct tr_context *dst,
+                            const struct tr_context *src) {
+  /* copy the committed surfaces and vertices, as well as the surface and
+     vertices currently being parsed */
+  int num_surfs = MIN(src->num_surfs + 1, TR_MAX_SURFS);
+  int num_verts = src->num_verts;
+  if (src->num_surfs < TR_MAX_SURFS) {
+    num_verts += src->surfs[src->num_surfs].num_verts;
+  }
+
+  memcpy(dst->surfs, src->surfs, sizeof(src->surfs[0]) * num_surfs);
+  memcpy(dst->surf_polys, src->surf_polys,
+         sizeof(src->surf_polys[0]) * num_surfs);
+  memcpy(dst->verts, src->verts, sizeof(src->verts[0]) * num_verts);
+  dst->num_surfs = src->num_surfs;
+  dst->num_verts = src->num_verts;
+  dst->num_indices = 0;
 
-  /* reset render context state */
-  rc->num_params = 0;
-  rc->num_surfs = 0;
-  rc->num_verts = 0;
-  rc->num_indices = 0;
   for (int i = 0; i < TA_NUM_LISTS; i++) {
-    struct tr_list *list = &rc->lists[i];
-    list->num_surfs = 0;
-    list->num_orig_surfs = 0;
+    const struct tr_list *src_list = &src->lists[i];
+    struct tr_list *dst_list = &dst->lists[i];
+    memcpy(dst_list->surfs, src_list->surfs,
+           sizeof(src_list->surfs[0]) * src_list->num_surfs);
+    dst_list->num_surfs = src_list->num_surfs;
+    dst_list->num_orig_surfs = src_list->num_orig_surfs;
   }
+
+  memcpy(dst->params, src->params, sizeof(src->params[0]) * src->num_params);
+  dst->num_params = src->num_params;
+
+  dst->state = src->state;
+  dst->parsed = src->parsed;
+}
+
+static void tr_track_param(struct tr *tr, const struct ta_context *ctx,
+                           struct tr_context *rc, const uint8_t *data) {
+  /* track info about the parse state for tracer debugging */
+  struct tr_param *rp = &rc->params[rc->num_params++];
+  rp->offset = (int)(data - ctx->params);
+  rp->list_type = tr->list_type;
+  rp->vert_type = tr->vert_type;
+  rp->last_surf = rc->num_surfs - 1;
+  rp->last_vert = rc->num_verts - 1;
+}
+
+static const uint8_t *tr_parse_vert_strip(struct tr *tr,
+                                          const struct ta_context *ctx,
+                                          struct tr_context *rc,
+                                          const uint8_t *data,
+                                          const uint8_t *data_end) {
+  /* if there is no need to change the Global Parameters, a Vertex Parameter
+     for the next polygon may be input immediately after inputting a Vertex
+     Parameter for which "End of Strip" was specified */
+  if (tr->last_vertex && tr->last_vertex->type0.pcw.end_of_strip) {
+    tr_reserve_surf(tr, rc, 1);
+  }
+
+  /* gather up the rest of the strip. the global parameters can't change
+     until it ends, so each vertex is of the same type and size */
+  int stride = ta_param_size(*(const union pcw *)data, tr->vert_type);
+  int num_verts = 0;
+  int end_of_strip = 0;
+
+  for (const uint8_t *ptr = data; ptr < data_end && !end_of_strip;
+       ptr += stride) {
+    union pcw pcw = *(const union pcw *)ptr;
+
+    if (pcw.para_type != TA_PARAM_VERTEX) {
+      break;
+    }
+
+    end_of_strip = pcw.end_of_strip;
+    num_verts++;
+  }
+
+  /* the strip's vertices are contiguous, decode them in place */
+  struct ta_surface *surf = &rc->surfs[rc->num_surfs];
+  int first_vert = rc->num_verts + surf->num_verts;
+  CHECK_LE(first_vert + num_verts, ARRAY_SIZE(rc->verts));
+
+  tr_decode_verts(tr->vert_type, data, stride, num_verts, tr->face_color,
+                  tr->face_offset_color, &rc->verts[first_vert]);
+  surf->num_verts += num_verts;
+
+  for (int i = 0; i < num_verts - 1; i++) {
+    tr_track_param(tr, ctx, rc, data);
+    data += stride;
+  }
+
+  /* in the case of the Polygon type, the last Vertex Parameter for an object
+     must have "End of Strip" specified */
+  tr->last_vertex = (const union vert_param *)data;
+
+  if (end_of_strip) {
+    tr_commit_surf(tr, rc);
+  }
+
+  tr_track_param(tr, ctx, rc, data);
+
+  return data + stride;
+}
+
+static void tr_parse_params(struct tr *tr, const struct ta_context *ctx,
+                            struct tr_context *rc, int end) {
+  const uint8_t *data = ctx->params + rc->parsed;
+  const uint8_t *data_end = ctx->params + end;
+
+  /* restore the parse state from where it was last left off */
+  tr->state = rc->state;
+
+  while (data < data_end) {
+    union pcw pcw = *(union pcw *)data;
+
+    /* polygon vertices are decoded a strip at a time */
+    if (pcw.para_type == TA_PARAM_VERTEX && tr_vert_batched(tr->vert_type)) {
+      data = tr_parse_vert_strip(tr, ctx, rc, data, data_end);
+      continue;
+    }
+
+    if (ta_pcw_list_type_valid(pcw, tr->list_type)) {
+      tr->list_type = pcw.list_type;
+    }
+
+    switch (pcw.para_type) {
+      /* control params */
+      case TA_PARAM_END_OF_LIST:
+        tr_parse_eol(tr, ctx, rc, data);
+        break;
+
+      case TA_PARAM_USER_TILE_CLIP:
+        break;
+
+      case TA_PARAM_OBJ_LIST_SET:
+        LOG_FATAL("TA_PARAM_OBJ_LIST_SET unsupported");
+        break;
+
+      /* global params */
+      case TA_PARAM_POLY_OR_VOL:
+      case TA_PARAM_SPRITE:
+        tr_parse_poly_param(tr, ctx, rc, data);
+        break;
+
+      /* vertex params */
+      case TA_PARAM_VERTEX:
+        tr_parse_vert_param(tr, ctx, rc, data);
+        break;
+    }
+
+    tr_track_param(tr, ctx, rc, data);
+
+    data += ta_param_size(pcw, tr->vert_type);
+  }
+
+  rc->state = tr->state;
+  rc->parsed = (int)(data - ctx->params);
 }
 
 static void tr_render_list(struct render_backend *r,
@@ -874,76 +1382,167 @@ void tr_render_context(struct render_backend *r, const struct tr_context *rc) {
   tr_render_context_until(r, rc, -1);
 }
 
+void tr_init_context(struct tr_context *rc) {
+  /* reset parse state */
+  memset(&rc->state, 0, sizeof(rc->state));
+  rc->state.last_poly = -1;
+  rc->state.list_type = TA_NUM_LISTS;
+  rc->state.vert_type = TA_NUM_VERTS;
+  rc->parsed = 0;
+
+  /* reset render context state */
+  rc->num_params = 0;
+  rc->num_surfs = 0;
+  rc->num_verts = 0;
+  rc->num_indices = 0;
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    struct tr_list *list = &rc->lists[i];
+    list->num_surfs = 0;
+    list->num_orig_surfs = 0;
+    list->num_unbatched_surfs = 0;
+  }
+
+  /* reserve the first opaque surface and its vertices for the background */
+  struct tr_list *list = &rc->lists[TA_LIST_OPAQUE];
+  list->surfs[list->num_surfs++] = 0;
+  list->num_orig_surfs++;
+  rc->surf_polys[0] = -1;
+  rc->num_surfs = 1;
+  rc->num_verts = 4;
+}
+
+struct tr_list_job {
+  struct tr_context *rc;
+  int list_type;
+  int sort;
+  int batch;
+  int first_index;
+};
+
+static void tr_sort_list(void *data) {
+  struct tr_list_job *job = data;
+
+  if (job->sort) {
+    tr_sort_surfaces(job->rc, job->list_type);
+  }
+}
+
+static void tr_index_list(void *data) {
+  struct tr_list_job *job = data;
+  struct tr_list *list = &job->rc->lists[job->list_type];
+
+  if (job->batch) {
+    tr_batch_surfaces(job->rc, job->list_type);
+  }
+
+  tr_generate_indices(job->rc, job->list_type, job->first_index);
+
+  if (!job->batch) {
+    list->num_unbatched_surfs = list->num_surfs;
+  }
+}
+
+static void tr_run_list_jobs(struct thread_pool *pool, thread_pool_fn fn,
+                             struct tr_list_job *jobs) {
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    if (pool) {
+      thread_pool_submit(pool, fn, &jobs[i]);
+    } else {
+      fn(&jobs[i]);
+    }
+  }
+}
+
+void tr_parse_context(const struct ta_context *ctx, struct tr_context *rc,
+                      int end) {
+  struct tr tr = {0};
+
+  tr_parse_params(&tr, ctx, rc, end);
+}
+
 void tr_convert_context(struct render_backend *r, void *userdata,
                         tr_find_texture_cb find_texture,
                         const struct ta_context *ctx, struct tr_context *rc) {
-  struct tr tr;
+  struct tr tr = {0};
   tr.r = r;
   tr.userdata = userdata;
   tr.find_texture = find_texture;
 
-  const uint8_t *data = ctx->params;
-  const uint8_t *end = ctx->params + ctx->size;
-
   ta_init_tables();
 
-  tr_reset(&tr, rc);
+  /* start off with the geometry parsed while the params were being received,
+     only parsing what's left of the param stream. the caller may have taken
+     ownership of that context, converting it in place */
+  if (ctx->rc == rc) {
+    rc->num_indices = 0;
+  } else if (ctx->rc) {
+    tr_copy_context(rc, ctx->rc);
+  } else {
+    tr_init_context(rc);
+  }
+
+  tr_parse_params(&tr, ctx, rc, ctx->size);
 
   rc->width = ctx->video_width;
   rc->height = ctx->video_height;
 
+  /* resolve the state latched at render start. textures not already in the
+     cache are queued to be decoded on the thread pool */
   tr_parse_bg(&tr, ctx, rc);
+  tr_resolve_surfs(&tr, ctx, rc);
 
-  while (data < end) {
-    union pcw pcw = *(union pcw *)data;
+  /* sorting and index generation only touch the surfaces belonging to each
+     list. index space is reserved for each list up front, making the output
+     identical no matter what order the lists are finalized in */
+  struct tr_list_job jobs[TA_NUM_LISTS];
+  int num_indices = 0;
 
-    if (ta_pcw_list_type_valid(pcw, tr.list_type)) {
-      tr.list_type = pcw.list_type;
-    }
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    struct tr_list_job *job = &jobs[i];
+    job->rc = rc;
+    job->list_type = i;
+    job->sort = ctx->autosort && (i == TA_LIST_TRANSLUCENT ||
+                                  i == TA_LIST_PUNCH_THROUGH);
+    job->batch = OPTION_batch_surfaces && !job->sort &&
+                 (i == TA_LIST_OPAQUE || i == TA_LIST_PUNCH_THROUGH);
+    job->first_index = num_indices;
+
+    num_indices += tr_count_indices(rc, i);
+  }
 
-    switch (pcw.para_type) {
-      /* control params */
-      case TA_PARAM_END_OF_LIST:
-        tr_parse_eol(&tr, ctx, rc, data);
-        break;
+  CHECK_LE(num_indices, ARRAY_SIZE(rc->indices));
 
-      case TA_PARAM_USER_TILE_CLIP:
-        break;
+  struct thread_pool *pool = NULL;
+  if (rc->num_surfs >= TR_PARALLEL_MIN_SURFS) {
+    pool = tr_thread_pool();
+  }
 
-      case TA_PARAM_OBJ_LIST_SET:
-        LOG_FATAL("TA_PARAM_OBJ_LIST_SET unsupported");
-        break;
+  /* sorting doesn't depend on the texture handles, so it runs alongside the
+     texture decodes */
+  tr_run_list_jobs(pool, &tr_sort_list, jobs);
 
-      /* global params */
-      case TA_PARAM_POLY_OR_VOL:
-      case TA_PARAM_SPRITE:
-        tr_parse_poly_param(&tr, ctx, rc, data);
-        break;
+  if (pool) {
+    thread_pool_wait(pool);
+  }
 
-      /* vertex params */
-      case TA_PARAM_VERTEX:
-        tr_parse_vert_param(&tr, ctx, rc, data);
-        break;
-    }
+  /* adjacent surfaces are merged during index generation by comparing their
+     params, so any pending textures must be bound before it, or the batching
+     which precedes it, runs */
+  tr_upload_textures(&tr);
+  tr_bind_deferred(&tr, rc);
 
-    /* track info about the parse state for tracer debugging */
-    struct tr_param *rp = &rc->params[rc->num_params++];
-    rp->offset = (int)(data - ctx->params);
-    rp->list_type = tr.list_type;
-    rp->vert_type = tr.vert_type;
-    rp->last_surf = rc->num_surfs - 1;
-    rp->last_vert = rc->num_verts - 1;
+  tr_run_list_jobs(pool, &tr_index_list, jobs);
 
-    data += ta_param_size(pcw, tr.vert_type);
+  if (pool) {
+    thread_pool_wait(pool);
   }
 
-  /* sort surfaces if requested */
-  if (ctx->autosort) {
-    tr_sort_surfaces(&tr, rc, TA_LIST_TRANSLUCENT);
-    tr_sort_surfaces(&tr, rc, TA_LIST_PUNCH_THROUGH);
+  prof_counter_add(COUNTER_tex_decodes, tr.num_decodes);
+  prof_counter_set(COUNTER_tex_queue_depth, tr.max_texture_jobs);
+  if (tr.num_decodes) {
+    prof_counter_set(COUNTER_tex_decode_latency,
+                     tr.decode_latency / tr.num_decodes / INT64_C(1000));
   }
 
-  for (int i = 0; i < TA_NUM_LISTS; i++) {
-    tr_generate_indices(&tr, rc, i);
-  }
+  rc->num_indices = num_indices;
 }
@@ -5,6 +5,8 @@
 #include "render/render_backend.h"
 
 struct tr;
+struct tr_host_texture;
+struct tex_cache;
 
 #define TR_MAX_SURFS (1024 * 64)
 
@@ -30,6 +32,9 @@ struct tr_texture {
   int width;
   int height;
   texture_handle_t handle;
+
+  /* decoded texture shared with other entries of identical content */
+  struct tr_host_texture *host;
 };
 
 struct tr_param {
@@ -45,12 +50,29 @@ struct tr_param {
   int last_vert;
 };
 
+/* parser state that carries over from one parameter to the next, enabling the
+   param stream to be parsed incrementally as it's received */
+struct tr_state {
+  const union vert_param *last_vertex;
+  int last_poly;
+  int list_type;
+  int vert_type;
+  /* poly params */
+  uint8_t face_color[4];
+  uint8_t face_offset_color[4];
+  /* sprite params */
+  uint8_t sprite_color[4];
+  uint8_t sprite_offset_color[4];
+};
+
 struct tr_list {
   int surfs[TR_MAX_SURFS];
   int num_surfs;
 
   /* debug info */
   int num_orig_surfs;
+  /* number of draw surfaces had the list not been batched by render state */
+  int num_unbatched_surfs;
 };
 
 struct tr_context {
@@ -62,6 +84,11 @@ struct tr_context {
   struct ta_surface surfs[TR_MAX_SURFS];
   int num_surfs;
 
+  /* offset of the poly param each surface was generated from. render state
+     that depends on registers latched at render start (textures, alpha ref,
+     autosort) is resolved from these once the context is finalized */
+  int surf_polys[TR_MAX_SURFS];
+
   struct ta_vertex verts[TR_MAX_SURFS];
   int num_verts;
 
@@ -74,6 +101,10 @@ struct tr_context {
   /* debug structures for stepping through the param stream in the tracer */
   struct tr_param params[TA_MAX_PARAMS];
   int num_params;
+
+  /* incremental parse state */
+  struct tr_state state;
+  int parsed;
 };
 
 static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
@@ -82,9 +113,28 @@ static inline tr_texture_key_t tr_texture_key(union tsp tsp, union tcw tcw) {
 
 typedef struct tr_texture *(*tr_find_texture_cb)(void *, union tsp, union tcw);
 
+void tr_init_context(struct tr_context *rc);
+void tr_parse_context(const struct ta_context *ctx, struct tr_context *rc,
+                      int end);
 void tr_convert_context(struct render_backend *r, void *userdata,
                         tr_find_texture_cb find_texture,
                         const struct ta_context *ctx, struct tr_context *rc);
+void tr_set_texture_cache(struct tex_cache *cache);
+void tr_release_texture(struct render_backend *r, struct tr_texture *entry);
+
+/* textures are normally resolved to their host texture while converting a
+   context. when the texture cache is owned by a different thread than the one
+   converting, it can instead resolve each texture referenced by the context
+   ahead of time. the source data of new host textures is copied, so guest
+   memory may change before the context is converted. host textures dropped by
+   tr_unref_texture may still be referenced by contexts yet to be rendered, and
+   are destroyed by the converting thread once they no longer are */
+void tr_resolve_texture(const struct ta_context *ctx,
+                        struct tr_texture *entry);
+struct tr_host_texture *tr_unref_texture(struct tr_texture *entry);
+void tr_destroy_host_texture(struct render_backend *r,
+                             struct tr_host_texture *host);
+
 void tr_render_context(struct render_backend *r, const struct tr_context *rc);
 void tr_render_context_until(struct render_backend *r,
                              const struct tr_context *rc, int end_surf);
@@ -0,0 +1,256 @@
+/*
+ * batched decoding of the ta's polygon vertex parameters
+ */
+
+#include "guest/pvr/tr_vert.h"
+
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+void tr_decode_verts_ref(int vert_type, const uint8_t *data, int stride,
+                         int num, const uint8_t *face_color,
+                         const uint8_t *face_offset_color,
+                         struct ta_vertex *out) {
+  for (int n = 0; n < num; n++, data += stride) {
+    const union vert_param *param = (const union vert_param *)data;
+    struct ta_vertex *vert = &out[n];
+
+    memset(vert, 0, sizeof(*vert));
+
+    switch (vert_type) {
+      case 0: {
+        PARSE_XYZ(param->type0.xyz, vert->xyz);
+        PARSE_PACKED_COLOR(param->type0.base_color, &vert->color);
+      } break;
+
+      case 1: {
+        PARSE_XYZ(param->type1.xyz, vert->xyz);
+        PARSE_FLOAT_COLOR(param->type1.base_color, &vert->color);
+      } break;
+
+      case 2: {
+        PARSE_XYZ(param->type2.xyz, vert->xyz);
+        PARSE_INTENSITY(face_color, param->type2.base_intensity, &vert->color);
+      } break;
+
+      case 3: {
+        PARSE_XYZ(param->type3.xyz, vert->xyz);
+        PARSE_UV(param->type3.uv, vert->uv);
+        PARSE_PACKED_COLOR(param->type3.base_color, &vert->color);
+        PARSE_PACKED_COLOR(param->type3.offset_color, &vert->offset_color);
+      } break;
+
+      case 4: {
+        PARSE_XYZ(param->type4.xyz, vert->xyz);
+        PARSE_UV16(param->type4.uv, vert->uv);
+        PARSE_PACKED_COLOR(param->type4.base_color, &vert->color);
+        PARSE_PACKED_COLOR(param->type4.offset_color, &vert->offset_color);
+      } break;
+
+      case 5: {
+        PARSE_XYZ(param->type5.xyz, vert->xyz);
+        PARSE_UV(param->type5.uv, vert->uv);
+        PARSE_FLOAT_COLOR(param->type5.base_color, &vert->color);
+        PARSE_FLOAT_COLOR(param->type5.offset_color, &vert->offset_color);
+      } break;
+
+      case 6: {
+        PARSE_XYZ(param->type6.xyz, vert->xyz);
+        PARSE_UV16(param->type6.uv, vert->uv);
+        PARSE_FLOAT_COLOR(param->type6.base_color, &vert->color);
+        PARSE_FLOAT_COLOR(param->type6.offset_color, &vert->offset_color);
+      } break;
+
+      case 7: {
+        PARSE_XYZ(param->type7.xyz, vert->xyz);
+        PARSE_UV(param->type7.uv, vert->uv);
+        PARSE_INTENSITY(face_color, param->type7.base_intensity, &vert->color);
+        PARSE_INTENSITY(face_offset_color, param->type7.offset_intensity,
+                        &vert->offset_color);
+      } break;
+
+      case 8: {
+        PARSE_XYZ(param->type8.xyz, vert->xyz);
+        PARSE_UV16(param->type8.uv, vert->uv);
+        PARSE_INTENSITY(face_color, param->type8.base_intensity, &vert->color);
+        PARSE_INTENSITY(face_offset_color, param->type8.offset_intensity,
+                        &vert->offset_color);
+      } break;
+
+      default:
+        LOG_FATAL("unsupported vertex type %d", vert_type);
+        break;
+    }
+  }
+}
+
+#if ARCH_X64
+/*
+ * sse2 decoders. each vertex is assembled as two overlapping 16-byte stores,
+ * the first writing out the xyz, the second the uv and both colors
+ */
+static inline uint32_t tr_load32(const uint8_t *data) {
+  uint32_t v;
+  memcpy(&v, data, sizeof(v));
+  return v;
+}
+
+static inline __m128i tr_uv_float(const uint8_t *data) {
+  return _mm_loadl_epi64((const __m128i *)(data + 16));
+}
+
+static inline __m128i tr_uv_16(const uint8_t *data) {
+  /* each 16-bit uv component is the high half of a 32-bit float */
+  uint32_t uv = tr_load32(data + 16);
+  return _mm_set_epi32(0, 0, uv << 16, uv & 0xffff0000);
+}
+
+static inline __m128i tr_packed_colors(__m128i c) {
+  /* swap the red and blue channels, converting from ARGB to the RGBA byte
+     order expected by the render backend */
+  const __m128i ga_mask = _mm_set1_epi32(0xff00ff00);
+  const __m128i b_mask = _mm_set1_epi32(0x000000ff);
+  __m128i ga = _mm_and_si128(c, ga_mask);
+  __m128i r = _mm_and_si128(_mm_srli_epi32(c, 16), b_mask);
+  __m128i b = _mm_slli_epi32(_mm_and_si128(c, b_mask), 16);
+  return _mm_or_si128(ga, _mm_or_si128(r, b));
+}
+
+static inline __m128i tr_float_colors(__m128 base, __m128 offset) {
+  /* convert a pair of ARGB float colors into packed RGBA colors, with each
+     component clamped to 0-255 by the saturating packs */
+  const __m128 scale = _mm_set1_ps(255.0f);
+  __m128i b = _mm_cvttps_epi32(_mm_mul_ps(base, scale));
+  __m128i o = _mm_cvttps_epi32(_mm_mul_ps(offset, scale));
+  b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1));
+  o = _mm_shuffle_epi32(o, _MM_SHUFFLE(0, 3, 2, 1));
+  __m128i c = _mm_packs_epi32(b, o);
+  return _mm_packus_epi16(c, c);
+}
+
+static inline __m128i tr_intensity_colors(__m128i face, const uint8_t *data) {
+  /* scale the 16-bit face colors by the clamped base and offset intensities,
+     leaving alpha untouched by scaling it by 255 */
+  const __m128 scale = _mm_set1_ps(255.0f);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i alpha = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i div255 = _mm_set1_epi16((short)0x8081);
+
+  __m128 in = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)(data + 24)));
+  __m128i i = _mm_cvttps_epi32(_mm_mul_ps(in, scale));
+  i = _mm_packs_epi32(i, i);
+  i = _mm_unpacklo_epi8(_mm_packus_epi16(i, i), zero);
+  i = _mm_shufflelo_epi16(i, _MM_SHUFFLE(0, 0, 0, 0));
+  i = _mm_shufflehi_epi16(i, _MM_SHUFFLE(1, 1, 1, 1));
+  i = _mm_or_si128(_mm_and_si128(i, rgb_mask), alpha);
+
+  /* x / 255 == (x * 0x8081) >> 23 for all 16-bit x */
+  __m128i c = _mm_mullo_epi16(face, i);
+  c = _mm_srli_epi16(_mm_mulhi_epu16(c, div255), 7);
+  return _mm_packus_epi16(c, c);
+}
+
+static inline void tr_store_vert(struct ta_vertex *out, const uint8_t *data,
+                                 __m128i uv, __m128i colors) {
+  __m128 xyz = _mm_loadu_ps((const float *)(data + 4));
+  _mm_storeu_ps(out->xyz, xyz);
+  _mm_storeu_si128((__m128i *)out->uv, _mm_unpacklo_epi64(uv, colors));
+}
+
+void tr_decode_verts(int vert_type, const uint8_t *data, int stride, int num,
+                     const uint8_t *face_color,
+                     const uint8_t *face_offset_color, struct ta_vertex *out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 zerof = _mm_setzero_ps();
+
+  /* the face colors are constant for the entire run, widen them to 16-bits
+     up front for the intensity types */
+  uint32_t base_face = tr_load32(face_color);
+  uint32_t offset_face = vert_type == 2 ? 0 : tr_load32(face_offset_color);
+  __m128i face = _mm_unpacklo_epi8(
+      _mm_set_epi32(0, 0, (int)offset_face, (int)base_face), zero);
+
+  struct ta_vertex *end = out + num;
+
+  switch (vert_type) {
+    case 0:
+      for (; out < end; out++, data += stride) {
+        __m128i c = _mm_cvtsi32_si128((int)tr_load32(data + 24));
+        tr_store_vert(out, data, zero, tr_packed_colors(c));
+      }
+      break;
+
+    case 1:
+      for (; out < end; out++, data += stride) {
+        __m128 base = _mm_loadu_ps((const float *)(data + 16));
+        tr_store_vert(out, data, zero, tr_float_colors(base, zerof));
+      }
+      break;
+
+    case 2:
+      for (; out < end; out++, data += stride) {
+        tr_store_vert(out, data, zero, tr_intensity_colors(face, data));
+      }
+      break;
+
+    case 3:
+      for (; out < end; out++, data += stride) {
+        __m128i c = _mm_loadl_epi64((const __m128i *)(data + 24));
+        tr_store_vert(out, data, tr_uv_float(data), tr_packed_colors(c));
+      }
+      break;
+
+    case 4:
+      for (; out < end; out++, data += stride) {
+        __m128i c = _mm_loadl_epi64((const __m128i *)(data + 24));
+        tr_store_vert(out, data, tr_uv_16(data), tr_packed_colors(c));
+      }
+      break;
+
+    case 5:
+      for (; out < end; out++, data += stride) {
+        __m128 base = _mm_loadu_ps((const float *)(data + 32));
+        __m128 offset = _mm_loadu_ps((const float *)(data + 48));
+        tr_store_vert(out, data, tr_uv_float(data),
+                      tr_float_colors(base, offset));
+      }
+      break;
+
+    case 6:
+      for (; out < end; out++, data += stride) {
+        __m128 base = _mm_loadu_ps((const float *)(data + 32));
+        __m128 offset = _mm_loadu_ps((const float *)(data + 48));
+        tr_store_vert(out, data, tr_uv_16(data),
+                      tr_float_colors(base, offset));
+      }
+      break;
+
+    case 7:
+      for (; out < end; out++, data += stride) {
+        tr_store_vert(out, data, tr_uv_float(data),
+                      tr_intensity_colors(face, data));
+      }
+      break;
+
+    case 8:
+      for (; out < end; out++, data += stride) {
+        tr_store_vert(out, data, tr_uv_16(data),
+                      tr_intensity_colors(face, data));
+      }
+      break;
+
+    default:
+      LOG_FATAL("unsupported vertex type %d", vert_type);
+      break;
+  }
+}
+#else
+void tr_decode_verts(int vert_type, const uint8_t *data, int stride, int num,
+                     const uint8_t *face_color,
+                     const uint8_t *face_offset_color, struct ta_vertex *out) {
+  tr_decode_verts_ref(vert_type, data, stride, num, face_color,
+                      face_offset_color, out);
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef TR_VERT_H
+#define TR_VERT_H
+
+#include "core/core.h"
+#include "guest/pvr/ta_types.h"
+#include "render/render_backend.h"
+
+/*
+ * polygon parsing helpers
+ */
+static inline uint8_t ftou8(float x) {
+  /* saturating floating point to uint8_t conversion */
+  return MIN(MAX((int32_t)(x * 255.0f), 0), 255);
+}
+
+static inline uint8_t fmulu8(uint8_t a, uint8_t b) {
+  /* fixed point multiply */
+  return (uint8_t)((uint32_t)a * (uint32_t)b / 255);
+}
+
+#define PARSE_XYZ(xyz, out) \
+  {                         \
+    (out)[0] = (xyz)[0];    \
+    (out)[1] = (xyz)[1];    \
+    (out)[2] = (xyz)[2];    \
+  }
+
+#define PARSE_UV(uv, out) \
+  {                       \
+    (out)[0] = (uv)[0];   \
+    (out)[1] = (uv)[1];   \
+  }
+
+#define PARSE_UV16(uv, out)     \
+  {                             \
+    uint32_t u = (uv)[1] << 16; \
+    uint32_t v = (uv)[0] << 16; \
+    (out)[0] = *(float *)&u;    \
+    (out)[1] = *(float *)&v;    \
+  }
+
+#define PARSE_FLOAT_COLOR(color, out)                                 \
+  {                                                                   \
+    /* when converting from float point to a packed color, clamp each \
+       component to 0-255 */                                          \
+    ((uint8_t *)out)[0] = ftou8(color##_r);                           \
+    ((uint8_t *)out)[1] = ftou8(color##_g);                           \
+    ((uint8_t *)out)[2] = ftou8(color##_b);                           \
+    ((uint8_t *)out)[3] = ftou8(color##_a);                           \
+  }
+
+#define PARSE_PACKED_COLOR(color, out)                \
+  {                                                   \
+    ((uint8_t *)out)[0] = (color & 0x00ff0000) >> 16; \
+    ((uint8_t *)out)[1] = (color & 0x0000ff00) >> 8;  \
+    ((uint8_t *)out)[2] = (color & 0x000000ff);       \
+    ((uint8_t *)out)[3] = (color & 0xff000000) >> 24; \
+  }
+
+#define PARSE_INTENSITY(color, intensity, out)                           \
+  {                                                                      \
+    /* when converting from intensity to a packed color, each operand is \
+       clamped to 0-255 before multiplication */                         \
+    uint8_t i = ftou8(intensity);                                        \
+    ((uint8_t *)out)[0] = fmulu8(color[0], i);                           \
+    ((uint8_t *)out)[1] = fmulu8(color[1], i);                           \
+    ((uint8_t *)out)[2] = fmulu8(color[2], i);                           \
+    ((uint8_t *)out)[3] = color[3];                                      \
+  }
+
+/*
+ * batched vertex decoding
+ */
+
+/* the polygon vertex types (0-8) can be decoded in batches, sprites and
+   modifier volumes are handled by the parser individually */
+static inline int tr_vert_batched(int vert_type) {
+  return vert_type >= 0 && vert_type <= 8;
+}
+
+/* decode a run of num vertex params of the same type, each stride bytes apart,
+   into consecutive vertices. face_color and face_offset_color are the packed
+   colors from the last global param, used by the intensity types */
+void tr_decode_verts(int vert_type, const uint8_t *data, int stride, int num,
+                     const uint8_t *face_color,
+                     const uint8_t *face_offset_color, struct ta_vertex *out);
+
+/* scalar reference implementation of the above */
+void tr_decode_verts_ref(int vert_type, const uint8_t *data, int stride,
+                         int num, const uint8_t *face_color,
+                         const uint8_t *face_offset_color,
+                         struct ta_vertex *out);
+
+#endif
@@ -0,0 +1,313 @@
+#include "guest/rewind.h"
+#include "core/core.h"
+#include "guest/dreamcast.h"
+#include "guest/savestate.h"
+
+#define REWIND_MAX_DELTAS 8192
+
+/* a delta steps the state following it back to the state it was recorded
+   against. it's stored as the indices of the pages it touches, followed by
+   the encoded xor of the device state, and the encoded xor of each page */
+struct rewind_delta {
+  uint8_t *data;
+  int size;
+  int data_size;
+  int num_pages;
+};
+
+struct rewind {
+  struct savestate *ss;
+  int64_t budget;
+
+  /* ring of deltas, ordered from oldest to newest. size only covers the
+     deltas themselves, see rewind_size for the full footprint */
+  struct rewind_delta deltas[REWIND_MAX_DELTAS];
+  int head;
+  int num_deltas;
+  int64_t size;
+
+  /* device state of the most recent state. the buffer is kept zeroed past
+     data_size, so states of differing sizes can be xor'd a word at a time */
+  uint8_t *data;
+  int data_size;
+  int data_max;
+
+  /* scratch space deltas are encoded into */
+  uint8_t *scratch;
+  int scratch_max;
+};
+
+/* xor'd states are mostly zero. they're encoded as a series of runs, each a
+   32-bit header holding the number of zero words in the run, followed by the
+   number of literal words, followed by the literal words themselves */
+static uint8_t *rewind_encode(uint8_t *dst, const uint8_t *src, int size) {
+  const uint32_t *in = (const uint32_t *)src;
+  int n = size >> 2;
+  int i = 0;
+
+  while (i < n) {
+    /* skip over zeros a pair of words at a time, most of a delta is zero */
+    uint32_t zeros = 0;
+    while (i + 1 < n && !(in[i] | in[i + 1]) && zeros < 0xfffe) {
+      zeros += 2;
+      i += 2;
+    }
+    while (i < n && !in[i] && zeros < 0xffff) {
+      zeros++;
+      i++;
+    }
+
+    int start = i;
+    uint32_t literals = 0;
+    while (i < n && in[i] && literals < 0xffff) {
+      literals++;
+      i++;
+    }
+
+    uint32_t header = (zeros << 16) | literals;
+    memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+    memcpy(dst, &in[start], literals << 2);
+    dst += literals << 2;
+  }
+
+  return dst;
+}
+
+/* decodes a run-length encoded xor, applying it to dst */
+static const uint8_t *rewind_decode(const uint8_t *src, uint8_t *dst,
+                                    int size) {
+  uint32_t *out = (uint32_t *)dst;
+  int n = size >> 2;
+  int i = 0;
+
+  while (i < n) {
+    uint32_t header;
+    memcpy(&header, src, sizeof(header));
+    src += sizeof(header);
+
+    int zeros = header >> 16;
+    int literals = header & 0xffff;
+    CHECK_LE(i + zeros + literals, n);
+    i += zeros;
+
+    for (int j = 0; j < literals; j++) {
+      uint32_t word;
+      memcpy(&word, src, sizeof(word));
+      src += sizeof(word);
+      out[i++] ^= word;
+    }
+  }
+
+  return src;
+}
+
+static void rewind_reserve_data(struct rewind *rw, int size) {
+  if (size <= rw->data_max) {
+    return;
+  }
+
+  int old_max = rw->data_max;
+  rw->data_max = MAX(rw->data_max * 2, size);
+  rw->data = realloc(rw->data, rw->data_max);
+  CHECK_NOTNULL(rw->data);
+  memset(rw->data + old_max, 0, rw->data_max - old_max);
+}
+
+static void rewind_set_data(struct rewind *rw, const uint8_t *data, int size) {
+  rewind_reserve_data(rw, size);
+  memcpy(rw->data, data, size);
+  memset(rw->data + size, 0, rw->data_max - size);
+  rw->data_size = size;
+}
+
+/* memory held besides the deltas, the most recent state in full along with
+   the buffers states are built in */
+static int64_t rewind_overhead(struct rewind *rw) {
+  struct savestate *ss = rw->ss;
+
+  return (int64_t)ss->mem_size + ss->data_max + ss->deltas_max +
+         rw->data_max + rw->scratch_max;
+}
+
+static void rewind_pop_oldest(struct rewind *rw) {
+  struct rewind_delta *delta = &rw->deltas[rw->head];
+
+  rw->size -= delta->size;
+  free(delta->data);
+  memset(delta, 0, sizeof(*delta));
+
+  rw->head = (rw->head + 1) % REWIND_MAX_DELTAS;
+  rw->num_deltas--;
+}
+
+static void rewind_pop_newest(struct rewind *rw) {
+  int newest = (rw->head + rw->num_deltas - 1) % REWIND_MAX_DELTAS;
+  struct rewind_delta *delta = &rw->deltas[newest];
+
+  rw->size -= delta->size;
+  free(delta->data);
+  memset(delta, 0, sizeof(*delta));
+
+  rw->num_deltas--;
+}
+
+static void rewind_push_delta(struct rewind *rw) {
+  struct savestate *ss = rw->ss;
+  int num_pages = savestate_num_pages(ss);
+  int data_words = ALIGN_UP(MAX(rw->data_size, ss->data_size), 4);
+
+  CHECK_EQ(ss->deltas_size, ss->num_dirty * SAVESTATE_PAGE_SIZE);
+
+  /* in the worst case, every word is a run of its own */
+  int max_size = ss->num_dirty * (int)sizeof(int32_t) + data_words * 2 +
+                 ss->deltas_size * 2 + (ss->num_dirty + 1) * 4;
+
+  if (max_size > rw->scratch_max) {
+    rw->scratch_max = max_size;
+    rw->scratch = realloc(rw->scratch, rw->scratch_max);
+    CHECK_NOTNULL(rw->scratch);
+  }
+
+  uint8_t *dst = rw->scratch;
+
+  for (int i = 0; i < num_pages; i++) {
+    if (bitmap_test(ss->dirty, i, 1)) {
+      int32_t page = i;
+      memcpy(dst, &page, sizeof(page));
+      dst += sizeof(page);
+    }
+  }
+
+  /* xor the previous device state with the new one in place */
+  rewind_reserve_data(rw, data_words);
+
+  uint32_t *prev = (uint32_t *)rw->data;
+  int words = ss->data_size >> 2;
+  int i = 0;
+
+  for (; i < words; i++) {
+    uint32_t word;
+    memcpy(&word, ss->data + (i << 2), sizeof(word));
+    prev[i] ^= word;
+  }
+
+  for (i <<= 2; i < ss->data_size; i++) {
+    rw->data[i] ^= ss->data[i];
+  }
+
+  dst = rewind_encode(dst, rw->data, data_words);
+
+  for (int i = 0; i < ss->num_dirty; i++) {
+    const uint8_t *delta = ss->deltas + i * SAVESTATE_PAGE_SIZE;
+    dst = rewind_encode(dst, delta, SAVESTATE_PAGE_SIZE);
+  }
+
+  /* make room for the new delta, discarding the oldest */
+  if (rw->num_deltas == REWIND_MAX_DELTAS) {
+    rewind_pop_oldest(rw);
+  }
+
+  int newest = (rw->head + rw->num_deltas) % REWIND_MAX_DELTAS;
+  struct rewind_delta *delta = &rw->deltas[newest];
+  delta->size = (int)(dst - rw->scratch);
+  delta->data = malloc(delta->size);
+  CHECK_NOTNULL(delta->data);
+  memcpy(delta->data, rw->scratch, delta->size);
+  delta->data_size = rw->data_size;
+  delta->num_pages = ss->num_dirty;
+
+  rw->num_deltas++;
+  rw->size += delta->size;
+
+  while (rw->num_deltas && rewind_size(rw) > rw->budget) {
+    rewind_pop_oldest(rw);
+  }
+}
+
+int64_t rewind_size(struct rewind *rw) {
+  return rw->size + rewind_overhead(rw);
+}
+
+int rewind_num_states(struct rewind *rw) {
+  return rw->num_deltas;
+}
+
+int rewind_load(struct rewind *rw, struct dreamcast *dc) {
+  if (!rw->num_deltas) {
+    return 0;
+  }
+
+  struct savestate *ss = rw->ss;
+  int newest = (rw->head + rw->num_deltas - 1) % REWIND_MAX_DELTAS;
+  struct rewind_delta *delta = &rw->deltas[newest];
+  int data_words = ALIGN_UP(MAX(rw->data_size, delta->data_size), 4);
+
+  const uint8_t *pages = delta->data;
+  const uint8_t *src = pages + delta->num_pages * sizeof(int32_t);
+
+  /* step the device state back. the bytes past the earlier state's size xor
+     back to zero */
+  rewind_reserve_data(rw, data_words);
+  src = rewind_decode(src, rw->data, data_words);
+  rw->data_size = delta->data_size;
+
+  /* and each page of memory that was changed */
+  for (int i = 0; i < delta->num_pages; i++) {
+    int32_t page;
+    memcpy(&page, pages + i * sizeof(int32_t), sizeof(page));
+    CHECK_LT(page, savestate_num_pages(ss));
+
+    uint8_t *dst = ss->mem + ((int64_t)page << SAVESTATE_PAGE_SHIFT);
+    src = rewind_decode(src, dst, SAVESTATE_PAGE_SIZE);
+
+    /* the page may not have been written to since, make sure the load still
+       copies it back */
+    bitmap_set(ss->modified, page, 1);
+  }
+
+  CHECK_EQ(src, delta->data + delta->size);
+
+  savestate_set_data(ss, rw->data, rw->data_size);
+  dc_load_state(dc, ss);
+
+  rewind_pop_newest(rw);
+
+  return 1;
+}
+
+void rewind_save(struct rewind *rw, struct dreamcast *dc) {
+  struct savestate *ss = rw->ss;
+
+  /* the first state has nothing to be delta'd against */
+  int first = !ss->mem_valid;
+
+  dc_save_state(dc, ss, 1);
+
+  if (!first) {
+    rewind_push_delta(rw);
+  }
+
+  rewind_set_data(rw, ss->data, ss->data_size);
+}
+
+void rewind_destroy(struct rewind *rw) {
+  while (rw->num_deltas) {
+    rewind_pop_oldest(rw);
+  }
+
+  savestate_destroy(rw->ss);
+  free(rw->scratch);
+  free(rw->data);
+  free(rw);
+}
+
+struct rewind *rewind_create(int64_t budget) {
+  struct rewind *rw = calloc(1, sizeof(struct rewind));
+
+  rw->budget = budget;
+  rw->ss = savestate_create();
+  rw->ss->record_deltas = 1;
+
+  return rw;
+}
@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+
+/*
+ * history of the machine's state, for stepping backwards in time
+ *
+ * the most recent state is kept in full as a savestate. each state before it
+ * is stored as a delta against the state that followed it, so stepping back
+ * applies the newest delta to the full state and loads the result
+ *
+ * deltas are built from the incremental saves, only the pages changed since
+ * the previous state are xor'd against their previous contents. the xor'd
+ * pages are mostly zeros, and are run-length encoded as they're stored. once
+ * the memory used exceeds the budget, the oldest deltas are discarded. the
+ * memory used includes the most recent state, which alone is the size of all
+ * of guest memory
+ */
+
+struct dreamcast;
+struct rewind;
+
+struct rewind *rewind_create(int64_t budget);
+void rewind_destroy(struct rewind *rw);
+
+/* record the machine's current state */
+void rewind_save(struct rewind *rw, struct dreamcast *dc);
+
+/* step the machine back to the state recorded before the most recent one,
+   returns 0 if there's no earlier state */
+int rewind_load(struct rewind *rw, struct dreamcast *dc);
+
+int rewind_num_states(struct rewind *rw);
+
+/* memory used by the stored deltas, the most recent state and the buffers
+   they're built in */
+int64_t rewind_size(struct rewind *rw);
+
+#endif
@@ -2,6 +2,7 @@
 #include "core/filesystem.h"
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
+#include "guest/savestate.h"
 
 #define FLASH_SECTOR_SIZE 0x4000
 
@@ -194,6 +195,16 @@ uint32_t flash_rom_read(struct flash *flash, uint32_t addr, uint32_t mask) {
   return flash_cmd_read(flash, addr, mask);
 }
 
+static void flash_serialize(struct device *dev, struct savestate *ss) {
+  struct flash *flash = (struct flash *)dev;
+
+  /* the rom is rarely written to, save it alongside guest memory so it's only
+     copied when it has changed */
+  savestate_pages(ss, flash->rom, sizeof(flash->rom), NULL, 0);
+  SAVESTATE_VALUE(ss, flash->cmd);
+  SAVESTATE_VALUE(ss, flash->cmd_state);
+}
+
 void flash_destroy(struct flash *flash) {
   flash_save_rom(flash);
   dc_destroy_device((struct device *)flash);
@@ -203,5 +214,9 @@ struct flash *flash_create(struct dreamcast *dc) {
   struct flash *flash =
       dc_create_device(dc, sizeof(struct flash), "flash", &flash_init, NULL);
 
+  /* setup state interface */
+  flash->stateif.enabled = 1;
+  flash->stateif.serialize = &flash_serialize;
+
   return flash;
 }
@@ -0,0 +1,370 @@
+#include <zlib.h>
+#include "guest/savestate.h"
+#include "core/core.h"
+#include "core/hash.h"
+#include "core/version.h"
+
+#define SAVESTATE_MAGIC 0x41545352 /* RSTA */
+#define SAVESTATE_VERSION 1
+
+/* device state is copied out of each device's struct as is, so snapshots are
+   only compatible with the build that wrote them */
+struct savestate_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t build;
+  int32_t data_size;
+  int32_t mem_size;
+};
+
+static uint64_t savestate_build() {
+  return hash_data(GIT_VERSION, (int)strlen(GIT_VERSION), 0);
+}
+
+static void savestate_reserve_data(struct savestate *ss, int size) {
+  if (size <= ss->data_max) {
+    return;
+  }
+
+  ss->data_max = MAX(ss->data_max * 2, size);
+  ss->data = realloc(ss->data, ss->data_max);
+  CHECK_NOTNULL(ss->data);
+}
+
+static uint8_t *savestate_alloc_delta(struct savestate *ss) {
+  int size = ss->deltas_size + SAVESTATE_PAGE_SIZE;
+
+  if (size > ss->deltas_max) {
+    ss->deltas_max = MAX(ss->deltas_max * 2, size);
+    ss->deltas = realloc(ss->deltas, ss->deltas_max);
+    CHECK_NOTNULL(ss->deltas);
+  }
+
+  uint8_t *delta = ss->deltas + ss->deltas_size;
+  ss->deltas_size = size;
+  return delta;
+}
+
+static void savestate_reserve_mem(struct savestate *ss, int size) {
+  if (size <= ss->mem_size) {
+    return;
+  }
+
+  int old_pages = savestate_num_pages(ss);
+  int new_pages = size >> SAVESTATE_PAGE_SHIFT;
+
+  ss->mem = realloc(ss->mem, size);
+  CHECK_NOTNULL(ss->mem);
+  ss->dirty = realloc(ss->dirty, new_pages * sizeof(bitmap_t));
+  CHECK_NOTNULL(ss->dirty);
+  bitmap_clear(ss->dirty, old_pages, new_pages - old_pages);
+  ss->modified = realloc(ss->modified, new_pages * sizeof(bitmap_t));
+  CHECK_NOTNULL(ss->modified);
+  bitmap_clear(ss->modified, old_pages, new_pages - old_pages);
+
+  ss->mem_size = size;
+
+  /* the new region has nothing to compare against */
+  ss->mem_valid = 0;
+}
+
+static int savestate_check_header(const struct savestate_header *hdr) {
+  if (hdr->magic != SAVESTATE_MAGIC || hdr->version != SAVESTATE_VERSION) {
+    LOG_WARNING("savestate_check_header unsupported state");
+    return 0;
+  }
+
+  if (hdr->build != savestate_build()) {
+    LOG_WARNING("savestate_check_header state was saved by a different build");
+    return 0;
+  }
+
+  if (hdr->data_size < 0 || hdr->mem_size < 0 ||
+      (hdr->mem_size % SAVESTATE_PAGE_SIZE)) {
+    LOG_WARNING("savestate_check_header corrupt state");
+    return 0;
+  }
+
+  return 1;
+}
+
+static void savestate_init_header(struct savestate *ss,
+                                  struct savestate_header *hdr) {
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->magic = SAVESTATE_MAGIC;
+  hdr->version = SAVESTATE_VERSION;
+  hdr->build = savestate_build();
+  hdr->data_size = ss->data_size;
+  hdr->mem_size = ss->mem_size;
+}
+
+/* the image read in replaces the previous one entirely, flag every page as
+   having changed. it has no relation to guest memory's write tracking, so
+   every page is compared on the next load */
+static void savestate_loaded(struct savestate *ss) {
+  int num_pages = savestate_num_pages(ss);
+  bitmap_set(ss->dirty, 0, num_pages);
+  ss->num_dirty = num_pages;
+  ss->mem_valid = 1;
+  ss->epoch = 0;
+}
+
+int savestate_read_file(struct savestate *ss, const char *path) {
+  gzFile file = gzopen(path, "rb");
+  if (!file) {
+    LOG_WARNING("savestate_read_file failed to open %s", path);
+    return 0;
+  }
+
+  struct savestate_header hdr;
+  int res = gzread(file, &hdr, sizeof(hdr)) == (int)sizeof(hdr) &&
+            savestate_check_header(&hdr);
+
+  if (res) {
+    savestate_reserve_data(ss, hdr.data_size);
+    savestate_reserve_mem(ss, hdr.mem_size);
+    ss->data_size = hdr.data_size;
+
+    res = gzread(file, ss->data, hdr.data_size) == hdr.data_size &&
+          gzread(file, ss->mem, hdr.mem_size) == hdr.mem_size &&
+          ss->mem_size == hdr.mem_size;
+  }
+
+  gzclose(file);
+
+  if (!res) {
+    LOG_WARNING("savestate_read_file failed to read %s", path);
+    ss->mem_valid = 0;
+    return 0;
+  }
+
+  savestate_loaded(ss);
+
+  return 1;
+}
+
+int savestate_write_file(struct savestate *ss, const char *path) {
+  CHECK(ss->mem_valid);
+
+  /* most of guest memory is usually empty or repetitive, compress it as it's
+     written out */
+  gzFile file = gzopen(path, "wb1");
+  if (!file) {
+    LOG_WARNING("savestate_write_file failed to open %s", path);
+    return 0;
+  }
+
+  struct savestate_header hdr;
+  savestate_init_header(ss, &hdr);
+
+  int res = gzwrite(file, &hdr, sizeof(hdr)) == (int)sizeof(hdr) &&
+            gzwrite(file, ss->data, ss->data_size) == ss->data_size &&
+            gzwrite(file, ss->mem, ss->mem_size) == ss->mem_size;
+
+  res &= gzclose(file) == Z_OK;
+
+  if (!res) {
+    LOG_WARNING("savestate_write_file failed to write %s", path);
+  }
+
+  return res;
+}
+
+int savestate_read(struct savestate *ss, const void *ptr, int size) {
+  const uint8_t *src = ptr;
+
+  struct savestate_header hdr;
+  if (size < (int)sizeof(hdr)) {
+    return 0;
+  }
+  memcpy(&hdr, src, sizeof(hdr));
+  src += sizeof(hdr);
+
+  if (!savestate_check_header(&hdr)) {
+    return 0;
+  }
+
+  if ((int)sizeof(hdr) + hdr.data_size + hdr.mem_size > size) {
+    LOG_WARNING("savestate_read truncated state");
+    return 0;
+  }
+
+  /* the memory image's layout is fixed for the life of the snapshot */
+  if (ss->mem_size && ss->mem_size != hdr.mem_size) {
+    LOG_WARNING("savestate_read memory size mismatch");
+    return 0;
+  }
+
+  savestate_reserve_data(ss, hdr.data_size);
+  memcpy(ss->data, src, hdr.data_size);
+  ss->data_size = hdr.data_size;
+  src += hdr.data_size;
+
+  savestate_reserve_mem(ss, hdr.mem_size);
+  memcpy(ss->mem, src, hdr.mem_size);
+
+  savestate_loaded(ss);
+
+  return 1;
+}
+
+int savestate_write(struct savestate *ss, void *ptr, int size) {
+  CHECK(ss->mem_valid);
+
+  if (size < savestate_size(ss)) {
+    return 0;
+  }
+
+  uint8_t *dst = ptr;
+
+  struct savestate_header hdr;
+  savestate_init_header(ss, &hdr);
+  memcpy(dst, &hdr, sizeof(hdr));
+  dst += sizeof(hdr);
+
+  memcpy(dst, ss->data, ss->data_size);
+  dst += ss->data_size;
+
+  memcpy(dst, ss->mem, ss->mem_size);
+
+  return 1;
+}
+
+int savestate_size(struct savestate *ss) {
+  return (int)sizeof(struct savestate_header) + ss->data_size + ss->mem_size;
+}
+
+void savestate_set_data(struct savestate *ss, const void *data, int size) {
+  savestate_reserve_data(ss, size);
+  memcpy(ss->data, data, size);
+  ss->data_size = size;
+}
+
+int savestate_num_pages(struct savestate *ss) {
+  return ss->mem_size >> SAVESTATE_PAGE_SHIFT;
+}
+
+void savestate_pages(struct savestate *ss, uint8_t *ptr, int size,
+                     const bitmap_t *written, int first_written) {
+  CHECK_EQ(size % SAVESTATE_PAGE_SIZE, 0);
+
+  if (!ss->loading) {
+    savestate_reserve_mem(ss, ss->mem_pos + size);
+  }
+
+  CHECK_LE(ss->mem_pos + size, ss->mem_size);
+
+  int full = !ss->loading && (!ss->incremental || !ss->mem_valid);
+  int record = ss->record_deltas && !ss->loading && !full;
+  uint8_t *image = ss->mem + ss->mem_pos;
+  int first_page = ss->mem_pos >> SAVESTATE_PAGE_SHIFT;
+  int num_pages = size >> SAVESTATE_PAGE_SHIFT;
+
+  for (int i = 0; i < num_pages; i++) {
+    int page = first_page + i;
+    int offset = i << SAVESTATE_PAGE_SHIFT;
+
+    if (!full) {
+      /* the image and guest memory can only differ in pages which were written
+         to since they were synced, or were modified in the image directly */
+      if (written && !bitmap_test(written, first_written + i, 1) &&
+          !bitmap_test(ss->modified, page, 1)) {
+        continue;
+      }
+
+      /* pages are often written to without their contents changing */
+      if (!memcmp(&image[offset], &ptr[offset], SAVESTATE_PAGE_SIZE)) {
+        continue;
+      }
+    }
+
+    if (ss->loading) {
+      memcpy(&ptr[offset], &image[offset], SAVESTATE_PAGE_SIZE);
+      ss->num_restored++;
+    } else {
+      if (record) {
+        /* record the xor and copy the page in a single pass, a word at a
+           time. pages and deltas are always word aligned */
+        uint64_t *delta = (uint64_t *)savestate_alloc_delta(ss);
+        uint64_t *dst = (uint64_t *)&image[offset];
+        const uint64_t *src = (const uint64_t *)&ptr[offset];
+
+        for (int j = 0; j < SAVESTATE_PAGE_SIZE / 8; j++) {
+          delta[j] = dst[j] ^ src[j];
+          dst[j] = src[j];
+        }
+      } else {
+        memcpy(&image[offset], &ptr[offset], SAVESTATE_PAGE_SIZE);
+      }
+    }
+
+    bitmap_set(ss->dirty, page, 1);
+    ss->num_dirty++;
+  }
+
+  ss->mem_pos += size;
+}
+
+void savestate_bytes(struct savestate *ss, void *ptr, int size) {
+  if (ss->loading) {
+    CHECK_LE(ss->data_pos + size, ss->data_size);
+    memcpy(ptr, &ss->data[ss->data_pos], size);
+    ss->data_pos += size;
+    return;
+  }
+
+  savestate_reserve_data(ss, ss->data_size + size);
+  memcpy(&ss->data[ss->data_size], ptr, size);
+  ss->data_size += size;
+}
+
+int savestate_loading(struct savestate *ss) {
+  return ss->loading;
+}
+
+void savestate_end(struct savestate *ss) {
+  CHECK_EQ(ss->mem_pos, ss->mem_size);
+
+  /* the image is now in sync with guest memory */
+  bitmap_clear(ss->modified, 0, savestate_num_pages(ss));
+
+  if (ss->loading) {
+    CHECK_EQ(ss->data_pos, ss->data_size);
+    ss->loading = 0;
+    return;
+  }
+
+  ss->mem_valid = 1;
+}
+
+void savestate_begin(struct savestate *ss, int loading, int incremental) {
+  ss->loading = loading;
+  ss->incremental = incremental;
+  ss->data_pos = 0;
+  ss->mem_pos = 0;
+  ss->num_dirty = 0;
+  bitmap_clear(ss->dirty, 0, savestate_num_pages(ss));
+
+  if (loading) {
+    CHECK(ss->mem_valid, "savestate_begin nothing has been saved");
+    ss->num_restored = 0;
+    return;
+  }
+
+  ss->data_size = 0;
+  ss->deltas_size = 0;
+}
+
+void savestate_destroy(struct savestate *ss) {
+  free(ss->deltas);
+  free(ss->modified);
+  free(ss->dirty);
+  free(ss->mem);
+  free(ss->data);
+  free(ss);
+}
+
+struct savestate *savestate_create() {
+  struct savestate *ss = calloc(1, sizeof(struct savestate));
+  return ss;
+}
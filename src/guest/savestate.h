@@ -0,0 +1,104 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stdint.h>
+#include "core/bitmap.h"
+
+/*
+ * snapshot of the machine's state
+ *
+ * each device serializes its own state through a single callback, which is
+ * called both when saving and loading. values are copied to or from the
+ * snapshot in the order they're visited, so the callback only needs to visit
+ * the same values in the same order each time
+ *
+ * guest memory is kept separately as a full image, divided into 4 kb pages.
+ * the owner of each region of memory passes along which of its pages have
+ * been written to since the image was last synced with it. when saving
+ * incrementally, only those pages are compared against the image and copied
+ * into it, and loads only copy back those pages. this makes frequent snapshots
+ * cost proportionally to what has changed since the last one, and gives
+ * consumers such as the rewind buffer the set of changed pages to work from.
+ * regions without write tracking fall back to comparing every page
+ */
+
+#define SAVESTATE_PAGE_SHIFT 12
+#define SAVESTATE_PAGE_SIZE (1 << SAVESTATE_PAGE_SHIFT)
+
+struct savestate {
+  /* set while the snapshot is being loaded into the machine */
+  int loading;
+  int incremental;
+
+  /* device state, appended to by each device when saving and consumed in the
+     same order when loading */
+  uint8_t *data;
+  int data_size;
+  int data_max;
+  int data_pos;
+
+  /* image of guest memory as of the last save. each page copied to or from
+     the image during the last save or load is flagged in dirty */
+  uint8_t *mem;
+  int mem_size;
+  int mem_pos;
+  int mem_valid;
+  bitmap_t *dirty;
+  int num_dirty;
+
+  /* epoch of guest memory's write tracking as of the last time the image was
+     synced with it, 0 if the image didn't come from this machine */
+  uint32_t epoch;
+
+  /* pages of the image modified directly since it was last synced, these are
+     copied on the next save or load regardless of guest memory being written */
+  bitmap_t *modified;
+
+  /* when set, incremental saves also record the xor of each changed page's
+     previous and new contents, in the order the pages are flagged in dirty */
+  int record_deltas;
+  uint8_t *deltas;
+  int deltas_size;
+  int deltas_max;
+
+  /* pages copied back to guest memory during the last load */
+  int num_restored;
+
+  /* latency of the last save and load */
+  int64_t save_time;
+  int64_t load_time;
+};
+
+struct savestate *savestate_create();
+void savestate_destroy(struct savestate *ss);
+
+/* called around each save or load of the machine's state */
+void savestate_begin(struct savestate *ss, int loading, int incremental);
+void savestate_end(struct savestate *ss);
+
+/* serialization interface for devices */
+int savestate_loading(struct savestate *ss);
+void savestate_bytes(struct savestate *ss, void *ptr, int size);
+
+/* written flags which of the region's pages have been written to since the
+   image was last synced with it, starting at bit first_written. each page is
+   compared against the image when it's NULL */
+void savestate_pages(struct savestate *ss, uint8_t *ptr, int size,
+                     const bitmap_t *written, int first_written);
+
+#define SAVESTATE_VALUE(ss, v) savestate_bytes(ss, &(v), (int)sizeof(v))
+
+int savestate_num_pages(struct savestate *ss);
+
+/* replaces the device state of the snapshot, used when stepping it back to an
+   earlier state */
+void savestate_set_data(struct savestate *ss, const void *data, int size);
+
+/* persisting snapshots to memory or disk */
+int savestate_size(struct savestate *ss);
+int savestate_write(struct savestate *ss, void *ptr, int size);
+int savestate_read(struct savestate *ss, const void *ptr, int size);
+int savestate_write_file(struct savestate *ss, const char *path);
+int savestate_read_file(struct savestate *ss, const char *path);
+
+#endif
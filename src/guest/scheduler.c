@@ -3,6 +3,7 @@
 #include "core/core.h"
 #include "core/list.h"
 #include "guest/dreamcast.h"
+#include "guest/savestate.h"
 
 #define MAX_TIMERS 128
 
@@ -32,6 +33,11 @@ void sched_cancel_timer(struct scheduler *sched, struct timer *timer) {
   list_add(&sched->free_timers, &timer->it);
 }
 
+/* note, while devices are running this is the time at the end of their slice */
+int64_t sched_current_time(struct scheduler *sched) {
+  return sched->base_time;
+}
+
 int64_t sched_remaining_time(struct scheduler *sched, struct timer *timer) {
   return timer->expire - sched->base_time;
 }
@@ -66,6 +72,136 @@ struct timer *sched_start_timer(struct scheduler *sched, timer_cb cb,
   return timer;
 }
 
+/* timers are serialized with their callback as an offset from a function in
+   this file, and their data as an offset into the device it points into.
+   unlike the raw pointers, both are stable between runs of the same build */
+struct timer_state {
+  int32_t index;
+  int32_t device;
+  int64_t expire;
+  int64_t cb;
+  int64_t data;
+};
+
+static void sched_save_timer(struct scheduler *sched, struct timer *timer,
+                             struct timer_state *state) {
+  state->index = (int32_t)(timer - sched->timers);
+  state->device = 0;
+  state->expire = timer->expire;
+  state->cb = (intptr_t)timer->cb - (intptr_t)&sched_tick;
+
+  list_for_each_entry(dev, &sched->dc->devices, struct device, it) {
+    uint8_t *begin = (uint8_t *)dev;
+    uint8_t *data = timer->data;
+
+    if (data >= begin && data < begin + dev->size) {
+      state->data = (int64_t)(data - begin);
+      return;
+    }
+
+    state->device++;
+  }
+
+  LOG_FATAL("sched_save_timer timer data isn't owned by a device");
+}
+
+static void sched_load_timer(struct scheduler *sched,
+                             const struct timer_state *state) {
+  CHECK(state->index >= 0 && state->index < MAX_TIMERS);
+
+  struct timer *timer = &sched->timers[state->index];
+  CHECK(!timer->active);
+  timer->active = 1;
+  timer->expire = state->expire;
+  timer->cb = (timer_cb)((intptr_t)&sched_tick + (intptr_t)state->cb);
+  timer->data = NULL;
+
+  int n = 0;
+  list_for_each_entry(dev, &sched->dc->devices, struct device, it) {
+    if (n++ == state->device) {
+      timer->data = (uint8_t *)dev + state->data;
+      break;
+    }
+  }
+
+  CHECK_NOTNULL(timer->data);
+}
+
+void sched_serialize_timer(struct scheduler *sched, struct savestate *ss,
+                           struct timer **timer) {
+  int32_t index = *timer ? (int32_t)(*timer - sched->timers) : -1;
+
+  SAVESTATE_VALUE(ss, index);
+
+  if (savestate_loading(ss)) {
+    CHECK(index >= -1 && index < MAX_TIMERS);
+    *timer = index >= 0 ? &sched->timers[index] : NULL;
+  }
+}
+
+void sched_serialize(struct scheduler *sched, struct savestate *ss) {
+  SAVESTATE_VALUE(ss, sched->base_time);
+
+  /* devices reference their timers by index, so each timer is restored to the
+     same slot, and the free list is restored in the same order for the slots
+     allocated after loading to match */
+  int32_t num_live = 0;
+  int32_t free_order[MAX_TIMERS];
+  int32_t num_free = 0;
+
+  list_for_each_entry(timer, &sched->live_timers, struct timer, it) {
+    num_live++;
+  }
+
+  list_for_each_entry(timer, &sched->free_timers, struct timer, it) {
+    free_order[num_free++] = (int32_t)(timer - sched->timers);
+  }
+
+  SAVESTATE_VALUE(ss, num_live);
+  SAVESTATE_VALUE(ss, num_free);
+  CHECK_EQ(num_live + num_free, MAX_TIMERS);
+
+  if (!savestate_loading(ss)) {
+    list_for_each_entry(timer, &sched->live_timers, struct timer, it) {
+      struct timer_state state;
+      sched_save_timer(sched, timer, &state);
+      SAVESTATE_VALUE(ss, state);
+    }
+
+    savestate_bytes(ss, free_order, num_free * (int)sizeof(free_order[0]));
+    return;
+  }
+
+  list_clear(&sched->live_timers);
+  list_clear(&sched->free_timers);
+
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    sched->timers[i].active = 0;
+  }
+
+  /* the live list was saved in order, append each timer back to it */
+  struct timer *last = NULL;
+
+  for (int i = 0; i < num_live; i++) {
+    struct timer_state state;
+    SAVESTATE_VALUE(ss, state);
+    sched_load_timer(sched, &state);
+
+    struct timer *timer = &sched->timers[state.index];
+    list_add_after_entry(&sched->live_timers, last, timer, it);
+    last = timer;
+  }
+
+  savestate_bytes(ss, free_order, num_free * (int)sizeof(free_order[0]));
+
+  for (int i = 0; i < num_free; i++) {
+    CHECK(free_order[i] >= 0 && free_order[i] < MAX_TIMERS);
+    struct timer *timer = &sched->timers[free_order[i]];
+    CHECK(!timer->active);
+    list_add(&sched->free_timers, &timer->it);
+  }
+}
+
 void sched_tick(struct scheduler *sched, int64_t ns) {
   int64_t target_time = sched->base_time + ns;
 
@@ -5,6 +5,7 @@
 #include "core/time.h"
 
 struct dreamcast;
+struct savestate;
 struct timer;
 struct scheduler;
 
@@ -19,10 +20,15 @@ struct scheduler *sched_create(struct dreamcast *dc);
 void sched_destroy(struct scheduler *sch);
 
 void sched_tick(struct scheduler *sch, int64_t ns);
+int64_t sched_current_time(struct scheduler *sch);
 
 struct timer *sched_start_timer(struct scheduler *sch, timer_cb cb, void *data,
                                 int64_t ns);
 int64_t sched_remaining_time(struct scheduler *sch, struct timer *);
 void sched_cancel_timer(struct scheduler *sch, struct timer *);
 
+void sched_serialize(struct scheduler *sch, struct savestate *ss);
+void sched_serialize_timer(struct scheduler *sch, struct savestate *ss,
+                           struct timer **timer);
+
 #endif
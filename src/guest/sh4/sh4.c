@@ -3,12 +3,14 @@
 #include "guest/bios/bios.h"
 #include "guest/dreamcast.h"
 #include "guest/memory.h"
+#include "guest/savestate.h"
 #include "guest/scheduler.h"
 #include "imgui.h"
 #include "jit/frontend/sh4/sh4_fallback.h"
 #include "jit/frontend/sh4/sh4_frontend.h"
 #include "jit/frontend/sh4/sh4_guest.h"
 #include "jit/jit.h"
+#include "jit/jit_guest.h"
 #include "stats.h"
 
 #if ARCH_X64
@@ -45,6 +47,8 @@ static void sh4_sr_updated(struct sh4 *sh4, uint32_t old_sr) {
       (ctx->sr & BL_MASK) != (old_sr & BL_MASK)) {
     sh4_intc_update_pending(sh4);
   }
+
+  sh4_mmu_sr_updated(sh4, old_sr);
 }
 
 static void sh4_fpscr_updated(struct sh4 *sh4, uint32_t old_fpscr) {
@@ -70,7 +74,7 @@ static void sh4_sleep(void *data) {
   sh4->ctx.sleep_mode = 1;
 }
 
-static void sh4_exception(struct sh4 *sh4, enum sh4_exception exc) {
+void sh4_raise_exception(struct sh4 *sh4, enum sh4_exception exc) {
   struct sh4_exception_info *exc_info = &sh4_exceptions[exc];
 
   /* let the custom exception handler have a first chance */
@@ -117,13 +121,50 @@ static void sh4_link_code(struct sh4 *sh4, void *branch, uint32_t target) {
   jit_link_code(sh4->jit, branch, target);
 }
 
+static int sh4_fetch_block(struct sh4 *sh4, uint32_t addr) {
+  struct jit_guest *guest = sh4->guest;
+  enum sh4_exception exc;
+
+  if (!sh4_mmu_translate_code(sh4, addr, &exc)) {
+    sh4_raise_exception(sh4, exc);
+    return 0;
+  }
+
+  /* blocks don't extend past the page they begin in, other than a block
+     beginning with a delayed branch at the end of the page. the delay slot's
+     fetch is checked here as well, raising any exception at the branch */
+  uint32_t page_mask = (1u << SH4_TLB_SHIFT) - 1;
+
+  if ((addr + 2) & page_mask) {
+    return 1;
+  }
+
+  uint32_t paddr = jit_guest_translate(guest, addr, JIT_TLB_EXEC);
+  struct jit_opdef *def = sh4_get_opdef(sh4_read16(sh4->dc->mem, paddr));
+
+  if ((def->flags & SH4_FLAG_DELAYED) &&
+      !sh4_mmu_translate_code(sh4, addr + 2, &exc)) {
+    sh4_raise_exception(sh4, exc);
+    return 0;
+  }
+
+  return 1;
+}
+
 static void sh4_compile_code(struct sh4 *sh4, uint32_t addr) {
+  /* instruction tlb exceptions are raised when dispatching to a new block,
+     the exception handler's block is then dispatched to in its place */
+  if (sh4->MMUCR->AT && !sh4_fetch_block(sh4, addr)) {
+    return;
+  }
+
   jit_compile_code(sh4->jit, addr);
 }
 
 static void sh4_invalid_instr(struct sh4 *sh4) {
   struct memory *mem = sh4->dc->mem;
   struct bios *bios = sh4->dc->bios;
+  struct jit_guest *guest = sh4->guest;
 
   /* TODO write tests to confirm if any other instructions generate illegal
      instruction exceptions */
@@ -140,14 +181,15 @@ static void sh4_invalid_instr(struct sh4 *sh4) {
     return;
   }
 
-  uint32_t pc = sh4->ctx.pc;
+  uint32_t pc = jit_guest_translate(guest, sh4->ctx.pc, JIT_TLB_EXEC);
   uint16_t data = sh4_read16(mem, pc);
   struct jit_opdef *def = sh4_get_opdef(data);
   enum sh4_exception exc = SH4_EXC_ILLINSTR;
 
   /* op may be valid if the delay slot raised this */
   if (def->op != SH4_OP_INVALID) {
-    data = sh4_read16(mem, pc + 2);
+    pc = jit_guest_translate(guest, sh4->ctx.pc + 2, JIT_TLB_EXEC);
+    data = sh4_read16(mem, pc);
     def = sh4_get_opdef(data);
     exc = SH4_EXC_ILLSLOT;
   }
@@ -158,7 +200,14 @@ static void sh4_invalid_instr(struct sh4 *sh4) {
 
   CHECK_EQ(def->op, SH4_OP_INVALID);
 
-  sh4_exception(sh4, exc);
+  sh4_raise_exception(sh4, exc);
+}
+
+int64_t sh4_slice_remaining(struct sh4 *sh4) {
+  /* run_cycles is decremented as each block is executed, and is <= 0 once the
+     slice has been ran */
+  int cycles = MAX(sh4->ctx.run_cycles, 0);
+  return CYCLES_TO_NANO(cycles, SH4_CLOCK_FREQ);
 }
 
 static void sh4_run(struct device *dev, int64_t ns) {
@@ -174,6 +223,38 @@ static void sh4_run(struct device *dev, int64_t ns) {
   prof_counter_add(COUNTER_sh4_instrs, sh4->ctx.ran_instrs);
 }
 
+static void sh4_serialize(struct device *dev, struct savestate *ss) {
+  struct sh4 *sh4 = (struct sh4 *)dev;
+  struct scheduler *sched = sh4->dc->sched;
+
+  SAVESTATE_VALUE(ss, sh4->ctx);
+  SAVESTATE_VALUE(ss, sh4->reg);
+  SAVESTATE_VALUE(ss, sh4->sq);
+  SAVESTATE_VALUE(ss, sh4->sorted_interrupts);
+  SAVESTATE_VALUE(ss, sh4->sort_id);
+  SAVESTATE_VALUE(ss, sh4->priority_mask);
+  SAVESTATE_VALUE(ss, sh4->requested_interrupts);
+  SAVESTATE_VALUE(ss, sh4->utlb);
+  SAVESTATE_VALUE(ss, sh4->itlb);
+  SAVESTATE_VALUE(ss, sh4->SCFSR2_last_read);
+  SAVESTATE_VALUE(ss, sh4->receive_fifo);
+  SAVESTATE_VALUE(ss, sh4->transmit_fifo);
+
+  for (int i = 0; i < ARRAY_SIZE(sh4->tmu_timers); i++) {
+    sched_serialize_timer(sched, ss, &sh4->tmu_timers[i]);
+  }
+
+  if (!savestate_loading(ss)) {
+    return;
+  }
+
+  /* translations cached and code compiled under the previous state are no
+     longer valid */
+  sh4->guest->tlb = sh4->MMUCR->AT ? sh4->tlb_cache : NULL;
+  sh4_mmu_flush(sh4);
+  jit_free_code(sh4->jit);
+}
+
 static void sh4_guest_destroy(struct jit_guest *guest) {
   free((struct sh4_guest *)guest);
 }
@@ -184,6 +265,12 @@ static struct jit_guest *sh4_guest_create(struct sh4 *sh4) {
   /* dispatch cache */
   guest->addr_mask = 0x00fffffe;
 
+  /* address translation, the tlb is only enabled once MMUCR.AT is set */
+  guest->tlb_shift = SH4_TLB_SHIFT;
+  guest->offset_fault = (int)offsetof(struct sh4_context, fault);
+  guest->translate = (jit_translate_cb)&sh4_mmu_translate;
+  guest->translated = (jit_translated_cb)&sh4_mmu_translated;
+
   /* memory interface */
   guest->ctx = &sh4->ctx;
   guest->membase = sh4_base(sh4->dc->mem);
@@ -220,6 +307,9 @@ static int sh4_init(struct device *dev) {
   struct sh4 *sh4 = (struct sh4 *)dev;
   struct dreamcast *dc = sh4->dc;
 
+  /* initialize mmu */
+  sh4->tlb_cache = calloc(SH4_TLB_CACHE_SIZE, sizeof(uint32_t));
+
   /* initialize jit */
   sh4->guest = sh4_guest_create(sh4);
   sh4->frontend = sh4_frontend_create(sh4->guest);
@@ -270,8 +360,7 @@ void sh4_reset(struct sh4 *sh4, uint32_t pc) {
 #undef SH4_REG
 
   /* reset tlb */
-  memset(sh4->utlb_sq_map, 0, sizeof(sh4->utlb_sq_map));
-  memset(sh4->utlb, 0, sizeof(sh4->utlb));
+  sh4_mmu_reset(sh4);
 
   /* reset interrupts */
   sh4_intc_reprioritize(sh4);
@@ -325,6 +414,7 @@ void sh4_destroy(struct sh4 *sh4) {
   sh4_guest_destroy(sh4->guest);
   sh4->frontend->destroy(sh4->frontend);
   sh4->backend->destroy(sh4->backend);
+  free(sh4->tlb_cache);
   dc_destroy_device((struct device *)sh4);
 }
 
@@ -345,6 +435,10 @@ struct sh4 *sh4_create(struct dreamcast *dc) {
   sh4->runif.enabled = 1;
   sh4->runif.run = &sh4_run;
 
+  /* setup state interface */
+  sh4->stateif.enabled = 1;
+  sh4->stateif.serialize = &sh4_serialize;
+
   return sh4;
 }
 
@@ -59,8 +59,14 @@ struct sh4 {
   /* pending interrupts moved to context for fast jit access */
 
   /* mmu */
-  uint32_t utlb_sq_map[64];
   struct sh4_tlb_entry utlb[64];
+  struct sh4_tlb_entry itlb[4];
+  /* translations cached for the jit's inline tlb probes, along with a log of
+     the filled pages so they can be flushed without clearing the entire
+     cache */
+  uint32_t *tlb_cache;
+  uint32_t tlb_log[SH4_TLB_LOG_SIZE];
+  int num_tlb_log;
 
   /* scif */
   uint32_t SCFSR2_last_read;
@@ -79,10 +85,12 @@ struct sh4 *sh4_create(struct dreamcast *dc);
 void sh4_destroy(struct sh4 *sh4);
 void sh4_debug_menu(struct sh4 *sh4);
 void sh4_reset(struct sh4 *sh4, uint32_t pc);
+int64_t sh4_slice_remaining(struct sh4 *sh4);
 
 void sh4_set_exception_handler(struct sh4 *sh4,
                                sh4_exception_handler_cb handler, void *data);
 
+void sh4_raise_exception(struct sh4 *sh4, enum sh4_exception exc);
 void sh4_raise_interrupt(struct sh4 *sh4, enum sh4_interrupt intr);
 void sh4_clear_interrupt(struct sh4 *sh4, enum sh4_interrupt intr);
 
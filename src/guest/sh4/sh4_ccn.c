@@ -1,6 +1,8 @@
 #include "guest/memory.h"
+#include "guest/pvr/ta.h"
 #include "guest/sh4/sh4.h"
 #include "jit/jit.h"
+#include "jit/jit_guest.h"
 
 #if 0
 #define LOG_CCN LOG_INFO
@@ -39,12 +41,11 @@ void sh4_ccn_pref(struct sh4 *sh4, uint32_t addr) {
   uint32_t sqi = (addr & 0x20) >> 5;
 
   if (sh4->MMUCR->AT) {
-    /* get upper 12 bits from UTLB */
-    uint32_t vpn = addr >> 20;
-    dst = sh4->utlb_sq_map[vpn & 0x3f];
-
-    /* get lower 20 bits from original address */
-    dst |= addr & 0xfffe0;
+    /* translate the sq address through the utlb. on a miss, the exception has
+       been raised and nothing is written */
+    if (!sh4_mmu_translate_sq(sh4, addr & 0xffffffe0, &dst)) {
+      return;
+    }
   } else {
     /* get upper 6 bits from QACR* registers */
     if (sqi) {
@@ -57,6 +58,21 @@ void sh4_ccn_pref(struct sh4 *sh4, uint32_t addr) {
     dst |= addr & 0x3ffffe0;
   }
 
+  /* polygon data streamed to the TA FIFO is by far the most common use of the
+     store queues, append it straight to the current context rather than going
+     through the address space lookup and area 4 dispatch */
+  uint32_t area_addr = dst & SH4_ADDR_MASK;
+
+  if (area_addr >= SH4_AREA4_BEGIN && area_addr <= SH4_AREA4_END) {
+    uint32_t area4_addr = area_addr & SH4_AREA4_ADDR_MASK;
+
+    if (area4_addr >= SH4_TA_POLY_BEGIN && area4_addr <= SH4_TA_POLY_END) {
+      ta_poly_write(sh4->dc->ta, area4_addr, (const uint8_t *)sh4->sq[sqi],
+                    32);
+      return;
+    }
+  }
+
   sh4_memcpy_to_guest(mem, dst, sh4->sq[sqi], 32);
 }
 
@@ -127,16 +143,6 @@ void sh4_ccn_ocache_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
   /* ignore */
 }
 
-REG_W32(sh4_cb, MMUCR) {
-  struct sh4 *sh4 = dc->sh4;
-
-  sh4->MMUCR->full = value;
-
-  if (sh4->MMUCR->AT) {
-    LOG_WARNING("MMU not fully supported");
-  }
-}
-
 REG_W32(sh4_cb, CCR) {
   struct sh4 *sh4 = dc->sh4;
 
@@ -1,4 +1,6 @@
 #include "guest/sh4/sh4.h"
+#include "jit/jit.h"
+#include "jit/jit_guest.h"
 
 #if 0
 #define LOG_MMU LOG_INFO
@@ -7,72 +9,475 @@
 #endif
 
 #define TLB_INDEX(addr) (((addr) >> 8) & 0x3f)
+#define ITLB_INDEX(addr) (((addr) >> 8) & 0x3)
 
-/*#define PAGE_SIZE(entry) (((entry)->lo.SZ1 << 1) | (entry)->lo.SZ0)*/
+#define PAGE_SIZE(entry) \
+  (sh4_page_sizes[((entry)->lo.SZ1 << 1) | (entry)->lo.SZ0])
+#define PAGE_MASK(entry) (~(PAGE_SIZE(entry) - 1))
 
-enum {
-  PAGE_SIZE_1KB,
-  PAGE_SIZE_4KB,
-  PAGE_SIZE_64KB,
-  PAGE_SIZE_1MB,
-};
+#define TLB_ACCESS_ALL (JIT_TLB_READ | JIT_TLB_WRITE | JIT_TLB_EXEC)
 
-static void sh4_mmu_utlb_sync(struct sh4 *sh4, struct sh4_tlb_entry *entry) {
-  int n = (int)(entry - sh4->utlb);
+static const uint32_t sh4_page_sizes[] = {0x400, 0x1000, 0x10000, 0x100000};
 
-  /* check if entry maps to sq region [0xe0000000, 0xe3ffffff] */
-  if ((entry->hi.VPN & (0xfc000000 >> 10)) == (0xe0000000 >> 10)) {
-    /* assume page size is 1MB
-       FIXME support all page sizes */
-    uint32_t vpn = entry->hi.VPN >> 10;
-    uint32_t ppn = entry->lo.PPN << 10;
+static uint32_t sh4_mmu_page_addr(struct sh4_tlb_entry *entry) {
+  return entry->hi.full & PAGE_MASK(entry);
+}
+
+static int sh4_mmu_privileged(struct sh4 *sh4) {
+  return (sh4->ctx.sr & MD_MASK) == MD_MASK;
+}
+
+static int sh4_mmu_match(struct sh4 *sh4, struct sh4_tlb_entry *entry,
+                         uint32_t addr) {
+  if (!entry->lo.V) {
+    return 0;
+  }
+
+  if (sh4_mmu_page_addr(entry) != (addr & PAGE_MASK(entry))) {
+    return 0;
+  }
+
+  /* asid comparison is skipped for shared pages, and for privileged accesses
+     when single virtual memory mode is enabled */
+  if (entry->lo.SH || (sh4->MMUCR->SV && sh4_mmu_privileged(sh4))) {
+    return 1;
+  }
+
+  return entry->hi.ASID == sh4->PTEH->ASID;
+}
+
+/*
+ * host-side translation cache
+ */
+static void sh4_mmu_cache(struct sh4 *sh4, uint32_t addr, uint32_t paddr,
+                          int access) {
+  uint32_t page = addr >> SH4_TLB_SHIFT;
+  uint32_t page_mask = (1u << SH4_TLB_SHIFT) - 1;
+  uint32_t entry = sh4->tlb_cache[page];
+
+  if (!entry) {
+    if (sh4->num_tlb_log >= SH4_TLB_LOG_SIZE) {
+      sh4_mmu_flush(sh4);
+    }
+
+    sh4->tlb_log[sh4->num_tlb_log++] = page;
+  } else if ((entry & ~page_mask) == (paddr & ~page_mask)) {
+    /* pages may be filled separately by the utlb and itlb, merge the access
+       rights when they map to the same physical page */
+    access |= entry & TLB_ACCESS_ALL;
+  }
+
+  sh4->tlb_cache[page] = (paddr & ~page_mask) | access;
+}
+
+static void sh4_mmu_invalidate_range(struct sh4 *sh4, uint32_t begin,
+                                     uint32_t size) {
+  LOG_MMU("sh4_mmu_invalidate_range 0x%08x-0x%08x", begin, begin + size);
+
+  /* drop cached translations for the range. the pages are left in the log,
+     flushing only zeroes their entries so stale or duplicate pages in it are
+     harmless */
+  uint32_t first = begin >> SH4_TLB_SHIFT;
+  uint32_t last = (begin + size - 1) >> SH4_TLB_SHIFT;
+
+  for (uint32_t page = first; page <= last; page++) {
+    sh4->tlb_cache[page] = 0;
+  }
+
+  /* and any code which was compiled from it */
+  jit_invalidate_range(sh4->jit, begin, begin + size);
+}
+
+static void sh4_mmu_invalidate_entry(struct sh4 *sh4,
+                                     struct sh4_tlb_entry *entry) {
+  if (!entry->lo.V) {
+    return;
+  }
+
+  sh4_mmu_invalidate_range(sh4, sh4_mmu_page_addr(entry), PAGE_SIZE(entry));
+}
+
+static void sh4_mmu_invalidate_private(struct sh4 *sh4) {
+  /* invalidate all pages whose translation depends on the current asid */
+  for (int i = 0; i < ARRAY_SIZE(sh4->utlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->utlb[i];
+
+    if (!entry->lo.SH) {
+      sh4_mmu_invalidate_entry(sh4, entry);
+    }
+  }
+
+  for (int i = 0; i < ARRAY_SIZE(sh4->itlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->itlb[i];
+
+    if (!entry->lo.SH) {
+      sh4_mmu_invalidate_entry(sh4, entry);
+    }
+  }
+}
+
+/*
+ * tlb lookup
+ */
+static struct sh4_tlb_entry *sh4_mmu_utlb_lookup(struct sh4 *sh4,
+                                                 uint32_t addr) {
+  /* URC is incremented on each utlb access, wrapping around at URB */
+  union mmucr *mmucr = sh4->MMUCR;
+  mmucr->URC++;
+  if (mmucr->URB && mmucr->URC >= mmucr->URB) {
+    mmucr->URC = 0;
+  }
+
+  for (int i = 0; i < ARRAY_SIZE(sh4->utlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->utlb[i];
+
+    if (sh4_mmu_match(sh4, entry, addr)) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static int sh4_mmu_itlb_replace(struct sh4 *sh4) {
+  uint32_t lrui = sh4->MMUCR->LRUI;
+
+  if ((lrui & 0x38) == 0x38) {
+    return 0;
+  } else if ((lrui & 0x26) == 0x06) {
+    return 1;
+  } else if ((lrui & 0x15) == 0x01) {
+    return 2;
+  } else if ((lrui & 0x0b) == 0x00) {
+    return 3;
+  }
+
+  /* LRUI was programmed with a setting that the hardware never generates */
+  LOG_WARNING("sh4_mmu_itlb_replace invalid LRUI 0x%x", lrui);
+  return 0;
+}
+
+static void sh4_mmu_itlb_touch(struct sh4 *sh4, int n) {
+  uint32_t lrui = sh4->MMUCR->LRUI;
+
+  switch (n) {
+    case 0:
+      lrui &= ~0x38;
+      break;
+    case 1:
+      lrui = (lrui | 0x20) & ~0x06;
+      break;
+    case 2:
+      lrui = (lrui | 0x14) & ~0x01;
+      break;
+    case 3:
+      lrui |= 0x0b;
+      break;
+  }
+
+  sh4->MMUCR->LRUI = lrui;
+}
 
-    sh4->utlb_sq_map[vpn & 0x3f] = ppn;
+static struct sh4_tlb_entry *sh4_mmu_itlb_lookup(struct sh4 *sh4,
+                                                 uint32_t addr) {
+  for (int i = 0; i < ARRAY_SIZE(sh4->itlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->itlb[i];
+
+    if (sh4_mmu_match(sh4, entry, addr)) {
+      sh4_mmu_itlb_touch(sh4, i);
+      return entry;
+    }
+  }
+
+  /* on an itlb miss, the utlb is searched and the entry is copied over */
+  struct sh4_tlb_entry *src = sh4_mmu_utlb_lookup(sh4, addr);
+
+  if (!src) {
+    return NULL;
+  }
 
-    LOG_INFO("sh4_mmu_utlb_sync sq map (%d) 0x%x -> 0x%x", n, vpn, ppn);
+  int n = sh4_mmu_itlb_replace(sh4);
+  struct sh4_tlb_entry *entry = &sh4->itlb[n];
+
+  *entry = *src;
+  /* only the upper bit of PR is maintained by the itlb */
+  entry->lo.PR &= 0x2;
+  entry->lo.D = 0;
+  entry->lo.WT = 0;
+
+  sh4_mmu_itlb_touch(sh4, n);
+
+  return entry;
+}
+
+static int sh4_mmu_data_access(struct sh4 *sh4, struct sh4_tlb_entry *entry) {
+  /* PR  privileged  user
+     00  r           -
+     01  rw          -
+     10  rw          r
+     11  rw          rw */
+  uint32_t pr = entry->lo.PR;
+  int access = 0;
+
+  if (sh4_mmu_privileged(sh4)) {
+    access |= JIT_TLB_READ;
+    access |= pr ? JIT_TLB_WRITE : 0;
   } else {
-    LOG_WARNING("sh4_mmu_utlb_sync memory mapping not supported");
+    access |= (pr & 0x2) ? JIT_TLB_READ : 0;
+    access |= (pr == 0x3) ? JIT_TLB_WRITE : 0;
   }
+
+  return access;
+}
+
+static uint32_t sh4_mmu_entry_addr(struct sh4_tlb_entry *entry,
+                                   uint32_t addr) {
+  uint32_t page_mask = PAGE_MASK(entry);
+  return ((entry->lo.PPN << 10) & page_mask) | (addr & ~page_mask);
 }
 
-static void sh4_mmu_translate(struct sh4 *sh4, uint32_t addr) {}
+static int sh4_mmu_lookup_data(struct sh4 *sh4, uint32_t addr, int access,
+                               uint32_t *paddr, int *allowed,
+                               enum sh4_exception *exc) {
+  int write = access & JIT_TLB_WRITE;
+  struct sh4_tlb_entry *entry = sh4_mmu_utlb_lookup(sh4, addr);
+
+  if (!entry) {
+    *exc = write ? SH4_EXC_DTLBMISSW : SH4_EXC_DTLBMISSR;
+    return 0;
+  }
+
+  *allowed = sh4_mmu_data_access(sh4, entry);
+
+  if (!(*allowed & access)) {
+    *exc = write ? SH4_EXC_DTLBPROTW : SH4_EXC_DTLBPROTR;
+    return 0;
+  }
+
+  /* writes to a clean page raise an initial page write exception, leave
+     write access out of the cache until the page is marked dirty */
+  if (!entry->lo.D) {
+    *allowed &= ~JIT_TLB_WRITE;
+
+    if (write) {
+      *exc = SH4_EXC_PAGEWRITE;
+      return 0;
+    }
+  }
+
+  *paddr = sh4_mmu_entry_addr(entry, addr);
+
+  return 1;
+}
+
+static int sh4_mmu_lookup(struct sh4 *sh4, uint32_t addr, int access,
+                          uint32_t *paddr, int *allowed,
+                          enum sh4_exception *exc) {
+  if (!sh4_mmu_translated(sh4, addr)) {
+    *paddr = addr;
+    *allowed = TLB_ACCESS_ALL;
+    return 1;
+  }
+
+  if (!(access & JIT_TLB_EXEC)) {
+    return sh4_mmu_lookup_data(sh4, addr, access, paddr, allowed, exc);
+  }
+
+  struct sh4_tlb_entry *entry = sh4_mmu_itlb_lookup(sh4, addr);
+
+  if (!entry) {
+    *exc = SH4_EXC_ITLBMISS;
+    return 0;
+  }
+
+  *allowed = 0;
+  if (sh4_mmu_privileged(sh4) || (entry->lo.PR & 0x2)) {
+    *allowed = JIT_TLB_EXEC;
+  }
+
+  if (!*allowed) {
+    *exc = SH4_EXC_ITLBPROT;
+    return 0;
+  }
+
+  *paddr = sh4_mmu_entry_addr(entry, addr);
+
+  return 1;
+}
+
+static void sh4_mmu_set_fault(struct sh4 *sh4, uint32_t addr) {
+  *sh4->TEA = addr;
+  sh4->PTEH->VPN = addr >> 10;
+}
+
+static void sh4_mmu_raise(struct sh4 *sh4, uint32_t addr,
+                          enum sh4_exception exc) {
+  LOG_MMU("sh4_mmu_raise exception 0x%x at 0x%08x",
+          sh4_exceptions[exc].expevt, addr);
+
+  /* the faulting instruction's pc is synced to the context before any access
+     it makes, see sh4_frontend_may_fault */
+  sh4_mmu_set_fault(sh4, addr);
+  sh4_raise_exception(sh4, exc);
+
+  /* have the caller skip the rest of the instruction and its block */
+  sh4->ctx.fault = 1;
+}
+
+int sh4_mmu_translate_code(struct sh4 *sh4, uint32_t addr,
+                           enum sh4_exception *exc) {
+  uint32_t paddr;
+  int allowed;
+
+  if (!sh4_mmu_lookup(sh4, addr, JIT_TLB_EXEC, &paddr, &allowed, exc)) {
+    sh4_mmu_set_fault(sh4, addr);
+    return 0;
+  }
+
+  return 1;
+}
+
+int sh4_mmu_translate_sq(struct sh4 *sh4, uint32_t addr, uint32_t *paddr) {
+  int allowed;
+  enum sh4_exception exc;
+
+  /* the sq area itself is in P4 and is never translated, but when AT is set
+     the address a store queue is flushed to is found by looking its vpn up
+     in the utlb as if it were a regular write */
+  if (!sh4_mmu_lookup_data(sh4, addr, JIT_TLB_WRITE, paddr, &allowed, &exc)) {
+    sh4_mmu_raise(sh4, addr, exc);
+    return 0;
+  }
+
+  return 1;
+}
+
+uint32_t sh4_mmu_translate(struct sh4 *sh4, uint32_t addr, int access) {
+  uint32_t paddr;
+  int allowed;
+  enum sh4_exception exc;
+
+  if (!sh4_mmu_lookup(sh4, addr, access, &paddr, &allowed, &exc)) {
+    sh4_mmu_raise(sh4, addr, exc);
+    return 0;
+  }
+
+  sh4_mmu_cache(sh4, addr, paddr, allowed);
+
+  return paddr;
+}
+
+int sh4_mmu_translated(struct sh4 *sh4, uint32_t addr) {
+  if (!sh4->MMUCR->AT) {
+    return 0;
+  }
+
+  /* P1, P2 and P4 are never translated */
+  if (addr >= 0x80000000 && addr < 0xc0000000) {
+    return 0;
+  }
+
+  if (addr >= SH4_P4_BEGIN) {
+    return 0;
+  }
+
+  /* nor is the on-chip ram */
+  if (addr >= SH4_CACHE_BEGIN && addr <= SH4_CACHE_END) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * state changes
+ */
+void sh4_mmu_flush(struct sh4 *sh4) {
+  for (int i = 0; i < sh4->num_tlb_log; i++) {
+    sh4->tlb_cache[sh4->tlb_log[i]] = 0;
+  }
+
+  sh4->num_tlb_log = 0;
+}
+
+void sh4_mmu_sr_updated(struct sh4 *sh4, uint32_t old_sr) {
+  if (!sh4->MMUCR->AT) {
+    return;
+  }
+
+  if ((sh4->ctx.sr & MD_MASK) == (old_sr & MD_MASK)) {
+    return;
+  }
+
+  /* the access rights of each cached page depend on the current mode */
+  sh4_mmu_flush(sh4);
+
+  /* with single virtual memory mode, privileged accesses ignore the asid */
+  if (sh4->MMUCR->SV) {
+    sh4_mmu_invalidate_private(sh4);
+  }
+}
+
+void sh4_mmu_reset(struct sh4 *sh4) {
+  memset(sh4->utlb, 0, sizeof(sh4->utlb));
+  memset(sh4->itlb, 0, sizeof(sh4->itlb));
+  sh4_mmu_flush(sh4);
+  sh4->guest->tlb = NULL;
+}
 
 void sh4_mmu_ltlb(struct sh4 *sh4) {
   uint32_t n = sh4->MMUCR->URC;
   struct sh4_tlb_entry *entry = &sh4->utlb[n];
+
+  LOG_MMU("sh4_mmu_ltlb (%d) 0x%08x -> 0x%08x", n, sh4->PTEH->full,
+          sh4->PTEL->full);
+
+  sh4_mmu_invalidate_entry(sh4, entry);
+
   entry->lo = *sh4->PTEL;
   entry->hi = *sh4->PTEH;
-
-  sh4_mmu_utlb_sync(sh4, entry);
+  entry->ptea = *sh4->PTEA;
 }
 
+/*
+ * memory mapped tlb arrays
+ */
 uint32_t sh4_mmu_itlb_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
+  struct sh4_tlb_entry *entry = &sh4->itlb[ITLB_INDEX(addr)];
+
   if (addr < 0x01000000) {
     LOG_MMU("sh4_mmu_itlb_read address array %08x", addr);
+
+    uint32_t data = entry->hi.full;
+    data |= entry->lo.V << 8;
+    return data;
   } else {
     LOG_MMU("sh4_mmu_itlb_read data array %08x", addr);
-  }
 
-  /* return an invalid entry */
-  return 0;
+    /* only PPN, V, SZ, PR, C and SH are maintained by the itlb */
+    uint32_t data = entry->lo.full & 0x1ffffdda;
+    return data;
+  }
 }
 
 uint32_t sh4_mmu_utlb_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
+  struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+
   if (addr < 0x01000000) {
     LOG_MMU("sh4_mmu_utlb_read address array %08x", addr);
 
-    struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
     uint32_t data = entry->hi.full;
     data |= entry->lo.D << 9;
     data |= entry->lo.V << 8;
     return data;
   } else {
     if (addr & 0x800000) {
-      LOG_FATAL("sh4_mmu_utlb_read data array 2 %08x", addr);
+      LOG_MMU("sh4_mmu_utlb_read data array 2 %08x", addr);
+
+      return entry->ptea;
     } else {
       LOG_MMU("sh4_mmu_utlb_read data array 1 %08x", addr);
 
-      struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
       uint32_t data = entry->lo.full;
       return data;
     }
@@ -81,41 +486,133 @@ uint32_t sh4_mmu_utlb_read(struct sh4 *sh4, uint32_t addr, uint32_t mask) {
 
 void sh4_mmu_itlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                         uint32_t mask) {
+  struct sh4_tlb_entry *entry = &sh4->itlb[ITLB_INDEX(addr)];
+
+  sh4_mmu_invalidate_entry(sh4, entry);
+
   if (addr < 0x01000000) {
     LOG_MMU("sh4_mmu_itlb_write address array %08x %08x", addr, data);
+
+    entry->hi.full = data & 0xfffffcff;
+    entry->lo.V = (data >> 8) & 1;
   } else {
     LOG_MMU("sh4_mmu_itlb_write data array %08x %08x", addr, data);
+
+    entry->lo.full = data & 0x1ffffdda;
+  }
+}
+
+static void sh4_mmu_utlb_write_assoc(struct sh4 *sh4, uint32_t data) {
+  uint32_t addr = data & 0xfffffc00;
+  uint32_t d = (data >> 9) & 1;
+  uint32_t v = (data >> 8) & 1;
+
+  /* the utlb is searched for the vpn, updating the D and V bits of the hit
+     entry. the itlb is searched as well, only updating the V bit */
+  for (int i = 0; i < ARRAY_SIZE(sh4->utlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->utlb[i];
+
+    if (!sh4_mmu_match(sh4, entry, addr)) {
+      continue;
+    }
+
+    sh4_mmu_invalidate_entry(sh4, entry);
+    entry->lo.D = d;
+    entry->lo.V = v;
+    break;
   }
 
-  /* ignore */
+  for (int i = 0; i < ARRAY_SIZE(sh4->itlb); i++) {
+    struct sh4_tlb_entry *entry = &sh4->itlb[i];
+
+    if (!sh4_mmu_match(sh4, entry, addr)) {
+      continue;
+    }
+
+    sh4_mmu_invalidate_entry(sh4, entry);
+    entry->lo.V = v;
+    break;
+  }
 }
 
 void sh4_mmu_utlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                         uint32_t mask) {
+  struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+
   if (addr < 0x01000000) {
     if (addr & 0x80) {
-      LOG_FATAL("sh4_mmu_utlb_write address array (associative) %08x %08x",
-                addr, data);
+      LOG_MMU("sh4_mmu_utlb_write address array (associative) %08x %08x", addr,
+              data);
+
+      sh4_mmu_utlb_write_assoc(sh4, data);
     } else {
       LOG_MMU("sh4_mmu_utlb_write address array %08x %08x", addr, data);
 
-      struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+      sh4_mmu_invalidate_entry(sh4, entry);
       entry->hi.full = data & 0xfffffcff;
       entry->lo.D = (data >> 9) & 1;
       entry->lo.V = (data >> 8) & 1;
-
-      sh4_mmu_utlb_sync(sh4, entry);
     }
   } else {
     if (addr & 0x800000) {
-      LOG_FATAL("sh4_mmu_utlb_write data array 2 %08x %08x", addr, data);
+      LOG_MMU("sh4_mmu_utlb_write data array 2 %08x %08x", addr, data);
+
+      entry->ptea = data & 0xf;
     } else {
       LOG_MMU("sh4_mmu_utlb_write data array 1 %08x %08x", addr, data);
 
-      struct sh4_tlb_entry *entry = &sh4->utlb[TLB_INDEX(addr)];
+      sh4_mmu_invalidate_entry(sh4, entry);
       entry->lo.full = data;
+    }
+  }
+}
+
+REG_W32(sh4_cb, PTEH) {
+  struct sh4 *sh4 = dc->sh4;
+  uint32_t old_asid = sh4->PTEH->ASID;
+
+  sh4->PTEH->full = value;
+
+  if (!sh4->MMUCR->AT || sh4->PTEH->ASID == old_asid) {
+    return;
+  }
+
+  /* rather than keeping compiled code around per-asid, any page which isn't
+     shared between address spaces is dropped when the asid changes */
+  sh4_mmu_flush(sh4);
+  sh4_mmu_invalidate_private(sh4);
+}
+
+REG_W32(sh4_cb, MMUCR) {
+  struct sh4 *sh4 = dc->sh4;
+  union mmucr old = *sh4->MMUCR;
+
+  sh4->MMUCR->full = value;
+
+  if (sh4->MMUCR->TI) {
+    for (int i = 0; i < ARRAY_SIZE(sh4->utlb); i++) {
+      sh4->utlb[i].lo.V = 0;
+    }
 
-      sh4_mmu_utlb_sync(sh4, entry);
+    for (int i = 0; i < ARRAY_SIZE(sh4->itlb); i++) {
+      sh4->itlb[i].lo.V = 0;
     }
   }
+
+  if (sh4->MMUCR->AT == old.AT && sh4->MMUCR->SV == old.SV &&
+      !sh4->MMUCR->TI) {
+    return;
+  }
+
+  /* TI always reads back as 0 */
+  sh4->MMUCR->TI = 0;
+
+  LOG_INFO("sh4 mmu address translation %s",
+           sh4->MMUCR->AT ? "enabled" : "disabled");
+
+  /* enable the inline tlb probes in compiled code and recompile everything,
+     code compiled under the previous setting assumed a different mapping */
+  sh4->guest->tlb = sh4->MMUCR->AT ? sh4->tlb_cache : NULL;
+  sh4_mmu_flush(sh4);
+  jit_invalidate_code(sh4->jit);
 }
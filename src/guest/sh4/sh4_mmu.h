@@ -3,9 +3,18 @@
 
 #include "guest/sh4/sh4_types.h"
 
+struct sh4;
+
+/* the host-side translation cache is indexed by 1kb virtual page, the smallest
+   page size supported by the mmu */
+#define SH4_TLB_SHIFT 10
+#define SH4_TLB_CACHE_SIZE (1 << (32 - SH4_TLB_SHIFT))
+#define SH4_TLB_LOG_SIZE 4096
+
 struct sh4_tlb_entry {
   union pteh hi;
   union ptel lo;
+  uint32_t ptea;
 };
 
 void sh4_mmu_ltlb(struct sh4 *sh4);
@@ -16,4 +25,17 @@ void sh4_mmu_itlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
 void sh4_mmu_utlb_write(struct sh4 *sh4, uint32_t addr, uint32_t data,
                         uint32_t mask);
 
+int sh4_mmu_translated(struct sh4 *sh4, uint32_t addr);
+
+/* on a tlb miss or protection violation, the exception is raised in the guest
+   and ctx.fault is set, the returned address is then invalid */
+uint32_t sh4_mmu_translate(struct sh4 *sh4, uint32_t addr, int access);
+int sh4_mmu_translate_sq(struct sh4 *sh4, uint32_t addr, uint32_t *paddr);
+int sh4_mmu_translate_code(struct sh4 *sh4, uint32_t addr,
+                           enum sh4_exception *exc);
+
+void sh4_mmu_flush(struct sh4 *sh4);
+void sh4_mmu_sr_updated(struct sh4 *sh4, uint32_t old_sr);
+void sh4_mmu_reset(struct sh4 *sh4);
+
 #endif
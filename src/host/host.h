@@ -9,6 +9,7 @@ struct host;
 void audio_push(struct host *host, const int16_t *data, int frames);
 
 /* video */
+int video_can_skip(struct host *host);
 
 /* input */
 int input_max_controllers(struct host *host);
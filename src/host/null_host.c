@@ -8,7 +8,13 @@ void audio_push(struct host *base, const int16_t *data, int num_frames) {}
 
 /*
  * video
+ *
+ * there's no video output, the null render backend is linked in place of the
+ * gl backend
  */
+int video_can_skip(struct host *base) {
+  return 0;
+}
 
 /*
  * input
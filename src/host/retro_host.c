@@ -21,6 +21,7 @@ static retro_audio_sample_batch_t audio_batch_cb;
 static retro_video_refresh_t video_cb;
 static retro_input_poll_t input_poll_cb;
 static retro_input_state_t input_state_cb;
+static bool can_dupe;
 
 /*
  * libretro host implementation
@@ -96,6 +97,15 @@ void audio_push(struct host *host, const int16_t *data, int frames) {
   audio_batch_cb(data, frames);
 }
 
+/*
+ * video
+ */
+int video_can_skip(struct host *host) {
+  /* a skipped frame is presented by having the frontend duplicate the
+     previous one, without that every frame must be drawn */
+  return can_dupe;
+}
+
 /*
  * input
  */
@@ -203,6 +213,11 @@ void retro_init() {
   char config[PATH_MAX] = {0};
   snprintf(config, sizeof(config), "%s" PATH_SEPARATOR "config", appdir);
   options_read(config);
+
+  /* skipped frames are presented by duplicating the previous one */
+  if (!env_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe)) {
+    can_dupe = false;
+  }
 }
 
 void retro_deinit() {}
@@ -265,22 +280,27 @@ void retro_run() {
   uintptr_t fb = hw_render.get_current_framebuffer();
   glBindFramebuffer(GL_FRAMEBUFFER, fb);
 
-  emu_render_frame(g_host->emu);
+  int drawn = emu_render_frame(g_host->emu);
 
-  /* call back into retroarch, letting it know a frame has been rendered */
-  video_cb(RETRO_HW_FRAME_BUFFER_VALID, VIDEO_WIDTH, VIDEO_HEIGHT, 0);
+  /* call back into retroarch, letting it know a frame has been rendered. if
+     the frame was skipped, the previous one is duplicated when supported */
+  const void *data = RETRO_HW_FRAME_BUFFER_VALID;
+  if (!drawn && can_dupe) {
+    data = NULL;
+  }
+  video_cb(data, VIDEO_WIDTH, VIDEO_HEIGHT, 0);
 }
 
 size_t retro_serialize_size() {
-  return 0;
+  return (size_t)emu_state_size(g_host->emu);
 }
 
 bool retro_serialize(void *data, size_t size) {
-  return false;
+  return emu_save_state(g_host->emu, data, (int)size);
 }
 
 bool retro_unserialize(const void *data, size_t size) {
-  return false;
+  return emu_load_state(g_host->emu, data, (int)size);
 }
 
 void retro_cheat_reset() {}
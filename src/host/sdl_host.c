@@ -354,6 +354,11 @@ static int video_restart(struct host *host) {
   return video_init(host);
 }
 
+int video_can_skip(struct host *host) {
+  /* the swap is skipped, leaving the previous frame on screen */
+  return 1;
+}
+
 /*
  * input
  */
@@ -1075,7 +1080,7 @@ int main(int argc, char **argv) {
 
         /* render emulator output and build up imgui buffers */
         host_debug_menu(host);
-        emu_render_frame(host->emu);
+        int drawn = emu_render_frame(host->emu);
         ui_build_menus(host->ui);
 
         /* overlay imgui */
@@ -1085,7 +1090,10 @@ int main(int argc, char **argv) {
         int64_t now = time_nanoseconds();
         prof_flip(time_nanoseconds());
 
-        host_swap_window(host);
+        /* when the frame is skipped, leave the previous one on screen */
+        if (drawn) {
+          host_swap_window(host);
+        }
       }
     }
   }
@@ -20,6 +20,12 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
   int32_t *run_cycles = (int32_t *)(ctx + guest->offset_cycles);
   int32_t *ran_instrs = (int32_t *)(ctx + guest->offset_instrs);
 
+  /* guests without address translation never fault */
+  uint32_t no_fault = 0;
+  uint32_t *fault = guest->translate
+                        ? (uint32_t *)(ctx + guest->offset_fault)
+                        : &no_fault;
+
   *run_cycles = cycles;
   *ran_instrs = 0;
 
@@ -30,10 +36,21 @@ static void interp_backend_run_code(struct jit_backend *base, int cycles) {
 
     do {
       uint32_t addr = *pc;
-      uint32_t data = guest->r32(guest->mem, addr);
-      const struct jit_opdef *def = frontend->lookup_op(frontend, &data);
-      def->fallback(guest, addr, data);
-      cycles += def->cycles;
+      uint32_t paddr = jit_guest_translate(guest, addr, JIT_TLB_EXEC);
+      int instr_cycles = 1;
+
+      if (!*fault) {
+        uint32_t data = guest->r32(guest->mem, paddr);
+        const struct jit_opdef *def = frontend->lookup_op(frontend, &data);
+        def->fallback(guest, addr, data);
+        instr_cycles = def->cycles;
+      }
+
+      /* if the fetch or an access made by the instruction raised an exception,
+         the pc has already been set to the guest's exception handler */
+      *fault = 0;
+
+      cycles += instr_cycles;
       instrs += 1;
     } while (cycles < RUN_SLICE);
 
@@ -412,6 +412,37 @@ static void x64_backend_emit_thunks(struct x64_backend *backend) {
   }
 }
 
+static void x64_backend_emit_translate_thunk(struct x64_backend *backend) {
+  struct jit_guest *guest = backend->base.guest;
+  auto &e = *backend->codegen;
+
+  if (!guest->translate) {
+    return;
+  }
+
+  e.align(32);
+
+  backend->translate_thunk = e.getCurr<void (*)()>();
+
+  /* save caller-saved registers that our code uses and ensure stack is
+     16-byte aligned */
+  int save_mask = JIT_ALLOCATE | JIT_CALLER_SAVE;
+  int offset = x64_backend_push_regs(backend, save_mask);
+  offset = ALIGN_UP(offset + X64_STACK_SHADOW_SPACE + 8, 16) - 8;
+  e.sub(e.rsp, offset);
+
+  /* resolve the tlb miss, the physical address is returned in eax */
+  e.mov(e.rax, (uint64_t)guest->translate);
+  e.call(e.rax);
+
+  /* restore caller-saved registers */
+  e.add(e.rsp, offset);
+  x64_backend_pop_regs(backend, save_mask);
+
+  /* return to jit code */
+  e.ret();
+}
+
 static void x64_backend_emit_constants(struct x64_backend *backend) {
   auto &e = *backend->codegen;
 
@@ -612,6 +643,57 @@ void x64_backend_emit_branch(struct x64_backend *backend, struct ir *ir,
   }
 }
 
+void x64_backend_emit_translate(struct x64_backend *backend,
+                                const struct ir_value *addr, int access) {
+  struct jit_guest *guest = backend->base.guest;
+  auto &e = *backend->codegen;
+
+  uint32_t page_mask = (1u << guest->tlb_shift) - 1;
+
+  /* probe the guest's tlb inline, only calling out to the guest to resolve
+     misses. the virtual address is kept in arg1 such that it's already in place
+     for the translate call, and the physical address is left in eax */
+  e.inLocalLabel();
+
+  x64_backend_mov_value(backend, arg1, addr);
+  e.mov(e.eax, arg1.cvt32());
+  e.shr(e.eax, guest->tlb_shift);
+  e.mov(arg0, (uint64_t)guest->tlb);
+  e.mov(e.eax, e.dword[arg0 + e.rax * 4]);
+  e.test(e.eax, access);
+  e.jz(".miss");
+
+  /* merge the physical page with the page offset of the virtual address */
+  e.xor_(e.eax, arg1.cvt32());
+  e.and_(e.eax, ~page_mask);
+  e.xor_(e.eax, arg1.cvt32());
+  e.jmp(".done");
+
+  e.L(".miss");
+  e.mov(arg0, (uint64_t)guest->data);
+  e.mov(arg2.cvt32(), access);
+  e.call(backend->translate_thunk);
+  x64_backend_emit_fault_check(backend);
+
+  e.L(".done");
+
+  e.outLocalLabel();
+}
+
+void x64_backend_emit_fault_check(struct x64_backend *backend) {
+  struct jit_guest *guest = backend->base.guest;
+  auto &e = *backend->codegen;
+
+  /* when addresses are translated, calls into the guest may have raised an
+     exception, in which case the rest of the block is skipped */
+  if (!guest->tlb) {
+    return;
+  }
+
+  e.cmp(e.dword[guestctx + guest->offset_fault], 0);
+  e.jne(backend->dispatch_fault);
+}
+
 static void x64_backend_emit_epilog(struct x64_backend *backend, struct ir *ir,
                                     struct ir_block *block) {
   auto &e = *backend->codegen;
@@ -642,6 +724,21 @@ static void x64_backend_emit_prolog(struct x64_backend *backend, struct ir *ir,
     }
   }
 
+  /* when translating addresses, multiple virtual addresses may alias to the
+     same dispatch cache entry. ensure the pc matches the block being entered,
+     else fall back to dispatch to compile / cache the correct block */
+  struct ir_block *entry = list_first_entry(&ir->blocks, struct ir_block, it);
+
+  if (guest->tlb && block == entry) {
+    list_for_each_entry(instr, &block->instrs, struct ir_instr, it) {
+      if (instr->op == OP_SOURCE_INFO) {
+        e.cmp(e.dword[guestctx + guest->offset_pc], instr->arg[0]->i32);
+        e.jne(backend->dispatch_compile);
+        break;
+      }
+    }
+  }
+
   /* yield control once remaining cycles are executed */
   e.mov(e.eax, e.dword[guestctx + guest->offset_cycles]);
   e.test(e.eax, e.eax);
@@ -796,6 +893,7 @@ struct jit_backend *x64_backend_create(struct jit_guest *guest, void *code,
   x64_dispatch_init(backend);
   x64_dispatch_emit_thunks(backend);
   x64_backend_emit_thunks(backend);
+  x64_backend_emit_translate_thunk(backend);
   x64_backend_emit_constants(backend);
   CHECK_LT(backend->codegen->getSize(), X64_THUNK_SIZE);
 
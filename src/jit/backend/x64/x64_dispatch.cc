@@ -55,8 +55,13 @@ void x64_dispatch_invalidate_code(struct jit_backend *base, uint32_t addr) {
 void x64_dispatch_cache_code(struct jit_backend *base, uint32_t addr,
                              void *code) {
   struct x64_backend *backend = container_of(base, struct x64_backend, base);
+  struct jit_guest *guest = backend->base.guest;
   void **entry = x64_dispatch_code_ptr(backend, addr);
-  CHECK_EQ(*entry, backend->dispatch_compile);
+
+  /* when translating addresses, distinct virtual addresses may alias to the
+     same entry, in which case the previous block is simply evicted. each block
+     validates the pc on entry in this mode, see x64_backend_emit_prolog */
+  CHECK(guest->tlb || *entry == backend->dispatch_compile);
   *entry = code;
 }
 
@@ -145,6 +150,18 @@ void x64_dispatch_emit_thunks(struct x64_backend *backend) {
     e.jmp(backend->dispatch_dynamic);
   }
 
+  if (guest->translate) {
+    /* jumped to from compiled code after a memory access raised an exception
+       in the guest. the rest of the block is abandoned, and the guest's
+       exception handler is jumped to through the dynamic dispatch thunk */
+    e.align(32);
+
+    backend->dispatch_fault = e.getCurr<void *>();
+
+    e.mov(e.dword[guestctx + guest->offset_fault], 0);
+    e.jmp(backend->dispatch_dynamic);
+  }
+
   {
     /* entry point to the compiled x64 code. sets up the stack frame, sets up
        fixed registers (context and memory base) and then jumps to the current
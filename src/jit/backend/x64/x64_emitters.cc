@@ -82,6 +82,8 @@ EMITTER(FALLBACK, CONSTRAINTS(NONE, IMM_I64, IMM_I32, IMM_I32)) {
   e.mov(arg1, addr);
   e.mov(arg2, raw_instr);
   e.call(fallback);
+
+  x64_backend_emit_fault_check(backend);
 }
 
 EMITTER(LOAD_HOST, CONSTRAINTS(REG_ALL, REG_I64)) {
@@ -103,7 +105,12 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
   Xbyak::Reg dst = RES_REG;
   struct ir_value *addr = ARG0;
 
-  if (ir_is_constant(addr)) {
+  /* addresses which are subject to translation can't be statically resolved,
+     as their mapping may change at run-time */
+  int translate = guest->tlb && (!ir_is_constant(addr) ||
+                                 guest->translated(guest->data, addr->i32));
+
+  if (!translate && ir_is_constant(addr)) {
     /* peel away one layer of abstraction and directly access the backing
        memory or directly invoke the callback when the address is constant */
     void *userdata;
@@ -125,8 +132,6 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
       e.mov(dst, e.rax);
     }
   } else {
-    Xbyak::Reg ra = x64_backend_reg(backend, addr);
-
     void *fn = nullptr;
     switch (RES->type) {
       case VALUE_I8:
@@ -146,8 +151,15 @@ EMITTER(LOAD_GUEST, CONSTRAINTS(REG_ALL, REG_I64 | IMM_I32)) {
         break;
     }
 
-    e.mov(arg0, (uint64_t)guest->mem);
-    e.mov(arg1, ra);
+    if (translate) {
+      x64_backend_emit_translate(backend, addr, JIT_TLB_READ);
+      e.mov(arg0, (uint64_t)guest->mem);
+      e.mov(arg1.cvt32(), e.eax);
+    } else {
+      Xbyak::Reg ra = x64_backend_reg(backend, addr);
+      e.mov(arg0, (uint64_t)guest->mem);
+      e.mov(arg1, ra);
+    }
     e.call((void *)fn);
     e.mov(dst, e.rax);
   }
@@ -158,7 +170,12 @@ EMITTER(STORE_GUEST, CONSTRAINTS(NONE, REG_I64 | IMM_I32, VAL_ALL)) {
   struct ir_value *addr = ARG0;
   struct ir_value *data = ARG1;
 
-  if (ir_is_constant(addr)) {
+  /* addresses which are subject to translation can't be statically resolved,
+     as their mapping may change at run-time */
+  int translate = guest->tlb && (!ir_is_constant(addr) ||
+                                 guest->translated(guest->data, addr->i32));
+
+  if (!translate && ir_is_constant(addr)) {
     /* peel away one layer of abstraction and directly access the backing
        memory or directly invoke the callback when the address is constant */
     void *userdata;
@@ -180,8 +197,6 @@ EMITTER(STORE_GUEST, CONSTRAINTS(NONE, REG_I64 | IMM_I32, VAL_ALL)) {
       e.call((void *)write);
     }
   } else {
-    Xbyak::Reg ra = x64_backend_reg(backend, addr);
-
     void *fn = nullptr;
     switch (data->type) {
       case VALUE_I8:
@@ -201,8 +216,15 @@ EMITTER(STORE_GUEST, CONSTRAINTS(NONE, REG_I64 | IMM_I32, VAL_ALL)) {
         break;
     }
 
-    e.mov(arg0, (uint64_t)guest->mem);
-    e.mov(arg1, ra);
+    if (translate) {
+      x64_backend_emit_translate(backend, addr, JIT_TLB_WRITE);
+      e.mov(arg0, (uint64_t)guest->mem);
+      e.mov(arg1.cvt32(), e.eax);
+    } else {
+      Xbyak::Reg ra = x64_backend_reg(backend, addr);
+      e.mov(arg0, (uint64_t)guest->mem);
+      e.mov(arg1, ra);
+    }
     x64_backend_mov_value(backend, arg2, data);
     e.call((void *)fn);
   }
@@ -960,6 +982,8 @@ EMITTER(CALL, CONSTRAINTS(NONE, VAL_I64, OPT_I64, OPT_I64)) {
     Xbyak::Reg addr = ARG0_REG;
     e.call(addr);
   }
+
+  x64_backend_emit_fault_check(backend);
 }
 
 EMITTER(CALL_COND, CONSTRAINTS(NONE, VAL_I64, VAL_I64, OPT_I64, OPT_I64)) {
@@ -986,6 +1010,8 @@ EMITTER(CALL_COND, CONSTRAINTS(NONE, VAL_I64, VAL_I64, OPT_I64, OPT_I64)) {
     e.call(addr);
   }
 
+  x64_backend_emit_fault_check(backend);
+
   e.L(".skip");
 
   e.outLocalLabel();
@@ -39,10 +39,12 @@ struct x64_backend {
   void *dispatch_static;
   void *dispatch_compile;
   void *dispatch_interrupt;
+  void *dispatch_fault;
   void (*dispatch_enter)(int32_t);
   void *dispatch_exit;
   void (*load_thunk[16])();
   void (*store_thunk)();
+  void (*translate_thunk)();
 
   /* debug stats */
   csh capstone_handle;
@@ -94,6 +96,9 @@ const Xbyak::Address x64_backend_xmm_constant(struct x64_backend *backend,
 void x64_backend_block_label(char *name, size_t size, struct ir_block *block);
 void x64_backend_emit_branch(struct x64_backend *backend, struct ir *ir,
                              const ir_value *target);
+void x64_backend_emit_translate(struct x64_backend *backend,
+                                const struct ir_value *addr, int access);
+void x64_backend_emit_fault_check(struct x64_backend *backend);
 
 /*
  * dispatch
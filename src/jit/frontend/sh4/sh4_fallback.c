@@ -4,6 +4,64 @@
 #include "jit/frontend/sh4/sh4_guest.h"
 #include "jit/jit.h"
 
+/* once a memory access has raised an exception, the rest of the instruction is
+   skipped. accesses are always made before the instruction writes to the
+   context, so the context is left as it was before the instruction */
+static int translate(struct sh4_guest *guest, uint32_t addr, int access,
+                     uint32_t *paddr) {
+  struct sh4_context *ctx = guest->ctx;
+
+  if (!ctx->fault) {
+    *paddr = jit_guest_translate((struct jit_guest *)guest, addr, access);
+  }
+
+  return !ctx->fault;
+}
+
+static uint64_t load_guest(struct sh4_guest *guest, uint32_t addr, int access,
+                           int size) {
+  uint32_t paddr;
+
+  if (!translate(guest, addr, access, &paddr)) {
+    return 0;
+  }
+
+  switch (size) {
+    case 1:
+      return guest->r8(guest->mem, paddr);
+    case 2:
+      return guest->r16(guest->mem, paddr);
+    case 4:
+      return guest->r32(guest->mem, paddr);
+    default:
+      return guest->r64(guest->mem, paddr);
+  }
+}
+
+static void store_guest(struct sh4_guest *guest, uint32_t addr, uint64_t v,
+                        int size) {
+  uint32_t paddr;
+
+  if (!translate(guest, addr, JIT_TLB_WRITE, &paddr)) {
+    return;
+  }
+
+  switch (size) {
+    case 1:
+      guest->w8(guest->mem, paddr, (uint8_t)v);
+      break;
+    case 2:
+      guest->w16(guest->mem, paddr, (uint16_t)v);
+      break;
+    case 4:
+      guest->w32(guest->mem, paddr, (uint32_t)v);
+      break;
+    default:
+      guest->w64(guest->mem, paddr, v);
+      break;
+  }
+}
+
 static uint32_t load_sr(struct sh4_context *ctx) {
   sh4_implode_sr(ctx);
   return ctx->sr;
@@ -11,6 +69,10 @@ static uint32_t load_sr(struct sh4_context *ctx) {
 
 static void store_sr(struct sh4_guest *guest, struct sh4_context *ctx,
                      uint32_t new_sr) {
+  if (ctx->fault) {
+    return;
+  }
+
   uint32_t old_sr = load_sr(ctx);
   ctx->sr = new_sr & SR_MASK;
   sh4_explode_sr(ctx);
@@ -23,6 +85,10 @@ static uint32_t load_fpscr(struct sh4_context *ctx) {
 
 static void store_fpscr(struct sh4_guest *guest, struct sh4_context *ctx,
                         uint32_t new_fpscr) {
+  if (ctx->fault) {
+    return;
+  }
+
   uint32_t old_fpscr = load_fpscr(ctx);
   ctx->fpscr = new_fpscr & FPSCR_MASK;
   guest->fpscr_updated(guest->data, old_fpscr);
@@ -55,46 +121,49 @@ typedef int32_t int128_t[4];
 #define V128                         int128_t
 
 #define CTX                          ((struct sh4_context *)guest->ctx)
+#define STORE_CTX(dst, v)            ((void)(CTX->fault || ((dst) = (v), 0)))
 #define FPU_DOUBLE_PR                (CTX->fpscr & PR_MASK)
 #define FPU_DOUBLE_SZ                (CTX->fpscr & SZ_MASK)
 
-#define DELAY_INSTR()                {                                                                   \
-                                       uint32_t delay_addr = addr + 2;                                   \
-                                       uint16_t delay_data = guest->r16(guest->mem, delay_addr);       \
-                                       const struct jit_opdef *def = sh4_get_opdef(delay_data);          \
-                                       def->fallback((struct jit_guest *)guest, delay_addr, delay_data); \
+#define DELAY_INSTR()                {                                                                     \
+                                       uint32_t delay_addr = addr + 2;                                     \
+                                       uint16_t delay_data = LOAD_INSTR_I16(delay_addr);                   \
+                                       const struct jit_opdef *def = sh4_get_opdef(delay_data);            \
+                                       if (!CTX->fault) {                                                  \
+                                         def->fallback((struct jit_guest *)guest, delay_addr, delay_data); \
+                                       }                                                                   \
                                      }
-#define NEXT_INSTR()                 (CTX->pc = addr + 2)
+#define NEXT_INSTR()                 STORE_CTX(CTX->pc, addr + 2)
 
 #define LOAD_GPR_I8(n)               ((int8_t)CTX->r[n])
 #define LOAD_GPR_I16(n)              ((int16_t)CTX->r[n])
 #define LOAD_GPR_I32(n)              ((int32_t)CTX->r[n])
-#define STORE_GPR_I32(n, v)          (CTX->r[n] = (v))
+#define STORE_GPR_I32(n, v)          STORE_CTX(CTX->r[n], v)
 #define STORE_GPR_IMM_I32(n, v)      STORE_GPR_I32(n, v)
 
 #define LOAD_GPR_ALT_I32(n)          ((int32_t)CTX->ralt[n])
-#define STORE_GPR_ALT_I32(n, v)      (CTX->ralt[n] = (v))
+#define STORE_GPR_ALT_I32(n, v)      STORE_CTX(CTX->ralt[n], v)
 
 #define LOAD_FPR_I32(n)              ((int32_t)CTX->fr[(n)^1])
 #define LOAD_FPR_I64(n)              (*(int64_t *)&CTX->fr[n])
 #define LOAD_FPR_F32(n)              (*(float *)&CTX->fr[(n)^1])
 #define LOAD_FPR_F64(n)              (*(double *)&CTX->fr[n])
 #define LOAD_FPR_V128(n)             {CTX->fr[(n)+0],CTX->fr[(n)+1],CTX->fr[(n)+2],CTX->fr[(n)+3]}
-#define STORE_FPR_I32(n, v)          (CTX->fr[(n)^1] = (v))
-#define STORE_FPR_I64(n, v)          (*(int64_t *)&CTX->fr[n] = (v))
-#define STORE_FPR_F32(n, v)          (*(float *)&CTX->fr[(n)^1] = (v))
-#define STORE_FPR_F64(n, v)          (*(double *)&CTX->fr[n] = (v))
-#define STORE_FPR_V128(n, v)         memcpy(&CTX->fr[n], v, sizeof(v))
+#define STORE_FPR_I32(n, v)          STORE_CTX(CTX->fr[(n)^1], v)
+#define STORE_FPR_I64(n, v)          STORE_CTX(*(int64_t *)&CTX->fr[n], v)
+#define STORE_FPR_F32(n, v)          STORE_CTX(*(float *)&CTX->fr[(n)^1], v)
+#define STORE_FPR_F64(n, v)          STORE_CTX(*(double *)&CTX->fr[n], v)
+#define STORE_FPR_V128(n, v)         ((void)(CTX->fault || (memcpy(&CTX->fr[n], v, sizeof(v)), 0)))
 #define STORE_FPR_IMM_I32(n, v)      STORE_FPR_I32(n, v)
 
 #define LOAD_XFR_I32(n)              ((int32_t)CTX->xf[(n)^1])
 #define LOAD_XFR_I64(n)              (*(int64_t *)&CTX->xf[n])
 #define LOAD_XFR_V128(n)             {CTX->xf[(n)+0],CTX->xf[(n)+1],CTX->xf[(n)+2],CTX->xf[(n)+3]}
-#define STORE_XFR_I32(n, v)          (CTX->xf[(n)^1] = (v))
-#define STORE_XFR_I64(n, v)          (*(int64_t *)&CTX->xf[n] = (v))
+#define STORE_XFR_I32(n, v)          STORE_CTX(CTX->xf[(n)^1], v)
+#define STORE_XFR_I64(n, v)          STORE_CTX(*(int64_t *)&CTX->xf[n], v)
 
 #define LOAD_PR_I32()                (CTX->pr)
-#define STORE_PR_I32(v)              (CTX->pr = v)
+#define STORE_PR_I32(v)              STORE_CTX(CTX->pr, v)
 #define STORE_PR_IMM_I32(v)          STORE_PR_I32(v)
 
 #define LOAD_SR_I32()                load_sr(CTX)
@@ -102,20 +171,20 @@ typedef int32_t int128_t[4];
 #define STORE_SR_IMM_I32(v)          STORE_SR_I32(v)
 
 #define LOAD_T_I32()                 (CTX->sr_t)
-#define STORE_T_I8(v)                (CTX->sr_t = v)
+#define STORE_T_I8(v)                STORE_CTX(CTX->sr_t, v)
 #define STORE_T_I32(v)               STORE_T_I8(v)
 #define STORE_T_IMM_I32(v)           STORE_T_I8(v)
 
 #define LOAD_S_I32()                 (CTX->sr_s)
-#define STORE_S_I32(v)               (CTX->sr_s = v)
+#define STORE_S_I32(v)               STORE_CTX(CTX->sr_s, v)
 #define STORE_S_IMM_I32(v)           STORE_S_I32(v)
 
 #define LOAD_M_I32()                 (CTX->sr_m)
-#define STORE_M_I32(v)               (CTX->sr_m = v)
+#define STORE_M_I32(v)               STORE_CTX(CTX->sr_m, v)
 #define STORE_M_IMM_I32(v)           STORE_M_I32(v)
 
 #define LOAD_QM_I32()                (CTX->sr_qm)
-#define STORE_QM_I32(v)              (CTX->sr_qm = v)
+#define STORE_QM_I32(v)              STORE_CTX(CTX->sr_qm, v)
 #define STORE_QM_IMM_I32(v)          STORE_QM_I32(v)
 
 #define LOAD_FPSCR_I32()             load_fpscr(CTX)
@@ -123,57 +192,59 @@ typedef int32_t int128_t[4];
 #define STORE_FPSCR_IMM_I32(v)       STORE_FPSCR_I32(v)
 
 #define LOAD_DBR_I32()               (CTX->dbr)
-#define STORE_DBR_I32(v)             (CTX->dbr = v)
+#define STORE_DBR_I32(v)             STORE_CTX(CTX->dbr, v)
 #define STORE_DBR_IMM_I32(v)         STORE_DBR_I32(v)
 
 #define LOAD_GBR_I32()               (CTX->gbr)
-#define STORE_GBR_I32(v)             (CTX->gbr = v)
+#define STORE_GBR_I32(v)             STORE_CTX(CTX->gbr, v)
 #define STORE_GBR_IMM_I32(v)         STORE_GBR_I32(v)
 
 #define LOAD_VBR_I32()               (CTX->vbr)
-#define STORE_VBR_I32(v)             (CTX->vbr = v)
+#define STORE_VBR_I32(v)             STORE_CTX(CTX->vbr, v)
 #define STORE_VBR_IMM_I32(v)         STORE_VBR_I32(v)
 
 #define LOAD_FPUL_I16()              (*(uint16_t *)&CTX->fpul)
 #define LOAD_FPUL_I32()              (CTX->fpul)
 #define LOAD_FPUL_F32()              (*(float *)&CTX->fpul)
-#define STORE_FPUL_I32(v)            (CTX->fpul = v)
-#define STORE_FPUL_F32(v)            (*(float *)&CTX->fpul = v)
+#define STORE_FPUL_I32(v)            STORE_CTX(CTX->fpul, v)
+#define STORE_FPUL_F32(v)            STORE_CTX(*(float *)&CTX->fpul, v)
 #define STORE_FPUL_IMM_I32(v)        STORE_FPUL_I32(v)
 
 #define LOAD_MACH_I32()              (CTX->mach)
-#define STORE_MACH_I32(v)            (CTX->mach = v)
+#define STORE_MACH_I32(v)            STORE_CTX(CTX->mach, v)
 #define STORE_MACH_IMM_I32(v)        STORE_MACH_I32(v)
 
 #define LOAD_MACL_I32()              (CTX->macl)
-#define STORE_MACL_I32(v)            (CTX->macl = v)
+#define STORE_MACL_I32(v)            STORE_CTX(CTX->macl, v)
 #define STORE_MACL_IMM_I32(v)        STORE_MACL_I32(v)
 
 #define LOAD_SGR_I32()               (CTX->sgr)
-#define STORE_SGR_I32(v)             (CTX->sgr = v)
+#define STORE_SGR_I32(v)             STORE_CTX(CTX->sgr, v)
 #define STORE_SGR_IMM_I32(v)         STORE_SGR_I32(v)
 
 #define LOAD_SPC_I32()               (CTX->spc)
-#define STORE_SPC_I32(v)             (CTX->spc = v)
+#define STORE_SPC_I32(v)             STORE_CTX(CTX->spc, v)
 #define STORE_SPC_IMM_I32(v)         STORE_SPC_I32(v)
 
 #define LOAD_SSR_I32()               (CTX->ssr)
-#define STORE_SSR_I32(v)             (CTX->ssr = v)
+#define STORE_SSR_I32(v)             STORE_CTX(CTX->ssr, v)
 #define STORE_SSR_IMM_I32(v)         STORE_SSR_I32(v)
 
-#define LOAD_I8(addr)                guest->r8(guest->mem, addr)
-#define LOAD_I16(addr)               guest->r16(guest->mem, addr)
-#define LOAD_I32(addr)               guest->r32(guest->mem, addr)
-#define LOAD_I64(addr)               guest->r64(guest->mem, addr)
+#define LOAD_INSTR_I16(addr)         ((uint16_t)load_guest(guest, addr, JIT_TLB_EXEC, 2))
+
+#define LOAD_I8(addr)                ((uint8_t)load_guest(guest, addr, JIT_TLB_READ, 1))
+#define LOAD_I16(addr)               ((uint16_t)load_guest(guest, addr, JIT_TLB_READ, 2))
+#define LOAD_I32(addr)               ((uint32_t)load_guest(guest, addr, JIT_TLB_READ, 4))
+#define LOAD_I64(addr)               load_guest(guest, addr, JIT_TLB_READ, 8)
 #define LOAD_IMM_I8(addr)            LOAD_I8(addr)
 #define LOAD_IMM_I16(addr)           LOAD_I16(addr)
 #define LOAD_IMM_I32(addr)           LOAD_I32(addr)
 #define LOAD_IMM_I64(addr)           LOAD_I64(addr)
 
-#define STORE_I8(addr, v)            guest->w8(guest->mem, addr, v)
-#define STORE_I16(addr, v)           guest->w16(guest->mem, addr, v)
-#define STORE_I32(addr, v)           guest->w32(guest->mem, addr, v)
-#define STORE_I64(addr, v)           guest->w64(guest->mem, addr, v)
+#define STORE_I8(addr, v)            store_guest(guest, addr, (uint8_t)(v), 1)
+#define STORE_I16(addr, v)           store_guest(guest, addr, (uint16_t)(v), 2)
+#define STORE_I32(addr, v)           store_guest(guest, addr, (uint32_t)(v), 4)
+#define STORE_I64(addr, v)           store_guest(guest, addr, (uint64_t)(v), 8)
 
 #define LOAD_HOST_F32(addr)          (*(float *)(uintptr_t)addr)
 #define LOAD_HOST_F64(addr)          (*(double *)(uintptr_t)addr)
@@ -372,9 +443,9 @@ typedef int32_t int128_t[4];
 #define ASHD_I32(v, n)               (((n) & 0x80000000) ? (((n) & 0x1f) ? ((v) >> -((n) & 0x1f)) : ((v) >> 31)) : ((v) << ((n) & 0x1f)))
 #define LSHD_I32(v, n)               (((n) & 0x80000000) ? (((n) & 0x1f) ? ((uint32_t)(v) >> -((n) & 0x1f)) : 0) : ((uint32_t)(v) << ((n) & 0x1f)))
 
-#define BRANCH_I32(d)                (CTX->pc = d)
+#define BRANCH_I32(d)                STORE_CTX(CTX->pc, d)
 #define BRANCH_IMM_I32               BRANCH_I32
-#define BRANCH_COND_IMM_I32(c, t, f) { CTX->pc = c ? t : f; return; }
+#define BRANCH_COND_IMM_I32(c, t, f) { STORE_CTX(CTX->pc, c ? t : f); return; }
 
 #define INVALID_INSTR()              guest->invalid_instr(guest->data)
 
@@ -19,6 +19,31 @@ struct sh4_frontend {
   struct jit_frontend;
 };
 
+static inline uint16_t sh4_frontend_load_instr(void *data, uint32_t addr) {
+  struct jit_guest *guest = data;
+  uint32_t paddr = jit_guest_translate(guest, addr, JIT_TLB_EXEC);
+  return guest->r16(guest->mem, paddr);
+}
+
+/* when addresses are translated, any memory access may raise an exception,
+   which requires the context to be up to date with the faulting instruction */
+static int sh4_frontend_may_fault(struct sh4_guest *guest,
+                                  struct jit_opdef *def) {
+  return guest->tlb && (def->flags & (SH4_FLAG_LOAD | SH4_FLAG_STORE));
+}
+
+/* blocks compiled from translated addresses don't extend past the page they
+   begin in, as the next page may not be mapped, or be remapped independently.
+   see sh4_compile_code for how a delay slot on the next page is handled */
+static int sh4_frontend_max_size(struct sh4_guest *guest, uint32_t begin_addr) {
+  if (!guest->tlb || !guest->translated(guest->data, begin_addr)) {
+    return INT32_MAX;
+  }
+
+  uint32_t page_size = 1u << guest->tlb_shift;
+  return (int)(page_size - (begin_addr & (page_size - 1)));
+}
+
 static const struct jit_opdef *sh4_frontend_lookup_op(struct jit_frontend *base,
                                                       const void *instr) {
   return sh4_get_opdef(*(const uint16_t *)instr);
@@ -39,7 +64,7 @@ static int sh4_frontend_is_terminator(struct jit_opdef *def) {
 }
 
 static int sh4_frontend_is_idle_loop(struct sh4_frontend *frontend,
-                                     uint32_t begin_addr) {
+                                     uint32_t begin_addr, int size) {
   struct sh4_guest *guest = (struct sh4_guest *)frontend->guest;
 
   /* look ahead to see if the current basic block is an idle loop */
@@ -48,9 +73,9 @@ static int sh4_frontend_is_idle_loop(struct sh4_frontend *frontend,
   int all_flags = 0;
   int offset = 0;
 
-  while (1) {
+  while (offset < size) {
     uint32_t addr = begin_addr + offset;
-    uint16_t data = guest->r16(guest->mem, addr);
+    uint16_t data = sh4_frontend_load_instr(guest, addr);
     struct jit_opdef *def = sh4_get_opdef(data);
 
     offset += 2;
@@ -58,7 +83,7 @@ static int sh4_frontend_is_idle_loop(struct sh4_frontend *frontend,
 
     if (def->flags & SH4_FLAG_DELAYED) {
       uint32_t delay_addr = begin_addr + offset;
-      uint16_t delay_data = guest->r16(guest->mem, delay_addr);
+      uint16_t delay_data = sh4_frontend_load_instr(guest, delay_addr);
       struct jit_opdef *delay_def = sh4_get_opdef(delay_data);
 
       offset += 2;
@@ -81,11 +106,12 @@ static int sh4_frontend_is_idle_loop(struct sh4_frontend *frontend,
         idle_loop &= (begin_addr - branch_addr) <= 32;
       }
 
-      break;
+      return idle_loop;
     }
   }
 
-  return idle_loop;
+  /* the block was cut short before reaching its branch */
+  return 0;
 }
 
 static void sh4_frontend_dump_code(struct jit_frontend *base,
@@ -103,7 +129,7 @@ static void sh4_frontend_dump_code(struct jit_frontend *base,
 
   while (offset < size) {
     uint32_t addr = begin_addr + offset;
-    uint16_t data = guest->r16(guest->mem, addr);
+    uint16_t data = sh4_frontend_load_instr(guest, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
@@ -114,7 +140,7 @@ static void sh4_frontend_dump_code(struct jit_frontend *base,
 
     if (def->flags & SH4_FLAG_DELAYED) {
       uint32_t delay_addr = begin_addr + offset;
-      uint16_t delay_data = guest->r16(guest->mem, delay_addr);
+      uint16_t delay_data = sh4_frontend_load_instr(guest, delay_addr);
       union sh4_instr delay_instr = {delay_data};
 
       sh4_format(delay_addr, delay_instr, buffer, sizeof(buffer));
@@ -152,7 +178,7 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
      an interrupt such as vblank before it'll exit. scale the block's number of
      cycles in order to yield execution faster, enabling the interrupt to
      actually be generated */
-  int idle_loop = sh4_frontend_is_idle_loop(frontend, begin_addr);
+  int idle_loop = sh4_frontend_is_idle_loop(frontend, begin_addr, size);
   int cycle_scale = idle_loop ? 8 : 1;
 
   while (offset < size) {
@@ -164,7 +190,7 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
     }
 
     uint32_t addr = begin_addr + offset;
-    uint16_t data = guest->r16(guest->mem, addr);
+    uint16_t data = sh4_frontend_load_instr(guest, addr);
     union sh4_instr instr = {data};
     struct jit_opdef *def = sh4_get_opdef(data);
 
@@ -176,8 +202,9 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
     ir_source_info(ir, addr, def->cycles * cycle_scale);
 
     /* the pc is normally only written to the context at the end of the block,
-       sync now for any instruction which needs to read the correct pc */
-    if (def->flags & SH4_FLAG_LOAD_PC) {
+       sync now for any instruction which needs to read the correct pc, or
+       which may raise an exception */
+    if ((def->flags & SH4_FLAG_LOAD_PC) || sh4_frontend_may_fault(guest, def)) {
       ir_store_context(ir, offsetof(struct sh4_context, pc),
                        ir_alloc_i32(ir, addr));
     }
@@ -195,7 +222,7 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
 
       if (def->flags & SH4_FLAG_DELAYED) {
         uint32_t delay_addr = begin_addr + offset;
-        uint32_t delay_data = guest->r16(guest->mem, delay_addr);
+        uint32_t delay_data = sh4_frontend_load_instr(guest, delay_addr);
         union sh4_instr delay_instr = {delay_data};
         struct jit_opdef *delay_def = sh4_get_opdef(delay_data);
 
@@ -209,6 +236,10 @@ static void sh4_frontend_translate_code(struct jit_frontend *base,
         if (delay_def->flags & SH4_FLAG_LOAD_PC) {
           ir_store_context(ir, offsetof(struct sh4_context, pc),
                            ir_alloc_i32(ir, delay_addr));
+        } else if (sh4_frontend_may_fault(guest, delay_def)) {
+          /* exceptions raised by a delay slot are reported at the branch */
+          ir_store_context(ir, offsetof(struct sh4_context, pc),
+                           ir_alloc_i32(ir, addr));
         }
 
         /* emit the delay slot's translation if available */
@@ -294,18 +325,26 @@ static void sh4_frontend_analyze_code(struct jit_frontend *base,
   struct sh4_frontend *frontend = (struct sh4_frontend *)base;
   struct sh4_guest *guest = (struct sh4_guest *)frontend->guest;
 
+  int max_size = sh4_frontend_max_size(guest, begin_addr);
+
   *size = 0;
 
-  while (1) {
+  while (*size < max_size) {
     uint32_t addr = begin_addr + *size;
-    uint16_t data = guest->r16(guest->mem, addr);
+    uint16_t data = sh4_frontend_load_instr(guest, addr);
     struct jit_opdef *def = sh4_get_opdef(data);
 
+    /* end the block before a branch whose delay slot is on the next page, it
+       then begins a block of its own */
+    if ((def->flags & SH4_FLAG_DELAYED) && *size && *size + 2 >= max_size) {
+      break;
+    }
+
     *size += 2;
 
     if (def->flags & SH4_FLAG_DELAYED) {
       uint32_t delay_addr = begin_addr + *size;
-      uint16_t delay_data = guest->r16(guest->mem, delay_addr);
+      uint16_t delay_data = sh4_frontend_load_instr(guest, delay_addr);
       struct jit_opdef *delay_def = sh4_get_opdef(delay_data);
 
       *size += 2;
@@ -118,6 +118,11 @@ struct sh4_context {
   /* processor sleep state */
   uint32_t sleep_mode;
 
+  /* set when a memory access raised a tlb exception. the rest of the faulting
+     instruction is skipped, leaving the context as it was before it such that
+     it can be restarted once the guest's exception handler returns */
+  uint32_t fault;
+
   /* the main dispatch loop is ran until run_cycles is <= 0 */
   int32_t run_cycles;
 
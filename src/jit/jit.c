@@ -5,6 +5,7 @@
 #include "jit/ir/ir.h"
 #include "jit/jit_backend.h"
 #include "jit/jit_frontend.h"
+#include "jit/jit_guest.h"
 #include "jit/passes/constant_propagation_pass.h"
 #include "jit/passes/control_flow_analysis_pass.h"
 #include "jit/passes/dead_code_elimination_pass.h"
@@ -165,6 +166,7 @@ static void jit_free_block(struct jit *jit, struct jit_block *block) {
 
   rb_unlink(&jit->blocks, &block->it, &block_map_cb);
   rb_unlink(&jit->reverse_blocks, &block->rit, &reverse_block_map_cb);
+  interval_tree_remove(&jit->block_ranges, &block->range_it);
 
   free(block);
 }
@@ -179,6 +181,10 @@ static void jit_finalize_block(struct jit *jit, struct jit_block *block) {
 
   rb_insert(&jit->blocks, &block->it, &block_map_cb);
   rb_insert(&jit->reverse_blocks, &block->rit, &reverse_block_map_cb);
+
+  block->range_it.low = block->guest_addr;
+  block->range_it.high = block->guest_addr + block->guest_size - 1;
+  interval_tree_insert(&jit->block_ranges, &block->range_it);
 }
 
 static struct jit_block *jit_alloc_block(struct jit *jit, uint32_t guest_addr,
@@ -238,6 +244,24 @@ void jit_invalidate_code(struct jit *jit) {
   /* don't reset backend code buffers, code is still running */
 }
 
+void jit_invalidate_range(struct jit *jit, uint32_t begin, uint32_t end) {
+  /* invalidate code pointers for each block overlapping [begin, end). like
+     jit_invalidate_code, this is safe to use while code is executing */
+  struct interval_tree_it it;
+  struct interval_node *n =
+      interval_tree_iter_first(&jit->block_ranges, begin, end - 1, &it);
+
+  while (n) {
+    struct jit_block *block = container_of(n, struct jit_block, range_it);
+
+    if (block->state != JIT_STATE_INVALID) {
+      jit_invalidate_block(jit, block, 0);
+    }
+
+    n = interval_tree_iter_next(&it);
+  }
+}
+
 void jit_link_code(struct jit *jit, void *branch, uint32_t addr) {
   struct jit_block *src = jit_lookup_block_reverse(jit, branch);
   struct jit_block *dst = jit_get_block(jit, addr);
@@ -301,8 +325,15 @@ static void jit_emit_callback(struct jit *jit, int type, uint32_t guest_addr,
 
 static void jit_promote_fastmem(struct jit *jit, struct jit_block *block,
                                 struct ir *ir) {
+  struct jit_guest *guest = jit->backend->guest;
   uint32_t last_addr = block->guest_addr;
 
+  /* fastmem accesses map guest addresses directly onto host memory, which is
+     only valid when guest addresses are physical */
+  if (guest->tlb) {
+    return;
+  }
+
   list_for_each_entry(blk, &ir->blocks, struct ir_block, it) {
     list_for_each_entry_safe(instr, &blk->instrs, struct ir_instr, it) {
       int fastmem = block->fastmem[last_addr - block->guest_addr];
@@ -360,7 +391,7 @@ void jit_compile_code(struct jit *jit, uint32_t guest_addr) {
   /* run optimization passes */
   jit_promote_fastmem(jit, block, &ir);
   cfa_run(jit->cfa, &ir);
-  lse_run(jit->lse, &ir);
+  lse_run(jit->lse, &ir, jit->backend->guest->tlb != NULL);
   cprop_run(jit->cprop, &ir);
   esimp_run(jit->esimp, &ir);
   dce_run(jit->dce, &ir);
@@ -2,6 +2,7 @@
 #define JIT_H
 
 #include <stdio.h>
+#include "core/interval_tree.h"
 #include "core/list.h"
 #include "core/rb_tree.h"
 
@@ -44,6 +45,7 @@ struct jit_block {
   /* lookup map iterators */
   struct rb_node it;
   struct rb_node rit;
+  struct interval_node range_it;
 };
 
 struct jit_edge {
@@ -84,6 +86,10 @@ struct jit {
   struct rb_tree blocks;
   struct rb_tree reverse_blocks;
 
+  /* compiled blocks indexed by the range of guest memory they were compiled
+     from, used to find the blocks affected when a range is invalidated */
+  struct rb_tree block_ranges;
+
   /* compiled block perf map */
   FILE *perf_map;
 
@@ -100,6 +106,7 @@ void jit_run(struct jit *jit, int cycles);
 void jit_compile_code(struct jit *jit, uint32_t guest_addr);
 void jit_link_code(struct jit *jit, void *code, uint32_t target);
 void jit_invalidate_code(struct jit *jit);
+void jit_invalidate_range(struct jit *jit, uint32_t begin, uint32_t end);
 void jit_free_code(struct jit *jit);
 
 #endif
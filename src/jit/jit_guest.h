@@ -9,6 +9,17 @@ typedef void (*mem_write_cb)(void *, uint32_t, uint32_t, uint32_t);
 typedef void (*jit_compile_cb)(void *, uint32_t);
 typedef void (*jit_link_cb)(void *, uint32_t);
 typedef void (*jit_interrupt_cb)(void *);
+typedef uint32_t (*jit_translate_cb)(void *, uint32_t, int);
+typedef int (*jit_translated_cb)(void *, uint32_t);
+
+/* access types for the optional address translation interface. each tlb entry
+   contains the physical page in its upper bits, and these flags in its lower
+   bits describing which types of accesses the cached translation is valid for */
+enum {
+  JIT_TLB_READ = 0x1,
+  JIT_TLB_WRITE = 0x2,
+  JIT_TLB_EXEC = 0x4,
+};
 
 struct memory;
 
@@ -31,6 +42,24 @@ struct jit_guest {
   void (*w32)(struct memory *, uint32_t, uint32_t);
   void (*w64)(struct memory *, uint32_t, uint64_t);
 
+  /* optional address translation interface. when tlb is non-NULL, guest
+     addresses are virtual and must be translated before being passed to the
+     above memory interface. tlb is a direct-mapped table of cached
+     translations, indexed by (addr >> tlb_shift). on a miss, translate resolves
+     the physical address and refills the entry. translated reports if an
+     address is subject to translation at all, enabling the backend to
+     statically resolve accesses to addresses that aren't
+
+     rather than resolving an address, translate may raise an exception in the
+     guest. in that case it sets the 32-bit flag at offset_fault in the
+     context, and the backend abandons the rest of the current block, clearing
+     the flag and dispatching to the guest's exception handler */
+  uint32_t *tlb;
+  int tlb_shift;
+  int offset_fault;
+  jit_translate_cb translate;
+  jit_translated_cb translated;
+
   /* runtime interface used by the backend and dispatch */
   void *data;
   int offset_pc;
@@ -42,4 +71,20 @@ struct jit_guest {
   jit_interrupt_cb check_interrupts;
 };
 
+static inline uint32_t jit_guest_translate(struct jit_guest *guest,
+                                           uint32_t addr, int access) {
+  if (!guest->tlb) {
+    return addr;
+  }
+
+  uint32_t entry = guest->tlb[addr >> guest->tlb_shift];
+
+  if (entry & access) {
+    uint32_t page_mask = (1u << guest->tlb_shift) - 1;
+    return (entry & ~page_mask) | (addr & page_mask);
+  }
+
+  return guest->translate(guest->data, addr, access);
+}
+
 #endif
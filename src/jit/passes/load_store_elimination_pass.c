@@ -133,8 +133,13 @@ static void lse_eliminate_loads(struct lse *lse, struct ir *ir,
   }
 }
 
+static int lse_may_fault(struct ir_instr *instr) {
+  return instr->op == OP_LOAD_GUEST || instr->op == OP_STORE_GUEST ||
+         instr->op == OP_CALL_COND;
+}
+
 static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
-                                 struct ir_block *block) {
+                                 struct ir_block *block, int precise) {
   lse_clear_available(lse);
 
   list_for_each_entry_safe_reverse(instr, &block->instrs, struct ir_instr, it) {
@@ -142,6 +147,10 @@ static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
       lse_clear_available(lse);
     } else if (instr->op == OP_BRANCH || instr->op == OP_BRANCH_COND) {
       lse_clear_available(lse);
+    } else if (precise && lse_may_fault(instr)) {
+      /* the block may be exited at this point, the context must be up to
+         date for the exception handler */
+      lse_clear_available(lse);
     } else if (instr->op == OP_LOAD_CONTEXT) {
       int offset = instr->arg[0]->i32;
       int size = ir_type_size(instr->result->type);
@@ -164,13 +173,13 @@ static void lse_eliminate_stores(struct lse *lse, struct ir *ir,
   }
 }
 
-void lse_run(struct lse *lse, struct ir *ir) {
+void lse_run(struct lse *lse, struct ir *ir, int precise) {
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
     lse_eliminate_loads(lse, ir, block);
   }
 
   list_for_each_entry(block, &ir->blocks, struct ir_block, it) {
-    lse_eliminate_stores(lse, ir, block);
+    lse_eliminate_stores(lse, ir, block, precise);
   }
 }
 
@@ -6,6 +6,9 @@ struct lse;
 
 struct lse *lse_create();
 void lse_destroy(struct lse *lse);
-void lse_run(struct lse *lse, struct ir *ir);
+
+/* when precise is set, guest memory accesses may raise exceptions which exit
+   the block early, and context stores aren't eliminated across them */
+void lse_run(struct lse *lse, struct ir *ir, int precise);
 
 #endif
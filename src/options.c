@@ -101,6 +101,18 @@ DEFINE_PERSISTENT_OPTION_INT(deadzone_3,   DEFAULT_DEADZONE,  "Deadzone for cont
 
 /* emulator */
 DEFINE_PERSISTENT_OPTION_STRING(aspect,    "4:3",             "Video aspect ratio");
+DEFINE_OPTION_INT(render_threads,          2,                 "Worker threads used to finalize render contexts");
+DEFINE_OPTION_INT(sw_render_threads, 4,                       "Worker threads used by the software renderer");
+DEFINE_PERSISTENT_OPTION_INT(frame_queue, 2,                  "Frames the emulation thread may run ahead of the video thread");
+DEFINE_PERSISTENT_OPTION_INT(frameskip, 0,                    "Max consecutive frames skipped when running behind");
+DEFINE_PERSISTENT_OPTION_INT(batch_surfaces, 0,               "Group opaque surfaces by render state to reduce draw calls");
+DEFINE_PERSISTENT_OPTION_INT(texture_cache, 0,                "Cache decoded textures on disk");
+DEFINE_PERSISTENT_OPTION_INT(texture_cache_size, 256,         "Max size of each game's texture cache in megabytes");
+DEFINE_PERSISTENT_OPTION_INT(texture_cache_compress, 1,       "Compress textures in the texture cache");
+DEFINE_PERSISTENT_OPTION_INT(texture_budget, 512,             "Max size of decoded textures kept alive in megabytes");
+DEFINE_PERSISTENT_OPTION_INT(rewind, 0,                       "Record a history of states to rewind through by holding backspace");
+DEFINE_PERSISTENT_OPTION_INT(rewind_interval, 4,              "Frames between each state recorded for rewinding");
+DEFINE_PERSISTENT_OPTION_INT(rewind_budget, 256,              "Max size of the rewind history in megabytes");
 
 /* bios */
 DEFINE_PERSISTENT_OPTION_STRING(region,    "usa",             "System region");
@@ -62,6 +62,18 @@ DECLARE_OPTION_INT(deadzone_3);
 
 /* emulator */
 DECLARE_OPTION_STRING(aspect);
+DECLARE_OPTION_INT(render_threads);
+DECLARE_OPTION_INT(sw_render_threads);
+DECLARE_OPTION_INT(frame_queue);
+DECLARE_OPTION_INT(frameskip);
+DECLARE_OPTION_INT(batch_surfaces);
+DECLARE_OPTION_INT(texture_cache);
+DECLARE_OPTION_INT(texture_cache_size);
+DECLARE_OPTION_INT(texture_cache_compress);
+DECLARE_OPTION_INT(texture_budget);
+DECLARE_OPTION_INT(rewind);
+DECLARE_OPTION_INT(rewind_interval);
+DECLARE_OPTION_INT(rewind_budget);
 
 /* bios */
 DECLARE_OPTION_STRING(region);
@@ -665,10 +665,31 @@ void r_begin_ta_surfaces(struct render_backend *r, int video_width,
                GL_DYNAMIC_DRAW);
 }
 
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  int stride = r->width * 4;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glReadPixels(0, 0, r->width, r->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  /* gl returns the bottom row first, flip it */
+  uint8_t *tmp = malloc(stride);
+  CHECK_NOTNULL(tmp);
+
+  for (int y = 0; y < r->height / 2; y++) {
+    uint8_t *top = &pixels[y * stride];
+    uint8_t *bottom = &pixels[(r->height - 1 - y) * stride];
+    memcpy(tmp, top, stride);
+    memcpy(top, bottom, stride);
+    memcpy(bottom, tmp, stride);
+  }
+
+  free(tmp);
+}
+
 void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
                    int y, int width, int height) {
   glBindTexture(GL_TEXTURE_2D, r->pixel_texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                GL_UNSIGNED_BYTE, pixels);
   glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -0,0 +1,150 @@
+#include "core/core.h"
+#include "render/render_backend.h"
+#include "stats.h"
+
+/*
+ * render backend which doesn't render anything. it's linked in place of the
+ * gl backend by the headless tools, so that the full frame pipeline can run
+ * without a gpu. each call only does the bookkeeping needed to validate its
+ * arguments, and updates the r_* counters
+ */
+
+struct render_backend {
+  int width, height;
+
+  /* viewport, only recorded */
+  int viewport[4];
+
+  /* texture handles in use */
+  uint8_t textures[MAX_TEXTURES];
+
+  /* state between calls to begin_surfaces and end_surfaces */
+  int in_surfaces;
+  int num_verts;
+  int num_indices;
+};
+
+void r_end_ui_surfaces(struct render_backend *r) {
+  CHECK(r->in_surfaces);
+  r->in_surfaces = 0;
+}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {
+  CHECK(r->in_surfaces);
+  CHECK(!surf->texture || r->textures[surf->texture]);
+
+  prof_counter_add(COUNTER_r_draws, 1);
+  prof_counter_add(COUNTER_r_verts, surf->num_verts);
+}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {
+  CHECK(!r->in_surfaces);
+  r->in_surfaces = 1;
+  r->num_verts = num_verts;
+  r->num_indices = indices ? num_indices : num_verts;
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  CHECK(r->in_surfaces);
+  r->in_surfaces = 0;
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  CHECK(r->in_surfaces);
+  CHECK(!surf->params.texture || r->textures[surf->params.texture]);
+  CHECK_LE(surf->first_vert + surf->num_verts, r->num_indices);
+
+  prof_counter_add(COUNTER_r_draws, 1);
+  prof_counter_add(COUNTER_r_verts, surf->num_verts);
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const uint16_t *indices,
+                         int num_indices) {
+  CHECK(!r->in_surfaces);
+  r->in_surfaces = 1;
+  r->num_verts = num_verts;
+  r->num_indices = num_indices;
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  memset(pixels, 0, r->width * r->height * 4);
+}
+
+void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
+                   int y, int width, int height) {
+  prof_counter_add(COUNTER_r_draws, 1);
+}
+
+void r_viewport(struct render_backend *r, int x, int y, int width, int height) {
+  r->viewport[0] = x;
+  r->viewport[1] = y;
+  r->viewport[2] = width;
+  r->viewport[3] = height;
+}
+
+void r_clear(struct render_backend *r) {}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  CHECK(r->textures[handle]);
+  r->textures[handle] = 0;
+
+  prof_counter_add(COUNTER_r_textures, -1);
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  /* find next open texture entry */
+  texture_handle_t handle;
+  for (handle = 1; handle < MAX_TEXTURES; handle++) {
+    if (!r->textures[handle]) {
+      break;
+    }
+  }
+  CHECK_LT(handle, MAX_TEXTURES);
+
+  r->textures[handle] = 1;
+
+  prof_counter_add(COUNTER_r_textures, 1);
+  prof_counter_add(COUNTER_r_texture_uploads, 1);
+
+  return handle;
+}
+
+int r_height(struct render_backend *r) {
+  return r->height;
+}
+
+int r_width(struct render_backend *r) {
+  return r->width;
+}
+
+void r_destroy(struct render_backend *r) {
+  for (int i = 1; i < MAX_TEXTURES; i++) {
+    r_destroy_texture(r, r->textures[i] ? i : 0);
+  }
+
+  free(r);
+}
+
+struct render_backend *r_create(int width, int height) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->width = width;
+  r->height = height;
+
+  return r;
+}
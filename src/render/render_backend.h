@@ -151,6 +151,9 @@ void r_viewport(struct render_backend *r, int x, int y, int width, int height);
 void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
                    int y, int width, int height);
 
+/* read back the entire color buffer as 32-bit RGBA, top row first */
+void r_read_pixels(struct render_backend *r, uint8_t *pixels);
+
 void r_begin_ta_surfaces(struct render_backend *r, int video_width,
                          int video_height, const struct ta_vertex *verts,
                          int num_verts, const uint16_t *indices,
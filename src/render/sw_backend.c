@@ -0,0 +1,213 @@
+#include "core/core.h"
+#include "options.h"
+#include "render/render_backend.h"
+#include "render/sw_raster.h"
+#include "stats.h"
+
+/*
+ * render backend which rasterizes ta surfaces on the cpu, see sw_raster.h. it
+ * keeps the same r_* counters as the null backend. ui surfaces are only
+ * counted, the tools linking this backend don't draw any ui
+ */
+
+struct render_backend {
+  int width, height;
+  struct sw_raster *sr;
+
+  /* texture handles in use */
+  struct sw_texture textures[MAX_TEXTURES];
+
+  /* state between calls to begin_surfaces and end_surfaces */
+  int in_ui_surfaces;
+};
+
+static void r_convert_texture(struct sw_texture *tex, enum pxl_format format,
+                              const uint8_t *buffer) {
+  int num_texels = tex->width * tex->height;
+  const uint16_t *src16 = (const uint16_t *)buffer;
+  uint8_t *dst = tex->data;
+
+  if (!buffer) {
+    memset(dst, 0, num_texels * 4);
+    return;
+  }
+
+  /* expand each format to 32-bit RGBA, matching how the 16-bit formats are
+     unpacked by gl */
+  for (int i = 0; i < num_texels; i++, dst += 4) {
+    switch (format) {
+      case PXL_RGB:
+        dst[0] = buffer[i * 3 + 0];
+        dst[1] = buffer[i * 3 + 1];
+        dst[2] = buffer[i * 3 + 2];
+        dst[3] = 0xff;
+        break;
+      case PXL_RGBA5551: {
+        uint16_t v = src16[i];
+        dst[0] = ((v >> 11) & 0x1f) * 0xff / 0x1f;
+        dst[1] = ((v >> 6) & 0x1f) * 0xff / 0x1f;
+        dst[2] = ((v >> 1) & 0x1f) * 0xff / 0x1f;
+        dst[3] = (v & 0x1) * 0xff;
+      } break;
+      case PXL_RGB565: {
+        uint16_t v = src16[i];
+        dst[0] = ((v >> 11) & 0x1f) * 0xff / 0x1f;
+        dst[1] = ((v >> 5) & 0x3f) * 0xff / 0x3f;
+        dst[2] = (v & 0x1f) * 0xff / 0x1f;
+        dst[3] = 0xff;
+      } break;
+      case PXL_RGBA4444: {
+        uint16_t v = src16[i];
+        dst[0] = ((v >> 12) & 0xf) * 0x11;
+        dst[1] = ((v >> 8) & 0xf) * 0x11;
+        dst[2] = ((v >> 4) & 0xf) * 0x11;
+        dst[3] = (v & 0xf) * 0x11;
+      } break;
+      default:
+        memcpy(dst, &buffer[i * 4], 4);
+        break;
+    }
+  }
+}
+
+void r_end_ui_surfaces(struct render_backend *r) {
+  CHECK(r->in_ui_surfaces);
+  r->in_ui_surfaces = 0;
+}
+
+void r_draw_ui_surface(struct render_backend *r,
+                       const struct ui_surface *surf) {
+  CHECK(r->in_ui_surfaces);
+  CHECK(!surf->texture || r->textures[surf->texture].data);
+
+  prof_counter_add(COUNTER_r_draws, 1);
+  prof_counter_add(COUNTER_r_verts, surf->num_verts);
+}
+
+void r_begin_ui_surfaces(struct render_backend *r,
+                         const struct ui_vertex *verts, int num_verts,
+                         const uint16_t *indices, int num_indices) {
+  CHECK(!r->in_ui_surfaces);
+  r->in_ui_surfaces = 1;
+}
+
+void r_end_ta_surfaces(struct render_backend *r) {
+  sw_raster_end(r->sr);
+}
+
+void r_draw_ta_surface(struct render_backend *r,
+                       const struct ta_surface *surf) {
+  const struct sw_texture *tex = NULL;
+
+  if (surf->params.texture) {
+    tex = &r->textures[surf->params.texture];
+    CHECK_NOTNULL(tex->data);
+  }
+
+  sw_raster_draw(r->sr, surf, tex);
+
+  prof_counter_add(COUNTER_r_draws, 1);
+  prof_counter_add(COUNTER_r_verts, surf->num_verts);
+}
+
+void r_begin_ta_surfaces(struct render_backend *r, int video_width,
+                         int video_height, const struct ta_vertex *verts,
+                         int num_verts, const uint16_t *indices,
+                         int num_indices) {
+  sw_raster_begin(r->sr, video_width, video_height, verts, num_verts, indices,
+                  num_indices);
+}
+
+void r_read_pixels(struct render_backend *r, uint8_t *pixels) {
+  memcpy(pixels, sw_raster_pixels(r->sr), r->width * r->height * 4);
+}
+
+void r_draw_pixels(struct render_backend *r, const uint8_t *pixels, int x,
+                   int y, int width, int height) {
+  /* the source rectangle always starts at the origin when drawn by the
+     emulator */
+  CHECK(x == 0 && y == 0);
+  sw_raster_blit(r->sr, pixels, width, height);
+
+  prof_counter_add(COUNTER_r_draws, 1);
+}
+
+void r_viewport(struct render_backend *r, int x, int y, int width, int height) {
+  sw_raster_viewport(r->sr, x, y, width, height);
+}
+
+void r_clear(struct render_backend *r) {
+  sw_raster_clear(r->sr);
+}
+
+void r_destroy_texture(struct render_backend *r, texture_handle_t handle) {
+  if (!handle) {
+    return;
+  }
+
+  struct sw_texture *tex = &r->textures[handle];
+  CHECK_NOTNULL(tex->data);
+  free(tex->data);
+  tex->data = NULL;
+
+  prof_counter_add(COUNTER_r_textures, -1);
+}
+
+texture_handle_t r_create_texture(struct render_backend *r,
+                                  enum pxl_format format,
+                                  enum filter_mode filter,
+                                  enum wrap_mode wrap_u, enum wrap_mode wrap_v,
+                                  int mipmaps, int width, int height,
+                                  const uint8_t *buffer) {
+  /* find next open texture entry */
+  texture_handle_t handle;
+  for (handle = 1; handle < MAX_TEXTURES; handle++) {
+    if (!r->textures[handle].data) {
+      break;
+    }
+  }
+  CHECK_LT(handle, MAX_TEXTURES);
+
+  struct sw_texture *tex = &r->textures[handle];
+  tex->filter = filter;
+  tex->wrap_u = wrap_u;
+  tex->wrap_v = wrap_v;
+  tex->width = width;
+  tex->height = height;
+  tex->data = malloc(width * height * 4);
+  CHECK_NOTNULL(tex->data);
+
+  r_convert_texture(tex, format, buffer);
+
+  prof_counter_add(COUNTER_r_textures, 1);
+  prof_counter_add(COUNTER_r_texture_uploads, 1);
+
+  return handle;
+}
+
+int r_height(struct render_backend *r) {
+  return r->height;
+}
+
+int r_width(struct render_backend *r) {
+  return r->width;
+}
+
+void r_destroy(struct render_backend *r) {
+  for (int i = 1; i < MAX_TEXTURES; i++) {
+    r_destroy_texture(r, r->textures[i].data ? i : 0);
+  }
+
+  sw_raster_destroy(r->sr);
+  free(r);
+}
+
+struct render_backend *r_create(int width, int height) {
+  struct render_backend *r = calloc(1, sizeof(struct render_backend));
+
+  r->width = width;
+  r->height = height;
+  r->sr = sw_raster_create(width, height, OPTION_sw_render_threads);
+
+  return r;
+}
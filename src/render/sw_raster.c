@@ -0,0 +1,750 @@
+#include <math.h>
+#include "render/sw_raster.h"
+#include "core/core.h"
+#include "core/thread_pool.h"
+
+#if ARCH_X64
+#include <emmintrin.h>
+#endif
+
+/* vertices are snapped to 1/16th of a pixel, and clamped to a guard band in
+   which the edge functions can be evaluated exactly */
+#define SW_SUBPIXEL_SCALE 16.0f
+#define SW_GUARD_BAND 8192.0f
+
+/* per-triangle attributes, interpolated from plane equations */
+enum {
+  PLANE_INVW,
+  PLANE_U,
+  PLANE_V,
+  PLANE_R,
+  PLANE_G,
+  PLANE_B,
+  PLANE_A,
+  PLANE_OFFSET_R,
+  PLANE_OFFSET_G,
+  PLANE_OFFSET_B,
+  NUM_PLANES,
+};
+
+struct sw_plane {
+  float dx;
+  float dy;
+  float c;
+};
+
+struct sw_tri {
+  /* edge functions, e(x, y) = a * x + b * y + c, with each edge's top-left
+     flag deciding ownership of pixels which lie exactly on it. vertices are
+     snapped to a subpixel grid, which makes these exact as doubles, so a pixel
+     on an edge shared by two triangles is always owned by exactly one */
+  double a[3];
+  double b[3];
+  double c[3];
+  int top_left[3];
+
+  /* bounding box in pixels, exclusive of the max */
+  int min_x, min_y;
+  int max_x, max_y;
+
+  /* attribute planes, every attribute other than 1/w is premultiplied by 1/w
+     to interpolate it with perspective correction */
+  struct sw_plane planes[NUM_PLANES];
+
+  uint64_t params;
+  const struct sw_texture *tex;
+};
+
+struct sw_bin {
+  int *tris;
+  int num_tris;
+  int max_tris;
+};
+
+struct sw_job {
+  struct sw_raster *sr;
+  int first_tile;
+  int tile_stride;
+};
+
+struct sw_raster {
+  int width, height;
+  uint8_t *color;
+  float *depth;
+
+  /* viewport, with its origin in the top left */
+  int vp_x, vp_y, vp_w, vp_h;
+
+  /* tiles covering the entire color buffer */
+  int tiles_x, tiles_y;
+  struct sw_bin *bins;
+
+  /* state between calls to begin and end */
+  int video_width, video_height;
+  const struct ta_vertex *verts;
+  int num_verts;
+  const uint16_t *indices;
+  int num_indices;
+
+  struct sw_tri *tris;
+  int num_tris;
+  int max_tris;
+
+  struct thread_pool *pool;
+  int num_threads;
+  struct sw_job jobs[THREAD_POOL_MAX_THREADS];
+};
+
+/*
+ * triangle setup
+ */
+static void sw_setup_plane(struct sw_tri *tri, int plane, double inv_area,
+                           float v0, float v1, float v2) {
+  struct sw_plane *p = &tri->planes[plane];
+  double dx = tri->a[0] * v0 + tri->a[1] * v1 + tri->a[2] * v2;
+  double dy = tri->b[0] * v0 + tri->b[1] * v1 + tri->b[2] * v2;
+  double c = tri->c[0] * v0 + tri->c[1] * v1 + tri->c[2] * v2;
+  p->dx = (float)(dx * inv_area);
+  p->dy = (float)(dy * inv_area);
+  p->c = (float)(c * inv_area);
+}
+
+static void sw_setup_edge(struct sw_tri *tri, int i, const float *vj,
+                          const float *vk) {
+  /* e_i is zero along the edge opposite vertex i, and increases towards it */
+  tri->a[i] = (double)vj[1] - vk[1];
+  tri->b[i] = (double)vk[0] - vj[0];
+  tri->c[i] = -(tri->a[i] * vj[0] + tri->b[i] * vj[1]);
+  tri->top_left[i] =
+      tri->a[i] > 0.0 || (tri->a[i] == 0.0 && tri->b[i] > 0.0);
+}
+
+static int sw_cull(int cull, double area) {
+  /* gl treats counter-clockwise triangles as front facing, due to the y axis
+     being flipped in screen space they have a negative area here */
+  if (area == 0.0) {
+    return 1;
+  }
+
+  switch (cull) {
+    case CULL_FRONT:
+      return area < 0.0;
+    case CULL_BACK:
+      return area > 0.0;
+    default:
+      return 0;
+  }
+}
+
+static struct sw_tri *sw_alloc_tri(struct sw_raster *sr) {
+  if (sr->num_tris >= sr->max_tris) {
+    sr->max_tris = MAX(sr->max_tris * 2, 1024);
+    sr->tris = realloc(sr->tris, sr->max_tris * sizeof(struct sw_tri));
+    CHECK_NOTNULL(sr->tris);
+  }
+
+  return &sr->tris[sr->num_tris];
+}
+
+static void sw_bin_tri(struct sw_raster *sr, int idx) {
+  struct sw_tri *tri = &sr->tris[idx];
+
+  int tile_min_x = tri->min_x / SW_TILE_SIZE;
+  int tile_min_y = tri->min_y / SW_TILE_SIZE;
+  int tile_max_x = (tri->max_x - 1) / SW_TILE_SIZE;
+  int tile_max_y = (tri->max_y - 1) / SW_TILE_SIZE;
+
+  for (int ty = tile_min_y; ty <= tile_max_y; ty++) {
+    for (int tx = tile_min_x; tx <= tile_max_x; tx++) {
+      struct sw_bin *bin = &sr->bins[ty * sr->tiles_x + tx];
+
+      if (bin->num_tris >= bin->max_tris) {
+        bin->max_tris = MAX(bin->max_tris * 2, 256);
+        bin->tris = realloc(bin->tris, bin->max_tris * sizeof(int));
+        CHECK_NOTNULL(bin->tris);
+      }
+
+      bin->tris[bin->num_tris++] = idx;
+    }
+  }
+}
+
+static void sw_setup_tri(struct sw_raster *sr, const struct ta_surface *surf,
+                         const struct sw_texture *tex,
+                         const struct ta_vertex *v0,
+                         const struct ta_vertex *v1,
+                         const struct ta_vertex *v2) {
+  const struct ta_vertex *v[3] = {v0, v1, v2};
+  float pos[3][2];
+
+  /* the vertex z is 1/w. the gl backend can't correctly clip vertices with a
+     negative w, and collapses them instead. drop these triangles entirely */
+  for (int i = 0; i < 3; i++) {
+    if (!(v[i]->xyz[2] > 0.0f)) {
+      return;
+    }
+
+    /* map from video coordinates to the viewport */
+    float x = sr->vp_x + v[i]->xyz[0] * sr->vp_w / (float)sr->video_width;
+    float y = sr->vp_y + v[i]->xyz[1] * sr->vp_h / (float)sr->video_height;
+    x = MIN(MAX(x, -SW_GUARD_BAND), SW_GUARD_BAND);
+    y = MIN(MAX(y, -SW_GUARD_BAND), SW_GUARD_BAND);
+    pos[i][0] = roundf(x * SW_SUBPIXEL_SCALE) / SW_SUBPIXEL_SCALE;
+    pos[i][1] = roundf(y * SW_SUBPIXEL_SCALE) / SW_SUBPIXEL_SCALE;
+  }
+
+  double e1x = (double)pos[1][0] - pos[0][0];
+  double e1y = (double)pos[1][1] - pos[0][1];
+  double e2x = (double)pos[2][0] - pos[0][0];
+  double e2y = (double)pos[2][1] - pos[0][1];
+  double area = e1x * e2y - e2x * e1y;
+
+  if (sw_cull(surf->params.cull, area)) {
+    return;
+  }
+
+  /* wind the triangle such that the edge functions are positive inside it */
+  if (area < 0.0) {
+    const struct ta_vertex *tmp = v[1];
+    v[1] = v[2];
+    v[2] = tmp;
+
+    float tmp_pos[2] = {pos[1][0], pos[1][1]};
+    pos[1][0] = pos[2][0];
+    pos[1][1] = pos[2][1];
+    pos[2][0] = tmp_pos[0];
+    pos[2][1] = tmp_pos[1];
+
+    area = -area;
+  }
+
+  /* clip the bounding box to the viewport, the bounds are sampled at pixel
+     centers */
+  float min_x = MIN(MIN(pos[0][0], pos[1][0]), pos[2][0]);
+  float min_y = MIN(MIN(pos[0][1], pos[1][1]), pos[2][1]);
+  float max_x = MAX(MAX(pos[0][0], pos[1][0]), pos[2][0]);
+  float max_y = MAX(MAX(pos[0][1], pos[1][1]), pos[2][1]);
+
+  if (min_x >= sr->vp_x + sr->vp_w || min_y >= sr->vp_y + sr->vp_h ||
+      max_x <= sr->vp_x || max_y <= sr->vp_y) {
+    return;
+  }
+
+  struct sw_tri *tri = sw_alloc_tri(sr);
+  tri->min_x = MAX((int)floorf(min_x), sr->vp_x);
+  tri->min_y = MAX((int)floorf(min_y), sr->vp_y);
+  tri->max_x = MIN((int)ceilf(max_x), sr->vp_x + sr->vp_w);
+  tri->max_y = MIN((int)ceilf(max_y), sr->vp_y + sr->vp_h);
+
+  if (tri->min_x >= tri->max_x || tri->min_y >= tri->max_y) {
+    return;
+  }
+
+  sw_setup_edge(tri, 0, pos[1], pos[2]);
+  sw_setup_edge(tri, 1, pos[2], pos[0]);
+  sw_setup_edge(tri, 2, pos[0], pos[1]);
+
+  double inv_area = 1.0 / area;
+  float invw[3];
+  float attrs[3][NUM_PLANES];
+
+  for (int i = 0; i < 3; i++) {
+    const uint8_t *color = (const uint8_t *)&v[i]->color;
+    const uint8_t *offset = (const uint8_t *)&v[i]->offset_color;
+
+    invw[i] = v[i]->xyz[2];
+    attrs[i][PLANE_INVW] = invw[i];
+    attrs[i][PLANE_U] = v[i]->uv[0] * invw[i];
+    attrs[i][PLANE_V] = v[i]->uv[1] * invw[i];
+    attrs[i][PLANE_R] = color[0] / 255.0f * invw[i];
+    attrs[i][PLANE_G] = color[1] / 255.0f * invw[i];
+    attrs[i][PLANE_B] = color[2] / 255.0f * invw[i];
+    attrs[i][PLANE_A] = color[3] / 255.0f * invw[i];
+    attrs[i][PLANE_OFFSET_R] = offset[0] / 255.0f * invw[i];
+    attrs[i][PLANE_OFFSET_G] = offset[1] / 255.0f * invw[i];
+    attrs[i][PLANE_OFFSET_B] = offset[2] / 255.0f * invw[i];
+  }
+
+  for (int i = 0; i < NUM_PLANES; i++) {
+    sw_setup_plane(tri, i, inv_area, attrs[0][i], attrs[1][i], attrs[2][i]);
+  }
+
+  tri->params = surf->params.full;
+  tri->tex = surf->params.texture ? tex : NULL;
+
+  sw_bin_tri(sr, sr->num_tris++);
+}
+
+/*
+ * pixel pipeline
+ */
+static inline int sw_wrap(int i, int size, enum wrap_mode mode) {
+  switch (mode) {
+    case WRAP_CLAMP_TO_EDGE:
+      return MIN(MAX(i, 0), size - 1);
+    case WRAP_MIRRORED_REPEAT: {
+      int period = size << 1;
+      int m = ((i % period) + period) % period;
+      return m < size ? m : period - 1 - m;
+    }
+    default:
+      return ((i % size) + size) % size;
+  }
+}
+
+static inline const uint8_t *sw_texel(const struct sw_texture *tex, int x,
+                                      int y) {
+  x = sw_wrap(x, tex->width, tex->wrap_u);
+  y = sw_wrap(y, tex->height, tex->wrap_v);
+  return &tex->data[(y * tex->width + x) << 2];
+}
+
+static void sw_sample(const struct sw_texture *tex, float u, float v,
+                      float *out) {
+  float fu = u * tex->width;
+  float fv = v * tex->height;
+
+  if (tex->filter == FILTER_NEAREST) {
+    const uint8_t *t = sw_texel(tex, (int)floorf(fu), (int)floorf(fv));
+
+    for (int i = 0; i < 4; i++) {
+      out[i] = t[i] / 255.0f;
+    }
+    return;
+  }
+
+  fu -= 0.5f;
+  fv -= 0.5f;
+
+  int x0 = (int)floorf(fu);
+  int y0 = (int)floorf(fv);
+  float wx = fu - x0;
+  float wy = fv - y0;
+
+  const uint8_t *t00 = sw_texel(tex, x0, y0);
+  const uint8_t *t10 = sw_texel(tex, x0 + 1, y0);
+  const uint8_t *t01 = sw_texel(tex, x0, y0 + 1);
+  const uint8_t *t11 = sw_texel(tex, x0 + 1, y0 + 1);
+
+  for (int i = 0; i < 4; i++) {
+    float top = t00[i] + (t10[i] - t00[i]) * wx;
+    float bottom = t01[i] + (t11[i] - t01[i]) * wx;
+    out[i] = (top + (bottom - top) * wy) / 255.0f;
+  }
+}
+
+static inline int sw_depth_test(int func, float src, float dst) {
+  switch (func) {
+    case DEPTH_NEVER:
+      return 0;
+    case DEPTH_LESS:
+      return src < dst;
+    case DEPTH_EQUAL:
+      return src == dst;
+    case DEPTH_LEQUAL:
+      return src <= dst;
+    case DEPTH_GREATER:
+      return src > dst;
+    case DEPTH_NEQUAL:
+      return src != dst;
+    case DEPTH_GEQUAL:
+      return src >= dst;
+    default:
+      return 1;
+  }
+}
+
+static inline float sw_blend_factor(int func, const float *src,
+                                    const float *dst, int i) {
+  switch (func) {
+    case BLEND_ZERO:
+      return 0.0f;
+    case BLEND_ONE:
+      return 1.0f;
+    case BLEND_SRC_COLOR:
+      return src[i];
+    case BLEND_ONE_MINUS_SRC_COLOR:
+      return 1.0f - src[i];
+    case BLEND_SRC_ALPHA:
+      return src[3];
+    case BLEND_ONE_MINUS_SRC_ALPHA:
+      return 1.0f - src[3];
+    case BLEND_DST_ALPHA:
+      return dst[3];
+    case BLEND_ONE_MINUS_DST_ALPHA:
+      return 1.0f - dst[3];
+    case BLEND_DST_COLOR:
+      return dst[i];
+    case BLEND_ONE_MINUS_DST_COLOR:
+      return 1.0f - dst[i];
+    default:
+      return 0.0f;
+  }
+}
+
+static inline float sw_plane_eval(const struct sw_plane *p, float x, float y) {
+  return p->dx * x + p->dy * y + p->c;
+}
+
+static inline float sw_saturate(float x) {
+  return MIN(MAX(x, 0.0f), 1.0f);
+}
+
+static void sw_shade(struct sw_raster *sr, const struct sw_tri *tri, int x,
+                     int y) {
+  struct ta_surface surf;
+  surf.params.full = tri->params;
+
+  float fx = x + 0.5f;
+  float fy = y + 0.5f;
+  float invw = sw_plane_eval(&tri->planes[PLANE_INVW], fx, fy);
+  float w = 1.0f / invw;
+
+  float col[4];
+  for (int i = 0; i < 4; i++) {
+    col[i] = sw_plane_eval(&tri->planes[PLANE_R + i], fx, fy) * w;
+  }
+
+  if (surf.params.ignore_alpha) {
+    col[3] = 1.0f;
+  }
+
+  /* shade the fragment the same as ta.glsl */
+  float frag[4];
+
+  if (tri->tex) {
+    float u = sw_plane_eval(&tri->planes[PLANE_U], fx, fy) * w;
+    float v = sw_plane_eval(&tri->planes[PLANE_V], fx, fy) * w;
+    float tex[4];
+    sw_sample(tri->tex, u, v, tex);
+
+    if (surf.params.ignore_texture_alpha) {
+      tex[3] = 1.0f;
+    }
+
+    if (surf.params.alpha_test && tex[3] < surf.params.alpha_ref / 255.0f) {
+      return;
+    }
+
+    switch (surf.params.shade) {
+      case SHADE_DECAL:
+        for (int i = 0; i < 4; i++) {
+          frag[i] = tex[i];
+        }
+        break;
+      case SHADE_MODULATE:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        frag[3] = tex[3];
+        break;
+      case SHADE_DECAL_ALPHA:
+        for (int i = 0; i < 3; i++) {
+          frag[i] = tex[i] * tex[3] + col[i] * (1.0f - tex[3]);
+        }
+        frag[3] = col[3];
+        break;
+      default:
+        for (int i = 0; i < 4; i++) {
+          frag[i] = tex[i] * col[i];
+        }
+        break;
+    }
+  } else {
+    for (int i = 0; i < 4; i++) {
+      frag[i] = col[i];
+    }
+  }
+
+  if (surf.params.offset_color) {
+    for (int i = 0; i < 3; i++) {
+      frag[i] += sw_plane_eval(&tri->planes[PLANE_OFFSET_R + i], fx, fy) * w;
+    }
+  }
+
+  if (surf.params.alpha_test) {
+    frag[3] = 1.0f;
+  }
+
+  /* depth is written out as log2(1 + w) / 17 by ta.glsl */
+  int idx = y * sr->width + x;
+
+  if (surf.params.depth_func != DEPTH_NONE || surf.params.debug_depth) {
+    float depth = sw_saturate(log2f(1.0f + w) / 17.0f);
+
+    if (surf.params.depth_func != DEPTH_NONE) {
+      if (!sw_depth_test(surf.params.depth_func, depth, sr->depth[idx])) {
+        return;
+      }
+
+      if (surf.params.depth_write) {
+        sr->depth[idx] = depth;
+      }
+    }
+
+    if (surf.params.debug_depth) {
+      frag[0] = frag[1] = frag[2] = depth;
+    }
+  }
+
+  for (int i = 0; i < 4; i++) {
+    frag[i] = sw_saturate(frag[i]);
+  }
+
+  uint8_t *out = &sr->color[idx << 2];
+
+  if (surf.params.src_blend != BLEND_NONE &&
+      surf.params.dst_blend != BLEND_NONE) {
+    float dst[4];
+    for (int i = 0; i < 4; i++) {
+      dst[i] = out[i] / 255.0f;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      float s = sw_blend_factor(surf.params.src_blend, frag, dst, i);
+      float d = sw_blend_factor(surf.params.dst_blend, frag, dst, i);
+      frag[i] = sw_saturate(frag[i] * s + dst[i] * d);
+    }
+  }
+
+  for (int i = 0; i < 4; i++) {
+    out[i] = (uint8_t)(frag[i] * 255.0f + 0.5f);
+  }
+}
+
+/*
+ * tile rasterization
+ */
+#if ARCH_X64
+static inline int sw_coverage(const struct sw_tri *tri, int x, int y) {
+  /* evaluate the edge functions for 4 horizontally adjacent pixel centers, as
+     two pairs of doubles */
+  const __m128d zero = _mm_setzero_pd();
+  __m128d px_lo = _mm_set_pd(x + 1.5, x + 0.5);
+  __m128d px_hi = _mm_set_pd(x + 3.5, x + 2.5);
+  double py = y + 0.5;
+  __m128d inside_lo = _mm_castsi128_pd(_mm_set1_epi32(-1));
+  __m128d inside_hi = inside_lo;
+
+  for (int i = 0; i < 3; i++) {
+    __m128d a = _mm_set1_pd(tri->a[i]);
+    __m128d row = _mm_set1_pd(tri->b[i] * py + tri->c[i]);
+    __m128d e_lo = _mm_add_pd(_mm_mul_pd(a, px_lo), row);
+    __m128d e_hi = _mm_add_pd(_mm_mul_pd(a, px_hi), row);
+    __m128d edge_lo = _mm_cmpgt_pd(e_lo, zero);
+    __m128d edge_hi = _mm_cmpgt_pd(e_hi, zero);
+
+    if (tri->top_left[i]) {
+      edge_lo = _mm_or_pd(edge_lo, _mm_cmpeq_pd(e_lo, zero));
+      edge_hi = _mm_or_pd(edge_hi, _mm_cmpeq_pd(e_hi, zero));
+    }
+
+    inside_lo = _mm_and_pd(inside_lo, edge_lo);
+    inside_hi = _mm_and_pd(inside_hi, edge_hi);
+  }
+
+  return _mm_movemask_pd(inside_lo) | (_mm_movemask_pd(inside_hi) << 2);
+}
+#else
+static inline int sw_coverage(const struct sw_tri *tri, int x, int y) {
+  double py = y + 0.5;
+  int mask = 0;
+
+  for (int j = 0; j < 4; j++) {
+    double px = x + j + 0.5;
+    int inside = 1;
+
+    for (int i = 0; i < 3; i++) {
+      double e = tri->a[i] * px + (tri->b[i] * py + tri->c[i]);
+      inside &= e > 0.0 || (e == 0.0 && tri->top_left[i]);
+    }
+
+    mask |= inside << j;
+  }
+
+  return mask;
+}
+#endif
+
+static void sw_raster_tile(struct sw_raster *sr, int tile) {
+  struct sw_bin *bin = &sr->bins[tile];
+  int tile_x = (tile % sr->tiles_x) * SW_TILE_SIZE;
+  int tile_y = (tile / sr->tiles_x) * SW_TILE_SIZE;
+
+  for (int n = 0; n < bin->num_tris; n++) {
+    const struct sw_tri *tri = &sr->tris[bin->tris[n]];
+    int min_x = MAX(tri->min_x, tile_x);
+    int min_y = MAX(tri->min_y, tile_y);
+    int max_x = MIN(tri->max_x, tile_x + SW_TILE_SIZE);
+    int max_y = MIN(tri->max_y, tile_y + SW_TILE_SIZE);
+
+    for (int y = min_y; y < max_y; y++) {
+      for (int x = min_x; x < max_x; x += 4) {
+        int mask = sw_coverage(tri, x, y);
+
+        /* mask off pixels past the end of the span */
+        mask &= (1 << MIN(max_x - x, 4)) - 1;
+
+        while (mask) {
+          int i = ctz32(mask);
+          sw_shade(sr, tri, x + i, y);
+          mask &= mask - 1;
+        }
+      }
+    }
+  }
+
+  /* empty the bin for the next set of surfaces */
+  bin->num_tris = 0;
+}
+
+static void sw_raster_tiles(void *data) {
+  struct sw_job *job = data;
+  struct sw_raster *sr = job->sr;
+  int num_tiles = sr->tiles_x * sr->tiles_y;
+
+  for (int i = job->first_tile; i < num_tiles; i += job->tile_stride) {
+    if (sr->bins[i].num_tris) {
+      sw_raster_tile(sr, i);
+    }
+  }
+}
+
+/*
+ * public interface
+ */
+const uint8_t *sw_raster_pixels(struct sw_raster *sr) {
+  return sr->color;
+}
+
+void sw_raster_blit(struct sw_raster *sr, const uint8_t *pixels, int width,
+                    int height) {
+  /* nearest neighbor scale the pixels to fill the viewport */
+  for (int y = 0; y < sr->vp_h; y++) {
+    int src_y = y * height / sr->vp_h;
+    const uint32_t *src = (const uint32_t *)pixels + src_y * width;
+    uint32_t *dst =
+        (uint32_t *)sr->color + (sr->vp_y + y) * sr->width + sr->vp_x;
+
+    for (int x = 0; x < sr->vp_w; x++) {
+      dst[x] = src[x * width / sr->vp_w];
+    }
+  }
+}
+
+void sw_raster_end(struct sw_raster *sr) {
+  if (sr->pool) {
+    for (int i = 0; i < sr->num_threads; i++) {
+      struct sw_job *job = &sr->jobs[i];
+      job->sr = sr;
+      job->first_tile = i;
+      job->tile_stride = sr->num_threads;
+      thread_pool_submit(sr->pool, &sw_raster_tiles, job);
+    }
+
+    thread_pool_wait(sr->pool);
+  } else {
+    struct sw_job *job = &sr->jobs[0];
+    job->sr = sr;
+    job->first_tile = 0;
+    job->tile_stride = 1;
+    sw_raster_tiles(job);
+  }
+
+  sr->num_tris = 0;
+  sr->verts = NULL;
+  sr->indices = NULL;
+}
+
+void sw_raster_draw(struct sw_raster *sr, const struct ta_surface *surf,
+                    const struct sw_texture *tex) {
+  CHECK_NOTNULL(sr->verts);
+  CHECK_LE(surf->first_vert + surf->num_verts, sr->num_indices);
+
+  const uint16_t *indices = &sr->indices[surf->first_vert];
+
+  for (int i = 0; i + 2 < surf->num_verts; i += 3) {
+    CHECK(indices[i + 0] < sr->num_verts && indices[i + 1] < sr->num_verts &&
+          indices[i + 2] < sr->num_verts);
+
+    sw_setup_tri(sr, surf, tex, &sr->verts[indices[i + 0]],
+                 &sr->verts[indices[i + 1]], &sr->verts[indices[i + 2]]);
+  }
+}
+
+void sw_raster_begin(struct sw_raster *sr, int video_width, int video_height,
+                     const struct ta_vertex *verts, int num_verts,
+                     const uint16_t *indices, int num_indices) {
+  CHECK(!sr->verts);
+
+  sr->video_width = video_width;
+  sr->video_height = video_height;
+  sr->verts = verts;
+  sr->num_verts = num_verts;
+  sr->indices = indices;
+  sr->num_indices = num_indices;
+}
+
+void sw_raster_clear(struct sw_raster *sr) {
+  int num_pixels = sr->width * sr->height;
+
+  memset(sr->color, 0, num_pixels * 4);
+
+  for (int i = 0; i < num_pixels; i++) {
+    sr->depth[i] = 1.0f;
+  }
+}
+
+void sw_raster_viewport(struct sw_raster *sr, int x, int y, int width,
+                        int height) {
+  /* flip the origin to the top left, and keep the viewport inside of the
+     color buffer */
+  int top = sr->height - (y + height);
+  sr->vp_x = MIN(MAX(x, 0), sr->width);
+  sr->vp_y = MIN(MAX(top, 0), sr->height);
+  sr->vp_w = MIN(x + width, sr->width) - sr->vp_x;
+  sr->vp_h = MIN(top + height, sr->height) - sr->vp_y;
+  sr->vp_w = MAX(sr->vp_w, 0);
+  sr->vp_h = MAX(sr->vp_h, 0);
+}
+
+void sw_raster_destroy(struct sw_raster *sr) {
+  if (sr->pool) {
+    thread_pool_destroy(sr->pool);
+  }
+
+  for (int i = 0; i < sr->tiles_x * sr->tiles_y; i++) {
+    free(sr->bins[i].tris);
+  }
+
+  free(sr->bins);
+  free(sr->tris);
+  free(sr->depth);
+  free(sr->color);
+  free(sr);
+}
+
+struct sw_raster *sw_raster_create(int width, int height, int num_threads) {
+  struct sw_raster *sr = calloc(1, sizeof(struct sw_raster));
+
+  sr->width = width;
+  sr->height = height;
+  sr->color = malloc(width * height * 4);
+  sr->depth = malloc(width * height * sizeof(float));
+  CHECK(sr->color && sr->depth);
+
+  sr->tiles_x = (width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+  sr->tiles_y = (height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+  sr->bins = calloc(sr->tiles_x * sr->tiles_y, sizeof(struct sw_bin));
+
+  /* shade on the calling thread when there's only one thread to use */
+  sr->num_threads = MIN(MAX(num_threads, 1), THREAD_POOL_MAX_THREADS);
+  if (sr->num_threads > 1) {
+    sr->pool = thread_pool_create(sr->num_threads);
+  }
+
+  sw_raster_viewport(sr, 0, 0, width, height);
+  sw_raster_clear(sr);
+
+  return sr;
+}
@@ -0,0 +1,59 @@
+#ifndef SW_RASTER_H
+#define SW_RASTER_H
+
+#include "render/render_backend.h"
+
+/*
+ * tile-based software rasterizer, used by the software render backend to
+ * render ta surfaces without a gpu
+ *
+ * the triangles of each surface are binned into 32x32 tiles as they're drawn.
+ * once all surfaces have been drawn, the tiles are shaded independently of
+ * each other by a pool of worker threads. each tile shades its triangles in
+ * the order they were drawn, so the output doesn't depend on the number of
+ * threads used
+ *
+ * the per-pixel pipeline follows ta.glsl and the gl backend's fixed-function
+ * state, with a few simplifications:
+ * - textures are always sampled from their first level
+ * - depth values are stored as floats, not quantized to 24 bits
+ * - triangles with a vertex behind the viewer are dropped, not clipped
+ */
+
+#define SW_TILE_SIZE 32
+
+struct sw_raster;
+
+/* textures are always stored as 32-bit RGBA */
+struct sw_texture {
+  enum filter_mode filter;
+  enum wrap_mode wrap_u;
+  enum wrap_mode wrap_v;
+  int width;
+  int height;
+  uint8_t *data;
+};
+
+struct sw_raster *sw_raster_create(int width, int height, int num_threads);
+void sw_raster_destroy(struct sw_raster *sr);
+
+/* viewport origin is the bottom left corner, the same as the gl backend */
+void sw_raster_viewport(struct sw_raster *sr, int x, int y, int width,
+                        int height);
+void sw_raster_clear(struct sw_raster *sr);
+
+void sw_raster_begin(struct sw_raster *sr, int video_width, int video_height,
+                     const struct ta_vertex *verts, int num_verts,
+                     const uint16_t *indices, int num_indices);
+void sw_raster_draw(struct sw_raster *sr, const struct ta_surface *surf,
+                    const struct sw_texture *tex);
+void sw_raster_end(struct sw_raster *sr);
+
+/* copy 32-bit RGBA pixels into the viewport, top row first */
+void sw_raster_blit(struct sw_raster *sr, const uint8_t *pixels, int width,
+                    int height);
+
+/* 32-bit RGBA color buffer, top row first */
+const uint8_t *sw_raster_pixels(struct sw_raster *sr);
+
+#endif
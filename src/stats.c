@@ -8,3 +8,38 @@ DEFINE_AGGREGATE_COUNTER(ta_renders);
 DEFINE_AGGREGATE_COUNTER(sh4_instrs);
 DEFINE_AGGREGATE_COUNTER(mmio_read);
 DEFINE_AGGREGATE_COUNTER(mmio_write);
+DEFINE_AGGREGATE_COUNTER(tex_decodes);
+DEFINE_AGGREGATE_COUNTER(tex_hits);
+DEFINE_AGGREGATE_COUNTER(tex_misses);
+DEFINE_AGGREGATE_COUNTER(tex_evictions);
+DEFINE_AGGREGATE_COUNTER(tex_redecodes);
+DEFINE_AGGREGATE_COUNTER(tex_invalidations);
+
+/* time in microseconds the emulation and video threads spend blocked on each
+   other while handing off frames */
+DEFINE_AGGREGATE_COUNTER(emu_wait_time);
+DEFINE_AGGREGATE_COUNTER(vid_wait_time);
+
+/* frames and contexts dropped by the frameskip logic, and how far behind
+   schedule in microseconds the most recent frame started */
+DEFINE_AGGREGATE_COUNTER(frames_skipped);
+DEFINE_AGGREGATE_COUNTER(contexts_skipped);
+DEFINE_COUNTER(frame_lateness);
+
+/* time in microseconds spent recording states for rewinding */
+DEFINE_AGGREGATE_COUNTER(rewind_time);
+
+/* peak number of decodes in flight and their average latency in microseconds,
+   for the most recently converted context */
+DEFINE_COUNTER(tex_queue_depth);
+DEFINE_COUNTER(tex_decode_latency);
+
+/* decoded bytes currently shared between texture cache entries */
+DEFINE_COUNTER(tex_bytes_saved);
+
+/* running totals kept by the null render backend, headless runs read these to
+   check and benchmark what would have been drawn */
+DEFINE_COUNTER(r_draws);
+DEFINE_COUNTER(r_verts);
+DEFINE_COUNTER(r_textures);
+DEFINE_COUNTER(r_texture_uploads);
@@ -11,5 +11,24 @@ DECLARE_COUNTER(ta_renders);
 DECLARE_COUNTER(sh4_instrs);
 DECLARE_COUNTER(mmio_read);
 DECLARE_COUNTER(mmio_write);
+DECLARE_COUNTER(tex_decodes);
+DECLARE_COUNTER(tex_queue_depth);
+DECLARE_COUNTER(tex_decode_latency);
+DECLARE_COUNTER(tex_hits);
+DECLARE_COUNTER(tex_misses);
+DECLARE_COUNTER(tex_bytes_saved);
+DECLARE_COUNTER(tex_evictions);
+DECLARE_COUNTER(tex_redecodes);
+DECLARE_COUNTER(tex_invalidations);
+DECLARE_COUNTER(emu_wait_time);
+DECLARE_COUNTER(vid_wait_time);
+DECLARE_COUNTER(frames_skipped);
+DECLARE_COUNTER(contexts_skipped);
+DECLARE_COUNTER(frame_lateness);
+DECLARE_COUNTER(rewind_time);
+DECLARE_COUNTER(r_draws);
+DECLARE_COUNTER(r_verts);
+DECLARE_COUNTER(r_textures);
+DECLARE_COUNTER(r_texture_uploads);
 
 #endif
@@ -6,6 +6,7 @@
 #include "guest/pvr/tr.h"
 #include "host/host.h"
 #include "imgui.h"
+#include "options.h"
 
 #define SCRUBBER_WINDOW_HEIGHT 20.0f
 
@@ -176,10 +177,12 @@ static struct tr_texture *tracer_find_texture(void *userdata, union tsp tsp,
   return (struct tr_texture *)tex;
 }
 
-static void tracer_add_texture(struct tracer *tracer,
-                               const struct trace_cmd *cmd) {
+static void tracer_add_texture(struct tracer *tracer, struct trace_cmd *cmd) {
   CHECK_EQ(cmd->type, TRACE_CMD_TEXTURE);
 
+  /* make sure the texture's data has been loaded */
+  trace_load_texture(tracer->trace, cmd);
+
   struct tracer_texture *tex = (struct tracer_texture *)tracer_find_texture(
       tracer, cmd->texture.tsp, cmd->texture.tcw);
 
@@ -215,81 +218,62 @@ static void tracer_next_param(struct tracer *tracer) {
   }
 }
 
-static void tracer_prev_context(struct tracer *tracer) {
-  struct trace_cmd *begin = tracer->current_cmd->prev;
-
-  /* ensure that there is a prev context */
-  struct trace_cmd *prev = begin;
-
-  while (prev) {
-    if (prev->type == TRACE_CMD_CONTEXT) {
-      break;
-    }
+/* seeks directly to the context for the frame, using the trace's frame index.
+   the texture commands in between are applied, but only the target context is
+   copied */
+static void tracer_seek_context(struct tracer *tracer, int frame) {
+  struct trace *trace = tracer->trace;
 
-    prev = prev->prev;
-  }
-
-  if (!prev) {
+  if (frame < 0 || frame >= trace->num_frames ||
+      (tracer->current_cmd && frame == tracer->frame)) {
     return;
   }
 
-  /* walk back to the prev context, reverting any textures that've been added */
-  struct trace_cmd *curr = begin;
+  struct trace_cmd *target = trace->frames[frame];
 
-  while (curr != prev) {
-    if (curr->type == TRACE_CMD_TEXTURE) {
-      struct trace_cmd *override = curr->override;
+  if (!tracer->current_cmd || frame > tracer->frame) {
+    /* walk towards the target context, adding any new textures */
+    struct trace_cmd *curr =
+        tracer->current_cmd ? tracer->current_cmd->next : trace->cmds;
 
-      if (override) {
-        tracer_add_texture(tracer, override);
+    while (curr != target) {
+      if (curr->type == TRACE_CMD_TEXTURE) {
+        tracer_add_texture(tracer, curr);
       }
-    }
-
-    curr = curr->prev;
-  }
-
-  tracer->frame = MAX(tracer->frame - 1, 0);
-  tracer->current_cmd = prev;
-  tracer->current_param = -1;
-  tracer->scroll_to_param = 0;
-  trace_copy_context(tracer->current_cmd, &tracer->ctx);
-}
 
-static void tracer_next_context(struct tracer *tracer) {
-  struct trace_cmd *begin =
-      tracer->current_cmd ? tracer->current_cmd->next : tracer->trace->cmds;
-
-  /* ensure that there is a next context */
-  struct trace_cmd *next = begin;
-
-  while (next) {
-    if (next->type == TRACE_CMD_CONTEXT) {
-      break;
+      curr = curr->next;
     }
+  } else {
+    /* walk back to the target context, reverting any textures that've been
+       added */
+    struct trace_cmd *curr = tracer->current_cmd->prev;
 
-    next = next->next;
-  }
-
-  if (!next) {
-    return;
-  }
+    while (curr != target) {
+      if (curr->type == TRACE_CMD_TEXTURE) {
+        struct trace_cmd *override = curr->override;
 
-  /* walk towards to the next context, adding any new textures */
-  struct trace_cmd *curr = begin;
+        if (override) {
+          tracer_add_texture(tracer, override);
+        }
+      }
 
-  while (curr != next) {
-    if (curr->type == TRACE_CMD_TEXTURE) {
-      tracer_add_texture(tracer, curr);
+      curr = curr->prev;
     }
-
-    curr = curr->next;
   }
 
-  tracer->frame = MIN(tracer->frame + 1, tracer->trace->num_frames - 1);
-  tracer->current_cmd = next;
+  tracer->frame = frame;
+  tracer->current_cmd = target;
   tracer->current_param = -1;
   tracer->scroll_to_param = 0;
-  trace_copy_context(tracer->current_cmd, &tracer->ctx);
+  trace_copy_context(trace, tracer->current_cmd, &tracer->ctx);
+}
+
+static void tracer_prev_context(struct tracer *tracer) {
+  tracer_seek_context(tracer, tracer->frame - 1);
+}
+
+static void tracer_next_context(struct tracer *tracer) {
+  tracer_seek_context(tracer, tracer->current_cmd ? tracer->frame + 1 : 0);
 }
 
 static void tracer_reset_context(struct tracer *tracer) {
@@ -304,6 +288,10 @@ static void tracer_render_debug_menu(struct tracer *tracer) {
         tracer->debug_depth = !tracer->debug_depth;
       }
 
+      if (igMenuItem("batch surfaces", NULL, OPTION_batch_surfaces, 1)) {
+        OPTION_batch_surfaces = !OPTION_batch_surfaces;
+      }
+
       igEndMenu();
     }
 
@@ -329,13 +317,7 @@ static void tracer_render_scrubber_menu(struct tracer *tracer) {
   int num_frames = tracer->trace->num_frames;
 
   if (igSliderInt("", &frame, 0, num_frames - 1, NULL)) {
-    while (tracer->frame != (int)frame) {
-      if (tracer->frame < (int)frame) {
-        tracer_next_context(tracer);
-      } else {
-        tracer_prev_context(tracer);
-      }
-    }
+    tracer_seek_context(tracer, frame);
   }
 
   igPopItemWidth();
@@ -649,20 +631,24 @@ static void tracer_render_side_menu(struct tracer *tracer) {
     igSetWindowPos(pos, ImGuiCond_Once);
 
     int total_orig_surfs = 0;
+    int total_unbatched_surfs = 0;
     int total_surfs = 0;
 
     for (int i = 0; i < TA_NUM_LISTS; i++) {
       struct tr_list *list = &tracer->rc.lists[i];
       igText(list_names[i]);
       igText("%d original surfaces", list->num_orig_surfs);
+      igText("%d unbatched draw surfaces", list->num_unbatched_surfs);
       igText("%d draw surfaces", list->num_surfs);
       igSeparator();
 
       total_orig_surfs += list->num_orig_surfs;
+      total_unbatched_surfs += list->num_unbatched_surfs;
       total_surfs += list->num_surfs;
     }
 
     igText("%d total original surfaces", total_orig_surfs);
+    igText("%d total unbatched draw surfaces", total_unbatched_surfs);
     igText("%d total draw surfaces", total_surfs);
     igText("%.2f kb index buffer", (tracer->rc.num_indices * 2.0f) / 1024.0f);
 
@@ -733,8 +719,7 @@ int tracer_keydown(struct tracer *tracer, int key, int16_t value) {
 void tracer_vid_destroyed(struct tracer *tracer) {
   rb_for_each_entry_safe(tex, &tracer->live_textures, struct tracer_texture,
                          live_it) {
-    r_destroy_texture(tracer->r, tex->handle);
-    tex->handle = 0;
+    tr_release_texture(tracer->r, (struct tr_texture *)tex);
   }
 
   tracer->r = NULL;
@@ -0,0 +1,74 @@
+#include "core/hash_map.h"
+#include "retest.h"
+
+#define MAX_KEYS 0x1000
+
+static uint64_t keys[MAX_KEYS];
+static int values[MAX_KEYS];
+static int live[MAX_KEYS];
+
+static uint64_t random_key() {
+  /* cluster the keys like tsp / tcw pairs, sharing most of their bits */
+  return ((uint64_t)(rand() % 16) << 32) | (uint64_t)(rand() % 0x10000);
+}
+
+static void validate_map(struct hash_map *map) {
+  int size = 0;
+
+  for (int i = 0; i < MAX_KEYS; i++) {
+    void *value = hash_map_find(map, keys[i]);
+
+    if (live[i]) {
+      CHECK_EQ(value, &values[i]);
+      size++;
+    } else {
+      CHECK_EQ(value, NULL);
+    }
+  }
+
+  CHECK_EQ(map->size, size);
+}
+
+TEST(hash_map_insert_remove) {
+  struct hash_map *map = hash_map_create(MAX_KEYS);
+
+  /* generate unique keys */
+  for (int i = 0; i < MAX_KEYS; i++) {
+    int unique = 0;
+
+    while (!unique) {
+      keys[i] = random_key();
+      unique = 1;
+
+      for (int j = 0; j < i && unique; j++) {
+        unique = keys[j] != keys[i];
+      }
+    }
+
+    live[i] = 0;
+  }
+
+  /* randomly insert and remove keys, validating the entire map after each
+     batch to catch entries lost when shifting back probe sequences */
+  for (int batch = 0; batch < 64; batch++) {
+    for (int n = 0; n < MAX_KEYS / 4; n++) {
+      int i = rand() % MAX_KEYS;
+
+      if (live[i]) {
+        hash_map_remove(map, keys[i]);
+        live[i] = 0;
+      } else {
+        hash_map_insert(map, keys[i], &values[i]);
+        live[i] = 1;
+      }
+    }
+
+    validate_map(map);
+  }
+
+  hash_map_clear(map);
+  memset(live, 0, sizeof(live));
+  validate_map(map);
+
+  hash_map_destroy(map);
+}
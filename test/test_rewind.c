@@ -0,0 +1,100 @@
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/rewind.h"
+#include "guest/sh4/sh4.h"
+#include "retest.h"
+
+#define NUM_STATES 8
+
+/* each state touches a few pages of each memory region, along with the cpu
+   context */
+static void write_state(struct dreamcast *dc, int n) {
+  uint8_t *ram = mem_ram(dc->mem, 0x0);
+  uint8_t *vram = mem_vram(dc->mem, 0x0);
+  uint8_t *aram = mem_aram(dc->mem, 0x0);
+
+  for (int i = 0; i < 0x4000; i += 4) {
+    ram[n * 0x1000 + i] = (uint8_t)(n + i);
+    vram[i] = (uint8_t)(n * 3);
+    aram[0x8000 + i] = (uint8_t)(n * 5 + i);
+  }
+
+  pvr_mark_vram(dc->pvr, 0, 0x4000);
+
+  dc->sh4->ctx.r[0] = n;
+}
+
+static void validate_state(struct dreamcast *dc, int n) {
+  uint8_t *ram = mem_ram(dc->mem, 0x0);
+  uint8_t *vram = mem_vram(dc->mem, 0x0);
+  uint8_t *aram = mem_aram(dc->mem, 0x0);
+
+  for (int i = 0; i < 0x4000; i += 4) {
+    CHECK_EQ(ram[n * 0x1000 + i], (uint8_t)(n + i));
+    CHECK_EQ(vram[i], (uint8_t)(n * 3));
+    CHECK_EQ(aram[0x8000 + i], (uint8_t)(n * 5 + i));
+  }
+
+  /* the page past those written should be untouched again */
+  CHECK_EQ(ram[(n + 4) * 0x1000], 0);
+  CHECK_EQ(dc->sh4->ctx.r[0], (uint32_t)n);
+}
+
+TEST(rewind_step_back) {
+  struct dreamcast *dc = dc_create();
+  struct rewind *rw = rewind_create(INT64_C(64) * 1024 * 1024);
+
+  dc_track_writes(dc, 1);
+  sh4_reset(dc->sh4, 0xa0000000);
+
+  /* the first state is kept in full, and counts against the budget */
+  write_state(dc, 0);
+  rewind_save(rw, dc);
+  int64_t base = rewind_size(rw);
+  CHECK_GT(base, 16 * 1024 * 1024);
+
+  for (int n = 1; n < NUM_STATES; n++) {
+    write_state(dc, n);
+    rewind_save(rw, dc);
+  }
+
+  /* only the changed pages are stored, each delta should be a small fraction
+     of a full state */
+  CHECK_EQ(rewind_num_states(rw), NUM_STATES - 1);
+  CHECK_LT(rewind_size(rw) - base, NUM_STATES * 1024 * 1024);
+
+  /* run ahead of the last state, then step back through each state */
+  write_state(dc, NUM_STATES);
+
+  for (int n = NUM_STATES - 2; n >= 0; n--) {
+    CHECK(rewind_load(rw, dc));
+    validate_state(dc, n);
+  }
+
+  CHECK(!rewind_load(rw, dc));
+  CHECK_EQ(rewind_num_states(rw), 0);
+
+  rewind_destroy(rw);
+  dc_destroy(dc);
+}
+
+TEST(rewind_budget) {
+  struct dreamcast *dc = dc_create();
+  struct rewind *rw = rewind_create(1);
+
+  sh4_reset(dc->sh4, 0xa0000000);
+
+  /* the most recent state alone exceeds the budget, no delta should be
+     kept */
+  for (int n = 0; n < NUM_STATES; n++) {
+    write_state(dc, n);
+    rewind_save(rw, dc);
+  }
+
+  CHECK_EQ(rewind_num_states(rw), 0);
+  CHECK(!rewind_load(rw, dc));
+
+  rewind_destroy(rw);
+  dc_destroy(dc);
+}
@@ -0,0 +1,171 @@
+#include "guest/dreamcast.h"
+#include "guest/memory.h"
+#include "guest/pvr/pvr.h"
+#include "guest/savestate.h"
+#include "guest/sh4/sh4.h"
+#include "retest.h"
+
+#define PAGE(n) ((n) << SAVESTATE_PAGE_SHIFT)
+
+static void fill_memory(struct dreamcast *dc) {
+  uint8_t *ram = mem_ram(dc->mem, 0x0);
+  uint8_t *vram = mem_vram(dc->mem, 0x0);
+  uint8_t *aram = mem_aram(dc->mem, 0x0);
+
+  for (int i = 0; i < PAGE(4); i++) {
+    ram[i] = (uint8_t)i;
+    vram[i] = (uint8_t)(i * 3);
+    aram[i] = (uint8_t)(i * 7);
+  }
+
+  /* video ram is written to through the pvr, which tracks the pages written */
+  pvr_mark_vram(dc->pvr, 0, PAGE(4));
+
+  dc->sh4->ctx.r[0] = 0xdeadbeef;
+  dc->sh4->ctx.pc = 0x8c010000;
+}
+
+static void validate_memory(struct dreamcast *dc) {
+  uint8_t *ram = mem_ram(dc->mem, 0x0);
+  uint8_t *vram = mem_vram(dc->mem, 0x0);
+  uint8_t *aram = mem_aram(dc->mem, 0x0);
+
+  for (int i = 0; i < PAGE(4); i++) {
+    CHECK_EQ(ram[i], (uint8_t)i);
+    CHECK_EQ(vram[i], (uint8_t)(i * 3));
+    CHECK_EQ(aram[i], (uint8_t)(i * 7));
+  }
+
+  CHECK_EQ(dc->sh4->ctx.r[0], 0xdeadbeef);
+  CHECK_EQ(dc->sh4->ctx.pc, 0x8c010000);
+}
+
+static void clobber_memory(struct dreamcast *dc) {
+  mem_ram(dc->mem, PAGE(1))[0] ^= 0xff;
+  mem_vram(dc->mem, PAGE(2))[17] ^= 0xff;
+  pvr_mark_vram(dc->pvr, PAGE(2) + 17, 1);
+  mem_aram(dc->mem, PAGE(3))[PAGE(1) - 1] ^= 0xff;
+
+  dc->sh4->ctx.r[0] = 0;
+  dc->sh4->ctx.pc = 0;
+}
+
+TEST(savestate_save_load) {
+  struct dreamcast *dc = dc_create();
+  struct savestate *ss = savestate_create();
+
+  sh4_reset(dc->sh4, 0xa0000000);
+  fill_memory(dc);
+
+  /* the first save copies every page */
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, savestate_num_pages(ss));
+
+  /* only the clobbered pages should be copied back */
+  clobber_memory(dc);
+  dc_load_state(dc, ss);
+  CHECK_EQ(ss->num_restored, 3);
+  validate_memory(dc);
+
+  savestate_destroy(ss);
+  dc_destroy(dc);
+}
+
+TEST(savestate_incremental) {
+  struct dreamcast *dc = dc_create();
+  struct savestate *ss = savestate_create();
+
+  sh4_reset(dc->sh4, 0xa0000000);
+  fill_memory(dc);
+  dc_save_state(dc, ss, 1);
+
+  /* saving again without changes shouldn't copy any pages */
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, 0);
+
+  /* each modified page should be flagged, in the order memory is saved */
+  clobber_memory(dc);
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, 3);
+
+  int ram_page = 1;
+  CHECK(bitmap_test(ss->dirty, ram_page, 1));
+  CHECK(!bitmap_test(ss->dirty, ram_page + 1, 1));
+
+  /* a full save copies every page regardless */
+  dc_save_state(dc, ss, 0);
+  CHECK_EQ(ss->num_dirty, savestate_num_pages(ss));
+
+  savestate_destroy(ss);
+  dc_destroy(dc);
+}
+
+TEST(savestate_serialize) {
+  struct dreamcast *dc = dc_create();
+  struct savestate *ss = savestate_create();
+  struct savestate *copy = savestate_create();
+
+  sh4_reset(dc->sh4, 0xa0000000);
+  fill_memory(dc);
+  dc_save_state(dc, ss, 0);
+
+  int size = savestate_size(ss);
+  uint8_t *data = malloc(size);
+  CHECK(!savestate_write(ss, data, size - 1));
+  CHECK(savestate_write(ss, data, size));
+
+  /* load the serialized copy back in to a clobbered machine */
+  CHECK(!savestate_read(copy, data, size - 1));
+  CHECK(savestate_read(copy, data, size));
+  clobber_memory(dc);
+  dc_load_state(dc, copy);
+  validate_memory(dc);
+
+  free(data);
+  savestate_destroy(copy);
+  savestate_destroy(ss);
+  dc_destroy(dc);
+}
+
+TEST(savestate_tracked_writes) {
+  struct dreamcast *dc = dc_create();
+  struct savestate *ss = savestate_create();
+
+  dc_track_writes(dc, 1);
+  sh4_reset(dc->sh4, 0xa0000000);
+  fill_memory(dc);
+  dc_save_state(dc, ss, 1);
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, 0);
+
+  /* writes through the host's pointers are caught */
+  clobber_memory(dc);
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, 3);
+
+  /* as are writes made by the kernel on the host's behalf, as long as they're
+     announced first */
+  FILE *fp = tmpfile();
+  CHECK_NOTNULL(fp);
+  uint8_t data[PAGE(2)];
+  memset(data, 0x5a, sizeof(data));
+  CHECK_EQ(fwrite(data, 1, sizeof(data), fp), sizeof(data));
+  fseek(fp, 0, SEEK_SET);
+
+  uint8_t *ram = mem_ram(dc->mem, PAGE(5) + 8);
+  mem_host_write(dc->mem, ram, sizeof(data));
+  CHECK_EQ(fread(ram, 1, sizeof(data), fp), sizeof(data));
+  fclose(fp);
+
+  dc_save_state(dc, ss, 1);
+  CHECK_EQ(ss->num_dirty, 3);
+
+  /* loads only copy back the pages written since */
+  ram[0] ^= 0xff;
+  dc_load_state(dc, ss);
+  CHECK_EQ(ss->num_restored, 1);
+  CHECK_EQ(ram[0], 0x5a);
+
+  savestate_destroy(ss);
+  dc_destroy(dc);
+}
@@ -0,0 +1,194 @@
+#include "guest/dreamcast.h"
+#include "guest/sh4/sh4.h"
+#include "jit/frontend/sh4/sh4_guest.h"
+#include "jit/jit_guest.h"
+#include "retest.h"
+
+#define PAGE_MASK 0xfffffc00
+
+struct mmu_test {
+  struct dreamcast *dc;
+  struct sh4 *sh4;
+  int raised;
+  enum sh4_exception exc;
+};
+
+/* record exceptions instead of entering the handler, leaving sr untouched */
+static int mmu_exception(void *data, enum sh4_exception exc) {
+  struct mmu_test *t = data;
+  t->raised = 1;
+  t->exc = exc;
+  return 1;
+}
+
+static void mmu_init(struct mmu_test *t, uint32_t mmucr) {
+  t->dc = dc_create();
+  t->sh4 = t->dc->sh4;
+  t->raised = 0;
+
+  sh4_reset(t->sh4, 0xa0000000);
+  sh4_set_exception_handler(t->sh4, &mmu_exception, t);
+  sh4_cb[MMUCR].write(t->dc, mmucr);
+}
+
+static void mmu_destroy(struct mmu_test *t) {
+  dc_destroy(t->dc);
+}
+
+static void mmu_set_asid(struct mmu_test *t, uint32_t asid) {
+  sh4_cb[PTEH].write(t->dc, asid);
+}
+
+static void mmu_set_md(struct mmu_test *t, int md) {
+  uint32_t old_sr = t->sh4->ctx.sr;
+  t->sh4->ctx.sr = md ? (old_sr | MD_MASK) : (old_sr & ~MD_MASK);
+  sh4_mmu_sr_updated(t->sh4, old_sr);
+}
+
+/* map a 4 kb page through the utlb */
+static void mmu_map(struct mmu_test *t, int n, uint32_t vaddr, uint32_t paddr,
+                    uint32_t asid, uint32_t pr, int shared, int dirty) {
+  struct sh4_tlb_entry *entry = &t->sh4->utlb[n];
+  memset(entry, 0, sizeof(*entry));
+  entry->hi.VPN = vaddr >> 10;
+  entry->hi.ASID = asid;
+  entry->lo.PPN = paddr >> 10;
+  entry->lo.V = 1;
+  entry->lo.SZ0 = 1;
+  entry->lo.PR = pr;
+  entry->lo.SH = shared;
+  entry->lo.D = dirty;
+}
+
+/* translate an address, returning 1 if the access succeeded. on failure the
+   raised exception is left in t->exc */
+static int mmu_access(struct mmu_test *t, uint32_t addr, int access,
+                      uint32_t *paddr) {
+  t->raised = 0;
+  t->sh4->ctx.fault = 0;
+
+  *paddr = sh4_mmu_translate(t->sh4, addr, access);
+
+  /* a fault should always be accompanied by an exception */
+  CHECK_EQ(t->sh4->ctx.fault, (uint32_t)t->raised);
+
+  return !t->raised;
+}
+
+static uint32_t mmu_cached(struct mmu_test *t, uint32_t addr) {
+  return t->sh4->tlb_cache[addr >> SH4_TLB_SHIFT];
+}
+
+TEST(sh4_mmu_translate) {
+  struct mmu_test t;
+  uint32_t paddr;
+
+  mmu_init(&t, 0x1);
+  mmu_map(&t, 0, 0x00400000, 0x0c100000, 0, 0x3, 0, 1);
+  mmu_map(&t, 1, 0x00600000, 0x0c200000, 0, 0x3, 0, 0);
+
+  /* hits are translated and cached for the jit */
+  CHECK(mmu_access(&t, 0x00400123, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c100123);
+  CHECK_EQ(mmu_cached(&t, 0x00400123) & PAGE_MASK, 0x0c100000);
+  CHECK_EQ(mmu_cached(&t, 0x00400123) & JIT_TLB_WRITE, JIT_TLB_WRITE);
+
+  /* P1 addresses are never translated */
+  CHECK(mmu_access(&t, 0x8c001234, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x8c001234);
+
+  /* misses raise an exception with the faulting address in TEA */
+  CHECK(!mmu_access(&t, 0x00500010, JIT_TLB_READ, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBMISSR);
+  CHECK_EQ(*t.sh4->TEA, 0x00500010);
+  CHECK_EQ(mmu_cached(&t, 0x00500010), 0);
+
+  CHECK(!mmu_access(&t, 0x00500010, JIT_TLB_WRITE, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBMISSW);
+
+  /* the first write to a clean page raises an initial page write exception,
+     reads are cached without write access */
+  CHECK(!mmu_access(&t, 0x00600000, JIT_TLB_WRITE, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_PAGEWRITE);
+
+  CHECK(mmu_access(&t, 0x00600004, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c200004);
+  CHECK_EQ(mmu_cached(&t, 0x00600004) & JIT_TLB_WRITE, 0);
+
+  /* instruction fetches fill the itlb from the utlb */
+  enum sh4_exception exc;
+  CHECK(sh4_mmu_translate_code(t.sh4, 0x00400000, &exc));
+  CHECK(!sh4_mmu_translate_code(t.sh4, 0x00800000, &exc));
+  CHECK_EQ(exc, SH4_EXC_ITLBMISS);
+
+  mmu_destroy(&t);
+}
+
+TEST(sh4_mmu_asid) {
+  struct mmu_test t;
+  uint32_t paddr;
+
+  mmu_init(&t, 0x1);
+  mmu_set_asid(&t, 1);
+  mmu_map(&t, 0, 0x00400000, 0x0c100000, 1, 0x3, 0, 1);
+  mmu_map(&t, 1, 0x00401000, 0x0c101000, 1, 0x3, 1, 1);
+  mmu_map(&t, 2, 0x00400000, 0x0c300000, 2, 0x3, 0, 1);
+
+  CHECK(mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c100000);
+  CHECK(mmu_access(&t, 0x00401000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c101000);
+
+  /* changing the asid drops the cached private pages, shared pages stay */
+  mmu_set_asid(&t, 2);
+  CHECK_EQ(mmu_cached(&t, 0x00400000), 0);
+
+  CHECK(mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c300000);
+  CHECK(mmu_access(&t, 0x00401000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c101000);
+
+  /* pages private to another asid miss */
+  mmu_set_asid(&t, 3);
+  CHECK(!mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBMISSR);
+  CHECK(mmu_access(&t, 0x00401000, JIT_TLB_READ, &paddr));
+
+  mmu_destroy(&t);
+}
+
+TEST(sh4_mmu_sv_md) {
+  struct mmu_test t;
+  uint32_t paddr;
+
+  /* AT and SV, privileged read-only page owned by another asid */
+  mmu_init(&t, 0x101);
+  mmu_set_asid(&t, 2);
+  mmu_map(&t, 0, 0x00400000, 0x0c100000, 1, 0x0, 0, 1);
+
+  /* privileged accesses ignore the asid in single virtual memory mode */
+  CHECK(mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(paddr, 0x0c100000);
+  CHECK(!mmu_access(&t, 0x00400000, JIT_TLB_WRITE, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBPROTW);
+
+  /* user accesses compare it, and switching modes drops cached pages */
+  mmu_set_md(&t, 0);
+  CHECK_EQ(mmu_cached(&t, 0x00400000), 0);
+  CHECK(!mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBMISSR);
+
+  /* once the asid matches, the page is still privileged only */
+  mmu_set_asid(&t, 1);
+  CHECK(!mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBPROTR);
+
+  /* without SV, privileged accesses compare the asid as well */
+  mmu_set_md(&t, 1);
+  sh4_cb[MMUCR].write(t.dc, 0x1);
+  mmu_set_asid(&t, 2);
+  CHECK(!mmu_access(&t, 0x00400000, JIT_TLB_READ, &paddr));
+  CHECK_EQ(t.exc, SH4_EXC_DTLBMISSR);
+
+  mmu_destroy(&t);
+}
@@ -0,0 +1,48 @@
+#include "core/sort.h"
+#include "retest.h"
+
+#define MAX_VALUES 0x4000
+
+static float depths[MAX_VALUES];
+static int expected[MAX_VALUES];
+static int expected_tmp[MAX_VALUES];
+static uint64_t keys[MAX_VALUES];
+static uint64_t keys_tmp[MAX_VALUES];
+
+static int compare_depth(const void *a, const void *b) {
+  int i = *(const int *)a;
+  int j = *(const int *)b;
+  return depths[i] <= depths[j];
+}
+
+static float random_depth() {
+  /* favor duplicate values in order to exercise the sort's stability, and
+     throw in both signs of zero */
+  switch (rand() % 4) {
+    case 0:
+      return (float)(rand() % 16);
+    case 1:
+      return (rand() % 2) ? 0.0f : -0.0f;
+    case 2:
+      return -(float)rand() / RAND_MAX * 1000.0f;
+    default:
+      return (float)rand() / RAND_MAX * 1000.0f;
+  }
+}
+
+TEST(rsort_matches_msort) {
+  for (int num = 0; num <= MAX_VALUES; num = num ? num * 4 : 1) {
+    for (int i = 0; i < num; i++) {
+      depths[i] = random_depth();
+      expected[i] = i;
+      keys[i] = ((uint64_t)rsort_float_key(depths[i]) << 32) | (uint32_t)i;
+    }
+
+    msort_noalloc(expected, expected_tmp, num, sizeof(int), &compare_depth);
+    rsort_noalloc(keys, keys_tmp, num);
+
+    for (int i = 0; i < num; i++) {
+      CHECK_EQ((int)(uint32_t)keys[i], expected[i]);
+    }
+  }
+}
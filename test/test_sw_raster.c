@@ -0,0 +1,183 @@
+#include "core/core.h"
+#include "core/time.h"
+#include "render/sw_raster.h"
+#include "retest.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define GRID_SIZE 16
+#define MAX_VERTS 4096
+#define MAX_INDICES 16384
+
+static struct ta_vertex verts[MAX_VERTS];
+static uint16_t indices[MAX_INDICES];
+static uint8_t texels[64 * 64 * 4];
+
+static float randf(float min, float max) {
+  return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void init_vertex(struct ta_vertex *v, float x, float y, float z,
+                        uint32_t color) {
+  v->xyz[0] = x;
+  v->xyz[1] = y;
+  v->xyz[2] = z;
+  v->uv[0] = x / 64.0f;
+  v->uv[1] = y / 64.0f;
+  v->color = color;
+  v->offset_color = 0;
+}
+
+TEST(sw_raster_shared_edges) {
+  /* cover the viewport with a jittered grid of triangles, drawn with additive
+     blending. every pixel should be touched by exactly one triangle */
+  int num_verts = 0;
+  int num_indices = 0;
+
+  for (int y = 0; y <= GRID_SIZE; y++) {
+    for (int x = 0; x <= GRID_SIZE; x++) {
+      float fx = x * WIDTH / (float)GRID_SIZE;
+      float fy = y * HEIGHT / (float)GRID_SIZE;
+
+      /* jitter the interior vertices */
+      if (x > 0 && x < GRID_SIZE && y > 0 && y < GRID_SIZE) {
+        fx += randf(-10.0f, 10.0f);
+        fy += randf(-10.0f, 10.0f);
+      }
+
+      init_vertex(&verts[num_verts++], fx, fy, randf(0.1f, 1.0f), 0x01010101);
+    }
+  }
+
+  for (int y = 0; y < GRID_SIZE; y++) {
+    for (int x = 0; x < GRID_SIZE; x++) {
+      uint16_t v0 = y * (GRID_SIZE + 1) + x;
+      uint16_t v1 = v0 + 1;
+      uint16_t v2 = v0 + GRID_SIZE + 1;
+      uint16_t v3 = v2 + 1;
+
+      /* alternate the winding of each pair */
+      if ((x + y) & 1) {
+        indices[num_indices++] = v0;
+        indices[num_indices++] = v1;
+        indices[num_indices++] = v2;
+      } else {
+        indices[num_indices++] = v2;
+        indices[num_indices++] = v1;
+        indices[num_indices++] = v0;
+      }
+      indices[num_indices++] = v1;
+      indices[num_indices++] = v3;
+      indices[num_indices++] = v2;
+    }
+  }
+
+  struct ta_surface surf = {0};
+  surf.params.depth_func = DEPTH_NONE;
+  surf.params.cull = CULL_NONE;
+  surf.params.src_blend = BLEND_ONE;
+  surf.params.dst_blend = BLEND_ONE;
+  surf.params.shade = SHADE_DECAL;
+  surf.first_vert = 0;
+  surf.num_verts = num_indices;
+
+  struct sw_raster *sr = sw_raster_create(WIDTH, HEIGHT, 4);
+  sw_raster_begin(sr, WIDTH, HEIGHT, verts, num_verts, indices, num_indices);
+  sw_raster_draw(sr, &surf, NULL);
+  sw_raster_end(sr);
+
+  const uint8_t *pixels = sw_raster_pixels(sr);
+  for (int i = 0; i < WIDTH * HEIGHT * 4; i++) {
+    CHECK_EQ(pixels[i], 1, "pixel %d,%d covered %d times",
+             (i >> 2) % WIDTH, (i >> 2) / WIDTH, pixels[i]);
+  }
+
+  sw_raster_destroy(sr);
+}
+
+static int64_t render_scene(struct sw_raster *sr, int num_tris,
+                            const struct sw_texture *tex) {
+  int num_verts = num_tris * 3;
+  float cx = 0.0f;
+  float cy = 0.0f;
+
+  srand(0);
+
+  /* scatter triangles up to 128 pixels across over the viewport, with some
+     hanging off of its edges */
+  for (int i = 0; i < num_verts; i++) {
+    if (i % 3 == 0) {
+      cx = randf(-32.0f, WIDTH + 32.0f);
+      cy = randf(-32.0f, HEIGHT + 32.0f);
+    }
+
+    float x = cx + randf(-64.0f, 64.0f);
+    float y = cy + randf(-64.0f, 64.0f);
+    uint32_t color = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    init_vertex(&verts[i], x, y, randf(0.01f, 2.0f), color);
+    indices[i] = i;
+  }
+
+  int64_t start = time_nanoseconds();
+
+  sw_raster_clear(sr);
+  sw_raster_begin(sr, WIDTH, HEIGHT, verts, num_verts, indices, num_verts);
+
+  /* exercise a spread of render state, one triangle per surface */
+  for (int i = 0; i < num_tris; i++) {
+    struct ta_surface surf = {0};
+    surf.params.texture = i & 1;
+    surf.params.depth_write = 1;
+    surf.params.depth_func = (i % 3) ? DEPTH_GEQUAL : DEPTH_NONE;
+    surf.params.cull = i % 3;
+    surf.params.src_blend = (i & 2) ? BLEND_SRC_ALPHA : BLEND_NONE;
+    surf.params.dst_blend = (i & 2) ? BLEND_ONE_MINUS_SRC_ALPHA : BLEND_NONE;
+    surf.params.shade = i & 3;
+    surf.params.offset_color = (i >> 2) & 1;
+    surf.params.alpha_test = (i % 5) == 0;
+    surf.params.alpha_ref = 0x40;
+    surf.first_vert = i * 3;
+    surf.num_verts = 3;
+
+    sw_raster_draw(sr, &surf, tex);
+  }
+
+  sw_raster_end(sr);
+
+  return time_nanoseconds() - start;
+}
+
+TEST(sw_raster_threads) {
+  static const int num_tris = 1200;
+  static uint8_t expected[WIDTH * HEIGHT * 4];
+
+  for (int i = 0; i < ARRAY_SIZE(texels); i++) {
+    texels[i] = rand() & 0xff;
+  }
+
+  struct sw_texture tex = {0};
+  tex.filter = FILTER_BILINEAR;
+  tex.wrap_u = WRAP_REPEAT;
+  tex.wrap_v = WRAP_MIRRORED_REPEAT;
+  tex.width = 64;
+  tex.height = 64;
+  tex.data = texels;
+
+  /* the output shouldn't depend on the number of threads shading tiles */
+  for (int num_threads = 1; num_threads <= 8; num_threads <<= 1) {
+    struct sw_raster *sr = sw_raster_create(WIDTH, HEIGHT, num_threads);
+    int64_t elapsed = render_scene(sr, num_tris, &tex);
+
+    if (num_threads == 1) {
+      memcpy(expected, sw_raster_pixels(sr), sizeof(expected));
+    } else {
+      CHECK(!memcmp(expected, sw_raster_pixels(sr), sizeof(expected)),
+            "output with %d threads differs", num_threads);
+    }
+
+    LOG_INFO("%d threads, %d triangles in %.2f ms", num_threads, num_tris,
+             elapsed / 1000000.0f);
+
+    sw_raster_destroy(sr);
+  }
+}
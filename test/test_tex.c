@@ -0,0 +1,189 @@
+#include "core/core.h"
+#include "core/time.h"
+#include "guest/pvr/tex.h"
+#include "retest.h"
+
+#define MAX_DIM 1024
+#define MAX_SRC_SIZE (PVR_CODEBOOK_SIZE + MAX_DIM * MAX_DIM * 2)
+#define MAX_DST_SIZE (MAX_DIM * MAX_DIM * 4)
+
+struct tex_fmt {
+  const char *name;
+  int texture_fmt;
+  int pixel_fmt;
+  int palette_fmt;
+};
+
+static struct tex_fmt tex_fmts[] = {
+    {"twiddled ARGB1555", PVR_TEX_TWIDDLED, PVR_PXL_ARGB1555, 0},
+    {"twiddled RGB565", PVR_TEX_TWIDDLED, PVR_PXL_RGB565, 0},
+    {"twiddled ARGB4444", PVR_TEX_TWIDDLED, PVR_PXL_ARGB4444, 0},
+    {"twiddled YUV422", PVR_TEX_TWIDDLED, PVR_PXL_YUV422, 0},
+    {"bitmap ARGB1555", PVR_TEX_BITMAP, PVR_PXL_ARGB1555, 0},
+    {"bitmap RGB565", PVR_TEX_BITMAP, PVR_PXL_RGB565, 0},
+    {"bitmap ARGB4444", PVR_TEX_BITMAP, PVR_PXL_ARGB4444, 0},
+    {"bitmap YUV422", PVR_TEX_BITMAP, PVR_PXL_YUV422, 0},
+    {"vq ARGB1555", PVR_TEX_VQ, PVR_PXL_ARGB1555, 0},
+    {"vq RGB565", PVR_TEX_VQ, PVR_PXL_RGB565, 0},
+    {"vq ARGB4444", PVR_TEX_VQ, PVR_PXL_ARGB4444, 0},
+    {"vq YUV422", PVR_TEX_VQ, PVR_PXL_YUV422, 0},
+    {"pal4 ARGB1555", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB1555},
+    {"pal4 RGB565", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_RGB565},
+    {"pal4 ARGB4444", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB4444},
+    {"pal4 ARGB8888", PVR_TEX_PALETTE_4BPP, PVR_PXL_4BPP, PVR_PAL_ARGB8888},
+    {"pal8 ARGB1555", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB1555},
+    {"pal8 RGB565", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_RGB565},
+    {"pal8 ARGB4444", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB4444},
+    {"pal8 ARGB8888", PVR_TEX_PALETTE_8BPP, PVR_PXL_8BPP, PVR_PAL_ARGB8888},
+};
+
+static uint8_t src[MAX_SRC_SIZE];
+static uint32_t palette[256];
+static uint8_t expected[MAX_DST_SIZE];
+static uint8_t actual[MAX_DST_SIZE];
+
+static void init_tex() {
+  for (int i = 0; i < ARRAY_SIZE(src); i++) {
+    src[i] = rand() & 0xff;
+  }
+
+  for (int i = 0; i < ARRAY_SIZE(palette); i++) {
+    palette[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+  }
+}
+
+TEST(tex_decode) {
+  init_tex();
+
+  for (int i = 0; i < ARRAY_SIZE(tex_fmts); i++) {
+    struct tex_fmt *fmt = &tex_fmts[i];
+
+    /* every square size, along with rectangles of differing aspect ratios */
+    for (int w = 8; w <= MAX_DIM; w <<= 1) {
+      for (int h = 8; h <= MAX_DIM; h <<= 1) {
+        if (w != h && (w > 256 || h > 256)) {
+          continue;
+        }
+
+        int size = w * h * 4;
+        memset(expected, 0, size);
+        memset(actual, 0xcd, size);
+
+        pvr_tex_decode_ref(src, w, h, w, fmt->texture_fmt, fmt->pixel_fmt,
+                           (const uint8_t *)palette, fmt->palette_fmt,
+                           expected, size);
+        pvr_tex_decode(src, w, h, w, fmt->texture_fmt, fmt->pixel_fmt,
+                       (const uint8_t *)palette, fmt->palette_fmt, actual,
+                       size);
+
+        CHECK(!memcmp(expected, actual, size), "%s %dx%d differs", fmt->name,
+              w, h);
+      }
+    }
+  }
+}
+
+TEST(tex_decode_perf) {
+  const int w = 256;
+  const int h = 256;
+  const int size = w * h * 4;
+  const int iterations = 16;
+
+  init_tex();
+
+  for (int i = 0; i < ARRAY_SIZE(tex_fmts); i++) {
+    struct tex_fmt *fmt = &tex_fmts[i];
+
+    int64_t start = time_nanoseconds();
+    for (int j = 0; j < iterations; j++) {
+      pvr_tex_decode_ref(src, w, h, w, fmt->texture_fmt, fmt->pixel_fmt,
+                         (const uint8_t *)palette, fmt->palette_fmt, expected,
+                         size);
+    }
+    int64_t ref = time_nanoseconds() - start;
+
+    start = time_nanoseconds();
+    for (int j = 0; j < iterations; j++) {
+      pvr_tex_decode(src, w, h, w, fmt->texture_fmt, fmt->pixel_fmt,
+                     (const uint8_t *)palette, fmt->palette_fmt, actual, size);
+    }
+    int64_t opt = time_nanoseconds() - start;
+
+    /* report the throughput in megatexels per second */
+    float texels = (float)w * h * iterations;
+    LOG_INFO("%-18s  ref %7.1f Mt/s  sse2 %7.1f Mt/s", fmt->name,
+             texels / (ref / 1000.0f), texels / (opt / 1000.0f));
+  }
+}
+
+/* yuv420 streams are uploaded as a series of 16x16 macroblocks, which are each
+   reencoded into a single uyvy422 texture */
+static int yuv_sizes[][2] = {{320, 240}, {640, 480}};
+
+TEST(yuv420_decode) {
+  init_tex();
+
+  for (int i = 0; i < ARRAY_SIZE(yuv_sizes); i++) {
+    int w = yuv_sizes[i][0];
+    int h = yuv_sizes[i][1];
+    int stride = w * 2;
+    int size = stride * h;
+    memset(expected, 0, size);
+    memset(actual, 0xcd, size);
+
+    const uint8_t *block = src;
+    for (int y = 0; y < h; y += 16) {
+      for (int x = 0; x < w; x += 16) {
+        int offset = y * stride + x * 2;
+        pvr_yuv420_decode_ref(block, &expected[offset], stride);
+        pvr_yuv420_decode(block, &actual[offset], stride);
+        block += PVR_YUV420_MACROBLOCK_SIZE;
+      }
+    }
+
+    CHECK(!memcmp(expected, actual, size), "yuv420 %dx%d differs", w, h);
+  }
+}
+
+TEST(yuv420_decode_perf) {
+  const int iterations = 64;
+
+  init_tex();
+
+  for (int i = 0; i < ARRAY_SIZE(yuv_sizes); i++) {
+    int w = yuv_sizes[i][0];
+    int h = yuv_sizes[i][1];
+    int stride = w * 2;
+    int64_t elapsed[2];
+
+    for (int simd = 0; simd < 2; simd++) {
+      uint8_t *dst = simd ? actual : expected;
+      int64_t start = time_nanoseconds();
+
+      for (int j = 0; j < iterations; j++) {
+        const uint8_t *block = src;
+
+        for (int y = 0; y < h; y += 16) {
+          for (int x = 0; x < w; x += 16) {
+            int offset = y * stride + x * 2;
+
+            if (simd) {
+              pvr_yuv420_decode(block, &dst[offset], stride);
+            } else {
+              pvr_yuv420_decode_ref(block, &dst[offset], stride);
+            }
+
+            block += PVR_YUV420_MACROBLOCK_SIZE;
+          }
+        }
+      }
+
+      elapsed[simd] = time_nanoseconds() - start;
+    }
+
+    /* report the time taken to reencode a single frame */
+    LOG_INFO("yuv420 %dx%d  ref %7.1f us / frame  sse2 %7.1f us / frame", w,
+             h, elapsed[0] / (iterations * 1000.0f),
+             elapsed[1] / (iterations * 1000.0f));
+  }
+}
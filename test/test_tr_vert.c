@@ -0,0 +1,66 @@
+#include "guest/pvr/tr_vert.h"
+#include "retest.h"
+
+#define MAX_VERTS 0x400
+#define MAX_STRIDE 64
+
+static uint8_t params[MAX_VERTS * MAX_STRIDE];
+static struct ta_vertex expected[MAX_VERTS];
+static struct ta_vertex actual[MAX_VERTS];
+
+static float rand_float() {
+  /* mostly in range colors and intensities, with some that need clamping */
+  switch (rand() % 8) {
+    case 0:
+      return -(float)rand() / RAND_MAX;
+    case 1:
+      return 1.0f + (float)rand() / RAND_MAX;
+    case 2:
+      return (float)(rand() % 3) - 1.0f;
+    default:
+      return (float)rand() / RAND_MAX;
+  }
+}
+
+static void init_params(int stride, int num) {
+  for (int i = 0; i < num * stride; i += 4) {
+    float f = rand_float();
+    uint32_t r = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+    /* fill each word with either a float or random bits, covering packed
+       colors and 16-bit uvs */
+    if (rand() & 1) {
+      memcpy(&params[i], &f, 4);
+    } else {
+      memcpy(&params[i], &r, 4);
+    }
+  }
+}
+
+TEST(tr_decode_verts) {
+  for (int vert_type = 0; vert_type <= 8; vert_type++) {
+    int stride = (vert_type == 5 || vert_type == 6) ? 64 : 32;
+
+    for (int iter = 0; iter < 16; iter++) {
+      uint8_t face_color[4];
+      uint8_t face_offset_color[4];
+      for (int i = 0; i < 4; i++) {
+        face_color[i] = rand() & 0xff;
+        face_offset_color[i] = rand() & 0xff;
+      }
+
+      int num = 1 + rand() % MAX_VERTS;
+      init_params(stride, num);
+
+      memset(expected, 0xcd, sizeof(expected));
+      memset(actual, 0xcd, sizeof(actual));
+
+      tr_decode_verts_ref(vert_type, params, stride, num, face_color,
+                          face_offset_color, expected);
+      tr_decode_verts(vert_type, params, stride, num, face_color,
+                      face_offset_color, actual);
+
+      CHECK(!memcmp(expected, actual, sizeof(expected)));
+    }
+  }
+}
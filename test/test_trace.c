@@ -0,0 +1,207 @@
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "retest.h"
+
+static uint8_t palette[64];
+static uint8_t texture[1024];
+static uint8_t other_texture[1024];
+
+static void trace_filename(char *filename, size_t size) {
+  snprintf(filename, size, "%s" PATH_SEPARATOR "retest.trace", fs_appdir());
+}
+
+static union tsp make_tsp(uint32_t full) {
+  union tsp tsp;
+  tsp.full = full;
+  return tsp;
+}
+
+static union tcw make_tcw(uint32_t full) {
+  union tcw tcw;
+  tcw.full = full;
+  return tcw;
+}
+
+static void init_context(struct ta_context *ctx, int size, int seed) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->autosort = seed & 1;
+  ctx->stride = 640;
+  ctx->video_width = 640;
+  ctx->video_height = 480;
+  ctx->bg_depth = 0.5f;
+  ctx->size = size;
+
+  srand(seed);
+  for (int i = 0; i < (int)sizeof(ctx->bg_vertices); i++) {
+    ctx->bg_vertices[i] = rand() & 0xff;
+  }
+  for (int i = 0; i < size; i++) {
+    ctx->params[i] = rand() & 0xff;
+  }
+}
+
+static void check_context(struct trace *trace, struct trace_cmd *cmd,
+                          const struct ta_context *expected) {
+  static struct ta_context ctx;
+  trace_copy_context(trace, cmd, &ctx);
+
+  CHECK_EQ(ctx.autosort, expected->autosort);
+  CHECK_EQ(ctx.size, expected->size);
+  CHECK(!memcmp(ctx.bg_vertices, expected->bg_vertices,
+                sizeof(ctx.bg_vertices)));
+  CHECK(!memcmp(ctx.params, expected->params, expected->size));
+}
+
+static void check_texture(struct trace *trace, struct trace_cmd *cmd,
+                          const uint8_t *expected) {
+  trace_load_texture(trace, cmd);
+
+  CHECK_EQ(cmd->texture.palette_size, (int)sizeof(palette));
+  CHECK_EQ(cmd->texture.texture_size, (int)sizeof(texture));
+  CHECK(!memcmp(cmd->texture.palette, palette, sizeof(palette)));
+  CHECK(!memcmp(cmd->texture.texture, expected, sizeof(texture)));
+}
+
+TEST(trace_compressed) {
+  static struct ta_context ctx0;
+  static struct ta_context ctx1;
+  char filename[PATH_MAX];
+  trace_filename(filename, sizeof(filename));
+
+  for (int i = 0; i < (int)sizeof(texture); i++) {
+    texture[i] = i & 0xff;
+    other_texture[i] = (i * 7) & 0xff;
+  }
+
+  init_context(&ctx0, 4096, 0);
+  init_context(&ctx1, 32, 1);
+
+  /* the second texture has the same data as the first, and should share its
+     block. the third replaces the first texture with new data */
+  struct trace_writer *writer = trace_writer_open(filename);
+  CHECK_NOTNULL(writer);
+  trace_writer_insert_texture(writer, make_tsp(1), make_tcw(1), 0, palette,
+                              sizeof(palette), texture, sizeof(texture));
+  trace_writer_insert_texture(writer, make_tsp(2), make_tcw(2), 0, palette,
+                              sizeof(palette), texture, sizeof(texture));
+  trace_writer_render_context(writer, &ctx0);
+  trace_writer_insert_texture(writer, make_tsp(1), make_tcw(1), 1, palette,
+                              sizeof(palette), other_texture,
+                              sizeof(other_texture));
+  trace_writer_render_context(writer, &ctx1);
+  trace_writer_close(writer);
+
+  struct trace *trace = trace_parse(filename);
+  CHECK_NOTNULL(trace);
+  CHECK_EQ(trace->num_cmds, 5);
+  CHECK_EQ(trace->num_blocks, 4);
+  CHECK_EQ(trace->num_frames, 2);
+
+  /* seek to the last frame first, nothing before it should need loading */
+  check_context(trace, trace->frames[1], &ctx1);
+  check_context(trace, trace->frames[0], &ctx0);
+
+  struct trace_cmd *cmds = trace->cmds;
+  CHECK(cmds[3].override == &cmds[0]);
+  CHECK(cmds[1].override == NULL);
+
+  check_texture(trace, &cmds[3], other_texture);
+  check_texture(trace, &cmds[1], texture);
+  check_texture(trace, &cmds[0], texture);
+  CHECK(cmds[0].texture.texture == cmds[1].texture.texture);
+
+  trace_destroy(trace);
+  remove(filename);
+}
+
+TEST(trace_unclosed) {
+  static struct ta_context ctx0;
+  static struct ta_context ctx1;
+  char filename[PATH_MAX];
+  trace_filename(filename, sizeof(filename));
+
+  for (int i = 0; i < (int)sizeof(texture); i++) {
+    texture[i] = i & 0xff;
+  }
+
+  init_context(&ctx0, 4096, 0);
+  init_context(&ctx1, 32, 1);
+
+  /* parse the trace while it's still being written, as if the writer had
+     crashed. everything up to the end of the last frame should be readable */
+  struct trace_writer *writer = trace_writer_open(filename);
+  CHECK_NOTNULL(writer);
+  trace_writer_insert_texture(writer, make_tsp(1), make_tcw(1), 0, palette,
+                              sizeof(palette), texture, sizeof(texture));
+  trace_writer_render_context(writer, &ctx0);
+  trace_writer_insert_texture(writer, make_tsp(2), make_tcw(2), 0, palette,
+                              sizeof(palette), texture, sizeof(texture));
+  trace_writer_render_context(writer, &ctx1);
+
+  struct trace *trace = trace_parse(filename);
+  CHECK_NOTNULL(trace);
+  CHECK_EQ(trace->num_cmds, 4);
+  CHECK_EQ(trace->num_blocks, 3);
+  CHECK_EQ(trace->num_frames, 2);
+
+  check_context(trace, trace->frames[1], &ctx1);
+  check_context(trace, trace->frames[0], &ctx0);
+  check_texture(trace, &trace->cmds[2], texture);
+  check_texture(trace, &trace->cmds[0], texture);
+
+  trace_destroy(trace);
+  trace_writer_close(writer);
+  remove(filename);
+}
+
+TEST(trace_uncompressed) {
+  static struct ta_context ctx0;
+  char filename[PATH_MAX];
+  trace_filename(filename, sizeof(filename));
+
+  init_context(&ctx0, 256, 2);
+
+  /* write out a trace in the original format, with each command's data
+     following it, and pointed to relative to the command */
+  FILE *fp = fopen(filename, "wb");
+  CHECK_NOTNULL(fp);
+
+  struct trace_cmd cmd = {0};
+  cmd.type = TRACE_CMD_TEXTURE;
+  cmd.texture.tsp = make_tsp(1);
+  cmd.texture.tcw = make_tcw(1);
+  cmd.texture.palette_size = sizeof(palette);
+  cmd.texture.palette = (const uint8_t *)(intptr_t)sizeof(cmd);
+  cmd.texture.texture_size = sizeof(texture);
+  cmd.texture.texture =
+      (const uint8_t *)(intptr_t)(sizeof(cmd) + sizeof(palette));
+  CHECK_EQ(fwrite(&cmd, sizeof(cmd), 1, fp), 1);
+  CHECK_EQ(fwrite(palette, sizeof(palette), 1, fp), 1);
+  CHECK_EQ(fwrite(texture, sizeof(texture), 1, fp), 1);
+
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.type = TRACE_CMD_CONTEXT;
+  cmd.context.autosort = ctx0.autosort;
+  cmd.context.bg_vertices_size = sizeof(ctx0.bg_vertices);
+  cmd.context.bg_vertices = (const uint8_t *)(intptr_t)sizeof(cmd);
+  cmd.context.params_size = ctx0.size;
+  cmd.context.params =
+      (const uint8_t *)(intptr_t)(sizeof(cmd) + sizeof(ctx0.bg_vertices));
+  CHECK_EQ(fwrite(&cmd, sizeof(cmd), 1, fp), 1);
+  CHECK_EQ(fwrite(ctx0.bg_vertices, sizeof(ctx0.bg_vertices), 1, fp), 1);
+  CHECK_EQ(fwrite(ctx0.params, ctx0.size, 1, fp), 1);
+  fclose(fp);
+
+  struct trace *trace = trace_parse(filename);
+  CHECK_NOTNULL(trace);
+  CHECK_EQ(trace->num_cmds, 2);
+  CHECK_EQ(trace->num_frames, 1);
+
+  check_texture(trace, trace->cmds, texture);
+  check_context(trace, trace->frames[0], &ctx0);
+
+  trace_destroy(trace);
+  remove(filename);
+}
@@ -80,7 +80,7 @@ static void process_file(struct jit_backend *backend, const char *filename,
       cfa_destroy(cfa);
     } else if (!strcmp(name, "lse")) {
       struct lse *lse = lse_create();
-      lse_run(lse, &ir);
+      lse_run(lse, &ir, 0);
       lse_destroy(lse);
     } else if (!strcmp(name, "cprop")) {
       struct cprop *cprop = cprop_create();
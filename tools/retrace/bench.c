@@ -0,0 +1,182 @@
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "render/render_backend.h"
+#include "texture_table.h"
+
+#define DEFAULT_ITERATIONS 10
+#define RENDER_WIDTH 640
+#define RENDER_HEIGHT 480
+
+enum {
+  STAGE_LOAD,
+  STAGE_DECODE,
+  STAGE_CONVERT,
+  STAGE_RENDER,
+  NUM_STAGES,
+};
+
+static const char *stage_names[] = {
+    "load", "decode", "convert", "render",
+};
+
+struct stage {
+  int64_t *samples;
+  int num_samples;
+};
+
+static void add_sample(struct stage *stage, int64_t elapsed) {
+  stage->samples[stage->num_samples++] = MAX(elapsed, 0);
+}
+
+static int sample_cmp(const void *a, const void *b) {
+  int64_t lhs = *(const int64_t *)a;
+  int64_t rhs = *(const int64_t *)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/* nearest-rank percentile of the sorted samples */
+static float percentile_ms(const struct stage *stage, int p) {
+  int rank = (stage->num_samples * p + 99) / 100;
+  int i = CLAMP(rank - 1, 0, stage->num_samples - 1);
+  return stage->samples[i] / (float)NS_PER_MS;
+}
+
+static void print_stage(const char *name, struct stage *stage) {
+  if (!stage->num_samples) {
+    return;
+  }
+
+  qsort(stage->samples, stage->num_samples, sizeof(stage->samples[0]),
+        &sample_cmp);
+
+  int64_t total = 0;
+  for (int i = 0; i < stage->num_samples; i++) {
+    total += stage->samples[i];
+  }
+
+  float mean = total / (float)stage->num_samples / (float)NS_PER_MS;
+
+  LOG_INFO("%-8s  %8.3f  %8.3f  %8.3f  %8.3f  %8.3f", name, mean,
+           percentile_ms(stage, 50), percentile_ms(stage, 90),
+           percentile_ms(stage, 99), percentile_ms(stage, 100));
+}
+
+/* replays each context in the trace, timing each stage of the pipeline it goes
+   through in the emulator:
+
+   load     copying the context out of the trace
+   decode   decoding the textures it references, measured as the difference
+            between converting it with and without the textures cached
+   convert  converting it with the textures already cached
+   render   drawing it with the software backend, when enabled
+
+   the null backend isn't linked into retrace, converting without a backend
+   does the same work as it would */
+int cmd_bench(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  int num_iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  const char *backend = argc > 2 ? argv[2] : "none";
+  int render = !strcmp(backend, "sw");
+
+  if (num_iterations <= 0 || (!render && strcmp(backend, "none"))) {
+    return 0;
+  }
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct render_backend *r = NULL;
+  if (render) {
+    r = r_create(RENDER_WIDTH, RENDER_HEIGHT);
+  }
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  struct stage stages[NUM_STAGES] = {0};
+  int max_samples = MAX(trace->num_frames * num_iterations, 1);
+
+  for (int i = 0; i < NUM_STAGES; i++) {
+    stages[i].samples = calloc(max_samples, sizeof(int64_t));
+    CHECK_NOTNULL(stages[i].samples);
+  }
+
+  for (int i = 0; i < num_iterations; i++) {
+    /* replay the trace from the start each iteration, so each context sees
+       the textures as they were when it was captured */
+    struct texture_table *table = texture_table_create();
+
+    struct trace_cmd *next = trace->cmds;
+    while (next) {
+      if (next->type == TRACE_CMD_TEXTURE) {
+        trace_load_texture(trace, next);
+        texture_table_add(table, next);
+      } else if (next->type == TRACE_CMD_CONTEXT) {
+        int64_t start = time_nanoseconds();
+        trace_copy_context(trace, next, ctx);
+        int64_t loaded = time_nanoseconds();
+        add_sample(&stages[STAGE_LOAD], loaded - start);
+
+        texture_table_release(table, r);
+
+        start = time_nanoseconds();
+        tr_convert_context(r, table, &texture_table_find, ctx, rc);
+        int64_t cold = time_nanoseconds() - start;
+
+        start = time_nanoseconds();
+        tr_convert_context(r, table, &texture_table_find, ctx, rc);
+        int64_t warm = time_nanoseconds() - start;
+
+        add_sample(&stages[STAGE_DECODE], cold - warm);
+        add_sample(&stages[STAGE_CONVERT], warm);
+
+        if (render) {
+          start = time_nanoseconds();
+          r_clear(r);
+          r_viewport(r, 0, 0, RENDER_WIDTH, RENDER_HEIGHT);
+          tr_render_context(r, rc);
+          add_sample(&stages[STAGE_RENDER], time_nanoseconds() - start);
+        }
+      }
+      next = next->next;
+    }
+
+    texture_table_destroy(table, r);
+  }
+
+  /* print results */
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("bench results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("%d contexts, %d iterations, %s backend", trace->num_frames,
+           num_iterations, backend);
+  LOG_INFO("");
+  LOG_INFO("%-8s  %8s  %8s  %8s  %8s  %8s", "ms", "mean", "p50", "p90", "p99",
+           "max");
+
+  for (int i = 0; i < NUM_STAGES; i++) {
+    print_stage(stage_names[i], &stages[i]);
+    free(stages[i].samples);
+  }
+
+  free(rc);
+  free(ctx);
+  if (r) {
+    r_destroy(r);
+  }
+  trace_destroy(trace);
+
+  return 1;
+}
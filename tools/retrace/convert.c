@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include "core/assert.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/tr.h"
+#include "options.h"
+
+#define NUM_ITERATIONS 10
+
+struct result {
+  const char *name;
+  int num_threads;
+  int64_t elapsed;
+};
+
+static struct tr_texture *find_texture(void *userdata, union tsp tsp,
+                                       union tcw tcw) {
+  /* return a non-zero handle so it doesn't try to create a texture with
+     the render backend (which is NULL) */
+  static struct tr_texture tex;
+  tex.handle = 1;
+  return &tex;
+}
+
+static int64_t convert_context(const struct ta_context *ctx,
+                               struct tr_context *rc, int num_threads) {
+  OPTION_render_threads = num_threads;
+
+  int64_t start = time_nanoseconds();
+
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    tr_convert_context(NULL, NULL, &find_texture, ctx, rc);
+  }
+
+  return time_nanoseconds() - start;
+}
+
+static int compare_contexts(const struct tr_context *a,
+                            const struct tr_context *b) {
+  if (a->num_surfs != b->num_surfs || a->num_indices != b->num_indices) {
+    return 0;
+  }
+
+  if (memcmp(a->surfs, b->surfs, sizeof(a->surfs[0]) * a->num_surfs) ||
+      memcmp(a->indices, b->indices, sizeof(a->indices[0]) * a->num_indices)) {
+    return 0;
+  }
+
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    const struct tr_list *la = &a->lists[i];
+    const struct tr_list *lb = &b->lists[i];
+
+    if (la->num_surfs != lb->num_surfs ||
+        memcmp(la->surfs, lb->surfs, sizeof(la->surfs[0]) * la->num_surfs)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int cmd_convert(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  int num_threads = argc > 1 ? atoi(argv[1]) : OPTION_render_threads;
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *serial = calloc(1, sizeof(struct tr_context));
+  struct tr_context *parallel = calloc(1, sizeof(struct tr_context));
+
+  struct result results[] = {
+      {"serial", 0, 0}, {"parallel", num_threads, 0},
+  };
+  int num_contexts = 0;
+  int num_surfs = 0;
+  int num_mismatches = 0;
+
+  /* convert each context in the trace, serially and across the worker pool */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+
+      results[0].elapsed +=
+          convert_context(ctx, serial, results[0].num_threads);
+      results[1].elapsed +=
+          convert_context(ctx, parallel, results[1].num_threads);
+
+      if (!compare_contexts(serial, parallel)) {
+        LOG_WARNING("context %d differs between serial and parallel output",
+                    num_contexts);
+        num_mismatches++;
+      }
+
+      num_contexts++;
+      num_surfs += serial->num_surfs;
+    }
+    next = next->next;
+  }
+
+  free(parallel);
+  free(serial);
+  free(ctx);
+  trace_destroy(trace);
+
+  /* print results */
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("convert results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("%d contexts, %d surfaces, %d mismatches", num_contexts, num_surfs,
+           num_mismatches);
+
+  for (int i = 0; i < ARRAY_SIZE(results); i++) {
+    struct result *res = &results[i];
+    float ms = res->elapsed / (float)NS_PER_MS;
+    float per_context =
+        num_contexts ? ms / (num_contexts * NUM_ITERATIONS) : 0.0f;
+    LOG_INFO("%-8s  %d threads  %.3f ms / context", res->name,
+             res->num_threads, per_context);
+  }
+
+  return 1;
+}
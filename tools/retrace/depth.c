@@ -47,15 +47,15 @@ static int depth_cmpf(const void *a, const void *b) {
   return ea->d.f <= eb->d.f;
 }
 
-static void test_context(struct trace_cmd *cmd, struct test *tests,
-                         int num_tests) {
+static void test_context(struct trace *trace, struct trace_cmd *cmd,
+                         struct test *tests, int num_tests) {
   CHECK_EQ(cmd->type, TRACE_CMD_CONTEXT);
 
   struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
   struct tr_context *rc = calloc(1, sizeof(struct tr_context));
 
   /* parse the context */
-  trace_copy_context(cmd, ctx);
+  trace_copy_context(trace, cmd, ctx);
   tr_convert_context(NULL, NULL, &find_texture, ctx, rc);
 
   /* sort each vertex by the original w */
@@ -150,7 +150,7 @@ int cmd_depth(int argc, const char **argv) {
   struct trace_cmd *next = trace->cmds;
   while (next) {
     if (next->type == TRACE_CMD_CONTEXT) {
-      test_context(next, tests, num_tests);
+      test_context(trace, next, tests, num_tests);
       break;
     }
     next = next->next;
@@ -0,0 +1,207 @@
+#include "core/core.h"
+#include "core/hash_map.h"
+#include "core/rb_tree.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+
+#define NUM_ITERATIONS 100
+
+struct lookup_node {
+  tr_texture_key_t key;
+  struct rb_node it;
+};
+
+struct lookup_keys {
+  tr_texture_key_t *keys;
+  int num_keys;
+  int max_keys;
+};
+
+static int lookup_node_cmp(const struct rb_node *rb_lhs,
+                           const struct rb_node *rb_rhs) {
+  const struct lookup_node *lhs =
+      rb_entry(rb_lhs, const struct lookup_node, it);
+  const struct lookup_node *rhs =
+      rb_entry(rb_rhs, const struct lookup_node, it);
+
+  if (lhs->key < rhs->key) {
+    return -1;
+  } else if (lhs->key > rhs->key) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static struct rb_callbacks lookup_node_cb = {&lookup_node_cmp, NULL, NULL};
+
+static void add_key(struct lookup_keys *keys, tr_texture_key_t key) {
+  if (keys->num_keys >= keys->max_keys) {
+    keys->max_keys = MAX(keys->max_keys * 2, 1024);
+    keys->keys = realloc(keys->keys, keys->max_keys * sizeof(keys->keys[0]));
+    CHECK_NOTNULL(keys->keys);
+  }
+
+  keys->keys[keys->num_keys++] = key;
+}
+
+/* record the keys looked up for each context, in the same order as the texture
+   sources are registered by the emulator */
+static void add_context_keys(struct lookup_keys *keys,
+                             const struct ta_context *ctx) {
+  const uint8_t *data = ctx->params;
+  const uint8_t *end = ctx->params + ctx->size;
+  int vert_type = 0;
+
+  if (ctx->bg_isp.texture) {
+    add_key(keys, tr_texture_key(ctx->bg_tsp, ctx->bg_tcw));
+  }
+
+  while (data < end) {
+    union pcw pcw = *(union pcw *)data;
+
+    switch (pcw.para_type) {
+      case TA_PARAM_POLY_OR_VOL:
+      case TA_PARAM_SPRITE: {
+        const union poly_param *param = (const union poly_param *)data;
+
+        vert_type = ta_vert_type(param->type0.pcw);
+
+        if (param->type0.pcw.texture) {
+          add_key(keys,
+                  tr_texture_key(param->type0.tsp, param->type0.tcw));
+        }
+      } break;
+
+      default:
+        break;
+    }
+
+    data += ta_param_size(pcw, vert_type);
+  }
+}
+
+static int64_t lookup_rb_tree(struct rb_tree *tree, struct lookup_keys *keys,
+                              uintptr_t *checksum) {
+  int64_t start = time_nanoseconds();
+
+  for (int n = 0; n < NUM_ITERATIONS; n++) {
+    for (int i = 0; i < keys->num_keys; i++) {
+      struct lookup_node search;
+      search.key = keys->keys[i];
+
+      struct lookup_node *node = rb_find_entry(
+          tree, &search, struct lookup_node, it, &lookup_node_cb);
+      *checksum += (uintptr_t)node;
+    }
+  }
+
+  return time_nanoseconds() - start;
+}
+
+static int64_t lookup_hash_map(struct hash_map *map, struct lookup_keys *keys,
+                               int cache_last, uintptr_t *checksum) {
+  int64_t start = time_nanoseconds();
+
+  for (int n = 0; n < NUM_ITERATIONS; n++) {
+    struct lookup_node *last = NULL;
+
+    for (int i = 0; i < keys->num_keys; i++) {
+      tr_texture_key_t key = keys->keys[i];
+      struct lookup_node *node = NULL;
+
+      if (cache_last && last && last->key == key) {
+        node = last;
+      } else {
+        node = hash_map_find(map, key);
+        last = node;
+      }
+
+      *checksum += (uintptr_t)node;
+    }
+  }
+
+  return time_nanoseconds() - start;
+}
+
+int cmd_lookup(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct lookup_keys textures = {0};
+  struct lookup_keys lookups = {0};
+
+  /* gather the unique texture keys, and the sequence of keys looked up */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_TEXTURE && !next->override) {
+      add_key(&textures,
+              tr_texture_key(next->texture.tsp, next->texture.tcw));
+    } else if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+      add_context_keys(&lookups, ctx);
+    }
+    next = next->next;
+  }
+
+  /* populate both containers with the same nodes */
+  struct lookup_node *nodes =
+      calloc(MAX(textures.num_keys, 1), sizeof(struct lookup_node));
+  struct rb_tree tree = {0};
+  struct hash_map *map = hash_map_create(MAX(textures.num_keys, 1));
+
+  for (int i = 0; i < textures.num_keys; i++) {
+    struct lookup_node *node = &nodes[i];
+    node->key = textures.keys[i];
+    rb_insert(&tree, &node->it, &lookup_node_cb);
+    hash_map_insert(map, node->key, node);
+  }
+
+  uintptr_t checksums[3] = {0};
+  int64_t elapsed[3];
+  elapsed[0] = lookup_rb_tree(&tree, &lookups, &checksums[0]);
+  elapsed[1] = lookup_hash_map(map, &lookups, 0, &checksums[1]);
+  elapsed[2] = lookup_hash_map(map, &lookups, 1, &checksums[2]);
+
+  CHECK_EQ(checksums[0], checksums[1]);
+  CHECK_EQ(checksums[0], checksums[2]);
+
+  /* print results */
+  static const char *names[] = {"rb_tree", "hash_map", "hash_map + last"};
+  int64_t num_lookups = (int64_t)lookups.num_keys * NUM_ITERATIONS;
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("lookup results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("%d textures, %d lookups per pass", textures.num_keys,
+           lookups.num_keys);
+
+  for (int i = 0; i < ARRAY_SIZE(names); i++) {
+    float per_lookup = num_lookups ? elapsed[i] / (float)num_lookups : 0.0f;
+    LOG_INFO("%-16s %.2f ns / lookup", names[i], per_lookup);
+  }
+
+  hash_map_destroy(map);
+  free(nodes);
+  free(lookups.keys);
+  free(textures.keys);
+  free(ctx);
+  trace_destroy(trace);
+
+  return 1;
+}
@@ -1,11 +1,27 @@
 #include "core/core.h"
 
+extern int cmd_bench(int argc, const char **argv);
+extern int cmd_convert(int argc, const char **argv);
 extern int cmd_depth(int argc, const char **argv);
+extern int cmd_lookup(int argc, const char **argv);
+extern int cmd_pack(int argc, const char **argv);
+extern int cmd_render(int argc, const char **argv);
+extern int cmd_sort(int argc, const char **argv);
+extern int cmd_stats(int argc, const char **argv);
+extern int cmd_texcache(int argc, const char **argv);
 
 static void print_help() {
   LOG_INFO("usage: retrace <command> [<args> ...]");
   LOG_INFO("the available commands are:");
+  LOG_INFO("    bench    benchmark each stage of the graphics pipeline");
+  LOG_INFO("    convert  benchmark serial and parallel context conversion");
   LOG_INFO("    depth    compare depth function accuracies");
+  LOG_INFO("    lookup   benchmark texture cache lookups");
+  LOG_INFO("    pack     rewrite a trace in the compressed format");
+  LOG_INFO("    render   render each context with the software backend");
+  LOG_INFO("    sort     benchmark and verify translucent surface sorting");
+  LOG_INFO("    stats    dump per-frame geometry and texture statistics");
+  LOG_INFO("    texcache prebuild a texture cache directory from a trace");
 }
 
 int main(int argc, const char **argv) {
@@ -14,8 +30,24 @@ int main(int argc, const char **argv) {
   if (argc >= 2) {
     const char *cmd = argv[1];
 
-    if (!strcmp(cmd, "depth")) {
+    if (!strcmp(cmd, "bench")) {
+      res = cmd_bench(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "convert")) {
+      res = cmd_convert(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "depth")) {
       res = cmd_depth(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "lookup")) {
+      res = cmd_lookup(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "pack")) {
+      res = cmd_pack(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "render")) {
+      res = cmd_render(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "sort")) {
+      res = cmd_sort(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "stats")) {
+      res = cmd_stats(argc - 2, argv + 2);
+    } else if (!strcmp(cmd, "texcache")) {
+      res = cmd_texcache(argc - 2, argv + 2);
     }
   }
 
@@ -0,0 +1,73 @@
+#include "core/core.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+
+static int64_t file_size(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return 0;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  int64_t size = ftell(fp);
+  fclose(fp);
+
+  return size;
+}
+
+/* rewrites a trace in the compressed format. traces recorded in the original
+   uncompressed format can still be read, but have to be loaded in full */
+int cmd_pack(int argc, const char **argv) {
+  if (argc < 2) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  const char *outname = argv[1];
+  int64_t start = time_nanoseconds();
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  struct trace_writer *writer = trace_writer_open(outname);
+  if (!writer) {
+    LOG_WARNING("failed to open %s", outname);
+    trace_destroy(trace);
+    return 0;
+  }
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_TEXTURE) {
+      trace_load_texture(trace, next);
+      trace_writer_insert_texture(
+          writer, next->texture.tsp, next->texture.tcw, next->texture.frame,
+          next->texture.palette, next->texture.palette_size,
+          next->texture.texture, next->texture.texture_size);
+    } else if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+      trace_writer_render_context(writer, ctx);
+    }
+    next = next->next;
+  }
+
+  trace_writer_close(writer);
+
+  int num_frames = trace->num_frames;
+  int64_t elapsed = time_nanoseconds() - start;
+
+  free(ctx);
+  trace_destroy(trace);
+
+  LOG_INFO("packed %d frames, %d kb -> %d kb in %.2f ms", num_frames,
+           (int)(file_size(filename) / 1024), (int)(file_size(outname) / 1024),
+           elapsed / 1000000.0f);
+
+  return 1;
+}
@@ -0,0 +1,89 @@
+#include "core/core.h"
+#include "core/filesystem.h"
+#include "core/md5.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "render/render_backend.h"
+#include "texture_table.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../retex/stb_image_write.h"
+
+#define RENDER_WIDTH 640
+#define RENDER_HEIGHT 480
+
+/* renders each context in a trace with the software backend, printing a digest
+   of each frame so runs can be compared against known good output. when an
+   output directory is given, each frame is also written out as a png */
+int cmd_render(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  const char *outdir = argc > 1 ? argv[1] : NULL;
+
+  if (outdir && !fs_mkdir(outdir)) {
+    LOG_WARNING("failed to create %s", outdir);
+    return 0;
+  }
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct render_backend *r = r_create(RENDER_WIDTH, RENDER_HEIGHT);
+  struct texture_table *table = texture_table_create();
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  uint8_t *pixels = malloc(RENDER_WIDTH * RENDER_HEIGHT * 4);
+  int num_frames = 0;
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_TEXTURE) {
+      trace_load_texture(trace, next);
+      texture_table_add(table, next);
+    } else if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+      tr_convert_context(r, table, &texture_table_find, ctx, rc);
+
+      r_clear(r);
+      r_viewport(r, 0, 0, RENDER_WIDTH, RENDER_HEIGHT);
+      tr_render_context(r, rc);
+      r_read_pixels(r, pixels);
+
+      MD5_CTX md5;
+      char digest[33];
+      MD5_Init(&md5);
+      MD5_Update(&md5, pixels, RENDER_WIDTH * RENDER_HEIGHT * 4);
+      MD5_Final(digest, &md5);
+      LOG_INFO("frame %d %s", num_frames, digest);
+
+      if (outdir) {
+        char pngname[PATH_MAX];
+        snprintf(pngname, sizeof(pngname), "%s" PATH_SEPARATOR "%05d.png",
+                 outdir, num_frames);
+        stbi_write_png(pngname, RENDER_WIDTH, RENDER_HEIGHT, 4, pixels,
+                       RENDER_WIDTH * 4);
+      }
+
+      num_frames++;
+    }
+    next = next->next;
+  }
+
+  free(pixels);
+  free(rc);
+  free(ctx);
+  texture_table_destroy(table, r);
+  r_destroy(r);
+  trace_destroy(trace);
+
+  return 1;
+}
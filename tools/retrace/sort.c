@@ -0,0 +1,141 @@
+#include "core/core.h"
+#include "core/sort.h"
+#include "core/time.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+
+#define NUM_ITERATIONS 100
+
+static float sort_minz[TR_MAX_SURFS];
+static int sort_surfs[TR_MAX_SURFS];
+static int sort_tmp[TR_MAX_SURFS];
+static uint64_t sort_keys[TR_MAX_SURFS];
+static uint64_t sort_keys_tmp[TR_MAX_SURFS];
+
+static int compare_surf(const void *a, const void *b) {
+  int i = *(const int *)a;
+  int j = *(const int *)b;
+  return sort_minz[i] <= sort_minz[j];
+}
+
+static void calc_minz(const struct tr_context *rc, const struct tr_list *list) {
+  for (int i = 0; i < list->num_surfs; i++) {
+    int surf_index = list->surfs[i];
+    const struct ta_surface *surf = &rc->surfs[surf_index];
+    const struct ta_vertex *verts = &rc->verts[surf->first_vert];
+
+    float minz = MIN(verts[0].xyz[2], verts[1].xyz[2]);
+    sort_minz[surf_index] = MIN(minz, verts[2].xyz[2]);
+  }
+}
+
+/* the merge sort previously used to sort translucent surfaces */
+static int64_t sort_msort(const struct tr_list *list) {
+  int64_t start = time_nanoseconds();
+
+  for (int n = 0; n < NUM_ITERATIONS; n++) {
+    memcpy(sort_surfs, list->surfs, list->num_surfs * sizeof(int));
+    msort_noalloc(sort_surfs, sort_tmp, list->num_surfs, sizeof(int),
+                  &compare_surf);
+  }
+
+  return time_nanoseconds() - start;
+}
+
+static int64_t sort_rsort(const struct tr_list *list) {
+  int64_t start = time_nanoseconds();
+
+  for (int n = 0; n < NUM_ITERATIONS; n++) {
+    for (int i = 0; i < list->num_surfs; i++) {
+      int surf_index = list->surfs[i];
+      uint64_t key = rsort_float_key(sort_minz[surf_index]);
+      sort_keys[i] = (key << 32) | (uint32_t)surf_index;
+    }
+
+    rsort_noalloc(sort_keys, sort_keys_tmp, list->num_surfs);
+  }
+
+  return time_nanoseconds() - start;
+}
+
+int cmd_sort(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  int64_t msort_elapsed = 0;
+  int64_t rsort_elapsed = 0;
+  int64_t num_surfs = 0;
+  int num_lists = 0;
+  int num_mismatches = 0;
+
+  /* sort the translucent and punch-through lists of each context, as
+     tr_convert_context does when autosort is enabled. the lists are parsed,
+     but not finalized, so they're still in submission order */
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+      tr_init_context(rc);
+      tr_parse_context(ctx, rc, ctx->size);
+
+      const int list_types[] = {TA_LIST_TRANSLUCENT, TA_LIST_PUNCH_THROUGH};
+
+      for (int i = 0; i < ARRAY_SIZE(list_types); i++) {
+        const struct tr_list *list = &rc->lists[list_types[i]];
+
+        if (!list->num_surfs) {
+          continue;
+        }
+
+        calc_minz(rc, list);
+        msort_elapsed += sort_msort(list);
+        rsort_elapsed += sort_rsort(list);
+
+        for (int j = 0; j < list->num_surfs; j++) {
+          if ((int)(uint32_t)sort_keys[j] != sort_surfs[j]) {
+            num_mismatches++;
+            break;
+          }
+        }
+
+        num_surfs += list->num_surfs;
+        num_lists++;
+      }
+    }
+    next = next->next;
+  }
+
+  /* print results */
+  int64_t num_sorted = num_surfs * NUM_ITERATIONS;
+
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("sort results");
+  LOG_INFO("===-----------------------------------------------------===");
+  LOG_INFO("");
+  LOG_INFO("%d lists, %d surfaces, %d mismatched lists", num_lists,
+           (int)num_surfs, num_mismatches);
+  LOG_INFO("msort            %.2f ns / surface",
+           num_sorted ? msort_elapsed / (float)num_sorted : 0.0f);
+  LOG_INFO("rsort            %.2f ns / surface",
+           num_sorted ? rsort_elapsed / (float)num_sorted : 0.0f);
+
+  free(rc);
+  free(ctx);
+  trace_destroy(trace);
+
+  return !num_mismatches;
+}
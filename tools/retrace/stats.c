@@ -0,0 +1,233 @@
+#include "core/core.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "texture_table.h"
+
+#define NUM_BUCKETS 20
+#define MAX_BAR_WIDTH 40
+
+static const char *list_names[] = {
+    "opaque", "opaque modvol", "translucent", "translucent modvol",
+    "punch-through",
+};
+
+static const char *pixel_names[] = {
+    "1555", "565", "4444", "yuv422", "bumpmap", "4bpp", "8bpp", "reserved",
+};
+
+static const char *texture_fmt_names[] = {
+    "invalid",
+    "twiddled",
+    "twiddled mipmaps",
+    "vq",
+    "vq mipmaps",
+    "palette 4bpp",
+    "palette 4bpp mipmaps",
+    "palette 8bpp",
+    "palette 8bpp mipmaps",
+    "bitmap rect",
+    NULL,
+    "bitmap",
+    NULL,
+    "twiddled rect",
+};
+
+/* power of two histogram, bucket 0 counts zeros and bucket n counts values in
+   [2^(n-1), 2^n) */
+struct histogram {
+  const char *name;
+  int buckets[NUM_BUCKETS];
+  int64_t total;
+  int count;
+  int max;
+};
+
+struct stats {
+  struct texture_table *table;
+
+  /* texture lookups made while converting the current frame */
+  int frame_lookups;
+
+  /* texture lookups made across all frames, by format */
+  int64_t texture_fmts[ARRAY_SIZE(texture_fmt_names)];
+  int64_t pixel_fmts[ARRAY_SIZE(pixel_names)];
+};
+
+static void histogram_add(struct histogram *hist, int value) {
+  int bucket = value > 0 ? 32 - clz32((uint32_t)value) : 0;
+  hist->buckets[MIN(bucket, NUM_BUCKETS - 1)]++;
+  hist->total += value;
+  hist->count++;
+  hist->max = MAX(hist->max, value);
+}
+
+static void print_bar(const char *label, int64_t count, int64_t max_count) {
+  char bar[MAX_BAR_WIDTH + 1];
+  int width = max_count ? (int)((count * MAX_BAR_WIDTH) / max_count) : 0;
+  memset(bar, '#', width);
+  bar[width] = 0;
+
+  LOG_INFO("  %-22s %8" PRId64 " %s", label, count, bar);
+}
+
+static void print_histogram(const struct histogram *hist) {
+  if (!hist->count) {
+    return;
+  }
+
+  LOG_INFO("");
+  LOG_INFO("%s per frame, mean %.1f, max %d", hist->name,
+           hist->total / (float)hist->count, hist->max);
+
+  int max_count = 0;
+  int last = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    max_count = MAX(max_count, hist->buckets[i]);
+    if (hist->buckets[i]) {
+      last = i;
+    }
+  }
+
+  for (int i = 0; i <= last; i++) {
+    char label[32];
+    if (i <= 1) {
+      snprintf(label, sizeof(label), "%d", i);
+    } else if (i == NUM_BUCKETS - 1) {
+      snprintf(label, sizeof(label), "%d+", 1 << (i - 1));
+    } else {
+      snprintf(label, sizeof(label), "%d-%d", 1 << (i - 1), (1 << i) - 1);
+    }
+    print_bar(label, hist->buckets[i], max_count);
+  }
+}
+
+static void print_formats(const char *name, const int64_t *counts,
+                          const char **names, int num) {
+  int64_t max_count = 0;
+  for (int i = 0; i < num; i++) {
+    max_count = MAX(max_count, counts[i]);
+  }
+
+  LOG_INFO("");
+  LOG_INFO("texture lookups by %s", name);
+
+  for (int i = 0; i < num; i++) {
+    if (names[i] && counts[i]) {
+      print_bar(names[i], counts[i], max_count);
+    }
+  }
+}
+
+static struct tr_texture *stats_find_texture(void *userdata, union tsp tsp,
+                                             union tcw tcw) {
+  struct stats *stats = userdata;
+
+  stats->texture_fmts[ta_texture_format(tcw)]++;
+  stats->pixel_fmts[tcw.pixel_fmt]++;
+  stats->frame_lookups++;
+
+  return texture_table_find(stats->table, tsp, tcw);
+}
+
+/* dumps the makeup of each frame in the trace, followed by histograms of them
+   across the whole trace. draws are the surfaces a render backend is asked to
+   draw, modifier volumes are parsed but not drawn */
+int cmd_stats(int argc, const char **argv) {
+  if (argc < 1) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  ta_init_tables();
+
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  struct stats stats = {0};
+  stats.table = texture_table_create();
+
+  struct histogram surfs = {0};
+  struct histogram verts = {0};
+  struct histogram draws = {0};
+  struct histogram lookups = {0};
+  struct histogram lists[TA_NUM_LISTS] = {0};
+  int frame = 0;
+
+  surfs.name = "surfaces";
+  verts.name = "vertices";
+  draws.name = "draws";
+  lookups.name = "texture lookups";
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    lists[i].name = list_names[i];
+  }
+
+  LOG_INFO("%5s  %6s  %6s  %6s  %6s  %-29s  %s", "frame", "surfs", "verts",
+           "idx", "draws", "lists (op/opm/tr/trm/pt)", "lookups");
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_TEXTURE) {
+      trace_load_texture(trace, next);
+      texture_table_add(stats.table, next);
+    } else if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+
+      stats.frame_lookups = 0;
+      tr_convert_context(NULL, &stats, &stats_find_texture, ctx, rc);
+
+      int num_draws = rc->lists[TA_LIST_OPAQUE].num_surfs +
+                      rc->lists[TA_LIST_PUNCH_THROUGH].num_surfs +
+                      rc->lists[TA_LIST_TRANSLUCENT].num_surfs;
+
+      char list_counts[64];
+      snprintf(list_counts, sizeof(list_counts), "%d/%d/%d/%d/%d",
+               rc->lists[TA_LIST_OPAQUE].num_surfs,
+               rc->lists[TA_LIST_OPAQUE_MODVOL].num_surfs,
+               rc->lists[TA_LIST_TRANSLUCENT].num_surfs,
+               rc->lists[TA_LIST_TRANSLUCENT_MODVOL].num_surfs,
+               rc->lists[TA_LIST_PUNCH_THROUGH].num_surfs);
+
+      LOG_INFO("%5d  %6d  %6d  %6d  %6d  %-29s  %d", frame, rc->num_surfs,
+               rc->num_verts, rc->num_indices, num_draws, list_counts,
+               stats.frame_lookups);
+
+      histogram_add(&surfs, rc->num_surfs);
+      histogram_add(&verts, rc->num_verts);
+      histogram_add(&draws, num_draws);
+      histogram_add(&lookups, stats.frame_lookups);
+      for (int i = 0; i < TA_NUM_LISTS; i++) {
+        histogram_add(&lists[i], rc->lists[i].num_surfs);
+      }
+
+      frame++;
+    }
+    next = next->next;
+  }
+
+  print_histogram(&surfs);
+  print_histogram(&verts);
+  print_histogram(&draws);
+  for (int i = 0; i < TA_NUM_LISTS; i++) {
+    print_histogram(&lists[i]);
+  }
+  print_histogram(&lookups);
+
+  print_formats("texture format", stats.texture_fmts, texture_fmt_names,
+                ARRAY_SIZE(texture_fmt_names));
+  print_formats("pixel format", stats.pixel_fmts, pixel_names,
+                ARRAY_SIZE(pixel_names));
+
+  texture_table_destroy(stats.table, NULL);
+  free(rc);
+  free(ctx);
+  trace_destroy(trace);
+
+  return 1;
+}
@@ -0,0 +1,66 @@
+#include "core/core.h"
+#include "file/tex_cache.h"
+#include "file/trace.h"
+#include "guest/pvr/ta.h"
+#include "guest/pvr/tr.h"
+#include "options.h"
+#include "texture_table.h"
+
+int cmd_texcache(int argc, const char **argv) {
+  if (argc < 2) {
+    return 0;
+  }
+
+  const char *filename = argv[0];
+  const char *cachedir = argv[1];
+
+  struct trace *trace = trace_parse(filename);
+  if (!trace) {
+    LOG_WARNING("failed to parse %s", filename);
+    return 0;
+  }
+
+  int64_t max_size = (int64_t)OPTION_texture_cache_size * 1024 * 1024;
+  struct tex_cache *cache =
+      tex_cache_create(cachedir, max_size, OPTION_texture_cache_compress);
+  if (!cache) {
+    trace_destroy(trace);
+    return 0;
+  }
+
+  struct texture_table *table = texture_table_create();
+  struct ta_context *ctx = calloc(1, sizeof(struct ta_context));
+  struct tr_context *rc = calloc(1, sizeof(struct tr_context));
+  int num_contexts = 0;
+
+  /* convert each context without a render backend, decoding each texture it
+     references through the cache */
+  tr_set_texture_cache(cache);
+
+  struct trace_cmd *next = trace->cmds;
+  while (next) {
+    if (next->type == TRACE_CMD_TEXTURE) {
+      trace_load_texture(trace, next);
+      texture_table_add(table, next);
+    } else if (next->type == TRACE_CMD_CONTEXT) {
+      trace_copy_context(trace, next, ctx);
+      tr_convert_context(NULL, table, &texture_table_find, ctx, rc);
+      num_contexts++;
+    }
+    next = next->next;
+  }
+
+  tr_set_texture_cache(NULL);
+
+  LOG_INFO("converted %d contexts, cache has %d textures totaling %d kb",
+           num_contexts, tex_cache_num_entries(cache),
+           (int)(tex_cache_size(cache) / 1024));
+
+  texture_table_destroy(table, NULL);
+  free(rc);
+  free(ctx);
+  tex_cache_destroy(cache);
+  trace_destroy(trace);
+
+  return 1;
+}
@@ -0,0 +1,85 @@
+#include "texture_table.h"
+#include "core/core.h"
+#include "core/hash.h"
+#include "file/trace.h"
+
+struct texture_entry {
+  struct tr_texture;
+  struct list_node it;
+};
+
+struct texture_table {
+  DECLARE_HASHTABLE(textures, 12);
+};
+
+static struct texture_entry *texture_table_entry(struct texture_table *table,
+                                                 union tsp tsp, union tcw tcw) {
+  tr_texture_key_t key = tr_texture_key(tsp, tcw);
+  struct list *bkt = hash_bkt(table->textures, key);
+
+  hash_bkt_for_each_entry(entry, bkt, struct texture_entry, it) {
+    if (tr_texture_key(entry->tsp, entry->tcw) == key) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+struct tr_texture *texture_table_find(void *userdata, union tsp tsp,
+                                      union tcw tcw) {
+  struct texture_table *table = userdata;
+  return (struct tr_texture *)texture_table_entry(table, tsp, tcw);
+}
+
+void texture_table_add(struct texture_table *table,
+                       const struct trace_cmd *cmd) {
+  struct texture_entry *entry =
+      texture_table_entry(table, cmd->texture.tsp, cmd->texture.tcw);
+
+  if (!entry) {
+    entry = calloc(1, sizeof(struct texture_entry));
+    CHECK_NOTNULL(entry);
+    entry->tsp = cmd->texture.tsp;
+    entry->tcw = cmd->texture.tcw;
+
+    tr_texture_key_t key = tr_texture_key(entry->tsp, entry->tcw);
+    hash_add(hash_bkt(table->textures, key), &entry->it);
+  }
+
+  entry->frame = cmd->texture.frame;
+  entry->dirty = 1;
+  entry->texture = cmd->texture.texture;
+  entry->texture_size = cmd->texture.texture_size;
+  entry->palette = cmd->texture.palette;
+  entry->palette_size = cmd->texture.palette_size;
+}
+
+void texture_table_release(struct texture_table *table,
+                           struct render_backend *r) {
+  for (int i = 0; i < HASH_SIZE(table->textures); i++) {
+    struct list *bkt = &table->textures[i];
+
+    list_for_each_entry(entry, bkt, struct texture_entry, it) {
+      tr_release_texture(r, (struct tr_texture *)entry);
+    }
+  }
+}
+
+void texture_table_destroy(struct texture_table *table,
+                           struct render_backend *r) {
+  for (int i = 0; i < HASH_SIZE(table->textures); i++) {
+    struct list *bkt = &table->textures[i];
+
+    list_for_each_entry_safe(entry, bkt, struct texture_entry, it) {
+      tr_release_texture(r, (struct tr_texture *)entry);
+      free(entry);
+    }
+  }
+
+  free(table);
+}
+
+struct texture_table *texture_table_create() {
+  return calloc(1, sizeof(struct texture_table));
+}
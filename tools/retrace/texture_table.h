@@ -0,0 +1,31 @@
+#ifndef TEXTURE_TABLE_H
+#define TEXTURE_TABLE_H
+
+#include "guest/pvr/tr.h"
+
+struct render_backend;
+struct trace_cmd;
+
+/*
+ * tracks the textures inserted by a trace as it's replayed, standing in for
+ * the emulator's texture cache when converting the trace's contexts
+ */
+struct texture_table;
+
+struct texture_table *texture_table_create();
+void texture_table_destroy(struct texture_table *table,
+                           struct render_backend *r);
+
+void texture_table_add(struct texture_table *table,
+                       const struct trace_cmd *cmd);
+
+/* releases the decoded data of each texture, forcing them to be decoded again
+   the next time they're converted */
+void texture_table_release(struct texture_table *table,
+                           struct render_backend *r);
+
+/* matches the find_texture callback passed to tr_convert_context */
+struct tr_texture *texture_table_find(void *userdata, union tsp tsp,
+                                      union tcw tcw);
+
+#endif